@@ -0,0 +1,24 @@
+#pragma once
+
+#include "all.h"
+
+// Shared by the benchmarks of the server data structures, which compare
+// the old layout with the new one in the same process. They link against
+// the server objects; build (from src/redis, after make):
+//   g++ -std=c++17 -O3 -I. ../../bench/<name>/<name>.cc $(ls *.o | grep -v main.o) \
+//       -o <name> -lpthread -lstdc++fs
+
+// Resident set size of the process, 0 when /proc is not there.
+inline size_t residentBytes() {
+    size_t pages = 0, resident = 0;
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if (fp == nullptr) {
+        return 0;
+    }
+
+    if (fscanf(fp, "%zu %zu", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    ::fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,240 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Hit ratio of the eviction policies against a running server. Every run
+// sets maxmemory and the policy, then GETs keys of a Zipfian distribution
+// and SETs the ones that missed, like a cache in front of a database would.
+// The key space is larger than maxmemory holds, so the server keeps
+// evicting; the hit ratio is measured after a warm up of the same length.
+// volatile-* policies see every key SET with a TTL.
+//
+// build:
+//   g++ -std=c++17 -O2 ../../bench/evict/evict.cc -o evict -lpthread
+// usage: ./evict <address> <port> [maxmemory] [keys] [requests] [value size]
+
+std::string maxmemory = "32mb";
+int keys = 1000000;
+int requests = 2000000;
+int valueLen = 100;
+int depth = 64;
+double skew = 0.99;
+
+int fd = -1;
+std::vector<char> buf(1 << 22);
+size_t have = 0;
+
+int connectServer(const char *ip, uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, ip, &addr.sin_addr);
+    if (::connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        perror("connect");
+        exit(1);
+    }
+
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+void append(std::string &out, const std::vector <std::string> &argv) {
+    out += "*" + std::to_string(argv.size()) + "\r\n";
+    for (auto &arg : argv) {
+        out += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+    }
+}
+
+/* Returns the bytes of the first complete reply in p, 0 if it is partial. */
+size_t replyLength(const char *p, size_t len) {
+    const char *crlf = static_cast<const char *>(memmem(p, len, "\r\n", 2));
+    if (crlf == nullptr) {
+        return 0;
+    }
+
+    size_t line = crlf - p + 2;
+    if (p[0] != '$') {
+        return line;
+    }
+
+    long bulk = atol(p + 1);
+    if (bulk < 0) {
+        return line;
+    }
+    return len >= line + bulk + 2 ? line + bulk + 2 : 0;
+}
+
+/* Sends the commands and returns their replies. */
+std::vector <std::string> roundTrip(const std::string &commands, size_t count) {
+    if (::write(fd, commands.data(), commands.size()) != (ssize_t) commands.size()) {
+        perror("write");
+        exit(1);
+    }
+
+    std::vector <std::string> replies;
+    while (replies.size() < count) {
+        ssize_t n = ::read(fd, buf.data() + have, buf.size() - have);
+        if (n <= 0) {
+            perror("read");
+            exit(1);
+        }
+
+        have += n;
+        size_t off = 0, len;
+        while (replies.size() < count && (len = replyLength(buf.data() + off, have - off)) > 0) {
+            replies.emplace_back(buf.data() + off, len);
+            off += len;
+        }
+        memmove(buf.data(), buf.data() + off, have - off);
+        have -= off;
+    }
+    return replies;
+}
+
+std::string command(const std::vector <std::string> &argv) {
+    std::string out;
+    append(out, argv);
+    std::string reply = roundTrip(out, 1)[0];
+    if (reply[0] == '-') {
+        fprintf(stderr, "%s: %s", argv[0].c_str(), reply.c_str() + 1);
+        exit(1);
+    }
+    return reply;
+}
+
+long long infoField(const char *field) {
+    std::string info = command({"info"});
+    size_t pos = info.find(std::string(field) + ":");
+    return pos == std::string::npos ? -1 : atoll(info.c_str() + pos + strlen(field) + 1);
+}
+
+/* Ranks of a Zipfian distribution, drawn by binary search of its CDF. */
+class Zipf {
+public:
+    Zipf(int n, double s) : cdf(n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += 1.0 / std::pow(i + 1, s);
+            cdf[i] = sum;
+        }
+
+        for (auto &it : cdf) {
+            it /= sum;
+        }
+    }
+
+    int next(std::mt19937_64 &gen) const {
+        double u = std::uniform_real_distribution<double>(0, 1)(gen);
+        return std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+void run(const char *policy, const Zipf &zipf) {
+    std::mt19937_64 gen(keys);
+    std::string value(valueLen, 'v');
+    bool volatileKeys = strncmp(policy, "volatile", 8) == 0;
+
+    command({"flushdb"});
+    command({"config", "set", "maxmemory", "0"});
+    command({"config", "set", "maxmemory-policy", policy});
+    long long evictedBefore = infoField("evicted_keys");
+    long long timeBefore = infoField("eviction_time_usec");
+    command({"config", "set", "maxmemory", maxmemory});
+
+    long long hits = 0, gets = 0, errors = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int sent = 0; sent < requests * 2; sent += depth) {
+        std::vector <std::string> batch;
+        std::string out;
+        for (int i = 0; i < depth; i++) {
+            batch.push_back("key:" + std::to_string(zipf.next(gen)));
+            append(out, {"GET", batch.back()});
+        }
+
+        auto replies = roundTrip(out, depth);
+        out.clear();
+        size_t misses = 0;
+        for (int i = 0; i < depth; i++) {
+            bool hit = replies[i][0] == '$' && replies[i] != "$-1\r\n";
+            if (sent >= requests) {
+                gets++;
+                hits += hit;
+            }
+
+            if (!hit) {
+                if (volatileKeys) {
+                    append(out, {"SET", batch[i], value, "EX", "100000"});
+                } else {
+                    append(out, {"SET", batch[i], value});
+                }
+                misses++;
+            }
+        }
+
+        if (misses > 0) {
+            for (auto &it : roundTrip(out, misses)) {
+                errors += it[0] == '-';
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-15s hit ratio %6.2f%%  evicted %9lld  eviction %7.1f ms  used %6.1f MB  "
+           "errors %lld  %8.0f requests/sec\n",
+           policy, 100.0 * hits / gets, infoField("evicted_keys") - evictedBefore,
+           (infoField("eviction_time_usec") - timeBefore) / 1000.0,
+           infoField("used_memory") / 1048576.0, errors, requests * 2 / seconds);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: evict <address> <port> [maxmemory] [keys] [requests] [value size]\n");
+        return 1;
+    }
+
+    if (argc > 3) {
+        maxmemory = argv[3];
+    }
+
+    if (argc > 4) {
+        keys = atoi(argv[4]);
+    }
+
+    if (argc > 5) {
+        requests = atoi(argv[5]);
+    }
+
+    if (argc > 6) {
+        valueLen = atoi(argv[6]);
+    }
+
+    fd = connectServer(argv[1], static_cast<uint16_t>(atoi(argv[2])));
+    Zipf zipf(keys, skew);
+    printf("maxmemory %s, %d keys of %d bytes, zipf %.2f\n", maxmemory.c_str(), keys, valueLen, skew);
+    for (const char *policy : {"allkeys-lru", "allkeys-lfu", "allkeys-random",
+                               "volatile-lru", "volatile-ttl"}) {
+        run(policy, zipf);
+    }
+
+    command({"config", "set", "maxmemory", "0"});
+    ::close(fd);
+    return 0;
+}
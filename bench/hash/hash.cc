@@ -0,0 +1,143 @@
+#include "all.h"
+#include "object.h"
+#include "timer.h"
+#include "hash.h"
+#include "set.h"
+#include "../common.h"
+
+// Compares the old small hashes and sets (unordered_map/unordered_set of
+// string objects) with HashType and SetType, which keep them as a listpack
+// and an intset: memory per key and HGET/SISMEMBER lookups.
+//
+// usage: ./hash <old|new> [keys] [fields]
+
+int keys = 1000000;
+int fields = 3;
+
+typedef std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> OldHash;
+typedef std::unordered_set <RedisObjectPtr, Hash, Equal> OldSet;
+
+std::vector <RedisObjectPtr> fieldObjs;
+std::vector <RedisObjectPtr> memberObjs;
+
+RedisObjectPtr makeObject(const char *fmt, int i) {
+    char buf[64];
+    int len = snprintf(buf, sizeof buf, fmt, i);
+    return createStringObject(buf, len);
+}
+
+void report(const char *op, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-9s %10.0f ops/sec\n", op, ops / seconds);
+}
+
+void reportMemory(const char *what, size_t before) {
+    printf("%-9s %10.1f bytes per key\n", what, (double) (residentBytes() - before) / keys);
+}
+
+size_t sink = 0;
+
+/* Every key gets its own field and value objects, as the keyspace does
+ * with the arguments of HSET. */
+void runOld() {
+    size_t before = residentBytes();
+    std::vector <OldHash> hashes(keys);
+    for (int i = 0; i < keys; i++) {
+        for (int j = 0; j < fields; j++) {
+            hashes[i].emplace(makeObject("field%d", j), makeObject("value:%d", i));
+        }
+    }
+    reportMemory("hash", before);
+
+    before = residentBytes();
+    std::vector <OldSet> sets(keys);
+    for (int i = 0; i < keys; i++) {
+        for (int j = 0; j < 5; j++) {
+            sets[i].insert(makeObject("%d", i * j));
+        }
+    }
+    reportMemory("set", before);
+
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < keys; i++) {
+        auto it = hashes[i].find(fieldObjs[i % fields]);
+        sink += sdslen(it->second->ptr);
+    }
+    report("HGET", start, keys);
+
+    start = TimeStamp::now();
+    for (int i = 0; i < keys; i++) {
+        sink += sets[i].count(memberObjs[i % memberObjs.size()]);
+    }
+    report("SISMEMBER", start, keys);
+}
+
+void runNew() {
+    size_t before = residentBytes();
+    std::vector <std::unique_ptr<HashType>> hashes(keys);
+    for (int i = 0; i < keys; i++) {
+        hashes[i].reset(new HashType());
+        for (int j = 0; j < fields; j++) {
+            hashes[i]->set(makeObject("field%d", j), makeObject("value:%d", i));
+        }
+    }
+    reportMemory("hash", before);
+
+    before = residentBytes();
+    std::vector <std::unique_ptr<SetType>> sets(keys);
+    for (int i = 0; i < keys; i++) {
+        sets[i].reset(new SetType());
+        for (int j = 0; j < 5; j++) {
+            sets[i]->add(makeObject("%d", i * j));
+        }
+    }
+    reportMemory("set", before);
+
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < keys; i++) {
+        const char *value;
+        size_t len;
+        if (hashes[i]->get(fieldObjs[i % fields], &value, &len)) {
+            sink += len;
+        }
+    }
+    report("HGET", start, keys);
+
+    start = TimeStamp::now();
+    for (int i = 0; i < keys; i++) {
+        sink += sets[i]->contains(memberObjs[i % memberObjs.size()]);
+    }
+    report("SISMEMBER", start, keys);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: hash <old|new> [keys] [fields]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        keys = atoi(argv[2]);
+    }
+
+    if (argc > 3) {
+        fields = std::max(atoi(argv[3]), 1);
+    }
+
+    for (int j = 0; j < fields; j++) {
+        fieldObjs.push_back(makeObject("field%d", j));
+    }
+
+    for (int j = 0; j < 1000; j++) {
+        memberObjs.push_back(makeObject("%d", j));
+    }
+
+    std::string layout = argv[1];
+    printf("layout %s, %d keys of %d fields\n", layout.c_str(), keys, fields);
+    if (layout == "old") {
+        runOld();
+    } else {
+        runNew();
+    }
+    return sink == 0;
+}
@@ -0,0 +1,141 @@
+#include "all.h"
+#include "object.h"
+#include "timer.h"
+#include "../common.h"
+
+// Compares the old two-probe keyspace (key set + per-type map) with the
+// single-probe tagged-value keyspace used by Redis::RedisMapLock.
+//
+// usage: ./keyspace <old|new> [keys] [rounds]
+
+int keys = 1000000;
+int rounds = 3;
+int valueLen = 16;
+
+typedef std::unordered_set <RedisObjectPtr, Hash, Equal> OldRedisMap;
+typedef std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> OldStringMap;
+
+typedef std::deque <RedisObjectPtr> ListValue;
+typedef std::unordered_set <RedisObjectPtr, Hash, Equal> SetValue;
+typedef std::pair <std::unordered_map<RedisObjectPtr, double, Hash, Equal>,
+        std::multimap<double, RedisObjectPtr>> ZsetValue;
+typedef std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> HashValue;
+typedef std::variant <RedisObjectPtr, std::unique_ptr<ListValue>, std::unique_ptr<SetValue>,
+std::unique_ptr<ZsetValue>, std::unique_ptr<HashValue>> RedisValue;
+typedef std::unordered_map <RedisObjectPtr, RedisValue, Hash, Equal> NewRedisMap;
+
+std::vector <RedisObjectPtr> keyObjs;
+std::vector <RedisObjectPtr> lookupObjs;
+RedisObjectPtr value;
+
+void createKeys() {
+    char buf[64];
+    for (int i = 0; i < keys; i++) {
+        int len = snprintf(buf, sizeof buf, "key:%08d", i);
+        keyObjs.push_back(createStringObject(buf, len));
+        lookupObjs.push_back(createStringObject(buf, len));
+    }
+
+    std::mt19937 gen(keys);
+    std::shuffle(lookupObjs.begin(), lookupObjs.end(), gen);
+    std::string v(valueLen, 'v');
+    value = createStringObject(const_cast<char *>(v.data()), v.size());
+}
+
+void report(const char *op, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-4s %10.0f ops/sec\n", op, ops / seconds);
+}
+
+size_t sink = 0;
+
+void runOld() {
+    OldRedisMap map;
+    OldStringMap stringMap;
+    size_t before = residentBytes();
+
+    TimeStamp start = TimeStamp::now();
+    for (auto &it : keyObjs) {
+        it->type = OBJ_STRING;
+        auto iter = map.find(it);
+        if (iter == map.end()) {
+            map.insert(it);
+            stringMap.insert(std::make_pair(it, value));
+        } else {
+            stringMap.find(it)->second = value;
+        }
+    }
+    report("SET", start, keyObjs.size());
+
+    size_t after = residentBytes();
+    printf("rss  %10.1f MB per million keys\n",
+           (after - before) / 1024.0 / 1024.0 * 1000000 / keyObjs.size());
+
+    start = TimeStamp::now();
+    for (int r = 0; r < rounds; r++) {
+        for (auto &it : lookupObjs) {
+            auto iter = map.find(it);
+            if (iter != map.end() && (*iter)->type == OBJ_STRING) {
+                sink += sdslen(stringMap.find(it)->second->ptr);
+            }
+        }
+    }
+    report("GET", start, lookupObjs.size() * rounds);
+}
+
+void runNew() {
+    NewRedisMap map;
+    size_t before = residentBytes();
+
+    TimeStamp start = TimeStamp::now();
+    for (auto &it : keyObjs) {
+        it->type = OBJ_STRING;
+        auto iter = map.find(it);
+        if (iter == map.end()) {
+            map.emplace(it, value);
+        } else {
+            std::get<OBJ_STRING>(iter->second) = value;
+        }
+    }
+    report("SET", start, keyObjs.size());
+
+    size_t after = residentBytes();
+    printf("rss  %10.1f MB per million keys\n",
+           (after - before) / 1024.0 / 1024.0 * 1000000 / keyObjs.size());
+
+    start = TimeStamp::now();
+    for (int r = 0; r < rounds; r++) {
+        for (auto &it : lookupObjs) {
+            auto iter = map.find(it);
+            if (iter != map.end() && iter->first->type == OBJ_STRING) {
+                sink += sdslen(std::get<OBJ_STRING>(iter->second)->ptr);
+            }
+        }
+    }
+    report("GET", start, lookupObjs.size() * rounds);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: keyspace <old|new> [keys] [rounds]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        keys = atoi(argv[2]);
+    }
+
+    if (argc > 3) {
+        rounds = atoi(argv[3]);
+    }
+
+    createKeys();
+    std::string layout = argv[1];
+    printf("layout %s, %d keys\n", layout.c_str(), keys);
+    if (layout == "old") {
+        runOld();
+    } else {
+        runNew();
+    }
+    return sink == 0;
+}
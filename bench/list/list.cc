@@ -0,0 +1,102 @@
+#include "all.h"
+#include "object.h"
+#include "timer.h"
+#include "quicklist.h"
+#include "../common.h"
+
+// Compares the old list (std::deque of string objects) with the Quicklist
+// of packed nodes: memory per element after pushing the elements, then
+// LRANGE of 100 elements from a random start.
+//
+// usage: ./list <old|new> [elements] [compress depth]
+
+int elements = 1000000;
+int compressDepth = 0;
+int queries = 10000;
+int rangeLen = 100;
+
+void report(const char *op, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-6s %10.0f ns/op\n", op, seconds * 1e9 / ops);
+}
+
+size_t sink = 0;
+std::vector <size_t> starts;
+
+void reportMemory(size_t before) {
+    size_t after = residentBytes();
+    printf("memory %10.1f bytes per element\n", (double) (after - before) / elements);
+}
+
+void runOld() {
+    char buf[32];
+    size_t before = residentBytes();
+    std::deque <RedisObjectPtr> list;
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < elements; i++) {
+        int len = snprintf(buf, sizeof buf, "queue:%04d", i % 10000);
+        list.push_back(createStringObject(buf, len));
+    }
+    report("RPUSH", start, elements);
+    reportMemory(before);
+
+    start = TimeStamp::now();
+    for (auto first : starts) {
+        for (int i = 0; i < rangeLen; i++) {
+            sink += sdslen(list[first + i]->ptr);
+        }
+    }
+    report("LRANGE", start, starts.size());
+}
+
+void runNew() {
+    char buf[32];
+    size_t before = residentBytes();
+    Quicklist list(compressDepth);
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < elements; i++) {
+        int len = snprintf(buf, sizeof buf, "queue:%04d", i % 10000);
+        list.pushTail(buf, len);
+    }
+    report("RPUSH", start, elements);
+    reportMemory(before);
+    printf("nodes  %10zu\n", list.nodes());
+
+    start = TimeStamp::now();
+    for (auto first : starts) {
+        list.range(first, first + rangeLen - 1, [](const char *value, size_t len) {
+            sink += len;
+        });
+    }
+    report("LRANGE", start, starts.size());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: list <old|new> [elements] [compress depth]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        elements = std::max(atoi(argv[2]), rangeLen);
+    }
+
+    if (argc > 3) {
+        compressDepth = atoi(argv[3]);
+    }
+
+    std::mt19937 gen(elements);
+    std::uniform_int_distribution <size_t> dist(0, elements - rangeLen);
+    for (int i = 0; i < queries; i++) {
+        starts.push_back(dist(gen));
+    }
+
+    std::string layout = argv[1];
+    printf("layout %s, %d elements\n", layout.c_str(), elements);
+    if (layout == "old") {
+        runOld();
+    } else {
+        runNew();
+    }
+    return sink == 0;
+}
@@ -0,0 +1,128 @@
+#include "all.h"
+#include "object.h"
+#include "timer.h"
+#include "../common.h"
+
+// Compares the old string objects (object, control block and sds allocated
+// one by one) with the embedded and shared integer encodings: memory per key
+// of a keyspace of short strings and of one of small counters, then GET-like
+// lookups. It first checks that integers out of the int64_t range are not
+// taken as integers.
+//
+// usage: ./object <old|new> [keys]
+
+int keys = 1000000;
+
+typedef std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> Keyspace;
+
+RedisObjectPtr makeOldObject(const char *buf, size_t len) {
+    RedisObjectPtr o(new RedisObject());
+    o->type = REDIS_STRING;
+    o->ptr = sdsnewlen(buf, len);
+    o->calHash();
+    return o;
+}
+
+RedisObjectPtr makeObject(bool old, const char *fmt, int i) {
+    char buf[64];
+    int len = snprintf(buf, sizeof buf, fmt, i);
+    if (old) {
+        return makeOldObject(buf, len);
+    }
+    return createStringObject(buf, len);
+}
+
+/* Counters below REDIS_SHARED_INTEGERS: the old code shared only the
+ * first 32 of them. */
+RedisObjectPtr makeCounter(bool old, int i) {
+    int64_t value = i % 1000;
+    if (old) {
+        if (value < 32) {
+            return shared.integers[value];
+        }
+
+        char buf[LONG_STR_SIZE];
+        int len = ll2string(buf, sizeof buf, value);
+        return makeOldObject(buf, len);
+    }
+    return createStringObjectFromLongLong(value);
+}
+
+void report(const char *op, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-8s %10.0f ns/op\n", op, seconds * 1e9 / ops);
+}
+
+void reportMemory(const char *what, size_t before) {
+    printf("%-8s %10.1f bytes per key\n", what, (double) (residentBytes() - before) / keys);
+}
+
+size_t sink = 0;
+
+/* Integers outside the range of an int64_t stay strings: INCR refuses
+ * them and they are never integer encoded. */
+void checkRange() {
+    const char *outside[] = {"9223372036854775808", "-9223372036854775809",
+                             "9999999999999999999", "18446744073709551615",
+                             "18446744073709551616"};
+    int64_t value;
+    for (auto s : outside) {
+        RedisObjectPtr o = createStringObject((char *) s, strlen(s));
+        assert(string2ll(s, strlen(s), &value) == 0);
+        assert(getLongLongFromObject(o, &value) == REDIS_ERR);
+        assert(tryObjectEncoding(o) == o);
+    }
+
+    assert(string2ll("9223372036854775807", 19, &value) && value == LLONG_MAX);
+    assert(string2ll("-9223372036854775808", 20, &value) && value == LLONG_MIN);
+}
+
+void run(bool old) {
+    size_t before = residentBytes();
+    Keyspace strings;
+    strings.reserve(keys);
+    for (int i = 0; i < keys; i++) {
+        strings.emplace(makeObject(old, "key:%08d", i), makeObject(old, "value:%08d", i));
+    }
+    reportMemory("string", before);
+
+    before = residentBytes();
+    Keyspace counters;
+    counters.reserve(keys);
+    for (int i = 0; i < keys; i++) {
+        counters.emplace(makeObject(old, "counter:%08d", i), makeCounter(old, i));
+    }
+    reportMemory("counter", before);
+
+    std::vector <RedisObjectPtr> lookups;
+    std::mt19937 gen(keys);
+    std::uniform_int_distribution<int> dist(0, keys - 1);
+    for (int i = 0; i < keys; i++) {
+        lookups.push_back(makeObject(old, "key:%08d", dist(gen)));
+    }
+
+    TimeStamp start = TimeStamp::now();
+    for (auto &key : lookups) {
+        auto it = strings.find(key);
+        sink += sdslen(it->second->ptr);
+    }
+    report("GET", start, lookups.size());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: object <old|new> [keys]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        keys = std::max(atoi(argv[2]), 1);
+    }
+
+    createSharedObjects();
+    checkRange();
+    std::string layout = argv[1];
+    printf("layout %s, %d keys\n", layout.c_str(), keys);
+    run(layout == "old");
+    return sink == 0;
+}
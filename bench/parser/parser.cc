@@ -0,0 +1,183 @@
+#include "all.h"
+#include "eventloop.h"
+#include "tcpconnection.h"
+#include "session.h"
+#include "timer.h"
+#include "../common.h"
+
+// Parses a pipeline of SET commands with the old parser, which allocates an
+// object for every argument, and with Session::processMultibulkBuffer, which
+// slices the input buffer and reuses the argument objects no command kept.
+//
+// usage: ./parser <old|new> [commands] [rounds] [valueLen]
+
+int commands = 100000;
+int rounds = 20;
+int valueLen = 10;
+size_t sink = 0;
+
+std::string createPipeline() {
+    std::string pipeline;
+    std::string value(valueLen, 'v');
+    char buf[256];
+    for (int i = 0; i < commands; i++) {
+        char key[32];
+        int keyLen = snprintf(key, sizeof key, "key:%06d", i % 1000000);
+        int len = snprintf(buf, sizeof buf, "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n",
+                           keyLen, key, valueLen);
+        pipeline.append(buf, len);
+        pipeline.append(value);
+        pipeline.append("\r\n");
+    }
+    return pipeline;
+}
+
+/* The parser before argument slices, kept here for comparison. */
+struct OldParser {
+    RedisObjectPtr cmd = createStringObject(nullptr, REDIS_COMMAND_LENGTH);
+    std::deque <RedisObjectPtr> redisCommands;
+    int32_t multibulklen = 0;
+    int64_t bulklen = -1;
+    int32_t argc = 0;
+    size_t pos = 0;
+
+    int32_t processMultibulkBuffer(Buffer *buffer) {
+        const char *newline = nullptr;
+        int64_t ll = 0;
+        const char *queryBuf = buffer->peek();
+        if (multibulklen == 0) {
+            newline = strchr(queryBuf + pos, '\r');
+            if (newline == nullptr) {
+                return REDIS_ERR;
+            }
+
+            string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
+            pos += (newline - (queryBuf + pos)) + 2;
+            multibulklen = ll;
+        }
+
+        while (multibulklen) {
+            if (bulklen == -1) {
+                newline = strchr(queryBuf + pos, '\r');
+                if (newline == nullptr) {
+                    break;
+                }
+
+                string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
+                pos += (newline - (queryBuf + pos)) + 2;
+                bulklen = ll;
+            }
+
+            if ((buffer->readableBytes() - pos) < (bulklen + 2)) {
+                break;
+            }
+
+            if (++argc == 1) {
+                cmd->ptr = sdscpylen(cmd->ptr, queryBuf + pos, bulklen);
+                if (cmd->ptr[0] >= 'A' && cmd->ptr[0] <= 'Z') {
+                    int len = sdslen(cmd->ptr);
+                    for (int i = 0; i < len; i++) {
+                        cmd->ptr[i] += 32;
+                    }
+                }
+                cmd->calHash();
+            } else {
+                redisCommands.push_back(createStringObject((char *) (queryBuf + pos), bulklen));
+            }
+
+            pos += bulklen + 2;
+            bulklen = -1;
+            multibulklen--;
+        }
+
+        if (multibulklen == 0) {
+            buffer->retrieve(pos);
+            pos = 0;
+            return REDIS_OK;
+        }
+        return REDIS_ERR;
+    }
+
+    void reset() {
+        argc = 0;
+        bulklen = -1;
+        redisCommands.clear();
+    }
+};
+
+void report(const char *mode, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-4s %10.0f commands/sec\n", mode, ops / seconds);
+}
+
+void runOld(const std::string &pipeline) {
+    OldParser parser;
+    Buffer buffer;
+    TimeStamp start = TimeStamp::now();
+    for (int r = 0; r < rounds; r++) {
+        buffer.append(pipeline.data(), pipeline.size());
+        while (buffer.readableBytes() > 0 && parser.processMultibulkBuffer(&buffer) == REDIS_OK) {
+            sink += parser.redisCommands.size();
+            parser.reset();
+        }
+    }
+    report("old", start, (size_t) commands * rounds);
+}
+
+void runNew(const std::string &pipeline) {
+    /* The connection is only needed to report protocol errors. */
+    int32_t fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+
+    EventLoop loop;
+    TcpConnectionPtr conn(new TcpConnection(&loop, fds[0], nullptr));
+    conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+    conn->connectEstablished();
+    SessionPtr session(new Session(nullptr, conn));
+
+    Buffer buffer;
+    TimeStamp start = TimeStamp::now();
+    for (int r = 0; r < rounds; r++) {
+        buffer.append(pipeline.data(), pipeline.size());
+        while (buffer.readableBytes() > 0 && session->processMultibulkBuffer(conn, &buffer) == REDIS_OK) {
+            sink++;
+            session->reset();
+        }
+    }
+    report("new", start, (size_t) commands * rounds);
+
+    conn->connectDestroyed();
+    ::close(fds[1]);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: parser <old|new> [commands] [rounds] [valueLen]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        commands = atoi(argv[2]);
+    }
+
+    if (argc > 3) {
+        rounds = atoi(argv[3]);
+    }
+
+    if (argc > 4) {
+        valueLen = atoi(argv[4]);
+    }
+
+    std::string pipeline = createPipeline();
+    std::string mode = argv[1];
+    printf("mode %s, %d SET commands, %d byte values\n", mode.c_str(), commands, valueLen);
+    if (mode == "old") {
+        runOld(pipeline);
+    } else {
+        runNew(pipeline);
+    }
+    return sink == 0;
+}
@@ -0,0 +1,160 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pipelined GET/SET throughput against a running server at pipeline depths
+// of 1, 16 and 128. The server runs the reads of a batch by shard, with a
+// key range well below the 1024 shards each one is locked once per batch.
+//
+// build:
+//   g++ -std=c++17 -O2 ../../bench/pipeline/pipeline.cc -o pipeline -lpthread
+// usage: ./pipeline <address> <port> <get|set> [clients] [requests] [keys]
+
+int clients = 8;
+int requests = 200000;
+int keys = 1;
+int valueLen = 3;
+
+int connectServer(const char *ip, uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, ip, &addr.sin_addr);
+    if (::connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        perror("connect");
+        exit(1);
+    }
+
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+std::string command(bool set, int key) {
+    std::string k = "key:" + std::to_string(key);
+    char buf[64];
+    std::string cmd;
+    if (set) {
+        snprintf(buf, sizeof buf, "*3\r\n$3\r\nSET\r\n$%zu\r\n", k.size());
+        cmd = buf + k + "\r\n$" + std::to_string(valueLen) + "\r\n" + std::string(valueLen, 'v') + "\r\n";
+    } else {
+        snprintf(buf, sizeof buf, "*2\r\n$3\r\nGET\r\n$%zu\r\n", k.size());
+        cmd = buf + k + "\r\n";
+    }
+    return cmd;
+}
+
+/* Returns the bytes of the first complete reply in p, 0 if it is partial. */
+size_t replyLength(const char *p, size_t len) {
+    const char *crlf = static_cast<const char *>(memmem(p, len, "\r\n", 2));
+    if (crlf == nullptr) {
+        return 0;
+    }
+
+    size_t line = crlf - p + 2;
+    if (p[0] != '$') {
+        return line;
+    }
+
+    long bulk = atol(p + 1);
+    if (bulk < 0) {
+        return line;
+    }
+    return len >= line + bulk + 2 ? line + bulk + 2 : 0;
+}
+
+void client(const char *ip, uint16_t port, bool set, int depth, int id) {
+    int fd = connectServer(ip, port);
+    unsigned seed = id;
+    std::string batch;
+    std::vector<char> buf(1 << 20);
+    size_t have = 0;
+
+    for (int sent = 0; sent < requests; sent += depth) {
+        batch.clear();
+        for (int i = 0; i < depth; i++) {
+            batch += command(set, rand_r(&seed) % keys);
+        }
+
+        if (::write(fd, batch.data(), batch.size()) != (ssize_t) batch.size()) {
+            perror("write");
+            exit(1);
+        }
+
+        int replies = 0;
+        while (replies < depth) {
+            ssize_t n = ::read(fd, buf.data() + have, buf.size() - have);
+            if (n <= 0) {
+                perror("read");
+                exit(1);
+            }
+
+            have += n;
+            size_t off = 0, len;
+            while (replies < depth && (len = replyLength(buf.data() + off, have - off)) > 0) {
+                off += len;
+                replies++;
+            }
+            memmove(buf.data(), buf.data() + off, have - off);
+            have -= off;
+        }
+    }
+    ::close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: pipeline <address> <port> <get|set> [clients] [requests] [keys]\n");
+        return 1;
+    }
+
+    const char *ip = argv[1];
+    uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+    bool set = std::string(argv[3]) == "set";
+    if (argc > 4) {
+        clients = atoi(argv[4]);
+    }
+
+    if (argc > 5) {
+        requests = atoi(argv[5]);
+    }
+
+    if (argc > 6) {
+        keys = atoi(argv[6]);
+    }
+
+    if (!set) {
+        /* Make sure the keys exist, so GET returns a value. */
+        std::thread(client, ip, port, true, 128, -1).join();
+    }
+
+    for (int depth : {1, 16, 128}) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector <std::thread> threads;
+        for (int i = 0; i < clients; i++) {
+            threads.emplace_back(client, ip, port, set, depth, i);
+        }
+
+        for (auto &it : threads) {
+            it.join();
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s depth %3d %10.0f requests/sec\n", set ? "SET" : "GET", depth,
+               1.0 * clients * requests / seconds);
+    }
+    return 0;
+}
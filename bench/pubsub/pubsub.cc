@@ -0,0 +1,181 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// PUBLISH fan-out against a running server: one publisher pipelines
+// messages to a channel with many subscribers, the time runs until every
+// subscriber has read every message. Needs ulimit -n above the number of
+// subscribers.
+//
+// build:
+//   g++ -std=c++17 -O2 ../../bench/pubsub/pubsub.cc -o pubsub -lpthread
+// usage: ./pubsub <address> <port> [subscribers] [messages] [size] [depth]
+
+int subscribers = 2000;
+int messages = 1000;
+int messageLen = 64;
+int depth = 16;
+int readers = 4;
+const std::string channel = "bench:fanout";
+
+int connectServer(const char *ip, uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, ip, &addr.sin_addr);
+    if (::connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        perror("connect");
+        exit(1);
+    }
+
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+std::string bulk(const std::string &s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+void writeAll(int fd, const std::string &s) {
+    if (::write(fd, s.data(), s.size()) != (ssize_t) s.size()) {
+        perror("write");
+        exit(1);
+    }
+}
+
+/* Reads exactly len bytes, the replies have a length known in advance. */
+void readAll(int fd, size_t len) {
+    char buf[65536];
+    while (len > 0) {
+        ssize_t n = ::read(fd, buf, std::min(len, sizeof buf));
+        if (n <= 0) {
+            perror("read");
+            exit(1);
+        }
+        len -= n;
+    }
+}
+
+/* Polls its share of the subscribers until each read total bytes. */
+void reader(const std::vector<int> &fds, size_t total, std::atomic<int> *done) {
+    std::vector<size_t> received(fds.size(), 0);
+    std::vector<struct pollfd> pfds;
+    for (int fd : fds) {
+        pfds.push_back({fd, POLLIN, 0});
+    }
+
+    size_t left = fds.size();
+    char buf[65536];
+    while (left > 0) {
+        if (::poll(pfds.data(), pfds.size(), 1000) < 0) {
+            perror("poll");
+            exit(1);
+        }
+
+        for (size_t i = 0; i < pfds.size(); i++) {
+            if (!(pfds[i].revents & POLLIN)) {
+                continue;
+            }
+
+            ssize_t n = ::read(pfds[i].fd, buf, sizeof buf);
+            if (n <= 0) {
+                perror("read");
+                exit(1);
+            }
+
+            received[i] += n;
+            if (received[i] == total) {
+                pfds[i].events = 0;
+                left--;
+                (*done)++;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: pubsub <address> <port> [subscribers] [messages] [size] [depth]\n");
+        return 1;
+    }
+
+    const char *ip = argv[1];
+    uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+    if (argc > 3) {
+        subscribers = atoi(argv[3]);
+    }
+
+    if (argc > 4) {
+        messages = atoi(argv[4]);
+    }
+
+    if (argc > 5) {
+        messageLen = atoi(argv[5]);
+    }
+
+    if (argc > 6) {
+        depth = atoi(argv[6]);
+    }
+
+    std::string subscribe = "*2\r\n" + bulk("SUBSCRIBE") + bulk(channel);
+    std::string confirm = "*3\r\n" + bulk("subscribe") + bulk(channel) + ":1\r\n";
+    std::vector<std::vector<int>> groups(readers);
+    for (int i = 0; i < subscribers; i++) {
+        int fd = connectServer(ip, port);
+        writeAll(fd, subscribe);
+        readAll(fd, confirm.size());
+        groups[i % readers].push_back(fd);
+    }
+
+    std::string payload(messageLen, 'm');
+    std::string message = "*3\r\n" + bulk("message") + bulk(channel) + bulk(payload);
+    std::string publish = "*3\r\n" + bulk("PUBLISH") + bulk(channel) + bulk(payload);
+    std::string reply = ":" + std::to_string(subscribers) + "\r\n";
+    size_t total = message.size() * messages;
+
+    std::atomic<int> done(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &it : groups) {
+        threads.emplace_back(reader, std::cref(it), total, &done);
+    }
+
+    int fd = connectServer(ip, port);
+    std::string batch;
+    for (int sent = 0; sent < messages; sent += depth) {
+        int count = std::min(depth, messages - sent);
+        batch.clear();
+        for (int i = 0; i < count; i++) {
+            batch += publish;
+        }
+        writeAll(fd, batch);
+        readAll(fd, reply.size() * count);
+    }
+    double published = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto &it : threads) {
+        it.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("subscribers %d messages %d size %d\n", subscribers, messages, messageLen);
+    printf("publish    %10.0f messages/sec\n", messages / published);
+    printf("fan-out    %10.0f deliveries/sec %8.1f MB/s\n",
+           1.0 * messages * subscribers / seconds, 1.0 * total * subscribers / seconds / (1024 * 1024));
+    return 0;
+}
@@ -1,5 +1,3 @@
-#pragma once
-
 #include "hiredis.h"
 
 int clients = 100;
@@ -19,13 +17,13 @@ public:
     };
 
     Client(EventLoop *loop, const char *ip, uint16_t port, Operation op)
-            : client(loop, nullptr),
+            : client(loop, ip, port, nullptr),
               operation(op),
               ack(0),
               sent(0) {
         client.setConnectionCallback(std::bind(&Client::connCallBack, this, std::placeholders::_1));
         client.setMessageCallback(std::bind(&Client::readCallBack, this, std::placeholders::_1, std::placeholders::_2));
-        client.connect(ip, port);
+        client.connect();
     }
 
     void countDown() {
@@ -157,7 +155,7 @@ int main(int argc, char *argv[]) {
 
         TimeStamp start = TimeStamp::now();
         for (auto &it : clientPtr) {
-            it.send();
+            it->send();
         }
 
         {
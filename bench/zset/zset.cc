@@ -0,0 +1,113 @@
+#include "all.h"
+#include "object.h"
+#include "timer.h"
+#include "zset.h"
+#include "../common.h"
+
+// Compares the old sorted set (member map + score multimap, ranks found by
+// walking the multimap) with the skiplist Zset: ZADD of every member, then
+// ZRANGE of 10 members starting at a random rank.
+//
+// usage: ./zset <old|new> [members] [queries]
+//   members 10000, 1000000 and 10000000 are the sizes of interest, 10M
+//   members take about 2GB with the new layout.
+
+int members = 1000000;
+int queries = 1000;
+int rangeLen = 10;
+
+typedef std::pair <std::unordered_map<RedisObjectPtr, double, Hash, Equal>,
+        std::multimap<double, RedisObjectPtr>> OldZset;
+
+std::vector <RedisObjectPtr> memberObjs;
+std::vector<double> scores;
+std::vector <size_t> starts;
+
+void createMembers() {
+    char buf[64];
+    std::mt19937 gen(members);
+    std::uniform_real_distribution<double> dist(0, 1000000);
+    for (int i = 0; i < members; i++) {
+        int len = snprintf(buf, sizeof buf, "member:%08d", i);
+        memberObjs.push_back(createStringObject(buf, len));
+        scores.push_back(dist(gen));
+    }
+
+    std::uniform_int_distribution <size_t> rank(0, members - rangeLen);
+    for (int i = 0; i < queries; i++) {
+        starts.push_back(rank(gen));
+    }
+}
+
+void report(const char *op, TimeStamp start, size_t ops) {
+    double seconds = timeDifference(TimeStamp::now(), start);
+    printf("%-6s %12.0f ns/op\n", op, seconds * 1e9 / ops);
+}
+
+size_t sink = 0;
+
+void runOld() {
+    OldZset zset;
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < members; i++) {
+        zset.first.insert(std::make_pair(memberObjs[i], scores[i]));
+        zset.second.insert(std::make_pair(scores[i], memberObjs[i]));
+    }
+    report("ZADD", start, members);
+
+    start = TimeStamp::now();
+    for (auto rank : starts) {
+        auto it = zset.second.begin();
+        std::advance(it, rank);
+        for (int i = 0; i < rangeLen; i++, ++it) {
+            sink += sdslen(it->second->ptr);
+        }
+    }
+    report("ZRANGE", start, starts.size());
+}
+
+void runNew() {
+    Zset zset;
+    TimeStamp start = TimeStamp::now();
+    for (int i = 0; i < members; i++) {
+        zset.add(memberObjs[i], scores[i]);
+    }
+    report("ZADD", start, members);
+
+    start = TimeStamp::now();
+    for (auto rank : starts) {
+        zset.rangeByRank(rank, rank + rangeLen - 1, false, [](const char *member, size_t len, double score) {
+            sink += len;
+        });
+    }
+    report("ZRANGE", start, starts.size());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: zset <old|new> [members] [queries]\n");
+        return 1;
+    }
+
+    if (argc > 2) {
+        members = atoi(argv[2]);
+    }
+
+    if (argc > 3) {
+        queries = atoi(argv[3]);
+    }
+
+    if (members < rangeLen) {
+        members = rangeLen;
+    }
+
+    createMembers();
+    std::string layout = argv[1];
+    printf("layout %s, %d members\n", layout.c_str(), members);
+    if (layout == "old") {
+        runOld();
+    } else {
+        runNew();
+    }
+    return sink == 0;
+}
@@ -1,9 +1,14 @@
 #include "acceptor.h"
 #include "log.h"
 
-Acceptor::Acceptor(EventLoop *loop, const char *ip, int16_t port) : loop(loop),
-channel(loop, Socket::createTcpSocket(ip, port)),
-sockfd(channel.getfd()),
+Acceptor::Acceptor(EventLoop *loop, const char *ip, int16_t port)
+	: Acceptor(loop, Socket::createTcpSocket(ip, port)) {
+
+}
+
+Acceptor::Acceptor(EventLoop *loop, int32_t sockfd) : loop(loop),
+channel(loop, sockfd),
+sockfd(sockfd),
 #ifndef _WIN64
 idleFd(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
 #endif
@@ -15,14 +20,29 @@ listenning(false) {
 }
 
 Acceptor::~Acceptor() {
+	if (loop->usesIoUring()) {
+		loop->cancelAccept(sockfd);
+	}
 	channel.disableAll();
 	channel.remove();
-	Socket::close(sockfd);
+	if (sockfd >= 0) {
+		Socket::close(sockfd);
+	}
+}
+
+int32_t Acceptor::releaseSocket() {
+	assert(!listenning);
+	int32_t fd = sockfd;
+	sockfd = -1;
+	return fd;
 }
 
 void Acceptor::handleRead() {
 	loop->assertInLoopThread();
-	int32_t connfd = Socket::accept(sockfd);
+	handleAccept(Socket::accept(sockfd));
+}
+
+void Acceptor::handleAccept(int32_t connfd) {
 	if (connfd >= 0) {
 		if (newConnectionCallback) {
 			Socket::setSocketNonBlock(connfd);
@@ -40,5 +60,11 @@ void Acceptor::handleRead() {
 void Acceptor::listen() {
 	loop->assertInLoopThread();
 	listenning = true;
+	if (loop->usesIoUring()) {
+		// A multishot accept takes every pending connection, a readable
+		// listening socket would be accepted from once per poll.
+		loop->submitAccept(sockfd, std::bind(&Acceptor::handleAccept, this, std::placeholders::_1));
+		return;
+	}
 	channel.enableReading();
 }
@@ -11,6 +11,9 @@ public:
 
 	Acceptor(EventLoop *loop, const char *ip, int16_t port);
 
+	// Accepts on a socket already bound and listening.
+	Acceptor(EventLoop *loop, int32_t sockfd);
+
 	~Acceptor();
 
 	void setNewConnectionCallback(const NewConnectionCallback &&cb) {
@@ -23,8 +26,16 @@ public:
 
 	void listen();
 
+	// Gives the listening socket up without closing it, for an Acceptor
+	// of another loop to take over before listen().
+	int32_t releaseSocket();
+
+	EventLoop *getLoop() const { return loop; }
+
 	void handleRead();
 
+	void handleAccept(int32_t connfd);
+
 private:
 	Acceptor(const Acceptor &);
 
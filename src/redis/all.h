@@ -17,6 +17,7 @@
 #include <string.h>
 #include <errno.h>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <deque>
@@ -41,6 +42,7 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <any>
+#include <variant>
 #include <string_view>
 #include <experimental/filesystem>
 #include <ratio>
@@ -148,7 +150,7 @@ typedef SSIZE_T ssize_t;
 /* Flag that is set when we should set SO_REUSEADDR before calling bind() */
 #define REDIS_REUSEADDR 5
 
-#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 39
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 44
 /* Client request types */
 #define REDIS_REQ_INLINE 1
 #define REDIS_REQ_MULTIBULK 2
@@ -157,7 +159,44 @@ typedef SSIZE_T ssize_t;
 #define REDIS_ERR -1
 #define REDIS_INLINE_MAX_SIZE (4096 * 64 * 10 * 10) /* Max size of inline reads */
 #define REDIS_LRU_BITS 24
+#define REDIS_LRU_CLOCK_MAX ((1 << REDIS_LRU_BITS) - 1) /* Max value of obj->lru */
+#define REDIS_LRU_CLOCK_RESOLUTION 1000 /* LRU clock resolution in ms */
+#define REDIS_LFU_INIT_VAL 5            /* Counter of a new key, so it is not evicted at once. */
+#define REDIS_LFU_LOG_FACTOR 10         /* Hits that take the counter from 5 to 255: ~1M. */
+#define REDIS_LFU_DECAY_TIME 1          /* Minutes for the counter to lose one. */
+#define REDIS_EVPOOL_SIZE 16            /* Eviction candidates kept by each shard. */
+#define REDIS_MIGRATE_INFLIGHT_BYTES (4 * 1024 * 1024) /* Payloads MIGRATE sent without a reply yet. */
+#define REDIS_MIGRATE_INFLIGHT_KEYS 1024   /* RESTORE-ASKING commands waiting for a reply. */
+#define REDIS_MIGRATE_DELETE_BATCH 128     /* Acknowledged keys deleted at a time. */
+#define REDIS_MIGRATE_SLOT_BATCH 1000      /* Keys a slot migration takes at a time. */
+#define REDIS_MIGRATE_SLOT_TIMEOUT 10000   /* Milliseconds a slot migration waits for the target. */
+#define REDIS_MIGRATE_CACHE_TTL 10         /* Seconds an idle connection to a target is kept. */
+#define REDIS_MIGRATE_RESENDS 16           /* Rounds keys written during a MIGRATE are sent again. */
+
+/* Maxmemory policies. */
+#define REDIS_MAXMEMORY_FLAG_LRU (1 << 0)
+#define REDIS_MAXMEMORY_FLAG_LFU (1 << 1)
+#define REDIS_MAXMEMORY_FLAG_ALLKEYS (1 << 2)
+#define REDIS_MAXMEMORY_VOLATILE_LRU ((0 << 8) | REDIS_MAXMEMORY_FLAG_LRU)
+#define REDIS_MAXMEMORY_VOLATILE_LFU ((1 << 8) | REDIS_MAXMEMORY_FLAG_LFU)
+#define REDIS_MAXMEMORY_VOLATILE_TTL (2 << 8)
+#define REDIS_MAXMEMORY_VOLATILE_RANDOM (3 << 8)
+#define REDIS_MAXMEMORY_ALLKEYS_LRU ((4 << 8) | REDIS_MAXMEMORY_FLAG_LRU | REDIS_MAXMEMORY_FLAG_ALLKEYS)
+#define REDIS_MAXMEMORY_ALLKEYS_LFU ((5 << 8) | REDIS_MAXMEMORY_FLAG_LFU | REDIS_MAXMEMORY_FLAG_ALLKEYS)
+#define REDIS_MAXMEMORY_ALLKEYS_RANDOM ((6 << 8) | REDIS_MAXMEMORY_FLAG_ALLKEYS)
+#define REDIS_MAXMEMORY_NO_EVICTION (7 << 8)
 #define REDIS_MBULK_BIG_ARG (4096 * 11 * 10 * 10)
+#define REDIS_ARGV_POOL_SIZE 16          /* Argument objects a session reuses. */
+#define REDIS_ARGV_POOL_MAX_BYTES 4096   /* Larger arguments are not kept. */
+#define REDIS_REPLY_REFERENCE_MIN_BYTES 16384   /* Larger values are written from the object. */
+#define REDIS_DISPATCH_RING_SIZE 4096    /* Requests in flight from one core to another. */
+#define REDIS_ZSET_MAX_PACKED_ENTRIES 128   /* Larger sorted sets use a skiplist. */
+#define REDIS_ZSET_MAX_PACKED_VALUE 64      /* So do sets with a longer member. */
+#define REDIS_LIST_MAX_NODE_SIZE 8192       /* Bytes of entries in one list node. */
+#define REDIS_DEFAULT_LIST_COMPRESS_DEPTH 0 /* Plain nodes at each end of a list, 0 compresses none. */
+#define REDIS_DEFAULT_HASH_MAX_LISTPACK_ENTRIES 128   /* Larger hashes use a dict. */
+#define REDIS_DEFAULT_HASH_MAX_LISTPACK_VALUE 64      /* So do hashes with a longer field or value. */
+#define REDIS_DEFAULT_SET_MAX_INTSET_ENTRIES 512      /* Larger integer sets use a dict. */
 #define REDIS_NULL -1
 #define REDIS_STRING 0
 #define REDIS_LIST 1
@@ -179,6 +218,7 @@ typedef SSIZE_T ssize_t;
 #define OBJ_SET_XX (1<<1)     /* Set if key exists. */
 #define OBJ_SET_EX (1<<2)     /* Set if time in seconds is given */
 #define OBJ_SET_PX (1<<3)     /* Set if time in ms in given */
+#define OBJ_SET_PXAT (1<<4)   /* Set if unix time in ms is given */
 /* Units */
 #define UNIT_SECONDS 0
 #define UNIT_MILLISECONDS 1
@@ -195,9 +235,12 @@ typedef SSIZE_T ssize_t;
 #define REDIS_DEFAULT_DBNUM     16
 #define REDIS_CONFIGLINE_MAX    1024
 #define REDIS_DBCRON_DBS_PER_CALL 16
+#define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Keys for each shard loop. */
+#define ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC 25 /* CPU max % for keys collection */
+#define ACTIVE_EXPIRE_CYCLE_MAX_DELETES 2000 /* Max keys removed per cycle. */
 #define REDIS_MAX_WRITE_PER_EVENT (1024*64)
 #define REDIS_SHARED_SELECT_CMDS 10
-#define REDIS_SHARED_INTEGERS 32
+#define REDIS_SHARED_INTEGERS 10000
 #define REDIS_SHARED_BULKHDR_LEN 32
 #define REDIS_MAX_LOGMSG_LEN    1024 /* Default maximum lengthgth of syslog messages */
 #define REDIS_AOF_REWRITE_PERC  100
@@ -233,7 +276,10 @@ typedef SSIZE_T ssize_t;
 #define REDIS_DEFAULT_REPL_DISABLE_TCP_NODELAY 0
 #define REDIS_DEFAULT_MAXMEMORY 0
 #define REDIS_DEFAULT_MAXMEMORY_SAMPLES 5
+#define REDIS_DEFAULT_MAXMEMORY_POLICY REDIS_MAXMEMORY_NO_EVICTION
 #define REDIS_DEFAULT_AOF_FILENGTHAME "appendonly.aof"
+#define REDIS_DEFAULT_AOF_FSYNC AOF_FSYNC_EVERYSEC
+#define REDIS_DEFAULT_AOF_USE_RDB_PREAMBLE 1
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
@@ -299,9 +345,10 @@ typedef SSIZE_T ssize_t;
 #define REDIS_RDB_TYPE_SET_INTSET    11
 #define REDIS_RDB_TYPE_ZSET_ZIPLIST  12
 #define REDIS_RDB_TYPE_HASH_ZIPLIST  13
+#define REDIS_RDB_TYPE_HASH_LISTPACK 16
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13) || t == 16)
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
 #define REDIS_RDB_OPCODE_SET        250
@@ -337,6 +384,19 @@ typedef SSIZE_T ssize_t;
 #define LONG_STR_SIZE      21          /* Bytes needed for long -> str + '\0' */
 #define AOF_AUTOSYNC_BYTES (1024*1024*32) /* fdatasync every 32MB */
 
+/* Append only defines */
+#define AOF_FSYNC_NO 0
+#define AOF_FSYNC_ALWAYS 1
+#define AOF_FSYNC_EVERYSEC 2
+
+#ifdef _WIN64
+#define redis_fsync _commit
+#elif defined(__linux__)
+#define redis_fsync fdatasync
+#else
+#define redis_fsync fsync
+#endif
+
 #define OBJ_SHARED_REFCOUNT INT_MAX
 #define REDIS_REPLY_STRING 1
 #define REDIS_REPLY_ARRAY 2
@@ -376,6 +436,8 @@ typedef SSIZE_T ssize_t;
 
 
 #define REDIS_SLAVE_SYNC_SIZE  65536
+#define REDIS_DEFAULT_REPL_SYNC_RATE 0   /* Full resync bytes per second, 0 is unlimited. */
+#define REDIS_DEFAULT_REPL_DISKLESS_SYNC 0
 #define REDIS_RECONNECT_COUNT 10
 
 #define CLUSTER_SLOTS 16384
@@ -424,6 +486,7 @@ typedef SSIZE_T ssize_t;
 
 #define RDB_SAVE_NONE 0
 #define RDB_SAVE_AOF_PREAMBLE (1<<0)
+#define RDB_EOF_MARK_SIZE 40
 
 
 #define LONG_STR_SIZE      21          /* Bytes needed for long -> str + '\0' */
@@ -0,0 +1,555 @@
+#include "aof.h"
+#include "redis.h"
+
+Aof::Aof(Redis *redis)
+        : redis(redis),
+          fp(nullptr),
+          fsyncPolicy(REDIS_DEFAULT_AOF_FSYNC),
+          appendOffset(0),
+          writtenOffset(0),
+          fsyncedOffset(0),
+          lastFsync(0),
+          stopped(true),
+          rewriting(false),
+          childPid(-1),
+          rewriteStart(0),
+          currentSize(0),
+          baseSize(0),
+          lastRewriteTime(-1),
+          lastRewriteSaved(0),
+          lastRewriteStatus(REDIS_OK) {
+
+}
+
+Aof::~Aof() {
+    stopAppendOnly();
+}
+
+/* Write the current dataset as an RDB preamble to tmpfile, then fsync it and
+ * rename it on filename. Used both to create the initial log and by the
+ * rewrite child, where the shards are read without taking their locks. */
+int32_t Aof::rewriteAppendOnlyFile(const char *tmpfile, const char *filename) {
+    FILE *tmp;
+    Rio rdb;
+    int32_t error;
+
+    if ((tmp = ::fopen(tmpfile, "w")) == nullptr) {
+        return REDIS_ERR;
+    }
+
+    redis->getRdb()->rioInitWithFile(&rdb, tmp);
+    if (redis->getRdb()->rdbSaveRio(&rdb, &error, RDB_SAVE_AOF_PREAMBLE) == REDIS_ERR ||
+        ::fflush(tmp) == EOF || ::fsync(fileno(tmp)) == REDIS_ERR) {
+        ::fclose(tmp);
+        unlink(tmpfile);
+        return REDIS_ERR;
+    }
+
+    ::fclose(tmp);
+    if (::rename(tmpfile, filename) == REDIS_ERR) {
+        unlink(tmpfile);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* Open the append only file and start the writer thread. When the file does
+ * not exist yet it is created with an RDB preamble of the current dataset,
+ * so the log alone is enough to rebuild the keyspace on restart. */
+int32_t Aof::startAppendOnly() {
+    const char *filename = REDIS_DEFAULT_AOF_FILENGTHAME;
+    struct stat sb;
+
+    if (::stat(filename, &sb) == REDIS_ERR) {
+        char tmpfile[256];
+        snprintf(tmpfile, 256, "temp-aof-%d.aof", (int32_t) getpid());
+        if (rewriteAppendOnlyFile(tmpfile, filename) == REDIS_ERR) {
+            LOG_WARN << "Error writing the AOF preamble: " << strerror(errno);
+            return REDIS_ERR;
+        }
+    }
+
+    if ((fp = ::fopen(filename, "a")) == nullptr) {
+        LOG_WARN << "Can't open the append-only file: " << strerror(errno);
+        return REDIS_ERR;
+    }
+
+    if (::fstat(fileno(fp), &sb) != REDIS_ERR) {
+        currentSize = sb.st_size;
+        baseSize = sb.st_size;
+    }
+
+    stopped = false;
+    lastFsync = mstime();
+    writer = std::thread(std::bind(&Aof::backgroundWriter, this));
+    LOG_INFO << "Append only file enabled";
+    return REDIS_OK;
+}
+
+void Aof::stopAppendOnly() {
+    if (fp == nullptr) {
+        return;
+    }
+
+    {
+        std::unique_lock <std::mutex> lck(mtx);
+        stopped = true;
+        writeCondition.notify_one();
+    }
+
+    writer.join();
+    ::fclose(fp);
+    fp = nullptr;
+}
+
+/* Called by the worker threads after a write command was executed. The
+ * command is serialized into the shared buffer and the returned offset can
+ * be passed to addFsyncCallback() once the whole input batch was processed. */
+int64_t Aof::feedAppendOnlyFile(std::deque <RedisObjectPtr> &robjs) {
+    std::deque <RedisObjectPtr> translated;
+    std::deque <RedisObjectPtr> *argv = &robjs;
+
+    /* SET with a relative EX/PX is logged with an absolute PXAT, otherwise
+     * replaying the log would extend the TTL by the server downtime. */
+    if (robjs.size() > 4 && !strcmp(robjs[0]->ptr, "set")) {
+        for (int32_t j = 3; j < robjs.size() - 1; j++) {
+            const char *a = robjs[j]->ptr;
+            if ((a[0] != 'e' && a[0] != 'E' && a[0] != 'p' && a[0] != 'P') ||
+                (a[1] != 'x' && a[1] != 'X') || a[2] != '\0') {
+                continue;
+            }
+
+            int64_t ttl;
+            if (string2ll(robjs[j + 1]->ptr, sdslen(robjs[j + 1]->ptr), &ttl) == 0) {
+                break;
+            }
+
+            if (a[0] == 'e' || a[0] == 'E') ttl *= 1000;
+            char buf[LONG_STR_SIZE];
+            int32_t len = ll2string(buf, sizeof(buf), mstime() + ttl);
+
+            translated = robjs;
+            translated[j] = createStringObject(const_cast<char *>("pxat"), 4);
+            translated[j + 1] = createStringObject(buf, len);
+            argv = &translated;
+            break;
+        }
+    }
+
+    std::unique_lock <std::mutex> lck(mtx);
+    size_t len = aofBuffer.readableBytes();
+    redis->structureRedisProtocol(aofBuffer, *argv);
+    if (rewriting) {
+        rewriteBuffer.append(aofBuffer.peek() + len, aofBuffer.readableBytes() - len);
+    }
+    appendOffset += aofBuffer.readableBytes() - len;
+    writeCondition.notify_one();
+    return appendOffset;
+}
+
+/* With appendfsync always a client must not see the reply before its writes
+ * are on disk. Sessions hold their replies and register here, the writer runs
+ * every callback covered by an fsync, so all the connections that wrote during
+ * one write batch share a single fdatasync. */
+void Aof::addFsyncCallback(int64_t offset, const std::function<void()> &cb) {
+    {
+        std::unique_lock <std::mutex> lck(mtx);
+        if (fsyncedOffset < offset && !stopped) {
+            fsyncCallbacks.push_back(std::make_pair(offset, cb));
+            return;
+        }
+    }
+    cb();
+}
+
+int32_t Aof::writeAppendOnlyFile(Buffer *buffer) {
+    size_t nwritten = ::fwrite(buffer->peek(), 1, buffer->readableBytes(), fp);
+    buffer->retrieve(nwritten);
+    currentSize += nwritten;
+    if (buffer->readableBytes() > 0 || ::fflush(fp) == EOF) {
+        LOG_WARN << "Error writing to the AOF file: " << strerror(errno);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+void Aof::backgroundWriter() {
+    Buffer buffer;
+    std::vector <std::pair<int64_t, std::function<void()>>> callbacks;
+    std::unique_lock <std::mutex> lck(mtx);
+    while (true) {
+        if (aofBuffer.readableBytes() == 0 && !stopped) {
+            writeCondition.wait_for(lck, std::chrono::milliseconds(1000 / REDIS_DEFAULT_HZ));
+        }
+
+        if (!rewriteFile.empty()) {
+            switchAppendOnlyFile(&buffer);
+        }
+
+        /* Bytes left over by a failed write go first. */
+        if (buffer.readableBytes() == 0) {
+            buffer.swap(aofBuffer);
+        } else {
+            buffer.append(aofBuffer.peek(), aofBuffer.readableBytes());
+            aofBuffer.retrieveAll();
+        }
+
+        int64_t offset = appendOffset;
+        int64_t written = writtenOffset;
+        int64_t fsynced = fsyncedOffset;
+        bool stop = stopped;
+        int32_t policy = fsyncPolicy;
+        lck.unlock();
+
+        if (buffer.readableBytes() > 0) {
+            if (writeAppendOnlyFile(&buffer) == REDIS_OK) {
+                written = offset;
+            } else if (!stop) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }
+
+        int64_t now = mstime();
+        if (written > fsynced &&
+            (policy == AOF_FSYNC_ALWAYS || stop ||
+             (policy == AOF_FSYNC_EVERYSEC && now - lastFsync >= 1000))) {
+            if (redis_fsync(fileno(fp)) == REDIS_ERR) {
+                LOG_WARN << "Error syncing the AOF file: " << strerror(errno);
+            } else {
+                fsynced = written;
+                lastFsync = now;
+            }
+        }
+
+        lck.lock();
+        writtenOffset = written;
+        fsyncedOffset = fsynced;
+        for (auto it = fsyncCallbacks.begin(); it != fsyncCallbacks.end();) {
+            if (it->first <= fsyncedOffset || stop) {
+                callbacks.push_back(std::move(*it));
+                it = fsyncCallbacks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (!callbacks.empty()) {
+            lck.unlock();
+            for (auto &it : callbacks) {
+                it.second();
+            }
+            callbacks.clear();
+            lck.lock();
+        }
+
+        if (stop) {
+            break;
+        }
+    }
+}
+
+#ifndef _WIN64
+
+/* Fork a child that writes a compacted log from the shards. Write commands
+ * and the shard locks are held across the fork so the child sees a point in
+ * time snapshot, every command fed after that point is also kept in
+ * rewriteBuffer and appended to the new file before it replaces the old one. */
+int32_t Aof::rewriteAppendOnlyFileBackground() {
+    if (childPid != -1 || fp == nullptr) {
+        return REDIS_ERR;
+    }
+
+    std::unique_lock <std::shared_mutex> lck(rewriteMutex);
+    pid_t childpid;
+    int64_t start = mstime();
+    if ((childpid = redis->forkChild()) == 0) {
+        char tmpfile[256];
+        char filename[256];
+        snprintf(tmpfile, 256, "temp-rewriteaof-%d.aof", (int32_t) getpid());
+        snprintf(filename, 256, "temp-rewriteaof-bg-%d.aof", (int32_t) getpid());
+        redis->getRdb()->setBlockEnable(false);
+        /* _exit() so stdio buffers inherited from the parent are not flushed twice. */
+        _exit(rewriteAppendOnlyFile(tmpfile, filename) == REDIS_OK ? 0 : 1);
+    }
+
+    if (childpid == -1) {
+        LOG_WARN << "Can't rewrite append only file in background: fork: " << strerror(errno);
+        return REDIS_ERR;
+    }
+
+    {
+        std::unique_lock <std::mutex> lk(mtx);
+        rewriting = true;
+        rewriteBuffer.retrieveAll();
+        rewriteStart = start;
+        childPid = childpid;
+    }
+
+    LOG_INFO << "Background append only file rewriting started by pid " << childpid;
+    return REDIS_OK;
+}
+
+void Aof::backgroundRewriteDoneHandler(int32_t exitcode, int32_t bysignal) {
+    char tmpfile[256];
+    snprintf(tmpfile, 256, "temp-rewriteaof-bg-%d.aof", (int32_t) childPid);
+
+    if (!bysignal && exitcode == 0) {
+        LOG_INFO << "Background AOF rewrite terminated with success";
+        /* The writer thread appends the buffered commands and renames the
+         * file, childPid is cleared once the new file is in place. */
+        std::unique_lock <std::mutex> lck(mtx);
+        rewriteFile = tmpfile;
+        writeCondition.notify_one();
+        return;
+    }
+
+    if (!bysignal) {
+        LOG_WARN << "Background AOF rewrite terminated with error";
+    } else {
+        LOG_WARN << "Background AOF rewrite terminated by signal " << bysignal;
+    }
+
+    unlink(tmpfile);
+    {
+        std::unique_lock <std::mutex> lck(mtx);
+        rewriting = false;
+        rewriteBuffer.retrieveAll();
+        lastRewriteStatus = REDIS_ERR;
+    }
+    childPid = -1;
+}
+
+#endif
+
+/* Called by the writer with the lock held. Everything fed since the fork is
+ * in rewriteBuffer, so once it is on disk after the child output the pending
+ * bytes for the old file can be dropped and all offsets count as synced. */
+int32_t Aof::switchAppendOnlyFile(Buffer *buffer) {
+    const char *filename = REDIS_DEFAULT_AOF_FILENGTHAME;
+    std::string tmpfile;
+    FILE *newfp;
+    struct stat sb;
+    int64_t oldSize = currentSize;
+    int32_t retval = REDIS_ERR;
+
+    tmpfile.swap(rewriteFile);
+    if ((newfp = ::fopen(tmpfile.c_str(), "a")) == nullptr) {
+        LOG_WARN << "Unable to open the temporary AOF produced by the child: " << strerror(errno);
+        goto cleanup;
+    }
+
+    if (::fwrite(rewriteBuffer.peek(), 1, rewriteBuffer.readableBytes(), newfp) !=
+        rewriteBuffer.readableBytes() || ::fflush(newfp) == EOF || redis_fsync(fileno(newfp)) == REDIS_ERR) {
+        LOG_WARN << "Error trying to flush the parent diff to the rewritten AOF: " << strerror(errno);
+        ::fclose(newfp);
+        goto cleanup;
+    }
+
+    if (::rename(tmpfile.c_str(), filename) == REDIS_ERR) {
+        LOG_WARN << "Error trying to rename the temporary AOF file: " << strerror(errno);
+        ::fclose(newfp);
+        goto cleanup;
+    }
+
+    ::fclose(fp);
+    fp = newfp;
+    if (::fstat(fileno(fp), &sb) != REDIS_ERR) {
+        currentSize = sb.st_size;
+        baseSize = sb.st_size;
+    }
+
+    buffer->retrieveAll();
+    aofBuffer.retrieveAll();
+    writtenOffset = appendOffset;
+    fsyncedOffset = appendOffset;
+    lastFsync = mstime();
+    lastRewriteTime = lastFsync - rewriteStart;
+    lastRewriteSaved = oldSize - currentSize;
+    retval = REDIS_OK;
+    LOG_INFO << "Background AOF rewrite finished successfully, " << lastRewriteSaved << " bytes saved";
+
+cleanup:
+    if (retval == REDIS_ERR) {
+        unlink(tmpfile.c_str());
+    }
+
+    lastRewriteStatus = retval;
+    rewriting = false;
+    rewriteBuffer.retrieveAll();
+    childPid = -1;
+    return retval;
+}
+
+bool Aof::rewriteNeeded() {
+    if (fp == nullptr || childPid != -1 || currentSize < REDIS_AOF_REWRITE_MIN_SIZE) {
+        return false;
+    }
+
+    int64_t base = baseSize ? baseSize.load() : 1;
+    int64_t growth = (currentSize * 100 / base) - 100;
+    if (growth >= REDIS_AOF_REWRITE_PERC) {
+        LOG_INFO << "Starting automatic rewriting of AOF on " << growth << "% growth";
+        return true;
+    }
+    return false;
+}
+
+sds Aof::catAppendOnlyInfo(sds info) {
+    return sdscatprintf(info,
+                        "# Persistence\r\n"
+                        "aof_enabled:%d\r\n"
+                        "aof_rewrite_in_progress:%d\r\n"
+                        "aof_last_rewrite_time_ms:%lld\r\n"
+                        "aof_last_rewrite_saved_bytes:%lld\r\n"
+                        "aof_last_bgrewrite_status:%s\r\n"
+                        "aof_current_size:%lld\r\n"
+                        "aof_base_size:%lld\r\n",
+                        fp != nullptr,
+                        childPid != -1,
+                        (long long) lastRewriteTime,
+                        (long long) lastRewriteSaved,
+                        lastRewriteStatus == REDIS_OK ? "ok" : "err",
+                        (long long) currentSize,
+                        (long long) baseSize);
+}
+
+/* Parse one complete command from the buffer. Returns REDIS_ERR when more
+ * data is needed, and sets badFormat when the buffer is not valid RESP. */
+int32_t Aof::processMultibulkBuffer(Buffer *buffer, std::deque <RedisObjectPtr> &robjs, bool *badFormat) {
+    const char *p = buffer->peek();
+    const char *end = p + buffer->readableBytes();
+    const char *newline;
+    int64_t multibulklen, bulklen;
+
+    robjs.clear();
+    newline = (const char *) memchr(p, '\r', end - p);
+    if (newline == nullptr || newline + 1 >= end) {
+        return REDIS_ERR;
+    }
+
+    if (p[0] != '*' || !string2ll(p + 1, newline - (p + 1), &multibulklen) || multibulklen <= 0) {
+        *badFormat = true;
+        return REDIS_ERR;
+    }
+
+    p = newline + 2;
+    for (int64_t j = 0; j < multibulklen; j++) {
+        if (p >= end) {
+            return REDIS_ERR;
+        }
+
+        newline = (const char *) memchr(p, '\r', end - p);
+        if (newline == nullptr || newline + 1 >= end) {
+            return REDIS_ERR;
+        }
+
+        if (p[0] != '$' || !string2ll(p + 1, newline - (p + 1), &bulklen) || bulklen < 0) {
+            *badFormat = true;
+            return REDIS_ERR;
+        }
+
+        p = newline + 2;
+        if (end - p < bulklen + 2) {
+            return REDIS_ERR;
+        }
+
+        RedisObjectPtr obj = createStringObject(const_cast<char *>(p), bulklen);
+        if (j == 0) {
+            for (int64_t i = 0; i < bulklen; i++) {
+                obj->ptr[i] = tolower(obj->ptr[i]);
+            }
+            obj->calHash();
+        }
+
+        robjs.push_back(obj);
+        p += bulklen + 2;
+    }
+
+    buffer->retrieve(p - buffer->peek());
+    return REDIS_OK;
+}
+
+/* Replay the append only file through the command table using a fake
+ * connection whose replies are discarded. An RDB preamble, if present, is
+ * loaded first and the command tail is read from where it ends. */
+int32_t Aof::loadAppendOnlyFile(const char *filename) {
+    FILE *fp;
+    struct stat sb;
+    char buf[PROTO_IOBUF_LENGTH];
+
+    if ((fp = ::fopen(filename, "r")) == nullptr) {
+        return REDIS_ERR;
+    }
+
+    if (::fstat(fileno(fp), &sb) != REDIS_ERR && sb.st_size == 0) {
+        ::fclose(fp);
+        return REDIS_OK;
+    }
+
+    if (::fread(buf, 1, 5, fp) == 5 && memcmp(buf, "REDIS", 5) == 0) {
+        Rio rdb;
+        ::rewind(fp);
+        redis->getRdb()->rioInitWithFile(&rdb, fp);
+        LOG_INFO << "Reading RDB preamble from AOF file...";
+        if (redis->getRdb()->rdbLoadRio(&rdb) != REDIS_OK) {
+            LOG_WARN << "Error reading the RDB preamble of the AOF file, AOF loading aborted";
+            ::fclose(fp);
+            return REDIS_ERR;
+        }
+        LOG_INFO << "Reading the remaining AOF tail...";
+    } else {
+        ::rewind(fp);
+    }
+
+    TcpConnectionPtr conn(new TcpConnection(redis->getEventLoop(), Socket::createSocket(), nullptr));
+    SessionPtr session(new Session(redis, conn));
+    auto &handlerCommands = redis->getHandlerCommandMap();
+    std::deque <RedisObjectPtr> robjs;
+    Buffer buffer;
+    bool badFormat = false;
+    bool eof = false;
+    int32_t retval = REDIS_OK;
+
+    while (true) {
+        if (processMultibulkBuffer(&buffer, robjs, &badFormat) != REDIS_OK) {
+            if (badFormat) {
+                LOG_WARN << "Bad file format reading the append only file";
+                retval = REDIS_ERR;
+                break;
+            }
+
+            if (eof) {
+                break;
+            }
+
+            size_t n = ::fread(buf, 1, sizeof(buf), fp);
+            if (n == 0) {
+                eof = true;
+            } else {
+                buffer.append(buf, n);
+            }
+            continue;
+        }
+
+        RedisObjectPtr cmd = robjs.front();
+        robjs.pop_front();
+        auto it = handlerCommands.find(cmd);
+        if (it == handlerCommands.end()) {
+            LOG_WARN << "Unknown command '" << cmd->ptr << "' reading the append only file";
+            retval = REDIS_ERR;
+            break;
+        }
+
+        it->second(robjs, session, conn);
+        conn->outputBuffer()->retrieveAll();
+    }
+
+    if (retval == REDIS_OK && buffer.readableBytes() > 0) {
+        LOG_WARN << "!!! Warning: short read while loading the AOF file, "
+                    "the last incomplete command was ignored !!!";
+    }
+
+    conn->setState(TcpConnection::kDisconnected);
+    ::fclose(fp);
+    return retval;
+}
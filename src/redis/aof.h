@@ -0,0 +1,86 @@
+#pragma once
+
+#include "all.h"
+#include "buffer.h"
+#include "object.h"
+
+class Redis;
+
+class Aof {
+public:
+    Aof(Redis *redis);
+
+    ~Aof();
+
+    int32_t startAppendOnly();
+
+    void stopAppendOnly();
+
+    int64_t feedAppendOnlyFile(std::deque <RedisObjectPtr> &robjs);
+
+    void addFsyncCallback(int64_t offset, const std::function<void()> &cb);
+
+    int32_t loadAppendOnlyFile(const char *filename);
+
+    void backgroundWriter();
+
+    int32_t rewriteAppendOnlyFileBackground();
+
+    void backgroundRewriteDoneHandler(int32_t exitcode, int32_t bysignal);
+
+    bool rewriteNeeded();
+
+    sds catAppendOnlyInfo(sds info);
+
+    std::shared_mutex &getRewriteMutex() { return rewriteMutex; }
+
+    int32_t getChildPid() { return childPid; }
+
+    void setFsyncPolicy(int32_t policy) { fsyncPolicy = policy; }
+
+    int32_t getFsyncPolicy() { return fsyncPolicy; }
+
+    bool appendOnlyEnabled() { return fp != nullptr; }
+
+private:
+    Aof(const Aof &);
+
+    void operator=(const Aof &);
+
+    int32_t writeAppendOnlyFile(Buffer *buffer);
+
+    int32_t rewriteAppendOnlyFile(const char *tmpfile, const char *filename);
+
+    int32_t switchAppendOnlyFile(Buffer *buffer);
+
+    int32_t processMultibulkBuffer(Buffer *buffer, std::deque <RedisObjectPtr> &robjs, bool *badFormat);
+
+    Redis *redis;
+    FILE *fp;
+    std::thread writer;
+    std::mutex mtx;
+    std::condition_variable writeCondition;
+    Buffer aofBuffer;
+    std::vector <std::pair<int64_t, std::function<void()>>> fsyncCallbacks;
+    std::atomic <int32_t> fsyncPolicy;
+    int64_t appendOffset;      /* Bytes fed into aofBuffer since startup. */
+    int64_t writtenOffset;     /* Bytes handed to the kernel. */
+    int64_t fsyncedOffset;     /* Bytes known to be on disk. */
+    int64_t lastFsync;
+    bool stopped;
+
+    /* Write commands hold rewriteMutex shared from execution until they were
+     * fed, so the fork for a rewrite never sees a command that is applied to
+     * the keyspace but missing from rewriteBuffer. */
+    std::shared_mutex rewriteMutex;
+    Buffer rewriteBuffer;      /* Commands fed while the child is running. */
+    bool rewriting;
+    std::string rewriteFile;   /* Set when the child is done, the writer swaps it in. */
+    std::atomic <int32_t> childPid;
+    int64_t rewriteStart;
+    std::atomic <int64_t> currentSize;
+    std::atomic <int64_t> baseSize;
+    std::atomic <int64_t> lastRewriteTime;
+    std::atomic <int64_t> lastRewriteSaved;
+    std::atomic <int32_t> lastRewriteStatus;
+};
@@ -4,8 +4,169 @@ const char Buffer::kCRLF[] = "\r\n";
 const char Buffer::CONTENT[] = "Content-Length";
 const int32_t Buffer::kCheapPrepend;
 const int32_t Buffer::kInitialSize;
+const int32_t BufferPool::kMinClassBytes;
+const int32_t BufferPool::kClasses;
+const int64_t BufferPool::kMaxPooledBytes;
+const int32_t BufferPool::kIdleCycles;
 
+/* The class whose slabs hold at least len bytes after the prepend, or
+ * kClasses when len is larger than the largest. */
+static int32_t classFor(int32_t len) {
+    int32_t index = 0;
+    while (index < BufferPool::kClasses && (BufferPool::kMinClassBytes << index) < len) {
+        index++;
+    }
+    return index;
+}
+
+BufferPool::BufferPool()
+        : pooled(0),
+          inuse(0) {
+    for (auto &it : classes) {
+        it.idleCycles = 0;
+        it.used = false;
+    }
+}
+
+/* Storage with room for at least len bytes after the prepend, sized to
+ * its class so it can go back to the pool. */
+std::vector<char> BufferPool::acquire(int32_t len) {
+    int32_t index = classFor(len);
+    if (index == kClasses) {
+        return std::vector<char>(Buffer::kCheapPrepend + len);
+    }
+
+    auto &sizeClass = classes[index];
+    sizeClass.used = true;
+    if (sizeClass.free.empty()) {
+        return std::vector<char>(Buffer::kCheapPrepend + (kMinClassBytes << index));
+    }
+
+    std::vector<char> storage(std::move(sizeClass.free.back()));
+    sizeClass.free.pop_back();
+    pooled -= storage.capacity();
+    return storage;
+}
+
+/* Kept in the largest class it fills, freed when it is smaller than the
+ * smallest class, larger than the largest or the pool is full. */
+void BufferPool::release(std::vector<char> &&storage) {
+    int64_t capacity = storage.capacity();
+    int64_t len = capacity - Buffer::kCheapPrepend;
+    if (len < kMinClassBytes || len >= ((int64_t) kMinClassBytes << kClasses) ||
+        pooled + capacity > kMaxPooledBytes) {
+        return;
+    }
+
+    int32_t index = kClasses - 1;
+    while ((kMinClassBytes << index) > len) {
+        index--;
+    }
+
+    storage.resize(Buffer::kCheapPrepend + (kMinClassBytes << index));
+    classes[index].free.push_back(std::move(storage));
+    pooled += capacity;
+}
+
+/* Called once a second: a class nobody took from for kIdleCycles calls
+ * frees half of its slabs on every further call. */
+void BufferPool::trim() {
+    for (auto &it : classes) {
+        if (it.used) {
+            it.used = false;
+            it.idleCycles = 0;
+            continue;
+        }
+
+        if (++it.idleCycles < kIdleCycles || it.free.empty()) {
+            continue;
+        }
+
+        size_t keep = it.free.size() / 2;
+        while (it.free.size() > keep) {
+            pooled -= it.free.back().capacity();
+            it.free.pop_back();
+        }
+    }
+}
+
+Buffer::~Buffer() {
+    if (pool != nullptr) {
+        pool->addInUse(-(int64_t) buffer.capacity());
+    }
+}
+
+void Buffer::swap(Buffer &rhs) {
+    if (pool != rhs.pool) {
+        int64_t delta = (int64_t) rhs.buffer.capacity() - (int64_t) buffer.capacity();
+        if (pool != nullptr) {
+            pool->addInUse(delta);
+        }
+
+        if (rhs.pool != nullptr) {
+            rhs.pool->addInUse(-delta);
+        }
+    }
+
+    buffer.swap(rhs.buffer);
+    std::swap(readerIndex, rhs.readerIndex);
+    std::swap(writerIndex, rhs.writerIndex);
+}
+
+/* Gives the storage of an empty pooled buffer back, the next write takes
+ * it again. */
+void Buffer::release() {
+    if (pool == nullptr || buffer.empty() || readableBytes() > 0) {
+        return;
+    }
+
+    std::vector<char> storage;
+    storage.swap(buffer);
+    pool->addInUse(-(int64_t) storage.capacity());
+    pool->release(std::move(storage));
+    readerIndex = kCheapPrepend;
+    writerIndex = kCheapPrepend;
+}
+
+void Buffer::makeSpace(int32_t len) {
+    if (buffer.empty()) {
+        if (pool != nullptr) {
+            buffer = pool->acquire(len);
+            pool->addInUse(buffer.capacity());
+        } else {
+            buffer.resize(kCheapPrepend + len);
+        }
+        readerIndex = kCheapPrepend;
+        writerIndex = kCheapPrepend;
+        return;
+    }
+
+    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+        size_t capacity = buffer.capacity();
+        buffer.resize(writerIndex + len);
+        if (pool != nullptr) {
+            pool->addInUse((int64_t) buffer.capacity() - (int64_t) capacity);
+        }
+    } else {
+        assert(kCheapPrepend < readerIndex);
+        int32_t readable = readableBytes();
+        std::copy(begin() + readerIndex,
+                  begin() + writerIndex,
+                  begin() + kCheapPrepend);
+        readerIndex = kCheapPrepend;
+        writerIndex = readerIndex + readable;
+        assert(readable == readableBytes());
+    }
+}
+
+/* A pooled buffer reads only into its writable bytes, the caller reserves
+ * the room first. Any other reads what does not fit into extrabuf and
+ * appends it from there. */
 ssize_t Buffer::readFd(int32_t fd, int32_t *saveErrno) {
+    if (pool != nullptr && writableBytes() == 0) {
+        ensureWritableBytes(kInitialSize);
+    }
+
     char extrabuf[65536];
     IOV_TYPE vec[2];
     const int32_t writable = writableBytes();
@@ -20,7 +181,7 @@ ssize_t Buffer::readFd(int32_t fd, int32_t *saveErrno) {
     vec[1].iov_base = extrabuf;
     vec[1].iov_len = sizeof extrabuf;
 #endif
-    const int iovcnt = (writable < sizeof(extrabuf)) ? 2 : 1;
+    const int iovcnt = (pool == nullptr && writable < sizeof(extrabuf)) ? 2 : 1;
     const ssize_t n = Socket::readv(fd, vec, iovcnt);
     if (n < 0) {
 #ifdef _WIN64
@@ -4,6 +4,47 @@
 #include "util.h"
 #include "socket.h"
 
+/* Free buffer storage of one event loop by size class, an idle connection
+ * hands its buffers back and a busy one takes them without going to the
+ * allocator. Only the loop thread acquires and releases, the byte counts
+ * are read by INFO from any thread. */
+class BufferPool {
+public:
+    static const int32_t kMinClassBytes = 1024;
+    static const int32_t kClasses = 11;                       /* 1KB to 1MB */
+    static const int64_t kMaxPooledBytes = 16 * 1024 * 1024;
+    static const int32_t kIdleCycles = 10;
+
+    BufferPool();
+
+    std::vector<char> acquire(int32_t len);
+
+    void release(std::vector<char> &&storage);
+
+    void trim();
+
+    void addInUse(int64_t bytes) { inuse += bytes; }
+
+    int64_t getPooledBytes() const { return pooled; }
+
+    int64_t getInUseBytes() const { return inuse; }
+
+private:
+    BufferPool(const BufferPool &);
+
+    void operator=(const BufferPool &);
+
+    struct SizeClass {
+        std::vector <std::vector<char>> free;
+        int32_t idleCycles;         /* trim() calls since the class was used. */
+        bool used;
+    };
+
+    SizeClass classes[kClasses];
+    std::atomic<int64_t> pooled;
+    std::atomic<int64_t> inuse;
+};
+
 class Buffer {
 public:
     static const int32_t kCheapPrepend = 16;
@@ -12,24 +53,33 @@ public:
     explicit Buffer(int32_t initialSize = kInitialSize)
             : buffer(kCheapPrepend + initialSize),
               readerIndex(kCheapPrepend),
-              writerIndex(kCheapPrepend) {
+              writerIndex(kCheapPrepend),
+              pool(nullptr) {
         assert(readableBytes() == 0);
         assert(writableBytes() == initialSize);
         assert(prependableBytes() == kCheapPrepend);
     }
 
-    void swap(Buffer &rhs) {
-        buffer.swap(rhs.buffer);
-        std::swap(readerIndex, rhs.readerIndex);
-        std::swap(writerIndex, rhs.writerIndex);
+    /* Starts without storage, the first write takes it from pool. */
+    explicit Buffer(BufferPool *pool)
+            : readerIndex(kCheapPrepend),
+              writerIndex(kCheapPrepend),
+              pool(pool) {
+
     }
 
+    ~Buffer();
+
+    void swap(Buffer &rhs);
+
+    void release();
+
     int32_t readableBytes() const {
         return writerIndex - readerIndex;
     }
 
     int32_t writableBytes() const {
-        return buffer.size() - writerIndex;
+        return buffer.empty() ? 0 : buffer.size() - writerIndex;
     }
 
     int32_t getWriterIndex() {
@@ -53,15 +103,27 @@ public:
     }
 
     const char *findCRLF() const {
-        const char *crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF + 2);
-        return crlf == beginWrite() ? nullptr : crlf;
+        return findCRLF(peek());
     }
 
+    /* memchr() is vectorized by the libc, skip to each '\r' with it instead
+     * of comparing the pattern at every byte. */
     const char *findCRLF(const char *start) const {
         assert(peek() <= start);
         assert(start <= beginWrite());
-        const char *crlf = std::search(start, beginWrite(), kCRLF, kCRLF + 2);
-        return crlf == beginWrite() ? nullptr : crlf;
+        const char *end = beginWrite();
+        while (start < end) {
+            const char *cr = static_cast<const char *>(memchr(start, '\r', end - start));
+            if (cr == nullptr || cr + 1 == end) {
+                return nullptr;
+            }
+
+            if (cr[1] == '\n') {
+                return cr;
+            }
+            start = cr + 1;
+        }
+        return nullptr;
     }
 
     const char *findEOL() const {
@@ -189,6 +251,9 @@ public:
     }
 
     void prepend(const void *data, int32_t len) {
+        if (buffer.empty()) {
+            makeSpace(0);
+        }
         assert(len <= prependableBytes());
         readerIndex -= len;
         const char *d = static_cast<const char *>(data);
@@ -306,7 +371,7 @@ private:
     void operator=(const Buffer &);
 
     char *begin() {
-        return &*buffer.begin();
+        return buffer.data();
     }
 
     char *prepeek() {
@@ -314,28 +379,16 @@ private:
     }
 
     const char *begin() const {
-        return &*buffer.begin();
+        return buffer.data();
     }
 
-    void makeSpace(int32_t len) {
-        if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-            buffer.resize(writerIndex + len);
-        } else {
-            assert(kCheapPrepend < readerIndex);
-            int32_t readable = readableBytes();
-            std::copy(begin() + readerIndex,
-                      begin() + writerIndex,
-                      begin() + kCheapPrepend);
-            readerIndex = kCheapPrepend;
-            writerIndex = readerIndex + readable;
-            assert(readable == readableBytes());
-        }
-    }
+    void makeSpace(int32_t len);
 
 private:
     std::vector<char> buffer;
     int32_t readerIndex;
     int32_t writerIndex;
+    BufferPool *pool;
 
     static const char kCRLF[];
     static const char kCRLFCRLF[];
@@ -38,6 +38,8 @@ class Poll;
 
 class Epoll;
 
+class IoUring;
+
 class Thread;
 
 class RedisObject;
@@ -82,6 +84,7 @@ typedef std::shared_ptr <Channel> ChannelPtr;
 typedef std::shared_ptr <TimerQueue> TimerQueuePtr;
 typedef std::shared_ptr <Poll> PollPtr;
 typedef std::shared_ptr <Epoll> EpollPtr;
+typedef std::shared_ptr <IoUring> IoUringPtr;
 typedef std::shared_ptr <Select> SelectPtr;
 typedef std::shared_ptr <Thread> ThreadPtr;
 typedef std::function<void()> TimerCallback;
@@ -92,6 +95,7 @@ typedef std::function<void(const TcpConnectionPtr &)> CloseCallback;
 typedef std::function<void(const TcpConnectionPtr &)> WriteCompleteCallback;
 typedef std::function<void(const TcpConnectionPtr &, size_t)> HighWaterMarkCallback;
 typedef std::function<void(const TcpConnectionPtr &, Buffer *)> MessageCallback;
+typedef std::function<void(ssize_t)> CompletionCallback;
 
 
 
@@ -13,7 +13,8 @@ Channel::Channel(EventLoop *loop, int32_t fd)
           index(-1),
           tied(false),
           eventHandling(false),
-          addedToLoop(false) {
+          addedToLoop(false),
+          receiveBuffer(nullptr) {
 
 }
 
@@ -4,6 +4,8 @@
 
 class EventLoop;
 
+class Buffer;
+
 class Channel {
 public:
     typedef std::function<void()> EventCallback;
@@ -83,6 +85,12 @@ public:
 
     EventLoop *ownerLoop() { return loop; }
 
+    /* A poller that receives for its channels (IoUring) appends the bytes
+     * to this buffer instead of reporting the fd readable. */
+    void setReceiveBuffer(Buffer *buffer) { receiveBuffer = buffer; }
+
+    Buffer *getReceiveBuffer() { return receiveBuffer; }
+
 private:
     Channel(const Channel &);
 
@@ -111,5 +119,6 @@ private:
     bool addedToLoop;
     bool logHup;
     std::weak_ptr<void> tie;
+    Buffer *receiveBuffer;
 
 };
@@ -8,7 +8,9 @@ Cluster::Cluster(Redis *redis)
           state(true),
           isConnect(false),
           replyCount(0) {
-
+    for (auto &it : routes) {
+        it.store(0, std::memory_order_relaxed);
+    }
 }
 
 Cluster::~Cluster() {
@@ -26,6 +28,7 @@ void Cluster::cretateClusterNode(int32_t slot, const std::string &ip,
     node.master = nullptr;
     node.slaves = nullptr;
     clusterSlotNodes.insert(std::make_pair(slot, node));
+    updateRoute(slot);
 }
 
 void Cluster::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
@@ -83,12 +86,13 @@ void Cluster::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
                     std::unique_lock <std::mutex> lck(mu);
 
                     for (auto &iter : map) {
-                        if (iter->type == OBJ_STRING) {
+                        if (iter.first->type == OBJ_STRING) {
 
                         }
                     }
                 }
                 migratingSlosTos.erase(ipPort);
+                updateRoutes();
                 clear();
                 LOG_INFO << "cluster migrate success " << ip << " " << port;
             }
@@ -101,7 +105,7 @@ void Cluster::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
 }
 
 void Cluster::clusterRedirectClient(const TcpConnectionPtr &conn, const SessionPtr &session,
-                                    ClusterNode *n, int32_t hashSlot, int32_t errCode) {
+                                    const ClusterNode *n, int32_t hashSlot, int32_t errCode) {
     if (errCode == CLUSTER_REDIR_CROSS_SLOT) {
         addReplySds(conn->outputBuffer(),
                     sdsnew("-CROSSSLOT Keys in request don't hash to the same slot\r\n"));
@@ -136,24 +140,7 @@ void Cluster::syncClusterSlot() {
 }
 
 uint32_t Cluster::keyHashSlot(char *key, int32_t keylen) {
-    int32_t s, e; /* start-end indexes of { and } */
-
-    for (s = 0; s < keylen; s++)
-        if (key[s] == '{') break;
-
-    /* No '{' ? Hash the whole key. This is the base case. */
-    if (s == keylen) return crc16(key, keylen) & 0x3FFF;
-
-    /* '{' found? Check if we have the corresponding '}'. */
-    for (e = s + 1; e < keylen; e++)
-        if (key[e] == '}') break;
-
-    /* No '}' or nothing betweeen {} ? Hash the whole key. */
-    if (e == keylen || e == s + 1) return crc16(key, keylen) & 0x3FFF;
-
-    /* If we are here there is both a { and a } on its right. Hash
-    * what is in the middle between { and }. */
-    return crc16(key + s + 1, e - s - 1) & 0x3FFF;
+    return ::keyHashSlot(key, keylen);
 }
 
 int32_t Cluster::getSlotOrReply(const SessionPtr &session, const RedisObjectPtr &o, const TcpConnectionPtr &conn) {
@@ -202,96 +189,11 @@ bool Cluster::getKeySlot(const std::string &name) {
 }
 
 void Cluster::clear() {
-    clusterDelCopys.clear();
-    clusterDelKeys.clear();
     slotSets.clear();
     redisCommands.clear();
     buffer.retrieveAll();
 }
 
-bool Cluster::replicationToNode(const std::deque <RedisObjectPtr> &obj, const SessionPtr &session,
-                                const std::string &ip, int16_t port, int8_t copy, int8_t replace, int32_t numKeys,
-                                int32_t firstKey) {
-    clear();
-
-    TcpConnectionPtr conn;
-    int8_t count = 0;
-
-    {
-        std::unique_lock <std::mutex> lck(redis->getClusterMutex());
-        auto &clusterConn = redis->getClusterConn();
-        for (auto &it : clusterConn) {
-            char buf[64] = "";
-            uint16_t p = 0;
-            auto addr = Socket::getPeerAddr(it.second->getSockfd());
-            Socket::toIp(buf, sizeof(buf), (const struct sockaddr *) &addr);
-            Socket::toPort(&p, (const struct sockaddr *) &addr);
-
-            if (memcmp(ip.c_str(), buf, ip.size()) == 0 && p == port) {
-                conn = it.second;
-                count++;
-            }
-        }
-
-        for (auto &it : clusterSlotNodes) {
-            if (it.second.ip == ip && it.second.port == port) {
-                std::string nodeName = it.second.name;
-                auto it = migratingSlosTos.find(std::move(nodeName));
-                if (it != migratingSlosTos.end()) {
-                    slotSets = it->second;
-                    count++;
-                }
-            }
-        }
-    }
-
-    if (count != 2) {
-        return false;
-    }
-
-    if (copy == 0) {
-        std::unique_lock <std::mutex> lck(redis->getClusterMutex());
-        for (int j = 0; j < numKeys; j++) {
-            clusterDelKeys.push_back(
-                    createRawStringObject(obj[firstKey + j]->type,
-                                          obj[firstKey + j]->ptr, sdslen(obj[firstKey + j]->ptr)));
-        }
-    }
-
-    if (!strcmp(obj[2]->ptr, "")) {
-        std::unique_lock <std::mutex> lck(redis->getClusterMutex());
-        for (auto &it : clusterDelKeys) {
-            char *key = it->ptr;
-            int32_t hashslot = keyHashSlot(key, sdslen(key));
-            auto iter = slotSets.find(hashslot);
-            if (iter == slotSets.end()) {
-                return false;
-            }
-
-            const RedisObjectPtr &dump = redis->createDumpPayload(it);
-            if (dump == nullptr) {
-                return false;
-            }
-            conn->sendPipe(dump->ptr);
-        }
-    } else {
-        std::unique_lock <std::mutex> lck(redis->getClusterMutex());
-        char *key = obj[2]->ptr;
-        int32_t hashslot = keyHashSlot(key, sdslen(key));
-        auto iter = slotSets.find(hashslot);
-        if (iter == slotSets.end()) {
-            return false;
-        }
-
-        const RedisObjectPtr &dump = redis->createDumpPayload(obj[2]);
-        if (dump == nullptr) {
-            return false;
-        }
-        conn->sendPipe(dump->ptr);
-    }
-    return true;
-}
-
 void Cluster::connCallback(const TcpConnectionPtr &conn) {
     if (conn->connected()) {
         isConnect = true;
@@ -349,6 +251,7 @@ void Cluster::connCallback(const TcpConnectionPtr &conn) {
             eraseClusterNode(ip, p);
             migratingSlosTos.erase(ip + std::to_string(p));
             importingSlotsFroms.erase(ip + std::to_string(p));
+            updateRoutes();
 
             for (auto it = clusterConns.begin(); it != clusterConns.end(); ++it) {
                 char ipp[64] = "";
@@ -378,10 +281,57 @@ ClusterNode *Cluster::checkClusterSlot(int32_t slot) {
 
 void Cluster::eraseMigratingSlot(const std::string &name) {
     migratingSlosTos.erase(name);
+    updateRoutes();
 }
 
 void Cluster::eraseImportingSlot(const std::string &name) {
     importingSlotsFroms.erase(name);
+    updateRoutes();
+}
+
+uintptr_t Cluster::buildRoute(int32_t slot) {
+    uintptr_t route = 0;
+    auto it = clusterSlotNodes.find(slot);
+    if (it != clusterSlotNodes.end()) {
+        /* Owners are interned by address, a route never points at a node
+         * of the slot map that may be changed or erased under a reader. */
+        const ClusterNode &owner = it->second;
+        auto &node = routeNodes[owner.ip + ":" + std::to_string(owner.port)];
+        if (node == nullptr) {
+            node.reset(new ClusterNode(owner));
+            node->slaves = nullptr;
+            node->master = nullptr;
+        }
+
+        route = reinterpret_cast<uintptr_t>(node.get());
+        if (redis->getIp() == owner.ip && redis->getPort() == owner.port) {
+            route |= kRouteSelf;
+        }
+    }
+
+    for (auto &iter : migratingSlosTos) {
+        if (iter.second.find(slot) != iter.second.end()) {
+            route |= kRouteMigrating;
+        }
+    }
+
+    for (auto &iter : importingSlotsFroms) {
+        if (iter.second.find(slot) != iter.second.end()) {
+            route |= kRouteImporting;
+        }
+    }
+    return route;
+}
+
+/* The release store publishes a newly interned node along with the word. */
+void Cluster::updateRoute(int32_t slot) {
+    routes[slot].store(buildRoute(slot), std::memory_order_release);
+}
+
+void Cluster::updateRoutes() {
+    for (int32_t slot = 0; slot < CLUSTER_SLOTS; slot++) {
+        updateRoute(slot);
+    }
 }
 
 void Cluster::addSlotDeques(const RedisObjectPtr &slot, std::string name) {
@@ -398,6 +348,7 @@ void Cluster::delSlotDeques(const RedisObjectPtr &obj, int32_t slot) {
     redisCommands.push_back(shared.delsync);
     redisCommands.push_back(createStringObject(obj->ptr, sdslen(obj->ptr)));
     clusterSlotNodes.erase(slot);
+    updateRoute(slot);
 }
 
 sds Cluster::showClusterNodes() {
@@ -421,85 +372,18 @@ sds Cluster::showClusterNodes() {
 }
 
 void Cluster::getKeyInSlot(int32_t hashslot, std::vector <RedisObjectPtr> &keys, int32_t count) {
-    int32_t j = 0;
-    auto &redisShards = redis->getRedisShards();
-    for (auto &it : redisShards) {
-        auto &mu = it.mtx;
-        auto &map = it.redisMap;
-        auto &stringMap = it.stringMap;
-        auto &hashMap = it.hashMap;
-        auto &zsetMap = it.zsetMap;
-        auto &setMap = it.setMap;
-        auto &listMap = it.listMap;
-
-        std::unique_lock <std::mutex> lck(mu);
-        for (auto &iter : map) {
-            if (iter->type == OBJ_STRING) {
-                auto iterr = stringMap.find(iter);
-                assert(iterr != stringMap.end());
-                assert(iterr->first->type == iter->type);
-                uint32_t slot = keyHashSlot(iter->ptr, sdslen(iter->ptr));
-                if (slot == hashslot) {
-                    keys.push_back(createRawStringObject(OBJ_STRING, iter->ptr, sdslen(iter->ptr)));
-                    if (--count == 0) {
-                        return;
-                    }
-                }
-            } else if (iter->type == OBJ_HASH) {
-                auto iterr = hashMap.find(iter);
-                assert(iterr != hashMap.end());
-                assert(iterr->first->type == iter->type);
-                uint32_t slot = keyHashSlot(iter->ptr, sdslen(iter->ptr));
-                if (slot == hashslot) {
-                    keys.push_back(createRawStringObject(OBJ_HASH, iter->ptr, sdslen(iter->ptr)));
-                    if (--count == 0) {
-                        return;
-                    }
-                }
-            } else if (iter->type == OBJ_LIST) {
-                auto iterr = listMap.find(iter);
-                assert(iterr != listMap.end());
-                assert(iterr->first->type == iter->type);
-                uint32_t slot = keyHashSlot(iter->ptr, sdslen(iter->ptr));
-                if (slot == hashslot) {
-                    keys.push_back(createRawStringObject(OBJ_LIST, iter->ptr, sdslen(iter->ptr)));
-                    if (--count == 0) {
-                        return;
-                    }
-                }
-            } else if (iter->type == OBJ_ZSET) {
-                auto iterr = zsetMap.find(iter);
-                assert(iterr != zsetMap.end());
-                assert(iterr->first->type == iter->type);
-                uint32_t slot = keyHashSlot(iter->ptr, sdslen(iter->ptr));
-                if (slot == hashslot) {
-                    keys.push_back(createRawStringObject(OBJ_ZSET, iter->ptr, sdslen(iter->ptr)));
-                    if (--count == 0) {
-                        return;
-                    }
-                }
-            } else if (iter->type == OBJ_SET) {
-                auto iterr = setMap.find(iter);
-                assert(iterr != setMap.end());
-                assert(iterr->first->type == iter->type);
-                uint32_t slot = keyHashSlot(iter->ptr, sdslen(iter->ptr));
-                if (slot == hashslot) {
-                    keys.push_back(createRawStringObject(OBJ_SET, iter->ptr, sdslen(iter->ptr)));
-                    if (--count == 0) {
-                        return;
-                    }
-                }
-            } else {
-                assert(false);
-            }
-        }
-    }
+    redis->getSlotIndex().getKeys(hashslot, keys, count);
+}
+
+size_t Cluster::countKeysInSlot(int32_t hashslot) {
+    return redis->getSlotIndex().countKeys(hashslot);
 }
 
 void Cluster::eraseClusterNode(int32_t slot) {
     auto it = clusterSlotNodes.find(slot);
     assert(it != clusterSlotNodes.end());
     clusterSlotNodes.erase(slot);
+    updateRoute(slot);
 }
 
 void Cluster::eraseClusterNode(const std::string &ip, int16_t port) {
@@ -17,6 +17,15 @@ struct ClusterNode {
     struct ClusterNode *master;
 };
 
+/* Where a command on a key of the slot goes. node is an interned copy of
+ * the owner that is never changed, nullptr while the slot has no owner. */
+struct ClusterRoute {
+    const ClusterNode *node;
+    bool self;
+    bool migrating;
+    bool importing;
+};
+
 class Redis;
 
 class Cluster {
@@ -53,11 +62,7 @@ public:
     void syncClusterSlot();
 
     void clusterRedirectClient(const TcpConnectionPtr &conn, const SessionPtr &session,
-                               ClusterNode *node, int32_t hashSlot, int32_t errCode);
-
-    bool replicationToNode(const std::deque <RedisObjectPtr> &obj,
-                           const SessionPtr &session, const std::string &ip,
-                           int16_t port, int8_t copy, int8_t replace, int32_t numKeys, int32_t firstKey);
+                               const ClusterNode *node, int32_t hashSlot, int32_t errCode);
 
     void delClusterImport(std::deque <RedisObjectPtr> &robj);
 
@@ -67,6 +72,8 @@ public:
 
     void getKeyInSlot(int32_t slot, std::vector <RedisObjectPtr> &keys, int32_t count);
 
+    size_t countKeysInSlot(int32_t slot);
+
     ClusterNode *checkClusterSlot(int32_t slot);
 
     sds showClusterNodes();
@@ -93,11 +100,36 @@ public:
 
     void eraseImportingSlot(const std::string &name);
 
+    /* Routing of a key on the command path, without locks. The route of a
+     * slot is one word, the interned node with the flags in its low bits,
+     * and the nodes are never freed, so a slot change is a single store. */
+    ClusterRoute getRoute(int32_t slot) const {
+        uintptr_t word = routes[slot].load(std::memory_order_acquire);
+        return {reinterpret_cast<const ClusterNode *>(word & ~kRouteFlags),
+                (word & kRouteSelf) != 0, (word & kRouteMigrating) != 0,
+                (word & kRouteImporting) != 0};
+    }
+
+    /* Republish the route of one slot or of all slots, with the cluster
+     * mutex held after changing the slot map or the migrating and
+     * importing sets through the accessors above. */
+    void updateRoute(int32_t slot);
+
+    void updateRoutes();
+
 private:
     Cluster(const Cluster &);
 
     void operator=(const Cluster &);
 
+    uintptr_t buildRoute(int32_t slot);
+
+    static const uintptr_t kRouteSelf = 1;
+    static const uintptr_t kRouteMigrating = 2;
+    static const uintptr_t kRouteImporting = 4;
+    static const uintptr_t kRouteFlags = kRouteSelf | kRouteMigrating | kRouteImporting;
+    static_assert(alignof(ClusterNode) > kRouteFlags, "route flags need the low bits of a node");
+
     EventLoop *loop;
     Redis *redis;
     std::atomic<bool> state;
@@ -106,12 +138,12 @@ private:
     std::map <int32_t, ClusterNode> clusterSlotNodes;
     std::unordered_map <std::string, std::unordered_set<int32_t>> migratingSlosTos;
     std::unordered_map <std::string, std::unordered_set<int32_t>> importingSlotsFroms;
-    std::vector <RedisObjectPtr> clusterDelKeys;
-    std::vector <RedisObjectPtr> clusterDelCopys;
     std::condition_variable condition;
     std::atomic <int32_t> replyCount;
     std::deque <RedisObjectPtr> redisCommands;
     std::unordered_set <int32_t> slotSets;
     Buffer buffer;
+    std::atomic <uintptr_t> routes[CLUSTER_SLOTS];
+    std::unordered_map <std::string, std::unique_ptr<ClusterNode>> routeNodes;
 
 };
@@ -0,0 +1,323 @@
+#include "dispatcher.h"
+#include "redis.h"
+
+/* How the replies of the parts of a command are merged. */
+static const int32_t kRouteKey = 0;     /* Single key, one part. */
+static const int32_t kRouteSum = 1;     /* Integer replies are added up, DEL. */
+static const int32_t kRouteArray = 2;   /* Array replies are put back in key order, MGET. */
+
+/* Core of the worker loop running on this thread, -1 on any other thread. */
+static thread_local int32_t currentCore = -1;
+
+Dispatcher::Dispatcher(Redis *redis)
+        : redis(redis),
+          cores(0),
+          forwarded(0) {
+
+}
+
+Dispatcher::~Dispatcher() {
+    for (auto &it : coreList) {
+        it->scratch->setState(TcpConnection::kDisconnected);
+    }
+}
+
+void Dispatcher::start(const std::vector<EventLoop *> &loops) {
+    assert(cores == 0);
+    if (loops.size() < 2) {
+        return;
+    }
+
+    routes[shared.del] = kRouteSum;
+    routes[shared.exists] = kRouteSum;
+    routes[shared.mget] = kRouteArray;
+    for (auto &it : {shared.set, shared.get, shared.ttl, shared.pttl,
+                     shared.incr, shared.decr, shared.hset, shared.hget, shared.hlen,
+                     shared.hgetall, shared.hkeys, shared.lpush, shared.rpush,
+                     shared.lpop, shared.rpop, shared.llen, shared.lrange, shared.sadd,
+                     shared.scard, shared.zadd, shared.zcard, shared.zrange, shared.zrevrange,
+                     shared.zrangebyscore, shared.zrank, shared.zrevrank, shared.zscore, shared.zrem,
+                     shared.hscan, shared.sscan, shared.zscan}) {
+        routes[it] = kRouteKey;
+    }
+
+    /* Only commands a handler is registered for are forwarded. */
+    auto &handlerCommands = redis->getHandlerCommandMap();
+    for (auto it = routes.begin(); it != routes.end();) {
+        if (handlerCommands.find(it->first) == handlerCommands.end()) {
+            it = routes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (size_t i = 0; i < loops.size(); i++) {
+        std::unique_ptr <Core> core(new Core);
+        core->loop = loops[i];
+        core->scratch = TcpConnectionPtr(new TcpConnection(loops[i], -1, std::any()));
+        core->scheduled = false;
+        coreList.push_back(std::move(core));
+    }
+
+    for (size_t i = 0; i < loops.size() * loops.size(); i++) {
+        rings.emplace_back(new SpscQueue<ForwardedPart *>(REDIS_DISPATCH_RING_SIZE));
+    }
+    overflows.resize(loops.size() * loops.size());
+
+    /* Dispatch starts on a loop once it knows its core. */
+    cores = loops.size();
+    for (size_t i = 0; i < loops.size(); i++) {
+        int32_t core = i;
+        loops[i]->runInLoop([core]() { currentCore = core; });
+    }
+}
+
+/* True when the shard belongs to another core than the calling thread, the
+ * commands on its keys are not run here in thread per core mode. */
+bool Dispatcher::isRemote(size_t shard) {
+    return redis->threadPerCore && currentCore >= 0 && shard % cores != currentCore;
+}
+
+/* Whether dispatch() takes the command. Behind a forwarded command only
+ * these may run, any other waits for the session's forwards to complete. */
+bool Dispatcher::isRoutable(const RedisObjectPtr &cmd) {
+    return redis->threadPerCore && currentCore >= 0 && routes.find(cmd) != routes.end();
+}
+
+/* Sends the command on obj to the cores owning its keys. Returns nullptr if
+ * it has to run on the calling thread, which is never the case when ordered
+ * is set because an earlier command of the session is still out: then the
+ * parts on keys of this core run right away and their reply is held too.
+ * The session owns the returned command and sends its reply once pending
+ * dropped to 0, Session::forwardCallback() is called when that happens. */
+ForwardedCommand *Dispatcher::dispatch(const RedisObjectPtr &cmd, const std::deque <RedisObjectPtr> &obj,
+                                       const SessionPtr &session, const TcpConnectionPtr &conn,
+                                       bool ordered) {
+    if ((!ordered && !redis->threadPerCore) || currentCore < 0 || obj.empty()) {
+        return nullptr;
+    }
+
+    auto it = routes.find(cmd);
+    if (it == routes.end()) {
+        return nullptr;
+    }
+
+    std::vector <ForwardedPart *> owners(cores, nullptr);
+    std::unique_ptr <ForwardedCommand> command(new ForwardedCommand);
+    for (size_t i = 0; i < obj.size(); i++) {
+        int32_t owner = (obj[i]->hash % Redis::kShards) % cores;
+        if (owners[owner] == nullptr) {
+            std::unique_ptr <ForwardedPart> part(new ForwardedPart);
+            part->command = command.get();
+            part->owner = owner;
+            part->aofOffset = 0;
+            owners[owner] = part.get();
+            command->parts.push_back(std::move(part));
+        }
+
+        owners[owner]->argv.push_back(obj[i]);
+        owners[owner]->positions.push_back(i);
+
+        /* The arguments after the key of a single key command. */
+        if (it->second == kRouteKey) {
+            owners[owner]->argv.insert(owners[owner]->argv.end(), obj.begin() + 1, obj.end());
+            break;
+        }
+    }
+
+    if (!ordered && command->parts.size() == 1 && command->parts[0]->owner == currentCore) {
+        return nullptr;
+    }
+
+    command->cmd = it->first;
+    command->route = it->second;
+    command->origin = currentCore;
+    command->pending = command->parts.size();
+    command->keys = obj.size();
+    command->session = session;
+    command->conn = conn;
+    forwarded++;
+
+    for (auto &part : command->parts) {
+        if (part->owner == currentCore) {
+            execute(part.get());
+            command->pending--;
+        } else {
+            send(currentCore, part->owner, part.get());
+        }
+    }
+
+    if (command->pending == 0) {
+        merge(command.get());
+    }
+    return command.release();
+}
+
+/* Runs a part on the core owning its keys, the reply is collected in the
+ * scratch connection of the core. */
+void Dispatcher::execute(ForwardedPart *part) {
+    Core *core = coreList[currentCore].get();
+    Buffer *buffer = core->scratch->outputBuffer();
+    const RedisObjectPtr &cmd = part->command->cmd;
+    auto &handlerCommands = redis->getHandlerCommandMap();
+    auto it = handlerCommands.find(cmd);
+    assert(it != handlerCommands.end());
+
+    /* The part is logged by the core executing it, under the same rule as
+     * in Session::processCommand(). */
+    bool logged = redis->aofEnabled && redis->checkCommand(cmd);
+    std::shared_lock <std::shared_mutex> lck;
+    std::vector <std::unique_lock<std::mutex>> shardLocks;
+    if (logged) {
+        lck = std::shared_lock<std::shared_mutex>(redis->getAof()->getRewriteMutex());
+        redis->lockWriteShards(cmd, part->argv, shardLocks);
+    }
+
+    if (!it->second(part->argv, part->command->session, core->scratch)) {
+        addReplyErrorFormat(buffer,
+                            "wrong number of arguments`%s`, for command", cmd->ptr);
+    } else if (logged) {
+        part->argv.push_front(cmd);
+        part->aofOffset = redis->getAof()->feedAppendOnlyFile(part->argv);
+        part->argv.pop_front();
+    }
+    redis->unlockWriteShards(shardLocks);
+
+    part->reply.swap(*buffer);
+    buffer->retrieveAll();
+}
+
+/* Parts a full ring does not take wait in the overflow of the sending core,
+ * nothing may pass them so the order from one core to another is kept. */
+void Dispatcher::send(int32_t from, int32_t to, ForwardedPart *part) {
+    auto &overflow = overflows[from * cores + to];
+    if (!overflow.empty() || !rings[from * cores + to]->push(part)) {
+        overflow.push_back(part);
+        if (overflow.size() == 1) {
+            coreList[from]->loop->queueInLoop(std::bind(&Dispatcher::flushOverflow, this, from, to));
+        }
+        return;
+    }
+    notify(to);
+}
+
+void Dispatcher::notify(int32_t to) {
+    /* Pairs with the fence in drain(), either the consumer sees the part or
+     * this sees scheduled cleared and queues another drain. */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Core *core = coreList[to].get();
+    if (!core->scheduled.exchange(true)) {
+        core->loop->queueInLoop(std::bind(&Dispatcher::drain, this, to));
+    }
+}
+
+void Dispatcher::flushOverflow(int32_t from, int32_t to) {
+    auto &overflow = overflows[from * cores + to];
+    auto &ring = rings[from * cores + to];
+    while (!overflow.empty() && ring->push(overflow.front())) {
+        overflow.pop_front();
+    }
+
+    notify(to);
+    if (!overflow.empty()) {
+        coreList[from]->loop->queueInLoop(std::bind(&Dispatcher::flushOverflow, this, from, to));
+    }
+}
+
+void Dispatcher::drain(int32_t core) {
+    coreList[core]->scheduled = false;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    ForwardedPart *part;
+    for (int32_t from = 0; from < cores; from++) {
+        auto &ring = rings[from * cores + core];
+        while (ring->pop(part)) {
+            receive(part);
+        }
+    }
+}
+
+/* A part on its owner, or its reply back on the core of the connection. */
+void Dispatcher::receive(ForwardedPart *part) {
+    ForwardedCommand *command = part->command;
+    if (command->origin != currentCore) {
+        execute(part);
+        send(currentCore, command->origin, part);
+        return;
+    }
+
+    if (--command->pending == 0) {
+        merge(command);
+        /* The session may free the command. */
+        SessionPtr session = command->session;
+        TcpConnectionPtr conn = command->conn;
+        session->forwardCallback(conn);
+    }
+}
+
+void Dispatcher::merge(ForwardedCommand *command) {
+    for (auto &part : command->parts) {
+        command->aofOffset = std::max(command->aofOffset, part->aofOffset);
+    }
+
+    if (command->route == kRouteSum) {
+        int64_t sum = 0;
+        for (auto &part : command->parts) {
+            if (part->reply.readableBytes() > 0 && part->reply.peek()[0] == ':') {
+                sum += strtoll(part->reply.peek() + 1, nullptr, 10);
+            }
+        }
+        addReplyLongLong(&command->reply, sum);
+    } else if (command->route == kRouteArray) {
+        mergeArray(command);
+    } else {
+        command->reply.swap(command->parts[0]->reply);
+    }
+    command->parts.clear();
+}
+
+/* Every part replied with one element per key it got, put them back in the
+ * order of the keys in the command. */
+void Dispatcher::mergeArray(ForwardedCommand *command) {
+    std::vector <std::string_view> elements(command->keys);
+    for (auto &part : command->parts) {
+        const char *p = part->reply.peek();
+        const char *end = p + part->reply.readableBytes();
+        if (p == end || *p != '*') {
+            command->reply.append(p, end - p);
+            return;
+        }
+
+        const char *line = (const char *) memchr(p, '\n', end - p);
+        if (line == nullptr) {
+            addReplyError(&command->reply, "malformed reply of a forwarded command");
+            return;
+        }
+
+        p = line + 1;
+        for (auto pos : part->positions) {
+            const char *start = p;
+            if (p == end || (line = (const char *) memchr(p, '\n', end - p)) == nullptr) {
+                addReplyError(&command->reply, "malformed reply of a forwarded command");
+                return;
+            }
+
+            /* The length ends at the \r before the newline. */
+            int64_t len = strtoll(p + 1, nullptr, 10);
+            p = line + 1;
+            if (*start == '$' && len >= 0) {
+                if (end - p < len + 2) {
+                    addReplyError(&command->reply, "malformed reply of a forwarded command");
+                    return;
+                }
+                p += len + 2;
+            }
+            elements[pos] = std::string_view(start, p - start);
+        }
+    }
+
+    addReplyMultiBulkLen(&command->reply, elements.size());
+    for (auto &it : elements) {
+        command->reply.append(it);
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "all.h"
+#include "buffer.h"
+#include "object.h"
+#include "callback.h"
+
+class Redis;
+class EventLoop;
+
+/* Ring shared by exactly one producer and one consumer thread. Each side
+ * only writes its own index, so neither push nor pop takes a lock. */
+template<typename T>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity)
+            : slots(capacity),
+              mask(capacity - 1),
+              head(0),
+              tail(0) {
+        assert((capacity & mask) == 0);
+    }
+
+    bool push(const T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    SpscQueue(const SpscQueue &);
+
+    void operator=(const SpscQueue &);
+
+    std::vector <T> slots;
+    size_t mask;
+    alignas(64) std::atomic <size_t> head;
+    alignas(64) std::atomic <size_t> tail;
+};
+
+struct ForwardedCommand;
+
+/* The part of a forwarded command executed by one core. */
+struct ForwardedPart {
+    ForwardedCommand *command;
+    int32_t owner;
+    std::deque <RedisObjectPtr> argv;
+    std::vector <size_t> positions;   /* Index of every key in the command, for MGET. */
+    Buffer reply;
+    int64_t aofOffset;
+};
+
+/* A command of a session in thread per core mode. The session keeps them in
+ * the order they came in and sends each reply once it and all before it are
+ * complete, only the loop of the connection touches it. */
+struct ForwardedCommand {
+    ForwardedCommand()
+            : route(0),
+              origin(-1),
+              pending(0),
+              keys(0),
+              aofOffset(0) {
+
+    }
+
+    RedisObjectPtr cmd;
+    int32_t route;
+    int32_t origin;
+    int32_t pending;    /* Parts not yet back, the reply is ready at 0. */
+    size_t keys;
+    SessionPtr session;
+    TcpConnectionPtr conn;
+    std::vector <std::unique_ptr<ForwardedPart>> parts;
+    Buffer reply;
+    int64_t aofOffset;
+};
+
+/* Thread per core mode. Every worker loop owns the shards with
+ * index % cores == its core, a command on a key of another core is sent to
+ * that core's loop, executed there and the reply is sent back to the loop
+ * of the connection. DEL and MGET are split by owner and merged again. */
+class Dispatcher {
+public:
+    Dispatcher(Redis *redis);
+
+    ~Dispatcher();
+
+    void start(const std::vector<EventLoop *> &loops);
+
+    bool isRemote(size_t shard);
+
+    bool isRoutable(const RedisObjectPtr &cmd);
+
+    ForwardedCommand *dispatch(const RedisObjectPtr &cmd, const std::deque <RedisObjectPtr> &obj,
+                               const SessionPtr &session, const TcpConnectionPtr &conn, bool ordered);
+
+    int64_t getForwarded() { return forwarded; }
+
+private:
+    Dispatcher(const Dispatcher &);
+
+    void operator=(const Dispatcher &);
+
+    struct Core {
+        EventLoop *loop;
+        TcpConnectionPtr scratch;   /* Never connected, collects replies of forwarded parts. */
+        std::atomic<bool> scheduled;
+    };
+
+    void execute(ForwardedPart *part);
+
+    void send(int32_t from, int32_t to, ForwardedPart *part);
+
+    void notify(int32_t to);
+
+    void flushOverflow(int32_t from, int32_t to);
+
+    void drain(int32_t core);
+
+    void receive(ForwardedPart *part);
+
+    void merge(ForwardedCommand *command);
+
+    void mergeArray(ForwardedCommand *command);
+
+    Redis *redis;
+    int32_t cores;
+    std::vector <std::unique_ptr<Core>> coreList;
+    std::vector <std::unique_ptr<SpscQueue<ForwardedPart *>>> rings;   /* rings[from * cores + to] */
+    std::vector <std::deque<ForwardedPart *>> overflows;   /* Parts a full ring did not take, in order. */
+    std::unordered_map <RedisObjectPtr, int32_t, Hash, Equal> routes;
+    std::atomic <int64_t> forwarded;
+};
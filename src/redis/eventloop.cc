@@ -13,11 +13,14 @@ int createEventfd()
 }
 #endif
 
+bool EventLoop::ioUringEnabled = false;
+
 EventLoop::EventLoop()
         : threadId(std::this_thread::get_id()),
 #ifdef __linux__
 wakeupFd(createEventfd()),
-epoller(new Epoll(this)),
+uring(ioUringEnabled ? IoUring::create(this) : nullptr),
+epoller(uring ? nullptr : new Epoll(this)),
 timerQueue(new TimerQueue(this)),
 wakeupChannel(new Channel(this, wakeupFd)),
 #endif
@@ -85,6 +88,12 @@ std::thread::id EventLoop::getThreadId() const {
 void EventLoop::updateChannel(Channel *channel) {
     assert(channel->ownerLoop() == this);
     assertInLoopThread();
+#ifdef __linux__
+    if (uring) {
+        uring->updateChannel(channel);
+        return;
+    }
+#endif
     epoller->updateChannel(channel);
 }
 
@@ -96,6 +105,12 @@ void EventLoop::removeChannel(Channel *channel) {
                std::find(activeChannels.begin(),
                          activeChannels.end(), channel) == activeChannels.end());
     }
+#ifdef __linux__
+    if (uring) {
+        uring->removeChannel(channel);
+        return;
+    }
+#endif
     epoller->removeChannel(channel);
 }
 
@@ -114,9 +129,60 @@ TimerPtr EventLoop::runAt(TimeStamp &&stamp, double when, bool repeat, TimerCall
 bool EventLoop::hasChannel(Channel *channel) {
     assert(channel->ownerLoop() == this);
     assertInLoopThread();
+#ifdef __linux__
+    if (uring) {
+        return uring->hasChannel(channel);
+    }
+#endif
     return epoller->hasChannel(channel);
 }
 
+bool EventLoop::usesIoUring() const {
+#ifdef __linux__
+    return uring != nullptr;
+#else
+    return false;
+#endif
+}
+
+ssize_t EventLoop::takeReceived(Channel *channel, int32_t *savedErrno) {
+#ifdef __linux__
+    return uring->takeReceived(channel, savedErrno);
+#else
+    assert(false);
+    return -1;
+#endif
+}
+
+uint64_t EventLoop::submitSend(int32_t fd, const IOV_TYPE *iov, int32_t iovcnt, CompletionCallback &&cb) {
+#ifdef __linux__
+    return uring->submitSend(fd, iov, iovcnt, std::move(cb));
+#else
+    assert(false);
+    return 0;
+#endif
+}
+
+void EventLoop::submitAccept(int32_t fd, CompletionCallback &&cb) {
+#ifdef __linux__
+    uring->submitAccept(fd, std::move(cb));
+#else
+    assert(false);
+#endif
+}
+
+void EventLoop::cancelAccept(int32_t fd) {
+#ifdef __linux__
+    uring->cancelAccept(fd);
+#endif
+}
+
+void EventLoop::cancelRequest(uint64_t request) {
+#ifdef __linux__
+    uring->cancel(request);
+#endif
+}
+
 void EventLoop::handleRead() {
     uint64_t one = 1;
 #ifdef __linux__
@@ -195,7 +261,15 @@ void EventLoop::run() {
     running = true;
     while (running) {
         activeChannels.clear();
+#ifdef __linux__
+        if (uring) {
+            uring->epollWait(&activeChannels);
+        } else {
+            epoller->epollWait(&activeChannels);
+        }
+#else
         epoller->epollWait(&activeChannels);
+#endif
         eventHandling = true;
 
         for (auto &it : activeChannels) {
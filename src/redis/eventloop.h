@@ -10,6 +10,7 @@
 
 #ifdef __linux__
 #include "epoll.h"
+#include "iouring.h"
 #endif
 
 #ifdef _WIN64
@@ -18,6 +19,7 @@
 
 #include "timer.h"
 #include "callback.h"
+#include "buffer.h"
 
 class EventLoop {
 public:
@@ -63,6 +65,27 @@ public:
 
     std::thread::id getThreadId() const;
 
+    BufferPool *getBufferPool() { return &bufferPool; }
+
+    /* Called before the loops are created: they poll with an io_uring
+     * instead of epoll where the kernel supports it. */
+    static void setIoUringEnabled(bool enabled) { ioUringEnabled = enabled; }
+
+    /* With an io_uring the loop receives for the channels that have a
+     * receive buffer and takes sends and accepts as requests, see
+     * IoUring. */
+    bool usesIoUring() const;
+
+    ssize_t takeReceived(Channel *channel, int32_t *savedErrno);
+
+    uint64_t submitSend(int32_t fd, const IOV_TYPE *iov, int32_t iovcnt, CompletionCallback &&cb);
+
+    void submitAccept(int32_t fd, CompletionCallback &&cb);
+
+    void cancelAccept(int32_t fd);
+
+    void cancelRequest(uint64_t request);
+
 private:
     EventLoop(const EventLoop &);
 
@@ -81,7 +104,8 @@ private:
 #endif
 
 #ifdef __linux__
-    EpollPtr epoller;
+    IoUringPtr uring;
+    EpollPtr epoller;          /* Only when there is no io_uring. */
     int32_t wakeupFd;
 #endif
 
@@ -103,5 +127,8 @@ private:
     bool callingPendingFunctors;
     std::vector <Functor> functors;
     std::vector <Functor> pendingFunctors;
+    BufferPool bufferPool;
+
+    static bool ioUringEnabled;
 };
 
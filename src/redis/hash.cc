@@ -0,0 +1,177 @@
+#include "hash.h"
+#include "listpack.h"
+#include "scan.h"
+
+HashType::HashType(size_t maxPackedEntries, size_t maxPackedValue)
+        : maxEntries(maxPackedEntries),
+          maxValue(maxPackedValue),
+          length(0) {
+
+}
+
+size_t HashType::size() const {
+    return dict ? dict->size() : length;
+}
+
+/* The entry of field, nullptr when it is not there. */
+const char *HashType::packedFind(const char *field, size_t len) const {
+    const char *p = entries.data();
+    const char *end = p + entries.size();
+    while (p < end) {
+        size_t flen, vlen;
+        const char *f = lpReadEntry(p, &flen);
+        if (flen == len && memcmp(f, field, len) == 0) {
+            return p;
+        }
+
+        p += lpEntryBytes(flen);
+        lpReadEntry(p, &vlen);
+        p += lpEntryBytes(vlen);
+    }
+    return nullptr;
+}
+
+/* Returns true when the field is new. */
+bool HashType::set(const RedisObjectPtr &field, const RedisObjectPtr &value) {
+    size_t flen = sdslen(field->ptr);
+    size_t vlen = sdslen(value->ptr);
+    if (!dict && (flen > maxValue || vlen > maxValue)) {
+        convert();
+    }
+
+    if (dict) {
+        auto it = dict->find(field);
+        if (it != dict->end()) {
+            it->second = value;
+            return false;
+        }
+
+        dict->emplace(field, value);
+        return true;
+    }
+
+    const char *p = packedFind(field->ptr, flen);
+    if (p != nullptr) {
+        size_t pos = p - entries.data() + lpEntryBytes(flen);
+        size_t oldlen;
+        lpReadEntry(entries.data() + pos, &oldlen);
+
+        std::string entry;
+        lpAppend(&entry, value->ptr, vlen);
+        entries.replace(pos, lpEntryBytes(oldlen), entry);
+        return false;
+    }
+
+    if (length + 1 > maxEntries) {
+        convert();
+        dict->emplace(field, value);
+        return true;
+    }
+
+    lpAppend(&entries, field->ptr, flen);
+    lpAppend(&entries, value->ptr, vlen);
+    length++;
+    return true;
+}
+
+bool HashType::get(const RedisObjectPtr &field, const char **value, size_t *len) const {
+    if (dict) {
+        auto it = dict->find(field);
+        if (it == dict->end()) {
+            return false;
+        }
+
+        *value = it->second->ptr;
+        *len = sdslen(it->second->ptr);
+        return true;
+    }
+
+    size_t flen = sdslen(field->ptr);
+    const char *p = packedFind(field->ptr, flen);
+    if (p == nullptr) {
+        return false;
+    }
+
+    *value = lpReadEntry(p + lpEntryBytes(flen), len);
+    return true;
+}
+
+void HashType::forEach(const Visitor &visitor) const {
+    if (dict) {
+        for (auto &it : *dict) {
+            visitor(it.first->ptr, sdslen(it.first->ptr), it.second->ptr, sdslen(it.second->ptr));
+        }
+        return;
+    }
+
+    const char *p = entries.data();
+    const char *end = p + entries.size();
+    while (p < end) {
+        size_t flen, vlen;
+        const char *f = lpReadEntry(p, &flen);
+        p += lpEntryBytes(flen);
+        const char *v = lpReadEntry(p, &vlen);
+        p += lpEntryBytes(vlen);
+        visitor(f, flen, v, vlen);
+    }
+}
+
+uint64_t HashType::scan(uint64_t cursor, size_t count, const Visitor &visitor) const {
+    if (!dict) {
+        forEach(visitor);
+        return 0;
+    }
+
+    return scanTable(*dict, cursor, &count, [&visitor](const auto &it) {
+        visitor(it.first->ptr, sdslen(it.first->ptr), it.second->ptr, sdslen(it.second->ptr));
+    });
+}
+
+/* Takes the packed entries of an RDB file. Returns false when they are not
+ * well formed, a hash beyond the limits becomes a dict right away. */
+bool HashType::loadPacked(const char *p, size_t len) {
+    assert(length == 0 && !dict);
+    const char *end = p + len;
+    size_t fields = 0;
+    bool fits = true;
+    for (const char *q = p; q < end; fields++) {
+        for (int32_t i = 0; i < 2; i++) {
+            size_t elen;
+            if (q >= end || ((uint8_t) *q >= 0x80 && end - q < 5)) {
+                return false;
+            }
+
+            lpReadEntry(q, &elen);
+            if (lpEntryBytes(elen) > (size_t) (end - q)) {
+                return false;
+            }
+
+            fits = fits && elen <= maxValue;
+            q += lpEntryBytes(elen);
+        }
+    }
+
+    entries.assign(p, len);
+    length = fields;
+    if (!fits || length > maxEntries) {
+        convert();
+    }
+    return true;
+}
+
+void HashType::convert() {
+    std::unique_ptr <std::unordered_map<RedisObjectPtr, RedisObjectPtr, Hash, Equal>> table(
+            new std::unordered_map<RedisObjectPtr, RedisObjectPtr, Hash, Equal>(length));
+    forEach([&table](const char *field, size_t flen, const char *value, size_t vlen) {
+        RedisObjectPtr f = createStringObject(const_cast<char *>(field), flen);
+        RedisObjectPtr v = createStringObject(const_cast<char *>(value), vlen);
+        f->type = OBJ_HASH;
+        v->type = OBJ_HASH;
+        table->emplace(f, v);
+    });
+
+    dict = std::move(table);
+    entries.clear();
+    entries.shrink_to_fit();
+    length = 0;
+}
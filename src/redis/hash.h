@@ -0,0 +1,50 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+
+/* Hash of a key. A small one is a listpack (see listpack.h) of field,
+ * value, field, value... searched linearly. It turns into a dict once it
+ * has more than maxPackedEntries fields or a field or value longer than
+ * maxPackedValue, and stays one. */
+class HashType {
+public:
+    typedef std::function<void(const char *field, size_t flen,
+                               const char *value, size_t vlen)> Visitor;
+
+    HashType(size_t maxPackedEntries = REDIS_DEFAULT_HASH_MAX_LISTPACK_ENTRIES,
+             size_t maxPackedValue = REDIS_DEFAULT_HASH_MAX_LISTPACK_VALUE);
+
+    size_t size() const;
+
+    bool isPacked() const { return dict == nullptr; }
+
+    bool set(const RedisObjectPtr &field, const RedisObjectPtr &value);
+
+    bool get(const RedisObjectPtr &field, const char **value, size_t *len) const;
+
+    void forEach(const Visitor &visitor) const;
+
+    /* Continues the scan at cursor (see scan.h), a packed hash is visited
+     * whole and gives cursor 0. */
+    uint64_t scan(uint64_t cursor, size_t count, const Visitor &visitor) const;
+
+    const std::string &getPacked() const { return entries; }
+
+    bool loadPacked(const char *p, size_t len);
+
+private:
+    HashType(const HashType &);
+
+    void operator=(const HashType &);
+
+    const char *packedFind(const char *field, size_t len) const;
+
+    void convert();
+
+    uint32_t maxEntries;
+    uint32_t maxValue;
+    uint32_t length;   /* Fields in entries. */
+    std::string entries;
+    std::unique_ptr <std::unordered_map<RedisObjectPtr, RedisObjectPtr, Hash, Equal>> dict;
+};
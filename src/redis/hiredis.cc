@@ -2341,7 +2341,7 @@ void Hiredis::redisContextTimer() {
 				//LOG_INFO << reply->str;
 				int32_t index = 0;
 				while (index < sdslen(reply->str)) {
-					std::shared_ptr <ClusterNode> node(new ClusterNode());
+					std::shared_ptr <RedisClusterNode> node(new RedisClusterNode());
 					const char *id = strchr(reply->str + index, ' ');
 					assert(id != nullptr);
 
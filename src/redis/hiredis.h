@@ -223,7 +223,7 @@ struct RedLockCallback {
 	std::function <void()> doingCallback;
 };
 
-struct ClusterNode {
+struct RedisClusterNode {
 	std::string id;
 	std::string ip;
 	std::string master;
@@ -399,7 +399,7 @@ private:
 	std::vector <RedisContextPtr> tmpAsync;
 
 	std::vector <TcpConnectionPtr> moveAskClients;
-	std::vector <std::shared_ptr<ClusterNode>> clusterNodes;
+	std::vector <std::shared_ptr<RedisClusterNode>> clusterNodes;
 	std::map <int16_t, std::string> clusterConnectInfos;
 	std::map <int16_t, std::string> clusterDelNodes;
 	std::map <int16_t, std::string> clusterMigrate;
@@ -0,0 +1,134 @@
+#include "intset.h"
+
+Intset::Intset()
+        : encoding(sizeof(int16_t)) {
+
+}
+
+uint8_t Intset::valueEncoding(int64_t value) {
+    if (value < INT32_MIN || value > INT32_MAX) {
+        return sizeof(int64_t);
+    } else if (value < INT16_MIN || value > INT16_MAX) {
+        return sizeof(int32_t);
+    }
+    return sizeof(int16_t);
+}
+
+int64_t Intset::get(size_t pos) const {
+    const char *p = contents.data() + pos * encoding;
+    if (encoding == sizeof(int64_t)) {
+        int64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    } else if (encoding == sizeof(int32_t)) {
+        int32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    int16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void Intset::set(size_t pos, int64_t value) {
+    char *p = &contents[pos * encoding];
+    if (encoding == sizeof(int64_t)) {
+        memcpy(p, &value, sizeof(int64_t));
+    } else if (encoding == sizeof(int32_t)) {
+        int32_t v = value;
+        memcpy(p, &v, sizeof(v));
+    } else {
+        int16_t v = value;
+        memcpy(p, &v, sizeof(v));
+    }
+}
+
+/* Position of value, or where it would be inserted when it is missing. */
+bool Intset::search(int64_t value, size_t *pos) const {
+    size_t min = 0;
+    size_t max = size();
+    while (min < max) {
+        size_t mid = min + (max - min) / 2;
+        int64_t cur = get(mid);
+        if (cur == value) {
+            *pos = mid;
+            return true;
+        } else if (cur < value) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+
+    *pos = min;
+    return false;
+}
+
+/* Rewrites every member in the wider encoding, from the back so the
+ * buffer can be widened in place. */
+void Intset::upgrade(uint8_t newEncoding) {
+    size_t length = size();
+    uint8_t oldEncoding = encoding;
+    contents.resize(length * newEncoding);
+    for (size_t i = length; i-- > 0;) {
+        encoding = oldEncoding;
+        int64_t v = get(i);
+        encoding = newEncoding;
+        set(i, v);
+    }
+    encoding = newEncoding;
+}
+
+bool Intset::add(int64_t value) {
+    if (valueEncoding(value) > encoding) {
+        upgrade(valueEncoding(value));
+    }
+
+    size_t pos;
+    if (search(value, &pos)) {
+        return false;
+    }
+
+    contents.insert(pos * encoding, encoding, '\0');
+    set(pos, value);
+    return true;
+}
+
+bool Intset::remove(int64_t value) {
+    size_t pos;
+    if (valueEncoding(value) > encoding || !search(value, &pos)) {
+        return false;
+    }
+
+    contents.erase(pos * encoding, encoding);
+    return true;
+}
+
+bool Intset::find(int64_t value) const {
+    size_t pos;
+    return valueEncoding(value) <= encoding && search(value, &pos);
+}
+
+void Intset::serialize(std::string *out) const {
+    uint32_t header[2] = {encoding, (uint32_t) size()};
+    out->assign((const char *) header, sizeof(header));
+    out->append(contents);
+}
+
+bool Intset::load(const char *p, size_t len) {
+    uint32_t header[2];
+    if (len < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(header, p, sizeof(header));
+    if ((header[0] != sizeof(int16_t) && header[0] != sizeof(int32_t) &&
+         header[0] != sizeof(int64_t)) || len != sizeof(header) + (size_t) header[0] * header[1]) {
+        return false;
+    }
+
+    encoding = header[0];
+    contents.assign(p + sizeof(header), len - sizeof(header));
+    return true;
+}
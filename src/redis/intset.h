@@ -0,0 +1,40 @@
+#pragma once
+
+#include "all.h"
+
+/* Sorted array of integers, each stored in the smallest of 2, 4 or 8 bytes
+ * that fits every member, found by binary search. serialize() writes the
+ * layout of a Redis intset: encoding and length as 32 bit values, then the
+ * members, all little endian. */
+class Intset {
+public:
+    Intset();
+
+    size_t size() const { return contents.size() / encoding; }
+
+    bool add(int64_t value);
+
+    bool remove(int64_t value);
+
+    bool find(int64_t value) const;
+
+    int64_t get(size_t pos) const;
+
+    size_t blobLen() const { return 8 + contents.size(); }
+
+    void serialize(std::string *out) const;
+
+    bool load(const char *p, size_t len);
+
+private:
+    static uint8_t valueEncoding(int64_t value);
+
+    bool search(int64_t value, size_t *pos) const;
+
+    void set(size_t pos, int64_t value);
+
+    void upgrade(uint8_t newEncoding);
+
+    uint8_t encoding;
+    std::string contents;
+};
@@ -0,0 +1,614 @@
+#ifdef __linux__
+#include "iouring.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "buffer.h"
+
+#include <sys/mman.h>
+
+static const uint32_t kRingEntries = 1024;
+static const uint32_t kCompletionEntries = 8192;
+
+/* The provided buffer ring the multishot recvs fill, buffers are copied out
+ * and handed back while the completions are handled. */
+static const uint32_t kBufferCount = 256;
+static const uint32_t kBufferSize = 16384;
+static const uint16_t kBufferGroup = 0;
+
+static int32_t ioUringSetup(uint32_t entries, struct io_uring_params *params) {
+    return (int32_t) ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int32_t ioUringEnter(int32_t fd, uint32_t toSubmit, uint32_t minComplete,
+                            uint32_t flags, void *arg, size_t argSize) {
+    return (int32_t) ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int32_t ioUringRegister(int32_t fd, uint32_t opcode, void *arg, uint32_t nrArgs) {
+    return (int32_t) ::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+IoUringPtr IoUring::create(EventLoop *loop) {
+    IoUringPtr uring(new IoUring(loop));
+    if (!uring->setup()) {
+        LOG_WARN << "io_uring is not usable here, polling with epoll";
+        return nullptr;
+    }
+    return uring;
+}
+
+IoUring::IoUring(EventLoop *loop)
+        : loop(loop),
+          ringfd(-1),
+          sqRing(nullptr),
+          sqRingBytes(0),
+          cqRing(nullptr),
+          cqRingBytes(0),
+          sqes(nullptr),
+          sqLocalTail(0),
+          bufRing(nullptr),
+          bufRingBytes(0),
+          bufBase(nullptr),
+          bufTail(0),
+          nextRequest(1),
+          nextRegistration(1) {
+    bzero(&params, sizeof params);
+}
+
+IoUring::~IoUring() {
+    if (bufRing != nullptr) {
+        ::munmap(bufRing, bufRingBytes + (size_t) kBufferCount * kBufferSize);
+    }
+
+    if (sqes != nullptr) {
+        ::munmap(sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+    }
+
+    if (cqRing != nullptr && cqRing != sqRing) {
+        ::munmap(cqRing, cqRingBytes);
+    }
+
+    if (sqRing != nullptr) {
+        ::munmap(sqRing, sqRingBytes);
+    }
+
+    if (ringfd >= 0) {
+        Socket::close(ringfd);
+    }
+}
+
+/* Multishot recv has no probe bit, it came with SINGLE_ISSUER in 6.0, so a
+ * ring that accepts that flag has it. Only the loop thread submits anyway.
+ * The wait timeout and the ops probed below are older. */
+bool IoUring::setup() {
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                   IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = kCompletionEntries;
+    ringfd = ioUringSetup(kRingEntries, &params);
+    if (ringfd < 0) {
+        return false;
+    }
+
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        return false;
+    }
+
+    sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+    }
+
+    void *p = ::mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    sqRing = p;
+
+    if (single) {
+        cqRing = sqRing;
+    } else {
+        p = ::mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        cqRing = p;
+    }
+
+    p = ::mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe *>(p);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqLocalTail = *sqTail;
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    const uint8_t needed[] = {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_ASYNC_CANCEL,
+                              IORING_OP_ACCEPT, IORING_OP_SENDMSG, IORING_OP_RECV};
+    size_t probeBytes = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    std::unique_ptr<char[]> buf(new char[probeBytes]());
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(buf.get());
+    if (ioUringRegister(ringfd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+    }
+
+    for (auto op : needed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return setupBufferRing();
+}
+
+/* The ring entries take the first page, the buffers follow. */
+bool IoUring::setupBufferRing() {
+    bufRingBytes = kBufferCount * sizeof(struct io_uring_buf);
+    void *p = ::mmap(nullptr, bufRingBytes + (size_t) kBufferCount * kBufferSize,
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    bufRing = static_cast<struct io_uring_buf *>(p);
+    bufBase = static_cast<char *>(p) + bufRingBytes;
+
+    struct io_uring_buf_reg reg;
+    bzero(&reg, sizeof reg);
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing);
+    reg.ring_entries = kBufferCount;
+    reg.bgid = kBufferGroup;
+    if (ioUringRegister(ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < kBufferCount; i++) {
+        recycleBuffer(i);
+    }
+    return true;
+}
+
+/* The ring tail overlays the reserved field of the first entry, only the
+ * other fields of an entry are written. */
+void IoUring::recycleBuffer(uint16_t bid) {
+    struct io_uring_buf *buf = &bufRing[bufTail & (kBufferCount - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(bufBase + (size_t) bid * kBufferSize);
+    buf->len = kBufferSize;
+    buf->bid = bid;
+    bufTail++;
+    __atomic_store_n(&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *IoUring::getSqe() {
+    if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= params.sq_entries) {
+        submit(false, 0);
+    }
+
+    assert(sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) < params.sq_entries);
+    unsigned index = sqLocalTail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    bzero(sqe, sizeof *sqe);
+    sqArray[index] = index;
+    sqLocalTail++;
+    return sqe;
+}
+
+/* Hands the queued requests to the kernel, then waits up to msTime for a
+ * completion if wait is set. */
+void IoUring::submit(bool wait, int32_t msTime) {
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    uint32_t toSubmit = sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = msTime / 1000;
+    ts.tv_nsec = (msTime % 1000) * 1000000LL;
+
+    struct io_uring_getevents_arg arg;
+    bzero(&arg, sizeof arg);
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    int32_t ret = ioUringEnter(ringfd, toSubmit, wait ? 1 : 0,
+                               IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        LOG_WARN << "io_uring_enter " << strerror(errno);
+    }
+}
+
+void IoUring::epollWait(ChannelList *activeChannels, int32_t msTime) {
+    for (auto fd : rearms) {
+        auto it = channels.find(fd);
+        if (it != channels.end()) {
+            armChannel(&it->second);
+        }
+    }
+    rearms.clear();
+
+    for (auto fd : acceptRearms) {
+        auto it = accepts.find(fd);
+        if (it != accepts.end() && it->second.request == 0) {
+            armAccept(fd, &it->second);
+        }
+    }
+    acceptRearms.clear();
+
+    /* Bytes received while reading was off are handed out once it is on
+     * again, without waiting for more. */
+    bool deliver = false;
+    for (auto fd : pendingFds) {
+        auto it = channels.find(fd);
+        if (it != channels.end() && it->second.channel->isReading()) {
+            deliver = true;
+        }
+    }
+
+    submit(!deliver, msTime);
+
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+        uint64_t userData = cqe->user_data;
+        int32_t res = cqe->res;
+        uint32_t flags = cqe->flags;
+        __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+        handleCompletion(userData, res, flags);
+    }
+
+    for (size_t i = 0; i < pendingFds.size();) {
+        auto it = channels.find(pendingFds[i]);
+        if (it == channels.end() || it->second.channel->isReading()) {
+            if (it != channels.end()) {
+                it->second.pending = false;
+                markReady(&it->second, POLLIN);
+            }
+            pendingFds[i] = pendingFds.back();
+            pendingFds.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    for (auto fd : readyFds) {
+        auto it = channels.find(fd);
+        if (it != channels.end() && it->second.ready) {
+            Registration &reg = it->second;
+            reg.channel->setRevents(reg.revents);
+            activeChannels->push_back(reg.channel);
+            reg.revents = 0;
+            reg.ready = false;
+        }
+    }
+    readyFds.clear();
+}
+
+void IoUring::handleCompletion(uint64_t userData, int32_t res, uint32_t flags) {
+    bool buffer = flags & IORING_CQE_F_BUFFER;
+    uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    auto it = requests.find(userData);
+    if (userData == 0 || it == requests.end()) {
+        if (buffer) {
+            recycleBuffer(bid);
+        }
+        return;
+    }
+
+    Request &req = it->second;
+    int32_t fd = req.fd;
+    bool more = flags & IORING_CQE_F_MORE;
+    switch (req.kind) {
+        case kPoll: {
+            Registration *reg = findRegistration(fd, req.registration);
+            requests.erase(it);
+            if (reg == nullptr || reg->poll != userData) {
+                break;
+            }
+
+            reg->poll = 0;
+            rearms.push_back(fd);
+            if (res > 0) {
+                markReady(reg, res);
+            } else if (res < 0 && res != -ECANCELED) {
+                markReady(reg, POLLERR);
+            }
+            break;
+        }
+        case kRecv: {
+            Registration *reg = findRegistration(fd, req.registration);
+            if (!more) {
+                requests.erase(it);
+            }
+
+            if (reg != nullptr) {
+                if (res > 0 && buffer) {
+                    reg->channel->getReceiveBuffer()->append(bufBase + (size_t) bid * kBufferSize, res);
+                    reg->received += res;
+                    markReceived(reg);
+                } else if (res == 0) {
+                    reg->eof = true;
+                    markReceived(reg);
+                } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+                    reg->error = -res;
+                    markReceived(reg);
+                }
+
+                /* Ended when the buffers ran out, armed again once they
+                 * are back. */
+                if (!more && reg->recv == userData) {
+                    reg->recv = 0;
+                    rearms.push_back(fd);
+                }
+            }
+
+            if (buffer) {
+                recycleBuffer(bid);
+            }
+            break;
+        }
+        case kSend: {
+            CompletionCallback callback(std::move(req.callback));
+            requests.erase(it);
+            callback(res);
+            break;
+        }
+        case kAccept: {
+            if (!more) {
+                requests.erase(it);
+            }
+
+            auto accept = accepts.find(fd);
+            if (accept == accepts.end() || accept->second.request != userData) {
+                if (res >= 0) {
+                    Socket::close(res);
+                }
+                break;
+            }
+
+            if (!more) {
+                accept->second.request = 0;
+                acceptRearms.push_back(fd);
+            }
+
+            if (res >= 0) {
+                accept->second.callback(res);
+            }
+            break;
+        }
+    }
+}
+
+void IoUring::markReady(Registration *reg, int32_t revents) {
+    reg->revents |= revents;
+    if (!reg->ready) {
+        reg->ready = true;
+        readyFds.push_back(reg->channel->getfd());
+    }
+}
+
+void IoUring::markReceived(Registration *reg) {
+    if (reg->channel->isReading()) {
+        markReady(reg, POLLIN);
+    } else if (!reg->pending) {
+        reg->pending = true;
+        pendingFds.push_back(reg->channel->getfd());
+    }
+}
+
+IoUring::Registration *IoUring::findRegistration(int32_t fd, uint64_t id) {
+    auto it = channels.find(fd);
+    if (it == channels.end() || it->second.id != id) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+uint64_t IoUring::addRequest(Kind kind, int32_t fd, uint64_t registration) {
+    uint64_t id = nextRequest++;
+    Request &req = requests[id];
+    req.kind = kind;
+    req.fd = fd;
+    req.registration = registration;
+    return id;
+}
+
+/* Brings the requests of the channel in line with the events it wants: a
+ * poll for them, or for all but reading when a recv takes care of that. */
+void IoUring::armChannel(Registration *reg) {
+    Channel *channel = reg->channel;
+    bool receiving = channel->getReceiveBuffer() != nullptr;
+    int32_t events = channel->getEvents();
+    if (receiving) {
+        events &= ~(POLLIN | POLLPRI);
+    }
+
+    if (reg->poll != 0 && reg->pollEvents != events) {
+        cancelRequest(reg->poll, true);
+        reg->poll = 0;
+    }
+
+    if (reg->poll == 0 && events != 0) {
+        armPoll(reg, events);
+    }
+
+    bool recv = receiving && channel->isReading() && !reg->eof && reg->error == 0;
+    if (recv && reg->recv == 0) {
+        armRecv(reg);
+    } else if (!recv && reg->recv != 0) {
+        cancelRequest(reg->recv, false);
+        reg->recv = 0;
+    }
+}
+
+void IoUring::armPoll(Registration *reg, int32_t events) {
+    int32_t fd = reg->channel->getfd();
+    uint64_t id = addRequest(kPoll, fd, reg->id);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = id;
+    reg->poll = id;
+    reg->pollEvents = events;
+}
+
+void IoUring::armRecv(Registration *reg) {
+    int32_t fd = reg->channel->getfd();
+    uint64_t id = addRequest(kRecv, fd, reg->id);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = id;
+    reg->recv = id;
+}
+
+void IoUring::armAccept(int32_t fd, Accept *accept) {
+    uint64_t id = addRequest(kAccept, fd, 0);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = id;
+    accept->request = id;
+}
+
+/* A removed poll is forgotten right away, anything else completes once
+ * more with what it still got. */
+void IoUring::cancelRequest(uint64_t request, bool poll) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = poll ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = request;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+    if (poll) {
+        requests.erase(request);
+    }
+}
+
+void IoUring::cancel(uint64_t request) {
+    loop->assertInLoopThread();
+    if (requests.find(request) != requests.end()) {
+        cancelRequest(request, false);
+    }
+}
+
+bool IoUring::hasChannel(Channel *channel) {
+    loop->assertInLoopThread();
+    auto it = channels.find(channel->getfd());
+    return it != channels.end() && it->second.channel == channel;
+}
+
+void IoUring::updateChannel(Channel *channel) {
+    loop->assertInLoopThread();
+    int32_t fd = channel->getfd();
+    auto it = channels.find(fd);
+    if (it == channels.end()) {
+        Registration reg;
+        bzero(&reg, sizeof reg);
+        reg.id = nextRegistration++;
+        reg.channel = channel;
+        it = channels.emplace(fd, reg).first;
+    }
+
+    assert(it->second.channel == channel);
+    armChannel(&it->second);
+}
+
+void IoUring::removeChannel(Channel *channel) {
+    loop->assertInLoopThread();
+    auto it = channels.find(channel->getfd());
+    assert(it != channels.end());
+    assert(it->second.channel == channel);
+    assert(channel->isNoneEvent());
+
+    Registration &reg = it->second;
+    if (reg.poll != 0) {
+        cancelRequest(reg.poll, true);
+    }
+
+    if (reg.recv != 0) {
+        cancelRequest(reg.recv, false);
+    }
+    channels.erase(it);
+}
+
+ssize_t IoUring::takeReceived(Channel *channel, int32_t *savedErrno) {
+    loop->assertInLoopThread();
+    auto it = channels.find(channel->getfd());
+    assert(it != channels.end());
+    Registration &reg = it->second;
+    if (reg.received > 0) {
+        ssize_t n = reg.received;
+        reg.received = 0;
+        if (reg.eof || reg.error != 0) {
+            markReceived(&reg);
+        }
+        return n;
+    }
+
+    if (reg.eof) {
+        return 0;
+    }
+
+    *savedErrno = reg.error != 0 ? reg.error : EAGAIN;
+    return -1;
+}
+
+uint64_t IoUring::submitSend(int32_t fd, const struct iovec *iov, int32_t iovcnt, CompletionCallback &&cb) {
+    loop->assertInLoopThread();
+    uint64_t id = addRequest(kSend, fd, 0);
+    Request &req = requests[id];
+    req.callback = std::move(cb);
+    req.iov.assign(iov, iov + iovcnt);
+    bzero(&req.msg, sizeof req.msg);
+    req.msg.msg_iov = req.iov.data();
+    req.msg.msg_iovlen = iovcnt;
+
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&req.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = id;
+    return id;
+}
+
+void IoUring::submitAccept(int32_t fd, CompletionCallback &&cb) {
+    loop->assertInLoopThread();
+    Accept &accept = accepts[fd];
+    accept.request = 0;
+    accept.callback = std::move(cb);
+    armAccept(fd, &accept);
+}
+
+void IoUring::cancelAccept(int32_t fd) {
+    loop->assertInLoopThread();
+    auto it = accepts.find(fd);
+    if (it == accepts.end()) {
+        return;
+    }
+
+    if (it->second.request != 0) {
+        cancelRequest(it->second.request, false);
+    }
+    accepts.erase(it);
+}
+#endif
@@ -0,0 +1,163 @@
+#pragma once
+
+#ifdef __linux__
+#include "all.h"
+#include "util.h"
+#include "log.h"
+#include "callback.h"
+#include <linux/io_uring.h>
+
+class Channel;
+
+class EventLoop;
+
+/* Poller on an io_uring, used instead of Epoll when the server starts with
+ * --io-uring yes and the kernel has what it needs. Channels are polled with
+ * one shot POLL_ADD requests armed again every wait, which keeps the level
+ * triggered behavior of Epoll. A channel with a receive buffer is not polled
+ * for reading, a multishot recv fills buffers of a provided buffer ring and
+ * the bytes are appended to its receive buffer before it is handed out as
+ * readable. Sends and accepts are requests completed with a callback.
+ * Whatever the loop queued in an iteration goes to the kernel with the
+ * io_uring_enter() that waits for the next completions. */
+class IoUring {
+public:
+    typedef std::vector<Channel *> ChannelList;
+
+    /* Returns nullptr when the kernel lacks something needed, the loop
+     * polls with Epoll then. */
+    static IoUringPtr create(EventLoop *loop);
+
+    ~IoUring();
+
+    void epollWait(ChannelList *activeChannels, int32_t msTime = 100);
+
+    bool hasChannel(Channel *channel);
+
+    void updateChannel(Channel *channel);
+
+    void removeChannel(Channel *channel);
+
+    /* Bytes received for the channel since the last call, 0 at the end of
+     * the stream, -1 with *savedErrno set on an error or when there is
+     * nothing. */
+    ssize_t takeReceived(Channel *channel, int32_t *savedErrno);
+
+    /* Sends the iovecs in one sendmsg, cb gets the bytes sent or -errno.
+     * The memory they point to has to stay put until then. Returns the
+     * request for cancel(). */
+    uint64_t submitSend(int32_t fd, const struct iovec *iov, int32_t iovcnt, CompletionCallback &&cb);
+
+    /* Accepts on the listening fd until cancelAccept(), cb gets every
+     * accepted fd, already non blocking. */
+    void submitAccept(int32_t fd, CompletionCallback &&cb);
+
+    void cancelAccept(int32_t fd);
+
+    /* The request completes with -ECANCELED unless it is done already. */
+    void cancel(uint64_t request);
+
+private:
+    IoUring(EventLoop *loop);
+
+    IoUring(const IoUring &);
+
+    void operator=(const IoUring &);
+
+    enum Kind {
+        kPoll, kRecv, kSend, kAccept
+    };
+
+    struct Request {
+        Kind kind;
+        int32_t fd;
+        uint64_t registration;
+        CompletionCallback callback;
+        struct msghdr msg;
+        std::vector<struct iovec> iov;
+    };
+
+    struct Registration {
+        uint64_t id;
+        Channel *channel;
+        uint64_t poll;          /* Armed POLL_ADD, 0 if none. */
+        int32_t pollEvents;
+        uint64_t recv;          /* Armed multishot recv, 0 if none. */
+        ssize_t received;
+        bool eof;
+        int32_t error;
+        int32_t revents;
+        bool ready;
+        bool pending;
+    };
+
+    struct Accept {
+        uint64_t request;
+        CompletionCallback callback;
+    };
+
+    bool setup();
+
+    bool setupBufferRing();
+
+    struct io_uring_sqe *getSqe();
+
+    void submit(bool wait, int32_t msTime);
+
+    uint64_t addRequest(Kind kind, int32_t fd, uint64_t registration);
+
+    void armChannel(Registration *reg);
+
+    void armPoll(Registration *reg, int32_t events);
+
+    void armRecv(Registration *reg);
+
+    void armAccept(int32_t fd, Accept *accept);
+
+    void cancelRequest(uint64_t request, bool poll);
+
+    void handleCompletion(uint64_t userData, int32_t res, uint32_t flags);
+
+    void markReady(Registration *reg, int32_t revents);
+
+    void markReceived(Registration *reg);
+
+    void recycleBuffer(uint16_t bid);
+
+    Registration *findRegistration(int32_t fd, uint64_t id);
+
+    EventLoop *loop;
+    int32_t ringfd;
+    struct io_uring_params params;
+
+    void *sqRing;
+    size_t sqRingBytes;
+    void *cqRing;
+    size_t cqRingBytes;
+    struct io_uring_sqe *sqes;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned sqLocalTail;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf *bufRing;
+    size_t bufRingBytes;
+    char *bufBase;
+    uint16_t bufTail;
+
+    uint64_t nextRequest;
+    uint64_t nextRegistration;
+    std::unordered_map<uint64_t, Request> requests;
+    std::unordered_map<int32_t, Registration> channels;
+    std::unordered_map<int32_t, Accept> accepts;
+    std::vector<int32_t> rearms;          /* Polls and recvs to arm again. */
+    std::vector<int32_t> acceptRearms;
+    std::vector<int32_t> readyFds;
+    std::vector<int32_t> pendingFds;      /* Received while not reading. */
+};
+#endif
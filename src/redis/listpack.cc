@@ -0,0 +1,61 @@
+#include "listpack.h"
+
+static const uint8_t kLongLen = 0x80;
+
+static size_t lenBytes(size_t len) {
+    return len < kLongLen ? 1 : 5;
+}
+
+size_t lpEntryBytes(size_t len) {
+    return len + lenBytes(len) * 2;
+}
+
+char *lpWriteEntry(char *p, const char *value, size_t len) {
+    uint32_t l = len;
+    if (len < kLongLen) {
+        *p++ = len;
+        memcpy(p, value, len);
+        p += len;
+        *p++ = len;
+    } else {
+        *p++ = kLongLen;
+        memcpy(p, &l, sizeof(l));
+        p += sizeof(l);
+        memcpy(p, value, len);
+        p += len;
+        memcpy(p, &l, sizeof(l));
+        p += sizeof(l);
+        *p++ = kLongLen;
+    }
+    return p;
+}
+
+const char *lpReadEntry(const char *p, size_t *len) {
+    if ((uint8_t) p[0] < kLongLen) {
+        *len = (uint8_t) p[0];
+        return p + 1;
+    }
+
+    uint32_t l;
+    memcpy(&l, p + 1, sizeof(l));
+    *len = l;
+    return p + 5;
+}
+
+const char *lpReadEntryBack(const char *p, size_t *len) {
+    if ((uint8_t) p[-1] < kLongLen) {
+        *len = (uint8_t) p[-1];
+        return p - 1 - *len;
+    }
+
+    uint32_t l;
+    memcpy(&l, p - 5, sizeof(l));
+    *len = l;
+    return p - 5 - *len;
+}
+
+void lpAppend(std::string *buf, const char *value, size_t len) {
+    size_t used = buf->size();
+    buf->resize(used + lpEntryBytes(len));
+    lpWriteEntry(&(*buf)[used], value, len);
+}
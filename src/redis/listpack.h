@@ -0,0 +1,22 @@
+#pragma once
+
+#include "all.h"
+
+/* Entries packed one after another in a buffer. An entry is its length,
+ * the bytes, then the length again so the buffer can be walked from either
+ * end. A length below 0x80 takes one byte, a longer one is a 0x80 marker
+ * and four bytes. */
+size_t lpEntryBytes(size_t len);
+
+/* Writes the entry at p, which has lpEntryBytes(len) bytes of room, and
+ * returns the end of it. */
+char *lpWriteEntry(char *p, const char *value, size_t len);
+
+/* The value of the entry starting at p. */
+const char *lpReadEntry(const char *p, size_t *len);
+
+/* The value of the entry ending right before p. */
+const char *lpReadEntryBack(const char *p, size_t *len);
+
+/* Appends an entry to buf. */
+void lpAppend(std::string *buf, const char *value, size_t len);
@@ -41,7 +41,66 @@ int main(int argc, char *argv[])
 	Logger::setOutput(dummyOutput);
 	printf("%s\n", logo);
 
-	Redis redis("127.0.0.1", 6379, 0);
+	bool appendOnly = false;
+	bool clusterEnabled = false;
+	bool threadPerCore = false;
+	int16_t threadCount = 0;
+	int32_t fsyncPolicy = REDIS_DEFAULT_AOF_FSYNC;
+	int64_t maxmemory = REDIS_DEFAULT_MAXMEMORY;
+	const char *maxmemoryPolicy = nullptr;
+	TcpServer::AcceptMode acceptMode = TcpServer::kSingleAcceptor;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--appendonly"))
+		{
+			appendOnly = !strcmp(argv[i + 1], "yes");
+		}
+		else if (!strcmp(argv[i], "--cluster-enabled"))
+		{
+			clusterEnabled = !strcmp(argv[i + 1], "yes");
+		}
+		else if (!strcmp(argv[i], "--threads"))
+		{
+			threadCount = atoi(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "--thread-per-core"))
+		{
+			threadPerCore = !strcmp(argv[i + 1], "yes");
+		}
+		else if (!strcmp(argv[i], "--appendfsync"))
+		{
+			if (!strcmp(argv[i + 1], "always")) fsyncPolicy = AOF_FSYNC_ALWAYS;
+			else if (!strcmp(argv[i + 1], "no")) fsyncPolicy = AOF_FSYNC_NO;
+			else fsyncPolicy = AOF_FSYNC_EVERYSEC;
+		}
+		else if (!strcmp(argv[i], "--maxmemory"))
+		{
+			maxmemory = memtoll(argv[i + 1], nullptr);
+		}
+		else if (!strcmp(argv[i], "--maxmemory-policy"))
+		{
+			maxmemoryPolicy = argv[i + 1];
+		}
+		else if (!strcmp(argv[i], "--reuseport"))
+		{
+			if (!strcmp(argv[i + 1], "yes")) acceptMode = TcpServer::kReusePort;
+			else if (!strcmp(argv[i + 1], "cpu")) acceptMode = TcpServer::kReusePortCpu;
+			else acceptMode = TcpServer::kSingleAcceptor;
+		}
+		else if (!strcmp(argv[i], "--io-uring"))
+		{
+			EventLoop::setIoUringEnabled(!strcmp(argv[i + 1], "yes"));
+		}
+	}
+
+	Redis redis("127.0.0.1", 6379, threadCount, clusterEnabled, appendOnly, acceptMode);
+	redis.getAof()->setFsyncPolicy(fsyncPolicy);
+	redis.threadPerCore = threadPerCore;
+	redis.maxmemory = maxmemory;
+	if (maxmemoryPolicy != nullptr && !redis.setMaxmemoryPolicy(maxmemoryPolicy))
+	{
+		LOG_WARN << "Invalid maxmemory-policy " << maxmemoryPolicy;
+	}
 	redis.run();
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
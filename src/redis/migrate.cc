@@ -0,0 +1,352 @@
+#include "migrate.h"
+#include "redis.h"
+#include "hiredis.h"
+
+/* Commands are written once this much piled up, or before a reply is read. */
+static const size_t kMigrateFlushBytes = 64 * 1024;
+
+Migrator::Migrator(Redis *redis)
+        : redis(redis),
+          stopped(false),
+          currentSlot(-1),
+          slotStart(0),
+          slotsDone(0),
+          slotsFailed(0),
+          migratedKeys(0),
+          migratedBytes(0),
+          slotKeys(0),
+          slotBytes(0) {
+
+}
+
+Migrator::~Migrator() {
+    {
+        std::unique_lock <std::mutex> lck(mtx);
+        stopped = true;
+        condition.notify_one();
+    }
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/* Idle connections are closed here, when the next migration comes. */
+Migrator::TargetPtr Migrator::getTarget(const std::string &ip, int16_t port) {
+    std::unique_lock <std::mutex> lck(mtx);
+    time_t now = time(nullptr);
+    for (auto it = targets.begin(); it != targets.end();) {
+        const TargetPtr &target = it->second;
+        if (it->second.use_count() == 1 && target->lastUse + REDIS_MIGRATE_CACHE_TTL < now) {
+            it = targets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    TargetPtr &target = targets[ip + ":" + std::to_string(port)];
+    if (target == nullptr) {
+        target.reset(new Target());
+    }
+    target->lastUse = now;
+    return target;
+}
+
+int32_t Migrator::migrateKeys(const std::string &ip, int16_t port, const char *password,
+                              const std::vector <RedisObjectPtr> &keys, bool copy, bool replace,
+                              int64_t timeout, size_t *moved, std::string *err) {
+    *moved = 0;
+    err->clear();
+
+    TargetPtr target = getTarget(ip, port);
+    std::unique_lock <std::mutex> lck(target->mtx);
+    struct timeval tv = {(time_t) (timeout / 1000), (suseconds_t) (timeout % 1000) * 1000};
+    if (target->context == nullptr) {
+        RedisContextPtr context = redisConnectWithTimeout(ip.c_str(), port, tv);
+        if (context->err) {
+            *err = "IOERR error or timeout connecting to the client";
+            return REDIS_ERR;
+        }
+        target->context = context;
+    }
+
+    RedisContextPtr c = target->context;
+    Socket::setTimeOut(c->fd, tv);
+
+    /* Replies come in the order of the commands. */
+    std::deque <Sent> pending;
+    std::deque <Sent> acked;
+    std::deque <RedisObjectPtr> changed;
+    size_t inflight = 0;
+    bool ioerr = false;
+
+    auto readReply = [&]() {
+        RedisReplyPtr reply;
+        if (c->redisGetReply(reply) == REDIS_ERR || reply == nullptr) {
+            *err = "IOERR error or timeout reading to target instance";
+            ioerr = true;
+            return false;
+        }
+
+        Sent sent = std::move(pending.front());
+        pending.pop_front();
+        size_t len = sent.dump != nullptr ? sdslen(sent.dump->ptr) : 0;
+        inflight -= len;
+        if (reply->type == REDIS_REPLY_ERROR) {
+            if (err->empty()) {
+                *err = "ERR Target instance replied with error: ";
+                err->append(reply->str, sdslen(reply->str));
+            }
+        } else if (sent.dump != nullptr) {
+            migratedKeys++;
+            migratedBytes += len;
+            if (!copy) {
+                acked.push_back(std::move(sent));
+                if (acked.size() >= REDIS_MIGRATE_DELETE_BATCH) {
+                    deleteKeys(acked, changed);
+                }
+            }
+        }
+        return true;
+    };
+
+    auto flush = [&]() {
+        int32_t done = 0;
+        do {
+            if (c->redisBufferWrite(&done) == REDIS_ERR) {
+                *err = "IOERR error or timeout writing to target instance";
+                ioerr = true;
+                return false;
+            }
+        } while (!done);
+        return true;
+    };
+
+    /* Sends the key as it is now, a key that is gone is deleted on the
+     * target if it was sent before. Returns false for a key that is gone. */
+    auto sendKey = [&](const RedisObjectPtr &key, bool resend) {
+        int64_t expire;
+        RedisObjectPtr dump = redis->createDumpPayload(key, &expire);
+        if (dump == nullptr) {
+            if (!resend) {
+                return false;
+            }
+
+            const char *argv[2] = {"DEL", key->ptr};
+            int32_t argvlen[2] = {3, (int32_t) sdslen(key->ptr)};
+            c->redisAppendCommandArgv(2, argv, argvlen);
+            pending.push_back(Sent{key, nullptr, 0});
+        } else {
+            char ttl[LONG_STR_SIZE];
+            int32_t ttllen = ll2string(ttl, sizeof(ttl),
+                                       expire == REDIS_ERR ? 0 : std::max<int64_t>(expire - mstime(), 1));
+            const char *argv[5] = {"RESTORE-ASKING", key->ptr, ttl, dump->ptr, "REPLACE"};
+            int32_t argvlen[5] = {14, (int32_t) sdslen(key->ptr), ttllen, (int32_t) sdslen(dump->ptr), 7};
+            c->redisAppendCommandArgv(replace || resend ? 5 : 4, argv, argvlen);
+            inflight += sdslen(dump->ptr);
+            pending.push_back(Sent{key, dump, expire});
+        }
+
+        if (c->sender.readableBytes() >= kMigrateFlushBytes && !flush()) {
+            return true;
+        }
+
+        while (!ioerr && (inflight > REDIS_MIGRATE_INFLIGHT_BYTES ||
+                          pending.size() > REDIS_MIGRATE_INFLIGHT_KEYS)) {
+            readReply();
+        }
+        return true;
+    };
+
+    if (password != nullptr) {
+        const char *argv[2] = {"AUTH", password};
+        int32_t argvlen[2] = {4, (int32_t) strlen(password)};
+        c->redisAppendCommandArgv(2, argv, argvlen);
+        pending.push_back(Sent{nullptr, nullptr, 0});
+    }
+
+    for (auto &key : keys) {
+        if (sendKey(key, false)) {
+            (*moved)++;
+        }
+
+        if (ioerr) {
+            break;
+        }
+    }
+
+    int32_t rounds = 0;
+    while (true) {
+        while (!ioerr && !pending.empty()) {
+            readReply();
+        }
+
+        deleteKeys(acked, changed);
+        if (ioerr || changed.empty() || !err->empty()) {
+            break;
+        }
+
+        if (++rounds > REDIS_MIGRATE_RESENDS) {
+            *err = "ERR Keys were written faster than they could be migrated";
+            break;
+        }
+
+        std::deque <RedisObjectPtr> again;
+        again.swap(changed);
+        for (auto &key : again) {
+            sendKey(key, true);
+            if (ioerr) {
+                break;
+            }
+        }
+    }
+
+    if (ioerr) {
+        /* The stream is out of step with the replies now. */
+        target->context.reset();
+    }
+    return err->empty() ? REDIS_OK : REDIS_ERR;
+}
+
+/* Deletes the acknowledged keys that still hold the value that was sent,
+ * the others go to changed. The shards of the keys stay locked from the
+ * check until the DEL was logged, so no write can come in between. */
+void Migrator::deleteKeys(std::deque <Sent> &keys, std::deque <RedisObjectPtr> &changed) {
+    if (keys.empty()) {
+        return;
+    }
+
+    std::deque <RedisObjectPtr> del;
+    for (auto &it : keys) {
+        del.push_back(it.key);
+    }
+
+    {
+        bool logged = redis->aofEnabled;
+        std::shared_lock <std::shared_mutex> lck;
+        if (logged) {
+            lck = std::shared_lock<std::shared_mutex>(redis->getAof()->getRewriteMutex());
+        }
+
+        std::vector <std::unique_lock<std::mutex>> shardLocks;
+        redis->lockWriteShards(shared.del, del, shardLocks);
+        del.clear();
+        del.push_back(shared.del);
+        for (auto &it : keys) {
+            int64_t expire;
+            RedisObjectPtr dump = redis->createDumpPayload(it.key, &expire);
+            if (dump == nullptr || expire != it.expire || sdslen(dump->ptr) != sdslen(it.dump->ptr) ||
+                memcmp(dump->ptr, it.dump->ptr, sdslen(dump->ptr)) != 0) {
+                changed.push_back(it.key);
+            } else if (redis->removeCommand(it.key)) {
+                del.push_back(it.key);
+            }
+        }
+
+        if (logged && del.size() > 1) {
+            redis->getAof()->feedAppendOnlyFile(del);
+        }
+        redis->unlockWriteShards(shardLocks);
+    }
+
+    if (redis->repliEnabled && redis->masterfd <= 0 && del.size() > 1) {
+        Buffer buffer;
+        redis->structureRedisProtocol(buffer, del);
+        redis->getReplication()->replicationFeedSlaves(&buffer);
+    }
+    keys.clear();
+}
+
+void Migrator::migrateSlot(int32_t slot, const std::string &ip, int16_t port) {
+    std::unique_lock <std::mutex> lck(mtx);
+    slotJobs.push_back(SlotJob{slot, ip, port});
+    if (!worker.joinable()) {
+        worker = std::thread(std::bind(&Migrator::slotWorker, this));
+    }
+    condition.notify_one();
+}
+
+void Migrator::slotWorker() {
+    while (true) {
+        SlotJob job;
+        {
+            std::unique_lock <std::mutex> lck(mtx);
+            condition.wait(lck, [this]() { return stopped || !slotJobs.empty(); });
+            if (stopped) {
+                return;
+            }
+
+            job = slotJobs.front();
+            slotJobs.pop_front();
+            currentSlot = job.slot;
+            currentTarget = job.ip + ":" + std::to_string(job.port);
+            slotStart = mstime();
+            slotKeys = 0;
+            slotBytes = 0;
+        }
+
+        LOG_INFO << "Migrating slot " << job.slot << " to " << job.ip << ":" << job.port;
+        std::string err;
+        while (true) {
+            std::vector <RedisObjectPtr> keys;
+            redis->getCluster()->getKeyInSlot(job.slot, keys, REDIS_MIGRATE_SLOT_BATCH);
+            if (keys.empty()) {
+                break;
+            }
+
+            int64_t keysBefore = migratedKeys;
+            int64_t bytesBefore = migratedBytes;
+            size_t moved;
+            int32_t ret = migrateKeys(job.ip, job.port, nullptr, keys, false, true,
+                                      REDIS_MIGRATE_SLOT_TIMEOUT, &moved, &err);
+            slotKeys += migratedKeys - keysBefore;
+            slotBytes += migratedBytes - bytesBefore;
+            if (ret == REDIS_ERR || moved == 0) {
+                break;
+            }
+        }
+
+        std::unique_lock <std::mutex> lck(mtx);
+        if (err.empty()) {
+            slotsDone++;
+            LOG_INFO << "Migrated slot " << job.slot << ": " << slotKeys << " keys in "
+                     << mstime() - slotStart << " ms";
+        } else {
+            slotsFailed++;
+            lastError = err;
+            LOG_WARN << "Migrating slot " << job.slot << " failed: " << err;
+        }
+        currentSlot = -1;
+    }
+}
+
+sds Migrator::catMigrateInfo(sds info) {
+    std::unique_lock <std::mutex> lck(mtx);
+    info = sdscatprintf(info,
+                        "migrate_keys:%lld\r\n"
+                        "migrate_bytes:%lld\r\n"
+                        "migrate_targets:%d\r\n"
+                        "migrate_slots_queued:%d\r\n"
+                        "migrate_slots_done:%lld\r\n"
+                        "migrate_slots_failed:%lld\r\n"
+                        "migrate_last_error:%s\r\n",
+                        (long long) migratedKeys,
+                        (long long) migratedBytes,
+                        (int32_t) targets.size(),
+                        (int32_t) slotJobs.size(),
+                        (long long) slotsDone,
+                        (long long) slotsFailed,
+                        lastError.c_str());
+    if (currentSlot >= 0) {
+        int64_t elapsed = std::max<int64_t>(mstime() - slotStart, 1);
+        info = sdscatprintf(info,
+                            "migrate_slot:slot=%d,target=%s,moved=%lld,left=%zu,"
+                            "rate=%.2fkeys/s,throughput=%.2fKB/s\r\n",
+                            currentSlot, currentTarget.c_str(),
+                            (long long) slotKeys,
+                            redis->getCluster()->countKeysInSlot(currentSlot),
+                            slotKeys * 1000.0 / elapsed,
+                            slotBytes * 1000.0 / elapsed / 1024);
+    }
+    return info;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+#include "callback.h"
+
+class Redis;
+
+/* Moves keys to another instance for MIGRATE and CLUSTER MIGRATE-SLOT. The
+ * keys travel as RESTORE-ASKING commands pipelined over a connection kept
+ * per target, with at most REDIS_MIGRATE_INFLIGHT_BYTES of payload and
+ * REDIS_MIGRATE_INFLIGHT_KEYS commands waiting for a reply. Keys the target
+ * acknowledged are deleted here REDIS_MIGRATE_DELETE_BATCH at a time and the
+ * DEL goes to the append only file and the replicas. A key written since it
+ * was dumped is not deleted but sent again, or deleted on the target when it
+ * is gone here. A slot migration runs on a thread of its own until the slot
+ * has no keys left. */
+class Migrator {
+public:
+    Migrator(Redis *redis);
+
+    ~Migrator();
+
+    /* Blocks the caller until every key was acknowledged or something
+     * failed, *err is then the error to reply with. *moved counts the keys
+     * that existed here. */
+    int32_t migrateKeys(const std::string &ip, int16_t port, const char *password,
+                        const std::vector <RedisObjectPtr> &keys, bool copy, bool replace,
+                        int64_t timeout, size_t *moved, std::string *err);
+
+    /* Queues the slot to be drained into the target. */
+    void migrateSlot(int32_t slot, const std::string &ip, int16_t port);
+
+    sds catMigrateInfo(sds info);
+
+private:
+    Migrator(const Migrator &);
+
+    void operator=(const Migrator &);
+
+    /* A cached connection, used by one migration at a time. */
+    struct Target {
+        std::mutex mtx;
+        RedisContextPtr context;
+        int64_t lastUse;
+    };
+
+    typedef std::shared_ptr <Target> TargetPtr;
+
+    /* A command waiting for its reply. The AUTH has no key, a DEL no dump. */
+    struct Sent {
+        RedisObjectPtr key;
+        RedisObjectPtr dump;
+        int64_t expire;
+    };
+
+    struct SlotJob {
+        int32_t slot;
+        std::string ip;
+        int16_t port;
+    };
+
+    TargetPtr getTarget(const std::string &ip, int16_t port);
+
+    void deleteKeys(std::deque <Sent> &keys, std::deque <RedisObjectPtr> &changed);
+
+    void slotWorker();
+
+    Redis *redis;
+    std::mutex mtx;
+    std::unordered_map <std::string, TargetPtr> targets;
+
+    std::thread worker;
+    std::condition_variable condition;
+    std::deque <SlotJob> slotJobs;
+    bool stopped;
+    int32_t currentSlot;       /* -1 while no slot is migrated. */
+    std::string currentTarget;
+    int64_t slotStart;
+    int64_t slotsDone;
+    int64_t slotsFailed;
+    std::string lastError;
+
+    std::atomic <int64_t> migratedKeys;
+    std::atomic <int64_t> migratedBytes;
+    std::atomic <int64_t> slotKeys;    /* Moved by the current slot migration. */
+    std::atomic <int64_t> slotBytes;
+};
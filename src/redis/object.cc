@@ -1,477 +1,644 @@
-#include "object.h"
-
-struct SharedObjectsStruct shared;
-
-RedisObject::RedisObject()
-        : hash(0),
-          ptr(nullptr) {
-
-}
-
-RedisObject::~RedisObject() {
-    if (ptr != nullptr) {
-        sdsfree(ptr);
-    }
-}
-
-void RedisObject::calHash() {
-    hash = dictGenHashFunction(ptr, sdslen(ptr));
-}
-
-bool RedisObject::operator<(const RedisObjectPtr &r) const {
-    auto cmp = memcmp(ptr, r->ptr, sdslen(ptr));
-    if (cmp < 0) {
-        return true;
-    } else if (cmp == 0) {
-        return memcmp(ptr, r->ptr, sdslen(ptr)) < 0;
-    } else {
-        return false;
-    }
-}
-
-RedisObjectPtr createObject(int32_t type, char *ptr) {
-    RedisObjectPtr o(new RedisObject());
-    o->encoding = REDIS_ENCODING_RAW;
-    o->type = type;
-    o->ptr = ptr;
-    o->calHash();
-    return o;
-}
-
-int32_t getLongLongFromObject(const RedisObjectPtr &o, int64_t *target) {
-    int64_t value;
-    if (o == nullptr) {
-        value = 0;
-    } else {
-        if (sdsEncodedObject(o)) {
-            if (string2ll(o->ptr, sdslen(o->ptr), &value) == 0) {
-                return REDIS_ERR;
-            }
-        } else if (o->encoding == OBJ_ENCODING_INT) {
-            if (string2ll(o->ptr, sdslen(o->ptr), &value) == 0) {
-                return REDIS_ERR;
-            }
-        } else {
-            assert(false);
-        }
-    }
-
-    if (target) {
-        *target = value;
-    }
-    return REDIS_OK;
-}
-
-int32_t getLongLongFromObjectOrReply(Buffer *buffer,
-                                     const RedisObjectPtr &o, int64_t *target, const char *msg) {
-    int64_t value;
-    if (getLongLongFromObject(o, &value) != REDIS_OK) {
-        if (msg != nullptr) {
-            addReplyError(buffer, (char *) msg);
-        } else {
-            addReplyError(buffer, "value is no an integer or out of range");
-        }
-        return REDIS_ERR;
-    }
-
-    *target = value;
-    return REDIS_OK;
-}
-
-int32_t getLongFromObjectOrReply(Buffer *buffer,
-                                 const RedisObjectPtr &o, int32_t *target, const char *msg) {
-    int64_t value;
-    if (getLongLongFromObject(o, &value) != REDIS_OK) {
-        if (msg != nullptr) {
-            addReplyError(buffer, (char *) msg);
-        } else {
-            addReplyError(buffer, "value is no an integer or out of range");
-        }
-        return REDIS_ERR;
-    }
-
-    *target = value;
-    return REDIS_OK;
-}
-
-RedisObjectPtr createStringObjectFromLongLong(int64_t value) {
-    RedisObjectPtr o;
-    if (value >= 0 && value < REDIS_SHARED_INTEGERS) {
-        o = shared.integers[value - 1];
-    } else {
-        o = createObject(REDIS_STRING, sdsfromlonglong(value));
-    }
-    return o;
-}
-
-int32_t getDoubleFromObjectOrReply(Buffer *buffer,
-                                   const RedisObjectPtr &o, double *target, const char *msg) {
-    double value;
-    if (getDoubleFromObject(o, &value) != REDIS_OK) {
-        if (msg != nullptr) {
-            addReplyError(buffer, (char *) msg);
-        } else {
-            addReplyError(buffer, "value is no a valid float");
-        }
-        return REDIS_ERR;
-    }
-
-    *target = value;
-    return REDIS_OK;
-}
-
-int32_t getDoubleFromObject(const RedisObjectPtr &o, double *target) {
-    double value;
-    char *eptr;
-
-    if (o == nullptr) {
-        value = 0;
-    } else {
-        if (sdsEncodedObject(o)) {
-            errno = 0;
-            value = strtod(o->ptr, &eptr);
-            if (isspace(((const char *) o->ptr)[0]) ||
-                eptr[0] != '\0' ||
-                (errno == ERANGE && value == 0) || errno == EINVAL)
-                return REDIS_ERR;
-        } else if (o->encoding == OBJ_ENCODING_INT) {
-            value = (long) o->ptr;
-        } else {
-            assert(false);
-        }
-    }
-
-    *target = value;
-    return REDIS_OK;
-}
-
-void createSharedObjects() {
-    int32_t j;
-    shared.crlf = createObject(REDIS_STRING, sdsnew("\r\n"));
-    shared.ok = createObject(REDIS_STRING, sdsnew("+OK\r\n"));
-    shared.err = createObject(REDIS_STRING, sdsnew("-ERR\r\n"));
-    shared.emptybulk = createObject(REDIS_STRING, sdsnew("$0\r\n\r\n"));
-    shared.czero = createObject(REDIS_STRING, sdsnew(":0\r\n"));
-    shared.cone = createObject(REDIS_STRING, sdsnew(":1\r\n"));
-    shared.cnegone = createObject(REDIS_STRING, sdsnew(":-1\r\n"));
-    shared.nullbulk = createObject(REDIS_STRING, sdsnew("$-1\r\n"));
-    shared.nullmultibulk = createObject(REDIS_STRING, sdsnew("*-1\r\n"));
-    shared.emptymultibulk = createObject(REDIS_STRING, sdsnew("*0\r\n"));
-    shared.pping = createObject(REDIS_STRING, sdsnew("PPING\r\n"));
-    shared.ping = createObject(REDIS_STRING, sdsnew("ping"));
-    shared.pong = createObject(REDIS_STRING, sdsnew("+PONG\r\n"));
-    shared.ppong = createObject(REDIS_STRING, sdsnew("PPONG"));
-    shared.queued = createObject(REDIS_STRING, sdsnew("+queued\r\n"));
-    shared.emptyscan = createObject(REDIS_STRING, sdsnew("*2\r\n$1\r\n0\r\n*0\r\n"));
-
-    shared.wrongtypeerr = createObject(REDIS_STRING, sdsnew(
-            "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n"));
-    shared.nokeyerr = createObject(REDIS_STRING, sdsnew(
-            "-ERR no such key\r\n"));
-    shared.syntaxerr = createObject(REDIS_STRING, sdsnew(
-            "-ERR syntax error\r\n"));
-    shared.sameobjecterr = createObject(REDIS_STRING, sdsnew(
-            "-ERR source and destination objects are the same\r\n"));
-    shared.outofrangeerr = createObject(REDIS_STRING, sdsnew(
-            "-ERR index out of range\r\n"));
-    shared.noscripterr = createObject(REDIS_STRING, sdsnew(
-            "-NOSCRIPT No matching script. Please use EVAL.\r\n"));
-    shared.loadingerr = createObject(REDIS_STRING, sdsnew(
-            "-LOADING Redis is loading the dataset in memory\r\n"));
-    shared.slowscripterr = createObject(REDIS_STRING, sdsnew(
-            "-BUSY Redis is busy running a script. You can only call SCRIPT KILL or SHUTDOWN NOSAVE.\r\n"));
-    shared.masterdownerr = createObject(REDIS_STRING, sdsnew(
-            "-MASTERDOWN Link with MASTER is down and slave-serve-stale-data is set to 'no'.\r\n"));
-    shared.bgsaveerr = createObject(REDIS_STRING, sdsnew(
-            "-MISCONF Redis is configured to save RDB snapshots, but is currently no able to persist on disk. Commands that may modify the data set are disabled. Please check Redis logs for details about the error.\r\n"));
-    shared.roslaveerr = createObject(REDIS_STRING, sdsnew(
-            "-READONLY You can't write against a read only slave.\r\n"));
-    shared.noautherr = createObject(REDIS_STRING, sdsnew(
-            "-NOAUTH Authentication required.\r\n"));
-    shared.oomerr = createObject(REDIS_STRING, sdsnew(
-            "-OOM command no allowed when used memory > 'maxmemory'.\r\n"));
-    shared.execaborterr = createObject(REDIS_STRING, sdsnew(
-            "-EXECABORT Transaction discarded because of previous errors.\r\n"));
-    shared.noreplicaserr = createObject(REDIS_STRING, sdsnew(
-            "-NOREPLICAS Not enough good slaves to write.\r\n"));
-    shared.busykeyerr = createObject(REDIS_STRING, sdsnew(
-            "-BUSYKEY Target key name already exists.\r\n"));
-
-    shared.space = createObject(REDIS_STRING, sdsnew(" "));
-    shared.colon = createObject(REDIS_STRING, sdsnew(":"));
-    shared.plus = createObject(REDIS_STRING, sdsnew("+"));
-    shared.asking = createObject(REDIS_STRING, sdsnew("asking"));
-
-    shared.messagebulk = createObject(REDIS_STRING, sdsnew("$7\r\nmessage\r\n"));
-    shared.pmessagebulk = createObject(REDIS_STRING, sdsnew("$8\r\npmessage\r\n"));
-    shared.subscribebulk = createObject(REDIS_STRING, sdsnew("$9\r\nsubscribe\r\n"));
-    shared.unsubscribebulk = createObject(REDIS_STRING, sdsnew("$11\r\nunsubscribe\r\n"));
-
-    shared.psubscribebulk = createObject(REDIS_STRING, sdsnew("$10\r\npsubscribe\r\n"));
-    shared.punsubscribebulk = createObject(REDIS_STRING, sdsnew("$12\r\npunsubscribe\r\n"));
-
-    shared.del = createObject(REDIS_STRING, sdsnew("del"));
-    shared.rpop = createObject(REDIS_STRING, sdsnew("rpop"));
-    shared.lpop = createObject(REDIS_STRING, sdsnew("lpop"));
-    shared.lpush = createObject(REDIS_STRING, sdsnew("lpush"));
-    shared.rpush = createObject(REDIS_STRING, sdsnew("rpush"));
-    shared.set = createObject(REDIS_STRING, sdsnew("set"));
-    shared.get = createObject(REDIS_STRING, sdsnew("get"));
-    shared.flushdb = createObject(REDIS_STRING, sdsnew("flushdb"));
-    shared.dbsize = createObject(REDIS_STRING, sdsnew("dbsize"));
-    shared.hset = createObject(REDIS_STRING, sdsnew("hset"));
-    shared.hget = createObject(REDIS_STRING, sdsnew("hget"));
-    shared.hgetall = createObject(REDIS_STRING, sdsnew("hgetall"));
-    shared.save = createObject(REDIS_STRING, sdsnew("save"));
-    shared.slaveof = createObject(REDIS_STRING, sdsnew("slaveof"));
-    shared.command = createObject(REDIS_STRING, sdsnew("command"));
-    shared.config = createObject(REDIS_STRING, sdsnew("config"));
-    shared.auth = createObject(REDIS_STRING, sdsnew("rpush"));
-    shared.info = createObject(REDIS_STRING, sdsnew("info"));
-    shared.echo = createObject(REDIS_STRING, sdsnew("echo"));
-    shared.client = createObject(REDIS_STRING, sdsnew("client"));
-    shared.hkeys = createObject(REDIS_STRING, sdsnew("hkeys"));
-    shared.hlen = createObject(REDIS_STRING, sdsnew("hlen"));
-    shared.keys = createObject(REDIS_STRING, sdsnew("keys"));
-    shared.bgsave = createObject(REDIS_STRING, sdsnew("bgsave"));
-    shared.memory = createObject(REDIS_STRING, sdsnew("memory"));
-    shared.cluster = createObject(REDIS_STRING, sdsnew("cluster"));
-    shared.migrate = createObject(REDIS_STRING, sdsnew("migrate"));
-    shared.debug = createObject(REDIS_STRING, sdsnew("debug"));
-    shared.ttl = createObject(REDIS_STRING, sdsnew("ttl"));
-    shared.lrange = createObject(REDIS_STRING, sdsnew("lrange"));
-    shared.llen = createObject(REDIS_STRING, sdsnew("llen"));
-    shared.sadd = createObject(REDIS_STRING, sdsnew("sadd"));
-    shared.scard = createObject(REDIS_STRING, sdsnew("scard"));
-    shared.addsync = createObject(REDIS_STRING, sdsnew("addsync"));
-    shared.setslot = createObject(REDIS_STRING, sdsnew("setslot"));
-    shared.node = createObject(REDIS_STRING, sdsnew("node"));
-    shared.clusterconnect = createObject(REDIS_STRING, sdsnew("clusterconnect"));
-    shared.sync = createObject(REDIS_STRING, sdsnew("sync"));
-    shared.psync = createObject(REDIS_STRING, sdsnew("psync"));
-    shared.delsync = createObject(REDIS_STRING, sdsnew("delsync"));
-    shared.zadd = createObject(REDIS_STRING, sdsnew("zadd"));
-    shared.zrange = createObject(REDIS_STRING, sdsnew("zrange"));
-    shared.zrevrange = createObject(REDIS_STRING, sdsnew("zrevrange"));
-    shared.zcard = createObject(REDIS_STRING, sdsnew("zcard"));
-    shared.dump = createObject(REDIS_STRING, sdsnew("dump"));
-    shared.restore = createObject(REDIS_STRING, sdsnew("restore"));
-    shared.incr = createObject(REDIS_STRING, sdsnew("incr"));
-    shared.decr = createObject(REDIS_STRING, sdsnew("decr"));
-    shared.monitor = createObject(REDIS_STRING, sdsnew("monitor"));
-    shared.mget = createObject(REDIS_STRING, sdsnew("mget"));
-    shared.mset = createObject(REDIS_STRING, sdsnew("mset"));
-    shared.subscribe = createObject(REDIS_STRING, sdsnew("subscribe"));
-    shared.select = createObject(REDIS_STRING, sdsnew("select"));
-    shared.unsubscribe = createObject(REDIS_STRING, sdsnew("unsubscribe"));
-    shared.publish = createObject(REDIS_STRING, sdsnew("publish"));
-    shared.rename = createObject(REDIS_STRING, sdsnew("rename"));
-    shared.move = createObject(REDIS_STRING, sdsnew("move"));
-    shared.object = createObject(REDIS_STRING, sdsnew("object"));
-    shared.scan = createObject(REDIS_STRING, sdsnew("scan"));
-    shared.hscan = createObject(REDIS_STRING, sdsnew("hscan"));
-    shared.randomkey = createObject(REDIS_STRING, sdsnew("randomkey"));
-    shared.renamenx = createObject(REDIS_STRING, sdsnew("renamenx"));
-    shared.bitop = createObject(REDIS_STRING, sdsnew("bitop"));
-    shared.brpoplpush = createObject(REDIS_STRING, sdsnew("brpoplpush"));
-    shared.rpoplpush = createObject(REDIS_STRING, sdsnew("rpoplpush"));
-    shared.sinterstore = createObject(REDIS_STRING, sdsnew("sinterstore"));
-    shared.sdiffstore = createObject(REDIS_STRING, sdsnew("sdiffstore"));
-    shared.sinter = createObject(REDIS_STRING, sdsnew("sinter"));
-    shared.smove = createObject(REDIS_STRING, sdsnew("smove"));
-    shared.sunionstore = createObject(REDIS_STRING, sdsnew("sunionstore"));
-    shared.smove = createObject(REDIS_STRING, sdsnew("smove"));
-    shared.zinterstore = createObject(REDIS_STRING, sdsnew("zinterstore"));
-    shared.zunionstore = createObject(REDIS_STRING, sdsnew("zunionstore"));
-    shared.pubsub = createObject(REDIS_STRING, sdsnew("pubsub"));
-    shared.eval = createObject(REDIS_STRING, sdsnew("eval"));
-
-    for (j = 0; j < REDIS_SHARED_INTEGERS; j++) {
-        shared.integers[j] = createObject(REDIS_STRING, sdsfromlonglong(j));
-        shared.integers[j]->encoding = REDIS_ENCODING_INT;
-    }
-
-    for (j = 0; j < REDIS_SHARED_BULKHDR_LEN; j++) {
-        shared.mbulkhdr[j] = createObject(REDIS_STRING, sdscatprintf(sdsempty(), "*%d\r\n", j));
-        shared.bulkhdr[j] = createObject(REDIS_STRING, sdscatprintf(sdsempty(), "$%d\r\n", j));
-    }
-}
-
-RedisObjectPtr createStringObject(char *ptr, size_t len) {
-    return createRawStringObject(ptr, len);
-}
-
-RedisObjectPtr createRawStringObject(int32_t type, char *ptr, size_t len) {
-    return createObject(type, sdsnewlen(ptr, len));
-}
-
-RedisObjectPtr createRawStringObject(char *ptr, size_t len) {
-    return createObject(REDIS_STRING, sdsnewlen(ptr, len));
-}
-
-void addReplyBulkLen(Buffer *buffer, const RedisObjectPtr &obj) {
-    size_t len;
-
-    if (sdsEncodedObject(obj)) {
-        len = sdslen((const sds) obj->ptr);
-    } else {
-        long n = (long) obj->ptr;
-        len = 1;
-
-        if (n < 0) {
-            len++;
-            n = -n;
-        }
-
-        while ((n = n / 10) != 0) {
-            len++;
-        }
-    }
-
-    if (len < REDIS_SHARED_BULKHDR_LEN) {
-        addReply(buffer, shared.bulkhdr[len]);
-    } else {
-        addReplyLongLongWithPrefix(buffer, len, '$');
-    }
-}
-
-void addReplyBulk(Buffer *buffer, const RedisObjectPtr &obj) {
-    addReplyBulkLen(buffer, obj);
-    addReply(buffer, obj);
-    addReply(buffer, shared.crlf);
-}
-
-void addReplyLongLongWithPrefix(Buffer *buffer, int64_t ll, char prefix) {
-    char buf[128];
-    int32_t len;
-    if (prefix == '*' && ll < REDIS_SHARED_BULKHDR_LEN) {
-        addReply(buffer, shared.mbulkhdr[ll]);
-        return;
-    } else if (prefix == '$' && ll < REDIS_SHARED_BULKHDR_LEN) {
-        addReply(buffer, shared.bulkhdr[ll]);
-        return;
-    }
-
-    buf[0] = prefix;
-    len = ll2string(buf + 1, sizeof(buf) - 1, ll);
-    buf[len + 1] = '\r';
-    buf[len + 2] = '\n';
-    buffer->append(buf, len + 3);
-}
-
-void addReplyLongLong(Buffer *buffer, size_t len) {
-    if (len == 0) {
-        addReply(buffer, shared.czero);
-    } else if (len == 1) {
-        addReply(buffer, shared.cone);
-    } else {
-        addReplyLongLongWithPrefix(buffer, len, ':');
-    }
-}
-
-void addReplyStatusLength(Buffer *buffer, const char *s, size_t len) {
-    addReplyString(buffer, "+", 1);
-    addReplyString(buffer, s, len);
-    addReplyString(buffer, "\r\n", 2);
-}
-
-void addReplyStatus(Buffer *buffer, const char *status) {
-    addReplyStatusLength(buffer, status, strlen(status));
-}
-
-void addReplyError(Buffer *buffer, const char *str) {
-    addReplyErrorLength(buffer, str, strlen(str));
-}
-
-void addReply(Buffer *buffer, const RedisObjectPtr &obj) {
-    buffer->append(obj->ptr, sdslen(obj->ptr));
-}
-
-/* Add sds to reply (takes ownership of sds and frees it) */
-void addReplyBulkSds(Buffer *buffer, sds s) {
-    addReplySds(buffer, sdscatfmt(sdsempty(), "$%u\r\n", (unsigned long) sdslen(s)));
-    addReplySds(buffer, s);
-    addReply(buffer, shared.crlf);
-}
-
-void addReplyMultiBulkLen(Buffer *buffer, int32_t length) {
-    if (length < REDIS_SHARED_BULKHDR_LEN) {
-        addReply(buffer, shared.mbulkhdr[length]);
-    } else {
-        addReplyLongLongWithPrefix(buffer, length, '*');
-    }
-}
-
-void prePendReplyLongLongWithPrefix(Buffer *buffer, int32_t length) {
-    char buf[128];
-    buf[0] = '*';
-    int32_t len = ll2string(buf + 1, sizeof(buf) - 1, length);
-    buf[len + 1] = '\r';
-    buf[len + 2] = '\n';
-    if (length == 0) {
-        buffer->append(buf, len + 3);
-    } else {
-        buffer->prepend(buf, len + 3);
-    }
-}
-
-void addReplyBulkCString(Buffer *buffer, const char *s) {
-    if (s == nullptr) {
-        addReply(buffer, shared.nullbulk);
-    } else {
-        addReplyBulkCBuffer(buffer, s, strlen(s));
-    }
-}
-
-void addReplyDouble(Buffer *buffer, double d) {
-    char dbuf[128], sbuf[128];
-    int32_t dlen, slen;
-    dlen = snprintf(dbuf, sizeof(dbuf), "%.17g", d);
-    slen = snprintf(sbuf, sizeof(sbuf), "$%d\r\n%s\r\n", dlen, dbuf);
-    addReplyString(buffer, sbuf, slen);
-}
-
-void addReplyBulkCBuffer(Buffer *buffer, const char *p, size_t len) {
-    addReplyLongLongWithPrefix(buffer, len, '$');
-    addReplyString(buffer, p, len);
-    addReply(buffer, shared.crlf);
-}
-
-void addReplyErrorFormat(Buffer *buffer, const char *fmt, ...) {
-    size_t l, j;
-    va_list ap;
-    va_start(ap, fmt);
-    sds s = sdscatvprintf(sdsempty(), fmt, ap);
-    va_end(ap);
-    l = sdslen(s);
-
-    for (j = 0; j < l; j++) {
-        if (s[j] == '\r' || s[j] == '\n') s[j] = ' ';
-    }
-
-    addReplyErrorLength(buffer, s, sdslen(s));
-    sdsfree(s);
-}
-
-void addReplyString(Buffer *buffer, const char *s, size_t len) {
-    buffer->append(s, len);
-}
-
-void addReplySds(Buffer *buffer, sds s) {
-    buffer->append(s, sdslen(s));
-    sdsfree(s);
-}
-
-void addReplyErrorLength(Buffer *buffer, const char *s, size_t len) {
-    addReplyString(buffer, "-ERR ", 5);
-    addReplyString(buffer, s, len);
-    addReplyString(buffer, "\r\n", 2);
-}
-
-
-
-
-
-
-
-
+#include "object.h"
+
+#include <cmath>
+
+struct SharedObjectsStruct shared;
+
+std::atomic <uint32_t> lruClock(0);
+std::atomic <uint32_t> lfuClock(0);
+std::atomic <uint32_t> objectLruInit(0);
+
+RedisObject::RedisObject()
+        : hash(0),
+          ptr(nullptr) {
+    encoding = REDIS_ENCODING_RAW;
+    lru = objectLruInit.load(std::memory_order_relaxed);
+    embedded = 0;
+    hashSlot = 0;
+    hashSlotCached = 0;
+}
+
+RedisObject::~RedisObject() {
+    if (ptr != nullptr && !embedded) {
+        sdsfree(ptr);
+    }
+}
+
+void RedisObject::calHash() {
+    hash = dictGenHashFunction(ptr, sdslen(ptr));
+    hashSlotCached = 0;
+}
+
+uint32_t RedisObject::getHashSlot() {
+    if (!hashSlotCached) {
+        hashSlot = keyHashSlot(ptr, sdslen(ptr));
+        hashSlotCached = 1;
+    }
+    return hashSlot;
+}
+
+void updateObjectClocks(bool lfu) {
+    int64_t ms = mstime();
+    uint32_t lru = (ms / REDIS_LRU_CLOCK_RESOLUTION) & REDIS_LRU_CLOCK_MAX;
+    uint32_t minutes = (ms / 1000 / 60) & 65535;
+    lruClock.store(lru, std::memory_order_relaxed);
+    lfuClock.store(minutes, std::memory_order_relaxed);
+    objectLruInit.store(lfu ? (minutes << 8) | REDIS_LFU_INIT_VAL : lru,
+                        std::memory_order_relaxed);
+}
+
+/* Milliseconds since the object was last accessed, the clock may have
+ * wrapped once in between. */
+uint64_t estimateObjectIdleTime(const RedisObjectPtr &o) {
+    uint32_t clock = lruClock.load(std::memory_order_relaxed);
+    if (clock >= o->lru) {
+        return (uint64_t) (clock - o->lru) * REDIS_LRU_CLOCK_RESOLUTION;
+    }
+    return (uint64_t) (clock + (REDIS_LRU_CLOCK_MAX - o->lru)) * REDIS_LRU_CLOCK_RESOLUTION;
+}
+
+/* The LFU counter of the object, less one for every REDIS_LFU_DECAY_TIME
+ * minutes since it was last decremented. */
+uint32_t LFUDecrAndReturn(const RedisObjectPtr &o) {
+    uint32_t ldt = o->lru >> 8;
+    uint32_t counter = o->lru & 255;
+    uint32_t now = lfuClock.load(std::memory_order_relaxed);
+    uint32_t elapsed = now >= ldt ? now - ldt : 65535 - ldt + now;
+    uint32_t periods = elapsed / REDIS_LFU_DECAY_TIME;
+    return periods > counter ? 0 : counter - periods;
+}
+
+/* Logarithmic increment: the more hits a counter has, the less likely it
+ * grows further. */
+uint8_t LFULogIncr(uint8_t counter) {
+    static thread_local uint64_t seed = (uint64_t) ustime() ^ (uintptr_t) &seed;
+    if (counter == 255) {
+        return 255;
+    }
+
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    double r = (double) (seed >> 11) / (double) (1ULL << 53);
+    double baseval = counter > REDIS_LFU_INIT_VAL ? counter - REDIS_LFU_INIT_VAL : 0;
+    double p = 1.0 / (baseval * REDIS_LFU_LOG_FACTOR + 1);
+    if (r < p) {
+        counter++;
+    }
+    return counter;
+}
+
+bool RedisObject::operator<(const RedisObjectPtr &r) const {
+    auto cmp = memcmp(ptr, r->ptr, sdslen(ptr));
+    if (cmp < 0) {
+        return true;
+    } else if (cmp == 0) {
+        return memcmp(ptr, r->ptr, sdslen(ptr)) < 0;
+    } else {
+        return false;
+    }
+}
+
+/* Objects are allocated together with their shared_ptr control block
+ * through zmalloc, so that they count in used_memory. */
+template <typename T>
+struct ObjectAllocator {
+    typedef T value_type;
+
+    ObjectAllocator() = default;
+
+    template <typename U>
+    ObjectAllocator(const ObjectAllocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(zmalloc(n * sizeof(T))); }
+
+    void deallocate(T *p, size_t) { zfree(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const ObjectAllocator<T> &, const ObjectAllocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const ObjectAllocator<T> &, const ObjectAllocator<U> &) { return false; }
+
+/* An object followed by the sdshdr8 and bytes of its string, one allocation
+ * of 64, 80 or 96 bytes with the control block. */
+template <size_t N>
+struct EmbeddedObject : public RedisObject {
+    char buf[N];
+};
+
+static_assert(48 - sizeof(struct sdshdr8) - 1 == REDIS_ENCODING_EMBSTR_SIZE_LIMIT,
+              "the largest embedded object holds REDIS_ENCODING_EMBSTR_SIZE_LIMIT bytes");
+
+template <size_t N>
+static RedisObjectPtr createEmbeddedObject(int32_t encoding, const char *ptr, size_t len) {
+    auto o = std::allocate_shared<EmbeddedObject<N>>(ObjectAllocator<EmbeddedObject<N>>());
+    struct sdshdr8 *sh = (struct sdshdr8 *) o->buf;
+    sh->len = len;
+    sh->alloc = N - sizeof(struct sdshdr8) - 1;
+    sh->flags = SDS_TYPE_8;
+    o->ptr = (sds) sh->buf;
+    if (ptr != nullptr) {
+        memcpy(o->ptr, ptr, len);
+    }
+    o->ptr[len] = '\0';
+    o->type = REDIS_STRING;
+    o->encoding = encoding;
+    o->embedded = 1;
+    o->calHash();
+    return o;
+}
+
+RedisObjectPtr createObject(int32_t type, char *ptr) {
+    RedisObjectPtr o = std::allocate_shared<RedisObject>(ObjectAllocator<RedisObject>());
+    o->encoding = REDIS_ENCODING_RAW;
+    o->type = type;
+    o->ptr = ptr;
+    o->calHash();
+    return o;
+}
+
+/* The string can not grow past the room it was created with: a caller that
+ * reuses the object checks sdsalloc() before writing into it. */
+RedisObjectPtr createEmbeddedStringObject(char *ptr, size_t len) {
+    assert(len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT);
+    if (len <= 16 - sizeof(struct sdshdr8) - 1) {
+        return createEmbeddedObject<16>(REDIS_ENCODING_EMBSTR, ptr, len);
+    } else if (len <= 32 - sizeof(struct sdshdr8) - 1) {
+        return createEmbeddedObject<32>(REDIS_ENCODING_EMBSTR, ptr, len);
+    } else {
+        return createEmbeddedObject<48>(REDIS_ENCODING_EMBSTR, ptr, len);
+    }
+}
+
+int32_t getLongLongFromObject(const RedisObjectPtr &o, int64_t *target) {
+    int64_t value;
+    if (o == nullptr) {
+        value = 0;
+    } else {
+        if (sdsEncodedObject(o)) {
+            if (string2ll(o->ptr, sdslen(o->ptr), &value) == 0) {
+                return REDIS_ERR;
+            }
+        } else if (o->encoding == OBJ_ENCODING_INT) {
+            if (string2ll(o->ptr, sdslen(o->ptr), &value) == 0) {
+                return REDIS_ERR;
+            }
+        } else {
+            assert(false);
+        }
+    }
+
+    if (target) {
+        *target = value;
+    }
+    return REDIS_OK;
+}
+
+int32_t getLongLongFromObjectOrReply(Buffer *buffer,
+                                     const RedisObjectPtr &o, int64_t *target, const char *msg) {
+    int64_t value;
+    if (getLongLongFromObject(o, &value) != REDIS_OK) {
+        if (msg != nullptr) {
+            addReplyError(buffer, (char *) msg);
+        } else {
+            addReplyError(buffer, "value is not an integer or out of range");
+        }
+        return REDIS_ERR;
+    }
+
+    *target = value;
+    return REDIS_OK;
+}
+
+int32_t getLongFromObjectOrReply(Buffer *buffer,
+                                 const RedisObjectPtr &o, int32_t *target, const char *msg) {
+    int64_t value;
+    if (getLongLongFromObject(o, &value) != REDIS_OK) {
+        if (msg != nullptr) {
+            addReplyError(buffer, (char *) msg);
+        } else {
+            addReplyError(buffer, "value is not an integer or out of range");
+        }
+        return REDIS_ERR;
+    }
+
+    *target = value;
+    return REDIS_OK;
+}
+
+/* Small values share one object, the others get an integer encoded object
+ * with room for the digits of any value, so that setLongLongObject() can
+ * change it in place. */
+RedisObjectPtr createStringObjectFromLongLong(int64_t value) {
+    if (value >= 0 && value < REDIS_SHARED_INTEGERS) {
+        return shared.integers[value];
+    }
+
+    char buf[LONG_STR_SIZE];
+    int32_t len = ll2string(buf, sizeof(buf), value);
+    return createEmbeddedObject<32>(REDIS_ENCODING_INT, buf, len);
+}
+
+/* Only for an integer encoded object nobody else holds a reference to. */
+void setLongLongObject(const RedisObjectPtr &o, int64_t value) {
+    assert(o->encoding == REDIS_ENCODING_INT && o->embedded);
+    char buf[LONG_STR_SIZE];
+    int32_t len = ll2string(buf, sizeof(buf), value);
+    memcpy(o->ptr, buf, len + 1);
+    sdssetlen(o->ptr, len);
+    o->calHash();
+}
+
+/* A string value that reads as a shared integer is replaced by the shared
+ * object, any other is kept as it is. */
+RedisObjectPtr tryObjectEncoding(const RedisObjectPtr &o) {
+    int64_t value;
+    size_t len = sdslen(o->ptr);
+    if (len <= 4 && string2ll(o->ptr, len, &value) &&
+        value >= 0 && value < REDIS_SHARED_INTEGERS) {
+        return shared.integers[value];
+    }
+    return o;
+}
+
+int32_t getDoubleFromObjectOrReply(Buffer *buffer,
+                                   const RedisObjectPtr &o, double *target, const char *msg) {
+    double value;
+    if (getDoubleFromObject(o, &value) != REDIS_OK) {
+        if (msg != nullptr) {
+            addReplyError(buffer, (char *) msg);
+        } else {
+            addReplyError(buffer, "value is not a valid float");
+        }
+        return REDIS_ERR;
+    }
+
+    *target = value;
+    return REDIS_OK;
+}
+
+int32_t getDoubleFromObject(const RedisObjectPtr &o, double *target) {
+    double value;
+    char *eptr;
+
+    if (o == nullptr) {
+        value = 0;
+    } else {
+        if (sdsEncodedObject(o)) {
+            errno = 0;
+            value = strtod(o->ptr, &eptr);
+            if (isspace(((const char *) o->ptr)[0]) ||
+                eptr[0] != '\0' ||
+                (errno == ERANGE && value == 0) || errno == EINVAL ||
+                std::isnan(value))
+                return REDIS_ERR;
+        } else if (o->encoding == OBJ_ENCODING_INT) {
+            int64_t ll;
+            if (string2ll(o->ptr, sdslen(o->ptr), &ll) == 0) {
+                return REDIS_ERR;
+            }
+            value = ll;
+        } else {
+            assert(false);
+        }
+    }
+
+    *target = value;
+    return REDIS_OK;
+}
+
+void createSharedObjects() {
+    int32_t j;
+    shared.crlf = createObject(REDIS_STRING, sdsnew("\r\n"));
+    shared.ok = createObject(REDIS_STRING, sdsnew("+OK\r\n"));
+    shared.err = createObject(REDIS_STRING, sdsnew("-ERR\r\n"));
+    shared.emptybulk = createObject(REDIS_STRING, sdsnew("$0\r\n\r\n"));
+    shared.czero = createObject(REDIS_STRING, sdsnew(":0\r\n"));
+    shared.cone = createObject(REDIS_STRING, sdsnew(":1\r\n"));
+    shared.cnegone = createObject(REDIS_STRING, sdsnew(":-1\r\n"));
+    shared.nullbulk = createObject(REDIS_STRING, sdsnew("$-1\r\n"));
+    shared.nullmultibulk = createObject(REDIS_STRING, sdsnew("*-1\r\n"));
+    shared.emptymultibulk = createObject(REDIS_STRING, sdsnew("*0\r\n"));
+    shared.pping = createObject(REDIS_STRING, sdsnew("PPING\r\n"));
+    shared.ping = createObject(REDIS_STRING, sdsnew("ping"));
+    shared.pong = createObject(REDIS_STRING, sdsnew("+PONG\r\n"));
+    shared.ppong = createObject(REDIS_STRING, sdsnew("PPONG"));
+    shared.queued = createObject(REDIS_STRING, sdsnew("+queued\r\n"));
+    shared.emptyscan = createObject(REDIS_STRING, sdsnew("*2\r\n$1\r\n0\r\n*0\r\n"));
+
+    shared.wrongtypeerr = createObject(REDIS_STRING, sdsnew(
+            "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n"));
+    shared.nokeyerr = createObject(REDIS_STRING, sdsnew(
+            "-ERR no such key\r\n"));
+    shared.syntaxerr = createObject(REDIS_STRING, sdsnew(
+            "-ERR syntax error\r\n"));
+    shared.sameobjecterr = createObject(REDIS_STRING, sdsnew(
+            "-ERR source and destination objects are the same\r\n"));
+    shared.outofrangeerr = createObject(REDIS_STRING, sdsnew(
+            "-ERR index out of range\r\n"));
+    shared.noscripterr = createObject(REDIS_STRING, sdsnew(
+            "-NOSCRIPT No matching script. Please use EVAL.\r\n"));
+    shared.loadingerr = createObject(REDIS_STRING, sdsnew(
+            "-LOADING Redis is loading the dataset in memory\r\n"));
+    shared.slowscripterr = createObject(REDIS_STRING, sdsnew(
+            "-BUSY Redis is busy running a script. You can only call SCRIPT KILL or SHUTDOWN NOSAVE.\r\n"));
+    shared.masterdownerr = createObject(REDIS_STRING, sdsnew(
+            "-MASTERDOWN Link with MASTER is down and slave-serve-stale-data is set to 'no'.\r\n"));
+    shared.bgsaveerr = createObject(REDIS_STRING, sdsnew(
+            "-MISCONF Redis is configured to save RDB snapshots, but is currently no able to persist on disk. Commands that may modify the data set are disabled. Please check Redis logs for details about the error.\r\n"));
+    shared.roslaveerr = createObject(REDIS_STRING, sdsnew(
+            "-READONLY You can't write against a read only slave.\r\n"));
+    shared.noautherr = createObject(REDIS_STRING, sdsnew(
+            "-NOAUTH Authentication required.\r\n"));
+    shared.oomerr = createObject(REDIS_STRING, sdsnew(
+            "-OOM command no allowed when used memory > 'maxmemory'.\r\n"));
+    shared.execaborterr = createObject(REDIS_STRING, sdsnew(
+            "-EXECABORT Transaction discarded because of previous errors.\r\n"));
+    shared.noreplicaserr = createObject(REDIS_STRING, sdsnew(
+            "-NOREPLICAS Not enough good slaves to write.\r\n"));
+    shared.busykeyerr = createObject(REDIS_STRING, sdsnew(
+            "-BUSYKEY Target key name already exists.\r\n"));
+
+    shared.space = createObject(REDIS_STRING, sdsnew(" "));
+    shared.colon = createObject(REDIS_STRING, sdsnew(":"));
+    shared.plus = createObject(REDIS_STRING, sdsnew("+"));
+    shared.asking = createObject(REDIS_STRING, sdsnew("asking"));
+
+    shared.messagebulk = createObject(REDIS_STRING, sdsnew("$7\r\nmessage\r\n"));
+    shared.pmessagebulk = createObject(REDIS_STRING, sdsnew("$8\r\npmessage\r\n"));
+    shared.subscribebulk = createObject(REDIS_STRING, sdsnew("$9\r\nsubscribe\r\n"));
+    shared.unsubscribebulk = createObject(REDIS_STRING, sdsnew("$11\r\nunsubscribe\r\n"));
+
+    shared.psubscribebulk = createObject(REDIS_STRING, sdsnew("$10\r\npsubscribe\r\n"));
+    shared.punsubscribebulk = createObject(REDIS_STRING, sdsnew("$12\r\npunsubscribe\r\n"));
+
+    shared.del = createObject(REDIS_STRING, sdsnew("del"));
+    shared.rpop = createObject(REDIS_STRING, sdsnew("rpop"));
+    shared.lpop = createObject(REDIS_STRING, sdsnew("lpop"));
+    shared.lpush = createObject(REDIS_STRING, sdsnew("lpush"));
+    shared.rpush = createObject(REDIS_STRING, sdsnew("rpush"));
+    shared.set = createObject(REDIS_STRING, sdsnew("set"));
+    shared.get = createObject(REDIS_STRING, sdsnew("get"));
+    shared.flushdb = createObject(REDIS_STRING, sdsnew("flushdb"));
+    shared.dbsize = createObject(REDIS_STRING, sdsnew("dbsize"));
+    shared.hset = createObject(REDIS_STRING, sdsnew("hset"));
+    shared.hget = createObject(REDIS_STRING, sdsnew("hget"));
+    shared.hgetall = createObject(REDIS_STRING, sdsnew("hgetall"));
+    shared.save = createObject(REDIS_STRING, sdsnew("save"));
+    shared.slaveof = createObject(REDIS_STRING, sdsnew("slaveof"));
+    shared.command = createObject(REDIS_STRING, sdsnew("command"));
+    shared.config = createObject(REDIS_STRING, sdsnew("config"));
+    shared.auth = createObject(REDIS_STRING, sdsnew("auth"));
+    shared.info = createObject(REDIS_STRING, sdsnew("info"));
+    shared.echo = createObject(REDIS_STRING, sdsnew("echo"));
+    shared.client = createObject(REDIS_STRING, sdsnew("client"));
+    shared.hkeys = createObject(REDIS_STRING, sdsnew("hkeys"));
+    shared.hlen = createObject(REDIS_STRING, sdsnew("hlen"));
+    shared.keys = createObject(REDIS_STRING, sdsnew("keys"));
+    shared.bgsave = createObject(REDIS_STRING, sdsnew("bgsave"));
+    shared.bgrewriteaof = createObject(REDIS_STRING, sdsnew("bgrewriteaof"));
+    shared.memory = createObject(REDIS_STRING, sdsnew("memory"));
+    shared.cluster = createObject(REDIS_STRING, sdsnew("cluster"));
+    shared.migrate = createObject(REDIS_STRING, sdsnew("migrate"));
+    shared.debug = createObject(REDIS_STRING, sdsnew("debug"));
+    shared.ttl = createObject(REDIS_STRING, sdsnew("ttl"));
+    shared.pttl = createObject(REDIS_STRING, sdsnew("pttl"));
+    shared.exists = createObject(REDIS_STRING, sdsnew("exists"));
+    shared.lrange = createObject(REDIS_STRING, sdsnew("lrange"));
+    shared.llen = createObject(REDIS_STRING, sdsnew("llen"));
+    shared.sadd = createObject(REDIS_STRING, sdsnew("sadd"));
+    shared.scard = createObject(REDIS_STRING, sdsnew("scard"));
+    shared.addsync = createObject(REDIS_STRING, sdsnew("addsync"));
+    shared.setslot = createObject(REDIS_STRING, sdsnew("setslot"));
+    shared.node = createObject(REDIS_STRING, sdsnew("node"));
+    shared.clusterconnect = createObject(REDIS_STRING, sdsnew("clusterconnect"));
+    shared.sync = createObject(REDIS_STRING, sdsnew("sync"));
+    shared.psync = createObject(REDIS_STRING, sdsnew("psync"));
+    shared.delsync = createObject(REDIS_STRING, sdsnew("delsync"));
+    shared.zadd = createObject(REDIS_STRING, sdsnew("zadd"));
+    shared.zrange = createObject(REDIS_STRING, sdsnew("zrange"));
+    shared.zrevrange = createObject(REDIS_STRING, sdsnew("zrevrange"));
+    shared.zcard = createObject(REDIS_STRING, sdsnew("zcard"));
+    shared.zrank = createObject(REDIS_STRING, sdsnew("zrank"));
+    shared.zrevrank = createObject(REDIS_STRING, sdsnew("zrevrank"));
+    shared.zrangebyscore = createObject(REDIS_STRING, sdsnew("zrangebyscore"));
+    shared.zscore = createObject(REDIS_STRING, sdsnew("zscore"));
+    shared.zrem = createObject(REDIS_STRING, sdsnew("zrem"));
+    shared.dump = createObject(REDIS_STRING, sdsnew("dump"));
+    shared.restore = createObject(REDIS_STRING, sdsnew("restore"));
+    shared.restoreasking = createObject(REDIS_STRING, sdsnew("restore-asking"));
+    shared.incr = createObject(REDIS_STRING, sdsnew("incr"));
+    shared.decr = createObject(REDIS_STRING, sdsnew("decr"));
+    shared.monitor = createObject(REDIS_STRING, sdsnew("monitor"));
+    shared.mget = createObject(REDIS_STRING, sdsnew("mget"));
+    shared.mset = createObject(REDIS_STRING, sdsnew("mset"));
+    shared.subscribe = createObject(REDIS_STRING, sdsnew("subscribe"));
+    shared.select = createObject(REDIS_STRING, sdsnew("select"));
+    shared.unsubscribe = createObject(REDIS_STRING, sdsnew("unsubscribe"));
+    shared.psubscribe = createObject(REDIS_STRING, sdsnew("psubscribe"));
+    shared.punsubscribe = createObject(REDIS_STRING, sdsnew("punsubscribe"));
+    shared.publish = createObject(REDIS_STRING, sdsnew("publish"));
+    shared.rename = createObject(REDIS_STRING, sdsnew("rename"));
+    shared.move = createObject(REDIS_STRING, sdsnew("move"));
+    shared.object = createObject(REDIS_STRING, sdsnew("object"));
+    shared.scan = createObject(REDIS_STRING, sdsnew("scan"));
+    shared.hscan = createObject(REDIS_STRING, sdsnew("hscan"));
+    shared.sscan = createObject(REDIS_STRING, sdsnew("sscan"));
+    shared.zscan = createObject(REDIS_STRING, sdsnew("zscan"));
+    shared.randomkey = createObject(REDIS_STRING, sdsnew("randomkey"));
+    shared.renamenx = createObject(REDIS_STRING, sdsnew("renamenx"));
+    shared.bitop = createObject(REDIS_STRING, sdsnew("bitop"));
+    shared.brpoplpush = createObject(REDIS_STRING, sdsnew("brpoplpush"));
+    shared.rpoplpush = createObject(REDIS_STRING, sdsnew("rpoplpush"));
+    shared.sinterstore = createObject(REDIS_STRING, sdsnew("sinterstore"));
+    shared.sdiffstore = createObject(REDIS_STRING, sdsnew("sdiffstore"));
+    shared.sinter = createObject(REDIS_STRING, sdsnew("sinter"));
+    shared.smove = createObject(REDIS_STRING, sdsnew("smove"));
+    shared.sunionstore = createObject(REDIS_STRING, sdsnew("sunionstore"));
+    shared.smove = createObject(REDIS_STRING, sdsnew("smove"));
+    shared.zinterstore = createObject(REDIS_STRING, sdsnew("zinterstore"));
+    shared.zunionstore = createObject(REDIS_STRING, sdsnew("zunionstore"));
+    shared.pubsub = createObject(REDIS_STRING, sdsnew("pubsub"));
+    shared.eval = createObject(REDIS_STRING, sdsnew("eval"));
+
+    for (j = 0; j < REDIS_SHARED_INTEGERS; j++) {
+        char buf[LONG_STR_SIZE];
+        int32_t len = ll2string(buf, sizeof(buf), j);
+        shared.integers[j] = createEmbeddedObject<16>(REDIS_ENCODING_INT, buf, len);
+    }
+
+    for (j = 0; j < REDIS_SHARED_BULKHDR_LEN; j++) {
+        shared.mbulkhdr[j] = createObject(REDIS_STRING, sdscatprintf(sdsempty(), "*%d\r\n", j));
+        shared.bulkhdr[j] = createObject(REDIS_STRING, sdscatprintf(sdsempty(), "$%d\r\n", j));
+    }
+}
+
+RedisObjectPtr createStringObject(char *ptr, size_t len) {
+    if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT) {
+        return createEmbeddedStringObject(ptr, len);
+    } else {
+        return createRawStringObject(ptr, len);
+    }
+}
+
+RedisObjectPtr createRawStringObject(int32_t type, char *ptr, size_t len) {
+    return createObject(type, sdsnewlen(ptr, len));
+}
+
+RedisObjectPtr createRawStringObject(char *ptr, size_t len) {
+    return createObject(REDIS_STRING, sdsnewlen(ptr, len));
+}
+
+void addReplyBulkLen(Buffer *buffer, const RedisObjectPtr &obj) {
+    /* Integer encoded objects keep their digits in ptr as well. */
+    size_t len = sdslen(obj->ptr);
+
+    if (len < REDIS_SHARED_BULKHDR_LEN) {
+        addReply(buffer, shared.bulkhdr[len]);
+    } else {
+        addReplyLongLongWithPrefix(buffer, len, '$');
+    }
+}
+
+void addReplyBulk(Buffer *buffer, const RedisObjectPtr &obj) {
+    addReplyBulkLen(buffer, obj);
+    addReply(buffer, obj);
+    addReply(buffer, shared.crlf);
+}
+
+void addReplyLongLongWithPrefix(Buffer *buffer, int64_t ll, char prefix) {
+    char buf[128];
+    int32_t len;
+    if (prefix == '*' && ll < REDIS_SHARED_BULKHDR_LEN) {
+        addReply(buffer, shared.mbulkhdr[ll]);
+        return;
+    } else if (prefix == '$' && ll < REDIS_SHARED_BULKHDR_LEN) {
+        addReply(buffer, shared.bulkhdr[ll]);
+        return;
+    }
+
+    buf[0] = prefix;
+    len = ll2string(buf + 1, sizeof(buf) - 1, ll);
+    buf[len + 1] = '\r';
+    buf[len + 2] = '\n';
+    buffer->append(buf, len + 3);
+}
+
+void addReplyLongLong(Buffer *buffer, size_t len) {
+    if (len == 0) {
+        addReply(buffer, shared.czero);
+    } else if (len == 1) {
+        addReply(buffer, shared.cone);
+    } else {
+        addReplyLongLongWithPrefix(buffer, len, ':');
+    }
+}
+
+void addReplyStatusLength(Buffer *buffer, const char *s, size_t len) {
+    addReplyString(buffer, "+", 1);
+    addReplyString(buffer, s, len);
+    addReplyString(buffer, "\r\n", 2);
+}
+
+void addReplyStatus(Buffer *buffer, const char *status) {
+    addReplyStatusLength(buffer, status, strlen(status));
+}
+
+void addReplyError(Buffer *buffer, const char *str) {
+    addReplyErrorLength(buffer, str, strlen(str));
+}
+
+void addReply(Buffer *buffer, const RedisObjectPtr &obj) {
+    buffer->append(obj->ptr, sdslen(obj->ptr));
+}
+
+/* Add sds to reply (takes ownership of sds and frees it) */
+void addReplyBulkSds(Buffer *buffer, sds s) {
+    addReplySds(buffer, sdscatfmt(sdsempty(), "$%u\r\n", (unsigned long) sdslen(s)));
+    addReplySds(buffer, s);
+    addReply(buffer, shared.crlf);
+}
+
+void addReplyMultiBulkLen(Buffer *buffer, int32_t length) {
+    if (length < REDIS_SHARED_BULKHDR_LEN) {
+        addReply(buffer, shared.mbulkhdr[length]);
+    } else {
+        addReplyLongLongWithPrefix(buffer, length, '*');
+    }
+}
+
+void prePendReplyLongLongWithPrefix(Buffer *buffer, int32_t length) {
+    char buf[128];
+    buf[0] = '*';
+    int32_t len = ll2string(buf + 1, sizeof(buf) - 1, length);
+    buf[len + 1] = '\r';
+    buf[len + 2] = '\n';
+    if (length == 0) {
+        buffer->append(buf, len + 3);
+    } else {
+        buffer->prepend(buf, len + 3);
+    }
+}
+
+void addReplyBulkCString(Buffer *buffer, const char *s) {
+    if (s == nullptr) {
+        addReply(buffer, shared.nullbulk);
+    } else {
+        addReplyBulkCBuffer(buffer, s, strlen(s));
+    }
+}
+
+void addReplyDouble(Buffer *buffer, double d) {
+    char dbuf[128], sbuf[128];
+    int32_t dlen, slen;
+    dlen = snprintf(dbuf, sizeof(dbuf), "%.17g", d);
+    slen = snprintf(sbuf, sizeof(sbuf), "$%d\r\n%s\r\n", dlen, dbuf);
+    addReplyString(buffer, sbuf, slen);
+}
+
+void addReplyBulkCBuffer(Buffer *buffer, const char *p, size_t len) {
+    addReplyLongLongWithPrefix(buffer, len, '$');
+    addReplyString(buffer, p, len);
+    addReply(buffer, shared.crlf);
+}
+
+void addReplyErrorFormat(Buffer *buffer, const char *fmt, ...) {
+    size_t l, j;
+    va_list ap;
+    va_start(ap, fmt);
+    sds s = sdscatvprintf(sdsempty(), fmt, ap);
+    va_end(ap);
+    l = sdslen(s);
+
+    for (j = 0; j < l; j++) {
+        if (s[j] == '\r' || s[j] == '\n') s[j] = ' ';
+    }
+
+    addReplyErrorLength(buffer, s, sdslen(s));
+    sdsfree(s);
+}
+
+void addReplyString(Buffer *buffer, const char *s, size_t len) {
+    buffer->append(s, len);
+}
+
+void addReplySds(Buffer *buffer, sds s) {
+    buffer->append(s, sdslen(s));
+    sdsfree(s);
+}
+
+void addReplyErrorLength(Buffer *buffer, const char *s, size_t len) {
+    addReplyString(buffer, "-ERR ", 5);
+    addReplyString(buffer, s, len);
+    addReplyString(buffer, "\r\n", 2);
+}
+
+
+
+
+
+
+
+
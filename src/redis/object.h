@@ -16,10 +16,18 @@ public:
 
     void calHash();
 
+    /* Cluster slot of the object as a key, computed on the first call. */
+    uint32_t getHashSlot();
+
     bool operator<(const RedisObjectPtr &r) const;
 
     unsigned type : 4;
     unsigned encoding : 4;
+    unsigned lru : REDIS_LRU_BITS;   /* Of a key: LRU clock of its last access, or
+                                      * LFU minutes (16 bits) and counter (8 bits). */
+    unsigned embedded : 1;  /* ptr lives in the object's own allocation. */
+    unsigned hashSlot : 14;
+    unsigned hashSlotCached : 1;
     size_t hash;
     sds ptr;
 };
@@ -48,12 +56,12 @@ struct SharedObjectsStruct {
             unsubscribebulk, psubscribebulk, punsubscribebulk, del, rpop, lpop,
             lpush, rpush, emptyscan, minstring, maxstring, sync, psync, set, get, flushdb,
             dbsize, asking, hset, hget, hgetall, save, slaveof, command, config, auth,
-            info, echo, client, hkeys, hlen, keys, bgsave, memory, cluster, migrate, debug,
-            ttl, lrange, llen, sadd, scard, addsync, setslot, node, clusterconnect, delsync,
-            zadd, zrange, zrevrange, zcard, dump, restore, incr, decr, monitor, mget, mset, subscribe,
-            unsubscribe, select, publish, rename, move, object, scan, hscan, randomkey, renamenx, bitop,
+            info, echo, client, hkeys, hlen, keys, bgsave, bgrewriteaof, memory, cluster, migrate, debug,
+            ttl, pttl, exists, lrange, llen, sadd, scard, addsync, setslot, node, clusterconnect, delsync,
+            zadd, zrange, zrevrange, zcard, dump, restore, restoreasking, incr, decr, monitor, mget, mset, subscribe,
+            unsubscribe, psubscribe, punsubscribe, select, publish, rename, move, object, scan, hscan, randomkey, renamenx, bitop,
             brpoplpush, rpoplpush, sinterstore, sdiffstore, sinter, smove, sunionstore, zinterstore, zunionstore,
-            pubsub, eval,
+            pubsub, eval, zrank, zrevrank, zrangebyscore, zscore, zrem, sscan, zscan,
             integers[REDIS_SHARED_INTEGERS],
             mbulkhdr[REDIS_SHARED_BULKHDR_LEN],
             bulkhdr[REDIS_SHARED_BULKHDR_LEN];
@@ -61,6 +69,21 @@ struct SharedObjectsStruct {
 
 extern struct SharedObjectsStruct shared;
 
+/* Clocks of the eviction policies, refreshed by the server cron: lruClock
+ * in seconds, lfuClock in minutes. objectLruInit is the lru of objects
+ * created now, depending on the policy either of both. */
+extern std::atomic <uint32_t> lruClock;
+extern std::atomic <uint32_t> lfuClock;
+extern std::atomic <uint32_t> objectLruInit;
+
+void updateObjectClocks(bool lfu);
+
+uint64_t estimateObjectIdleTime(const RedisObjectPtr &o);
+
+uint32_t LFUDecrAndReturn(const RedisObjectPtr &o);
+
+uint8_t LFULogIncr(uint8_t counter);
+
 void createSharedObjects();
 
 RedisObjectPtr createRawStringObject(char *ptr, size_t len);
@@ -69,10 +92,16 @@ RedisObjectPtr createRawStringObject(int32_t type, char *ptr, size_t len);
 
 RedisObjectPtr createObject(int32_t type, char *ptr);
 
+RedisObjectPtr createEmbeddedStringObject(char *ptr, size_t len);
+
 RedisObjectPtr createStringObject(char *ptr, size_t len);
 
 RedisObjectPtr createStringObjectFromLongLong(int64_t value);
 
+void setLongLongObject(const RedisObjectPtr &o, int64_t value);
+
+RedisObjectPtr tryObjectEncoding(const RedisObjectPtr &o);
+
 /* -----------------------------------------------------------------------------
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
@@ -0,0 +1,423 @@
+#include "pubsub.h"
+#include "eventloop.h"
+#include "util.h"
+
+/* A token is "*", "?", a class starting with '[' or '=' and the literal. */
+std::vector <std::string> PatternTrie::tokenize(const char *pattern, size_t len) {
+    std::vector <std::string> tokens;
+    for (size_t i = 0; i < len; i++) {
+        if (pattern[i] == '*') {
+            /* Consecutive stars match the same as one. */
+            if (tokens.empty() || tokens.back() != "*") {
+                tokens.push_back("*");
+            }
+        } else if (pattern[i] == '?') {
+            tokens.push_back("?");
+        } else if (pattern[i] == '[') {
+            /* Up to the closing bracket, or the end like stringmatchlen(). */
+            size_t j = i + 1;
+            if (j < len && pattern[j] == '^') {
+                j++;
+            }
+
+            while (j < len && pattern[j] != ']') {
+                if (pattern[j] == '\\' && j + 1 < len) {
+                    j++;
+                }
+                j++;
+            }
+
+            j = std::min(j, len - 1);
+            tokens.push_back(std::string(pattern + i, j - i + 1));
+            i = j;
+        } else if (pattern[i] == '\\' && i + 1 < len) {
+            tokens.push_back(std::string("=") + pattern[++i]);
+        } else {
+            tokens.push_back(std::string("=") + pattern[i]);
+        }
+    }
+    return tokens;
+}
+
+PatternTrie::PatternTrie() {
+
+}
+
+PatternTrie::~PatternTrie() {
+
+}
+
+std::unique_ptr <PatternTrie::Node> &PatternTrie::child(Node *node, const std::string &token) {
+    if (token == "*") {
+        return node->star;
+    } else if (token == "?") {
+        return node->any;
+    } else if (token[0] == '=') {
+        return node->literals[token[1]];
+    }
+
+    for (auto &it : node->classes) {
+        if (it.first == token) {
+            return it.second;
+        }
+    }
+
+    node->classes.emplace_back(token, nullptr);
+    return node->classes.back().second;
+}
+
+void PatternTrie::add(const RedisObjectPtr &pattern) {
+    Node *node = &root;
+    for (auto &token : tokenize(pattern->ptr, sdslen(pattern->ptr))) {
+        std::unique_ptr <Node> &next = child(node, token);
+        if (next == nullptr) {
+            next.reset(new Node());
+        }
+        node = next.get();
+    }
+    node->patterns.push_back(pattern);
+}
+
+void PatternTrie::remove(const RedisObjectPtr &pattern) {
+    remove(&root, tokenize(pattern->ptr, sdslen(pattern->ptr)), 0, pattern);
+}
+
+/* Returns true if the node is left empty, its parent then drops it. */
+bool PatternTrie::remove(Node *node, const std::vector <std::string> &tokens, size_t i,
+                         const RedisObjectPtr &pattern) {
+    if (i == tokens.size()) {
+        auto &patterns = node->patterns;
+        auto it = std::find_if(patterns.begin(), patterns.end(),
+                               [&pattern](const RedisObjectPtr &o) { return Equal()(o, pattern); });
+        if (it != patterns.end()) {
+            patterns.erase(it);
+        }
+        return node->empty();
+    }
+
+    const std::string &token = tokens[i];
+    std::unique_ptr <Node> &next = child(node, token);
+    if (next != nullptr && remove(next.get(), tokens, i + 1, pattern)) {
+        next.reset();
+    }
+
+    /* child() may have added the slot it was asked for, drop it again. */
+    if (token[0] == '=') {
+        auto it = node->literals.find(token[1]);
+        if (it != node->literals.end() && it->second == nullptr) {
+            node->literals.erase(it);
+        }
+    } else if (token[0] == '[') {
+        node->classes.erase(std::remove_if(node->classes.begin(), node->classes.end(),
+                                           [](const std::pair<std::string, std::unique_ptr<Node>> &it) {
+                                               return it.second == nullptr;
+                                           }), node->classes.end());
+    }
+    return node->empty();
+}
+
+void PatternTrie::match(const char *channel, size_t len, std::vector <RedisObjectPtr> &patterns) const {
+    if (root.empty()) {
+        return;
+    }
+
+    Visited visited;
+    match(&root, channel, len, 0, visited, patterns);
+}
+
+void PatternTrie::match(const Node *node, const char *channel, size_t len, size_t pos,
+                        Visited &visited, std::vector <RedisObjectPtr> &patterns) const {
+    if (!visited.insert(std::make_pair(node, pos)).second) {
+        return;
+    }
+
+    if (pos == len) {
+        patterns.insert(patterns.end(), node->patterns.begin(), node->patterns.end());
+        if (node->star != nullptr) {
+            match(node->star.get(), channel, len, pos, visited, patterns);
+        }
+        return;
+    }
+
+    auto it = node->literals.find(channel[pos]);
+    if (it != node->literals.end()) {
+        match(it->second.get(), channel, len, pos + 1, visited, patterns);
+    }
+
+    if (node->any != nullptr) {
+        match(node->any.get(), channel, len, pos + 1, visited, patterns);
+    }
+
+    for (auto &iter : node->classes) {
+        if (stringmatchlen(iter.first.data(), iter.first.size(), channel + pos, 1, 0)) {
+            match(iter.second.get(), channel, len, pos + 1, visited, patterns);
+        }
+    }
+
+    if (node->star != nullptr) {
+        for (size_t i = pos; i <= len; i++) {
+            match(node->star.get(), channel, len, i, visited, patterns);
+        }
+    }
+}
+
+PubSub::PubSub() {
+
+}
+
+PubSub::~PubSub() {
+
+}
+
+bool PubSub::addSubscriber(SubscriberMap &map, const TcpConnectionPtr &conn, const RedisObjectPtr &name) {
+    auto &subscribers = map[name][conn->getLoop()];
+    return subscribers.emplace(conn->getSockfd(), conn).second;
+}
+
+bool PubSub::removeSubscriber(SubscriberMap &map, int32_t sockfd, const RedisObjectPtr &name) {
+    auto it = map.find(name);
+    if (it == map.end()) {
+        return false;
+    }
+
+    for (auto iter = it->second.begin(); iter != it->second.end(); ++iter) {
+        if (iter->second.erase(sockfd) > 0) {
+            if (iter->second.empty()) {
+                it->second.erase(iter);
+            }
+
+            if (it->second.empty()) {
+                map.erase(it);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t PubSub::subscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &channel) {
+    std::unique_lock <std::mutex> lck(mtx);
+    ClientState &client = clients[conn->getSockfd()];
+    if (client.channels.insert(channel).second) {
+        addSubscriber(channels, conn, channel);
+    }
+    return client.channels.size() + client.patterns.size();
+}
+
+int32_t PubSub::unsubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &channel) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = clients.find(conn->getSockfd());
+    if (it == clients.end()) {
+        return 0;
+    }
+
+    if (it->second.channels.erase(channel) > 0) {
+        removeSubscriber(channels, conn->getSockfd(), channel);
+    }
+
+    int32_t count = it->second.channels.size() + it->second.patterns.size();
+    if (count == 0) {
+        clients.erase(it);
+    }
+    return count;
+}
+
+int32_t PubSub::psubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &pattern) {
+    std::unique_lock <std::mutex> lck(mtx);
+    ClientState &client = clients[conn->getSockfd()];
+    if (client.patterns.insert(pattern).second) {
+        if (patterns.find(pattern) == patterns.end()) {
+            trie.add(pattern);
+        }
+        addSubscriber(patterns, conn, pattern);
+    }
+    return client.channels.size() + client.patterns.size();
+}
+
+int32_t PubSub::punsubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &pattern) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = clients.find(conn->getSockfd());
+    if (it == clients.end()) {
+        return 0;
+    }
+
+    if (it->second.patterns.erase(pattern) > 0) {
+        removeSubscriber(patterns, conn->getSockfd(), pattern);
+        if (patterns.find(pattern) == patterns.end()) {
+            trie.remove(pattern);
+        }
+    }
+
+    int32_t count = it->second.channels.size() + it->second.patterns.size();
+    if (count == 0) {
+        clients.erase(it);
+    }
+    return count;
+}
+
+int32_t PubSub::countSubscriptions(int32_t sockfd) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = clients.find(sockfd);
+    if (it == clients.end()) {
+        return 0;
+    }
+    return it->second.channels.size() + it->second.patterns.size();
+}
+
+void PubSub::getSubscriptions(int32_t sockfd, std::vector <RedisObjectPtr> *channels,
+                              std::vector <RedisObjectPtr> *patterns) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = clients.find(sockfd);
+    if (it == clients.end()) {
+        return;
+    }
+
+    if (channels != nullptr) {
+        channels->assign(it->second.channels.begin(), it->second.channels.end());
+    }
+
+    if (patterns != nullptr) {
+        patterns->assign(it->second.patterns.begin(), it->second.patterns.end());
+    }
+}
+
+void PubSub::removeClient(int32_t sockfd) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = clients.find(sockfd);
+    if (it == clients.end()) {
+        return;
+    }
+
+    for (auto &channel : it->second.channels) {
+        removeSubscriber(channels, sockfd, channel);
+    }
+
+    for (auto &pattern : it->second.patterns) {
+        removeSubscriber(patterns, sockfd, pattern);
+        if (patterns.find(pattern) == patterns.end()) {
+            trie.remove(pattern);
+        }
+    }
+    clients.erase(it);
+}
+
+PubSub::MessagePtr PubSub::createMessage(const RedisObjectPtr &pattern, const RedisObjectPtr &channel,
+                                         const RedisObjectPtr &message) {
+    auto catBulk = [](std::string *s, const RedisObjectPtr &o) {
+        char buf[32];
+        int32_t len = snprintf(buf, sizeof(buf), "$%zu\r\n", sdslen(o->ptr));
+        s->append(buf, len);
+        s->append(o->ptr, sdslen(o->ptr));
+        s->append("\r\n", 2);
+    };
+
+    std::shared_ptr <std::string> s(new std::string());
+    s->reserve(64 + sdslen(channel->ptr) + sdslen(message->ptr) +
+               (pattern != nullptr ? sdslen(pattern->ptr) : 0));
+    if (pattern == nullptr) {
+        s->append(shared.mbulkhdr[3]->ptr, sdslen(shared.mbulkhdr[3]->ptr));
+        s->append(shared.messagebulk->ptr, sdslen(shared.messagebulk->ptr));
+    } else {
+        s->append(shared.mbulkhdr[4]->ptr, sdslen(shared.mbulkhdr[4]->ptr));
+        s->append(shared.pmessagebulk->ptr, sdslen(shared.pmessagebulk->ptr));
+        catBulk(s.get(), pattern);
+    }
+
+    catBulk(s.get(), channel);
+    catBulk(s.get(), message);
+    return s;
+}
+
+int32_t PubSub::addDeliveries(std::vector <Delivery> &deliveries, const Subscribers &subscribers,
+                              const MessagePtr &message) {
+    int32_t receivers = 0;
+    for (auto &it : subscribers) {
+        auto delivery = std::find_if(deliveries.begin(), deliveries.end(),
+                                     [&it](const Delivery &d) { return d.loop == it.first; });
+        if (delivery == deliveries.end()) {
+            deliveries.push_back(Delivery{it.first, MessageList()});
+            delivery = deliveries.end() - 1;
+        }
+
+        for (auto &iter : it.second) {
+            delivery->messages.emplace_back(iter.second, message);
+        }
+        receivers += it.second.size();
+    }
+    return receivers;
+}
+
+int32_t PubSub::publish(const RedisObjectPtr &channel, const RedisObjectPtr &message) {
+    std::vector <Delivery> deliveries;
+    int32_t receivers = 0;
+    {
+        std::unique_lock <std::mutex> lck(mtx);
+        auto it = channels.find(channel);
+        if (it != channels.end()) {
+            receivers += addDeliveries(deliveries, it->second, createMessage(nullptr, channel, message));
+        }
+
+        std::vector <RedisObjectPtr> matched;
+        trie.match(channel->ptr, sdslen(channel->ptr), matched);
+        for (auto &pattern : matched) {
+            auto iter = patterns.find(pattern);
+            assert(iter != patterns.end());
+            receivers += addDeliveries(deliveries, iter->second, createMessage(pattern, channel, message));
+        }
+    }
+
+    /* Queued even on the loop of the publisher, so the message is not
+     * written into the middle of the reply that loop is producing. */
+    for (auto &it : deliveries) {
+        it.loop->queueInLoop(std::bind(&PubSub::deliver, std::move(it.messages)));
+    }
+    return receivers;
+}
+
+void PubSub::deliver(const MessageList &messages) {
+    for (auto &it : messages) {
+        const TcpConnectionPtr &conn = it.first;
+        if (!conn->connected()) {
+            continue;
+        }
+
+        const std::string &message = *it.second;
+        if (message.size() < REDIS_REPLY_REFERENCE_MIN_BYTES ||
+            !conn->appendReference(it.second, message.data(), message.size())) {
+            conn->outputBuffer()->append(message.data(), message.size());
+        }
+    }
+
+    for (auto &it : messages) {
+        it.first->flushOutput();
+    }
+}
+
+void PubSub::getChannels(const RedisObjectPtr &pattern, std::vector <RedisObjectPtr> &channels) {
+    std::unique_lock <std::mutex> lck(mtx);
+    for (auto &it : this->channels) {
+        if (pattern == nullptr || stringmatchlen(pattern->ptr, sdslen(pattern->ptr),
+                                                 it.first->ptr, sdslen(it.first->ptr), 0)) {
+            channels.push_back(it.first);
+        }
+    }
+}
+
+size_t PubSub::countSubscribers(const RedisObjectPtr &channel) {
+    std::unique_lock <std::mutex> lck(mtx);
+    auto it = channels.find(channel);
+    if (it == channels.end()) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (auto &iter : it->second) {
+        count += iter.second.size();
+    }
+    return count;
+}
+
+size_t PubSub::countPatterns() {
+    std::unique_lock <std::mutex> lck(mtx);
+    return patterns.size();
+}
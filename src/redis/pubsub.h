@@ -0,0 +1,136 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+#include "tcpconnection.h"
+
+class EventLoop;
+
+/* Glob patterns of PSUBSCRIBE by their tokens: a literal character, '?',
+ * '*' or a whole [...] class. Patterns sharing a prefix share the nodes of
+ * it, a channel is matched against all patterns in one walk that never
+ * visits a node twice at the same position of the channel. */
+class PatternTrie {
+public:
+    PatternTrie();
+
+    ~PatternTrie();
+
+    void add(const RedisObjectPtr &pattern);
+
+    void remove(const RedisObjectPtr &pattern);
+
+    /* Appends every pattern matching the channel once. */
+    void match(const char *channel, size_t len, std::vector <RedisObjectPtr> &patterns) const;
+
+private:
+    PatternTrie(const PatternTrie &);
+
+    void operator=(const PatternTrie &);
+
+    struct Node {
+        std::unordered_map<char, std::unique_ptr<Node>> literals;
+        std::vector <std::pair<std::string, std::unique_ptr<Node>>> classes;
+        std::unique_ptr <Node> any;
+        std::unique_ptr <Node> star;
+        std::vector <RedisObjectPtr> patterns;   /* Patterns ending here. */
+
+        bool empty() const {
+            return literals.empty() && classes.empty() && any == nullptr &&
+                   star == nullptr && patterns.empty();
+        }
+    };
+
+    typedef std::set <std::pair<const Node *, size_t>> Visited;
+
+    static std::vector <std::string> tokenize(const char *pattern, size_t len);
+
+    static std::unique_ptr <Node> &child(Node *node, const std::string &token);
+
+    bool remove(Node *node, const std::vector <std::string> &tokens, size_t i,
+                const RedisObjectPtr &pattern);
+
+    void match(const Node *node, const char *channel, size_t len, size_t pos,
+               Visited &visited, std::vector <RedisObjectPtr> &patterns) const;
+
+    Node root;
+};
+
+/* Channels and patterns with their subscribers. The subscribers of each are
+ * kept by the loop of their connection: a message is serialized once and
+ * every loop with subscribers gets one functor queued that writes it to all
+ * of them. A reverse index from the connection to its channels and patterns
+ * lets a disconnect remove only what the connection subscribed to. */
+class PubSub {
+public:
+    PubSub();
+
+    ~PubSub();
+
+    /* These return the number of channels and patterns the connection is
+     * subscribed to afterwards. */
+    int32_t subscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &channel);
+
+    int32_t unsubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &channel);
+
+    int32_t psubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &pattern);
+
+    int32_t punsubscribe(const TcpConnectionPtr &conn, const RedisObjectPtr &pattern);
+
+    int32_t countSubscriptions(int32_t sockfd);
+
+    void getSubscriptions(int32_t sockfd, std::vector <RedisObjectPtr> *channels,
+                          std::vector <RedisObjectPtr> *patterns);
+
+    void removeClient(int32_t sockfd);
+
+    /* Returns the number of connections the message is sent to. */
+    int32_t publish(const RedisObjectPtr &channel, const RedisObjectPtr &message);
+
+    /* Channels with subscribers matching the pattern, all if it is null. */
+    void getChannels(const RedisObjectPtr &pattern, std::vector <RedisObjectPtr> &channels);
+
+    size_t countSubscribers(const RedisObjectPtr &channel);
+
+    size_t countPatterns();
+
+private:
+    PubSub(const PubSub &);
+
+    void operator=(const PubSub &);
+
+    typedef std::unordered_map <EventLoop *, std::unordered_map<int32_t, TcpConnectionPtr>> Subscribers;
+    typedef std::unordered_map <RedisObjectPtr, Subscribers, Hash, Equal> SubscriberMap;
+    typedef std::unordered_set <RedisObjectPtr, Hash, Equal> ObjectSet;
+    typedef std::shared_ptr<const std::string> MessagePtr;
+    typedef std::vector <std::pair<TcpConnectionPtr, MessagePtr>> MessageList;
+
+    struct ClientState {
+        ObjectSet channels;
+        ObjectSet patterns;
+    };
+
+    struct Delivery {
+        EventLoop *loop;
+        MessageList messages;
+    };
+
+    static bool addSubscriber(SubscriberMap &map, const TcpConnectionPtr &conn,
+                              const RedisObjectPtr &name);
+
+    static bool removeSubscriber(SubscriberMap &map, int32_t sockfd, const RedisObjectPtr &name);
+
+    static int32_t addDeliveries(std::vector <Delivery> &deliveries, const Subscribers &subscribers,
+                                 const MessagePtr &message);
+
+    static MessagePtr createMessage(const RedisObjectPtr &pattern, const RedisObjectPtr &channel,
+                                    const RedisObjectPtr &message);
+
+    static void deliver(const MessageList &messages);
+
+    std::mutex mtx;
+    SubscriberMap channels;
+    SubscriberMap patterns;
+    PatternTrie trie;
+    std::unordered_map <int32_t, ClientState> clients;
+};
@@ -0,0 +1,238 @@
+#include "quicklist.h"
+#include "listpack.h"
+#include "util.h"
+
+/* Nodes smaller than this are never compressed. */
+static const size_t kMinCompressBytes = 48;
+
+Quicklist::Quicklist(int32_t compressDepth)
+        : head(nullptr),
+          tail(nullptr),
+          count(0),
+          length(0),
+          compressDepth(compressDepth) {
+
+}
+
+Quicklist::~Quicklist() {
+    while (head != nullptr) {
+        Node *next = head->next;
+        delete head;
+        head = next;
+    }
+}
+
+Quicklist::Node *Quicklist::createNode(Node *prev, Node *next) {
+    Node *node = new Node;
+    node->prev = prev;
+    node->next = next;
+    node->count = 0;
+    node->rawSize = 0;
+    node->compressed = false;
+
+    if (prev != nullptr) {
+        prev->next = node;
+    } else {
+        head = node;
+    }
+
+    if (next != nullptr) {
+        next->prev = node;
+    } else {
+        tail = node;
+    }
+    length++;
+    return node;
+}
+
+void Quicklist::removeNode(Node *node) {
+    if (node->prev != nullptr) {
+        node->prev->next = node->next;
+    } else {
+        head = node->next;
+    }
+
+    if (node->next != nullptr) {
+        node->next->prev = node->prev;
+    } else {
+        tail = node->prev;
+    }
+
+    length--;
+    delete node;
+}
+
+void Quicklist::pushHead(const char *value, size_t len) {
+    insert(true, value, len);
+}
+
+void Quicklist::pushTail(const char *value, size_t len) {
+    insert(false, value, len);
+}
+
+bool Quicklist::popHead(const Visitor &visitor) {
+    return pop(true, visitor);
+}
+
+bool Quicklist::popTail(const Visitor &visitor) {
+    return pop(false, visitor);
+}
+
+/* The end nodes are never compressed, an entry goes into the end node while
+ * it has room and into a new node otherwise. */
+void Quicklist::insert(bool athead, const char *value, size_t len) {
+    size_t bytes = lpEntryBytes(len);
+    Node *node = athead ? head : tail;
+    if (node == nullptr || node->compressed ||
+        node->data.size() + bytes > REDIS_LIST_MAX_NODE_SIZE) {
+        node = athead ? createNode(nullptr, head) : createNode(tail, nullptr);
+        compressEnds();
+    }
+
+    size_t used = node->data.size();
+    node->data.resize(used + bytes);
+    char *p = &node->data[0];
+    if (athead) {
+        memmove(p + bytes, p, used);
+    } else {
+        p += used;
+    }
+
+    lpWriteEntry(p, value, len);
+    node->count++;
+    count++;
+}
+
+bool Quicklist::pop(bool athead, const Visitor &visitor) {
+    Node *node = athead ? head : tail;
+    if (node == nullptr) {
+        return false;
+    }
+
+    decompressNode(node);
+    size_t len;
+    const char *begin = node->data.data();
+    const char *end = begin + node->data.size();
+    if (athead) {
+        const char *value = lpReadEntry(begin, &len);
+        visitor(value, len);
+        node->data.erase(0, lpEntryBytes(len));
+    } else {
+        const char *value = lpReadEntryBack(end, &len);
+        visitor(value, len);
+        node->data.resize(node->data.size() - lpEntryBytes(len));
+    }
+
+    count--;
+    if (--node->count == 0) {
+        removeNode(node);
+        compressEnds();
+    }
+    return true;
+}
+
+void Quicklist::range(size_t start, size_t end, const Visitor &visitor) const {
+    assert(start <= end && end < count);
+
+    /* Find the node holding start from the nearer end. */
+    Node *node;
+    size_t first;
+    if (start < count / 2) {
+        node = head;
+        first = 0;
+        while (start >= first + node->count) {
+            first += node->count;
+            node = node->next;
+        }
+    } else {
+        node = tail;
+        first = count - node->count;
+        while (start < first) {
+            node = node->prev;
+            first -= node->count;
+        }
+    }
+
+    std::string scratch;
+    size_t remaining = end - start + 1;
+    size_t skip = start - first;
+    for (; node != nullptr && remaining > 0; node = node->next) {
+        const char *p = node->data.data();
+        if (node->compressed) {
+            scratch.resize(node->rawSize);
+            unsigned int n = lzfDecompress(node->data.data(), node->data.size(),
+                                           &scratch[0], node->rawSize);
+            assert(n == node->rawSize);
+            p = scratch.data();
+        }
+
+        for (uint32_t i = 0; i < node->count && remaining > 0; i++) {
+            size_t len;
+            const char *value = lpReadEntry(p, &len);
+            if (skip > 0) {
+                skip--;
+            } else {
+                visitor(value, len);
+                remaining--;
+            }
+            p += lpEntryBytes(len);
+        }
+    }
+}
+
+void Quicklist::compressNode(Node *node) {
+    if (node == nullptr || node->compressed || node->data.size() < kMinCompressBytes) {
+        return;
+    }
+
+    /* Kept as it is unless compression saves some bytes. */
+    std::string out(node->data.size() - 8, '\0');
+    unsigned int n = lzfCompress(node->data.data(), node->data.size(), &out[0], out.size());
+    if (n == 0) {
+        return;
+    }
+
+    out.resize(n);
+    out.shrink_to_fit();
+    node->rawSize = node->data.size();
+    node->data.swap(out);
+    node->compressed = true;
+}
+
+void Quicklist::decompressNode(Node *node) {
+    if (!node->compressed) {
+        return;
+    }
+
+    std::string raw(node->rawSize, '\0');
+    unsigned int n = lzfDecompress(node->data.data(), node->data.size(), &raw[0], raw.size());
+    assert(n == node->rawSize);
+    node->data.swap(raw);
+    node->compressed = false;
+}
+
+/* Called when a node came or went at an end: the compressDepth nodes at
+ * either end are kept plain and the one that just moved inside is
+ * compressed. */
+void Quicklist::compressEnds() {
+    if (compressDepth <= 0) {
+        return;
+    }
+
+    Node *forward = head;
+    Node *backward = tail;
+    for (int32_t i = 0; i < compressDepth && forward != nullptr; i++) {
+        decompressNode(forward);
+        forward = forward->next;
+    }
+
+    for (int32_t i = 0; i < compressDepth && backward != nullptr; i++) {
+        decompressNode(backward);
+        backward = backward->prev;
+    }
+
+    if (length > (size_t) compressDepth * 2) {
+        compressNode(forward);
+        compressNode(backward);
+    }
+}
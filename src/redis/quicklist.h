@@ -0,0 +1,66 @@
+#pragma once
+
+#include "all.h"
+
+/* List kept as a doubly linked list of nodes, each a listpack buffer of
+ * many entries (see listpack.h). Nodes further than compressDepth
+ * from both ends are LZF compressed, 0 leaves every node as it is.
+ * Indexes are 0 based from the head. */
+class Quicklist {
+public:
+    typedef std::function<void(const char *value, size_t len)> Visitor;
+
+    Quicklist(int32_t compressDepth = REDIS_DEFAULT_LIST_COMPRESS_DEPTH);
+
+    ~Quicklist();
+
+    size_t size() const { return count; }
+
+    size_t nodes() const { return length; }
+
+    void pushHead(const char *value, size_t len);
+
+    void pushTail(const char *value, size_t len);
+
+    bool popHead(const Visitor &visitor);
+
+    bool popTail(const Visitor &visitor);
+
+    void range(size_t start, size_t end, const Visitor &visitor) const;
+
+    void forEach(const Visitor &visitor) const { if (count > 0) range(0, count - 1, visitor); }
+
+private:
+    Quicklist(const Quicklist &);
+
+    void operator=(const Quicklist &);
+
+    struct Node {
+        Node *prev;
+        Node *next;
+        uint32_t count;       /* Entries in the node. */
+        uint32_t rawSize;     /* Bytes of the entries when not compressed. */
+        bool compressed;
+        std::string data;
+    };
+
+    Node *createNode(Node *prev, Node *next);
+
+    void removeNode(Node *node);
+
+    void insert(bool head, const char *value, size_t len);
+
+    bool pop(bool head, const Visitor &visitor);
+
+    void compressNode(Node *node);
+
+    void decompressNode(Node *node);
+
+    void compressEnds();
+
+    Node *head;
+    Node *tail;
+    size_t count;
+    size_t length;
+    int32_t compressDepth;
+};
@@ -1,9 +1,11 @@
 #include "rdb.h"
 #include "redis.h"
+#include "rdbloader.h"
 
 Rdb::Rdb(Redis *redis)
         : redis(redis),
-          blockEnabled(true) {
+          blockEnabled(true),
+          syncRateLimit(REDIS_DEFAULT_REPL_SYNC_RATE) {
 
 }
 
@@ -137,6 +139,10 @@ void Rdb::rioInitWithBuffer(Rio *r, sds s) {
                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
     r->tellFuc = std::bind(&Rdb::rioBufferTell, this, std::placeholders::_1);
     r->flushFuc = std::bind(&Rdb::rioBufferFlush, this, std::placeholders::_1);
+    r->updateFuc = nullptr;
+    r->cksum = 0;
+    r->processedBytes = 0;
+    r->maxProcessingChunk = 0;
     r->io.buffer.ptr = s;
     r->io.buffer.pos = 0;
 }
@@ -158,6 +164,137 @@ void Rdb::rioInitWithFile(Rio *r, FILE *fp) {
     r->io.file.autosync = 0;
 }
 
+#ifndef _WIN64
+
+/* Rio writing the same stream to several replica sockets, used by the fork
+ * child of a diskless sync. Output is buffered and flushed to every socket
+ * in turn, a socket that fails is only marked in state[] so the others go
+ * on. Returns 0 once no socket is left. */
+void Rdb::rioInitWithFdset(Rio *r, int32_t *fds, int32_t numfds) {
+    r->readFuc = nullptr;
+    r->writeFuc = std::bind(&Rdb::rioFdsetWrite, this,
+                            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    r->tellFuc = std::bind(&Rdb::rioFdsetTell, this, std::placeholders::_1);
+    r->flushFuc = std::bind(&Rdb::rioFdsetFlush, this, std::placeholders::_1);
+    r->updateFuc = std::bind(&Rdb::rioGenericUpdateChecksum, this,
+                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    r->cksum = 0;
+    r->processedBytes = 0;
+    r->maxProcessingChunk = 1024 * 64;
+    r->io.fdset.fds = (int32_t *) zmalloc(sizeof(int32_t) * numfds);
+    r->io.fdset.state = (int32_t *) zmalloc(sizeof(int32_t) * numfds);
+    memcpy(r->io.fdset.fds, fds, sizeof(int32_t) * numfds);
+    memset(r->io.fdset.state, 0, sizeof(int32_t) * numfds);
+    r->io.fdset.numfds = numfds;
+    r->io.fdset.pos = 0;
+    r->io.fdset.buf = sdsempty();
+}
+
+void Rdb::rioFreeFdset(Rio *r) {
+    zfree(r->io.fdset.fds);
+    zfree(r->io.fdset.state);
+    sdsfree(r->io.fdset.buf);
+}
+
+size_t Rdb::rioFdsetWrite(Rio *r, const void *buf, size_t len) {
+    bool doflush = (buf == nullptr && len == 0);
+    if (len) {
+        r->io.fdset.buf = sdscatlen(r->io.fdset.buf, buf, len);
+        doflush = sdslen(r->io.fdset.buf) > PROTO_IOBUF_LENGTH;
+    }
+
+    if (!doflush) {
+        return 1;
+    }
+
+    const char *p = r->io.fdset.buf;
+    len = sdslen(r->io.fdset.buf);
+    while (len) {
+        size_t count = len < 1024 * 16 ? len : 1024 * 16;
+        int32_t broken = 0;
+        for (int32_t j = 0; j < r->io.fdset.numfds; j++) {
+            if (r->io.fdset.state[j] != 0) {
+                broken++;
+                continue;
+            }
+
+            /* The sockets stay non blocking since the parent shares them,
+             * wait for writability here instead. */
+            size_t nwritten = 0;
+            while (nwritten != count) {
+                ssize_t retval = ::write(r->io.fdset.fds[j], p + nwritten, count - nwritten);
+                if (retval > 0) {
+                    nwritten += retval;
+                    continue;
+                }
+
+                if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    struct pollfd pfd;
+                    pfd.fd = r->io.fdset.fds[j];
+                    pfd.events = POLLOUT;
+                    if (::poll(&pfd, 1, REPLI_TIME_OUT * 1000) > 0) {
+                        continue;
+                    }
+                    errno = ETIMEDOUT;
+                }
+
+                r->io.fdset.state[j] = errno ? errno : EIO;
+                broken++;
+                break;
+            }
+        }
+
+        if (broken == r->io.fdset.numfds) {
+            return 0;
+        }
+
+        p += count;
+        len -= count;
+        r->io.fdset.pos += count;
+    }
+
+    sdsclear(r->io.fdset.buf);
+    return 1;
+}
+
+off_t Rdb::rioFdsetTell(Rio *r) {
+    return r->io.fdset.pos;
+}
+
+int32_t Rdb::rioFdsetFlush(Rio *r) {
+    return rioFdsetWrite(r, nullptr, 0) ? REDIS_OK : 0;
+}
+
+/* The snapshot wrapped in $EOF:<mark>\r\n ... <mark>, so the replica can
+ * load it without knowing its length in advance. The framing is written
+ * around the checksum so the payload is a plain RDB file. */
+int32_t Rdb::rdbSaveRioWithEOFMark(Rio *rdb, int32_t *error) {
+    char eofmark[RDB_EOF_MARK_SIZE];
+    getRandomHexChars(eofmark, RDB_EOF_MARK_SIZE);
+    if (error) *error = 0;
+
+    if (rdb->writeFuc(rdb, "$EOF:", 5) == 0 ||
+        rdb->writeFuc(rdb, eofmark, RDB_EOF_MARK_SIZE) == 0 ||
+        rdb->writeFuc(rdb, "\r\n", 2) == 0) {
+        goto werr;
+    }
+
+    if (rdbSaveRio(rdb, error, RDB_SAVE_NONE) == REDIS_ERR) {
+        goto werr;
+    }
+
+    if (rdb->writeFuc(rdb, eofmark, RDB_EOF_MARK_SIZE) == 0 ||
+        rdb->flushFuc(rdb) == 0) {
+        goto werr;
+    }
+    return REDIS_OK;
+    werr:
+    if (error && *error == 0) *error = errno;
+    return REDIS_ERR;
+}
+
+#endif
+
 int32_t Rdb::rdbEncodeInteger(int64_t value, uint8_t *enc) {
     if (value >= -(1 << 7) && value <= (1 << 7) - 1) {
         enc[0] = (REDIS_RDB_ENCVAL << 6) | REDIS_RDB_ENC_INT8;
@@ -335,6 +472,8 @@ RedisObjectPtr Rdb::rdbGenericLoadStringObject(Rio *rdb, int32_t encode) {
     if (len && rioRead(rdb, (void *) o->ptr, len) == 0) {
         return nullptr;
     }
+
+    o->calHash();
     return o;
 }
 
@@ -347,113 +486,169 @@ int32_t Rdb::rdbSaveBinaryDoubleValue(Rio *rdb, double val) {
     return rdbWriteRaw(rdb, &val, sizeof(val));
 }
 
-int32_t Rdb::rdbSaveStruct(Rio *rdb) {
-    int64_t now = mstime();
-    size_t n = 0;
-    auto &redisShards = redis->getRedisShards();
-    for (auto &it : redisShards) {
-        auto &mu = it.mtx;
-        auto &map = it.redisMap;
-        auto &stringMap = it.stringMap;
-        auto &hashMap = it.hashMap;
-        auto &listMap = it.listMap;
-        auto &zsetMap = it.zsetMap;
-        auto &setMap = it.setMap;
+/* The RDB type of a keyspace entry, packed hashes and intsets are written
+ * as one blob. */
+static int32_t rdbValueType(const Redis::RedisValue &value) {
+    switch (value.index()) {
+        case OBJ_HASH:
+            return std::get<OBJ_HASH>(value)->isPacked() ?
+                   REDIS_RDB_TYPE_HASH_LISTPACK : REDIS_RDB_TYPE_HASH;
+        case OBJ_SET:
+            return std::get<OBJ_SET>(value)->isIntset() ?
+                   REDIS_RDB_TYPE_SET_INTSET : REDIS_RDB_TYPE_SET;
+        case OBJ_LIST:
+            return REDIS_RDB_TYPE_LIST;
+        case OBJ_ZSET:
+            return REDIS_RDB_TYPE_ZSET;
+        default:
+            return REDIS_RDB_TYPE_STRING;
+    }
+}
+
+/* Write the payload of a keyspace entry, the type tag selects the layout. */
+static int32_t rdbSaveValueStruct(Rdb *r, Rio *rdb, const Redis::RedisValue &value) {
+    switch (value.index()) {
+        case OBJ_STRING: {
+            if (r->rdbSaveValue(rdb, std::get<OBJ_STRING>(value)) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
+            break;
+        }
+        case OBJ_LIST: {
+            auto &list = *std::get<OBJ_LIST>(value);
+            if (r->rdbSaveLen(rdb, list.size()) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-        if (blockEnabled) mu.lock();
-        for (auto &iter : map) {
-            int64_t expire = redis->getExpire(iter);
-            if (iter->type == OBJ_STRING) {
-                auto iterr = stringMap.find(iter);
-                assert(iterr != stringMap.end());
-                assert(iterr->first->type == OBJ_STRING);
-                if (rdbSaveKeyValuePair(rdb, iterr->first,
-                                        iterr->second, expire, now) == REDIS_ERR) {
-                    return REDIS_ERR;
+            bool failed = false;
+            list.forEach([r, rdb, &failed](const char *entry, size_t len) {
+                if (!failed && r->rdbSaveRawString(rdb, entry, len) == REDIS_ERR) {
+                    failed = true;
                 }
-            } else if (iter->type == OBJ_LIST) {
-                auto iterr = listMap.find(iter);
-                assert(iterr != listMap.end());
-                assert(iterr->first->type == OBJ_LIST);
+            });
 
-                if (rdbSaveKey(rdb, iterr->first) == REDIS_ERR) {
+            if (failed) {
+                return REDIS_ERR;
+            }
+            break;
+        }
+        case OBJ_HASH: {
+            auto &rhash = *std::get<OBJ_HASH>(value);
+            if (rhash.isPacked()) {
+                auto &packed = rhash.getPacked();
+                if (r->rdbSaveRawString(rdb, packed.data(), packed.size()) == REDIS_ERR) {
                     return REDIS_ERR;
                 }
+                break;
+            }
 
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
+            if (r->rdbSaveLen(rdb, rhash.size()) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveValue(rdb, iterrr) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
+            bool failed = false;
+            rhash.forEach([r, rdb, &failed](const char *field, size_t flen, const char *val, size_t vlen) {
+                if (!failed && (r->rdbSaveRawString(rdb, field, flen) == REDIS_ERR ||
+                                r->rdbSaveRawString(rdb, val, vlen) == REDIS_ERR)) {
+                    failed = true;
                 }
-            } else if (iter->type == OBJ_HASH) {
-                auto iterr = hashMap.find(iter);
-                assert(iterr != hashMap.end());
-                assert(iterr->first->type == OBJ_HASH);
+            });
 
-                if (rdbSaveKey(rdb, iterr->first) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
+            if (failed) {
+                return REDIS_ERR;
+            }
+            break;
+        }
+        case OBJ_ZSET: {
+            auto &zset = *std::get<OBJ_ZSET>(value);
+            if (r->rdbSaveLen(rdb, zset.size()) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
+            bool failed = false;
+            zset.forEach([r, rdb, &failed](const char *member, size_t len, double score) {
+                if (failed) {
+                    return;
                 }
 
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveValue(rdb, iterrr.first) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-
-                    if (rdbSaveValue(rdb, iterrr.second) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
+                if (r->rdbSaveBinaryDoubleValue(rdb, score) == REDIS_ERR ||
+                    r->rdbSaveRawString(rdb, member, len) == REDIS_ERR) {
+                    failed = true;
                 }
-            } else if (iter->type == OBJ_ZSET) {
-                auto iterr = zsetMap.find(iter);
-                assert(iterr != zsetMap.end());
-                assert(iterr->first->type == OBJ_ZSET);
-                assert(iterr->second.first.size() == iterr->second.second.size());
+            });
 
-                if (rdbSaveKey(rdb, iterr->first) == REDIS_ERR) {
+            if (failed) {
+                return REDIS_ERR;
+            }
+            break;
+        }
+        case OBJ_SET: {
+            auto &set = *std::get<OBJ_SET>(value);
+            if (set.isIntset()) {
+                std::string blob;
+                set.getIntset().serialize(&blob);
+                if (r->rdbSaveRawString(rdb, blob.data(), blob.size()) == REDIS_ERR) {
                     return REDIS_ERR;
                 }
+                break;
+            }
 
-                if (rdbSaveLen(rdb, iterr->second.first.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
+            if (r->rdbSaveLen(rdb, set.size()) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
+
+            bool failed = false;
+            set.forEach([r, rdb, &failed](const char *member, size_t len) {
+                if (!failed && r->rdbSaveRawString(rdb, member, len) == REDIS_ERR) {
+                    failed = true;
                 }
+            });
 
-                for (auto &iterrr : iterr->second.first) {
-                    if (rdbSaveBinaryDoubleValue(rdb, iterrr.second) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
+            if (failed) {
+                return REDIS_ERR;
+            }
+            break;
+        }
+        default:
+            assert(false);
+    }
+    return REDIS_OK;
+}
+
+int32_t Rdb::rdbSaveStruct(Rio *rdb) {
+    int64_t now = mstime();
+    auto &redisShards = redis->getRedisShards();
+    for (auto &it : redisShards) {
+        auto &mu = it.mtx;
+        auto &map = it.redisMap;
+        auto &expireMap = it.expireMap;
 
-                    if (rdbSaveValue(rdb, iterrr.first) == REDIS_ERR) {
-                        return REDIS_ERR;
+        if (blockEnabled) mu.lock();
+        for (auto &iter : map) {
+            const RedisObjectPtr &key = iter.first;
+            if (key->type == OBJ_STRING) {
+                int64_t expire = REDIS_ERR;
+                if (!expireMap.empty()) {
+                    auto e = expireMap.find(key);
+                    if (e != expireMap.end()) {
+                        expire = e->second;
                     }
                 }
-            } else if (iter->type == OBJ_SET) {
-                auto iterr = setMap.find(iter);
-                assert(iterr != setMap.end());
-                assert(iterr->first->type == OBJ_SET);
 
-                if (rdbSaveKey(rdb, iterr->first) == REDIS_ERR) {
+                if (rdbSaveKeyValuePair(rdb, key,
+                                        std::get<OBJ_STRING>(iter.second), expire, now) == REDIS_ERR) {
                     return REDIS_ERR;
                 }
+                continue;
+            }
 
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
+            if (rdbSaveType(rdb, rdbValueType(iter.second)) == REDIS_ERR ||
+                rdbSaveStringObject(rdb, key) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveValue(rdb, iterrr) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-                }
-            } else {
-                assert(false);
+            if (rdbSaveValueStruct(this, rdb, iter.second) == REDIS_ERR) {
+                return REDIS_ERR;
             }
         }
 
@@ -462,267 +657,453 @@ int32_t Rdb::rdbSaveStruct(Rio *rdb) {
     return REDIS_OK;
 }
 
-int32_t Rdb::rdbLoadSet(Rio *rdb, int32_t type) {
-    RedisObjectPtr key;
+/* Read the payload of a keyspace entry of the rdb type, the counterpart of
+ * rdbSaveValueStruct(). */
+static int32_t rdbLoadValueStruct(Rdb *r, Rio *rdb, int32_t type, Redis::RedisValue *value) {
+    Redis *redis = r->getRedis();
     int32_t len;
+    if (type == REDIS_STRING) {
+        RedisObjectPtr val;
+        if ((val = r->rdbLoadObject(type, rdb)) == nullptr) {
+            return REDIS_ERR;
+        }
 
-    if ((key = rdbLoadStringObject(rdb)) == nullptr) {
-        return REDIS_ERR;
-    }
+        val->type = OBJ_STRING;
+        *value = val;
+    } else if (type == REDIS_SET || type == REDIS_RDB_TYPE_SET_INTSET) {
+        auto set = std::make_unique<Redis::SetValue>(redis->setMaxIntsetEntries);
+        if (type == REDIS_RDB_TYPE_SET_INTSET) {
+            RedisObjectPtr blob;
+            if ((blob = r->rdbLoadStringObject(rdb)) == nullptr) {
+                return REDIS_ERR;
+            }
 
-    key->type = OBJ_SET;
-    if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
-        return REDIS_ERR;
-    }
+            if (!set->loadIntset(blob->ptr, sdslen(blob->ptr))) {
+                LOG_WARN << "Corrupt intset in RDB file";
+                return REDIS_ERR;
+            }
+        } else {
+            if ((len = r->rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-    std::unordered_set <RedisObjectPtr, Hash, Equal> set;
-    for (int32_t i = 0; i < len; i++) {
-        RedisObjectPtr val;
-        if ((val = rdbLoadObject(type, rdb)) == nullptr) {
+            for (int32_t i = 0; i < len; i++) {
+                RedisObjectPtr val;
+                if ((val = r->rdbLoadObject(type, rdb)) == nullptr) {
+                    return REDIS_ERR;
+                }
+
+                val->type = OBJ_SET;
+                set->add(val);
+            }
+        }
+
+        if (set->size() == 0) {
+            return REDIS_ERR;
+        }
+        *value = std::move(set);
+    } else if (type == REDIS_ZSET) {
+        if ((len = r->rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
             return REDIS_ERR;
         }
 
-        val->type = OBJ_SET;
-        auto it = set.find(val);
-        assert(it == set.end());
-        set.insert(val);
-    }
+        auto zset = std::make_unique<Redis::ZsetValue>();
+        for (int32_t i = 0; i < len; i++) {
+            RedisObjectPtr val;
+            double socre;
+            if (r->rdbLoadBinaryDoubleValue(rdb, &socre) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
 
-    assert(!set.empty());
+            if ((val = r->rdbLoadObject(type, rdb)) == nullptr) {
+                return REDIS_ERR;
+            }
 
-    auto &redisShards = redis->getRedisShards();
-    size_t index = key->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
-    auto &map = redisShards[index].redisMap;
-    auto &setMap = redisShards[index].setMap;
-    {
-        std::unique_lock <std::mutex> lck(mu);
-        auto it = setMap.find(key);
-        assert(it == setMap.end());
-        setMap.insert(std::make_pair(key, std::move(set)));
-    }
-    return REDIS_OK;
-}
+            val->type = OBJ_ZSET;
+            zset->add(val, socre);
+        }
 
-int32_t Rdb::rdbLoadZset(Rio *rdb, int32_t type) {
-    RedisObjectPtr key;
-    int32_t len;
-    if ((key = rdbLoadStringObject(rdb)) == nullptr) {
-        return REDIS_ERR;
-    }
+        if (zset->size() == 0) {
+            return REDIS_ERR;
+        }
+        *value = std::move(zset);
+    } else if (type == REDIS_LIST) {
+        if ((len = r->rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
+            return REDIS_ERR;
+        }
 
-    key->type = OBJ_ZSET;
-    if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
-        return REDIS_ERR;
-    }
+        auto list = std::make_unique<Redis::ListValue>(redis->listCompressDepth);
+        for (int32_t i = 0; i < len; i++) {
+            RedisObjectPtr val;
+            if ((val = r->rdbLoadObject(type, rdb)) == nullptr) {
+                return REDIS_ERR;
+            }
 
-    Redis::SortIndexMap indexMap;
-    Redis::SortMap sortMap;
-    for (int32_t i = 0; i < len; i++) {
-        RedisObjectPtr val;
-        double socre;
-        if (rdbLoadBinaryDoubleValue(rdb, &socre) == REDIS_ERR) {
-            return REDIS_ERR;
+            list->pushTail(val->ptr, sdslen(val->ptr));
         }
 
-        if ((val = rdbLoadObject(type, rdb)) == nullptr) {
+        if (list->size() == 0) {
             return REDIS_ERR;
         }
+        *value = std::move(list);
+    } else if (type == REDIS_HASH || type == REDIS_RDB_TYPE_HASH_LISTPACK) {
+        auto rhash = std::make_unique<Redis::HashValue>(redis->hashMaxListpackEntries,
+                                                        redis->hashMaxListpackValue);
+        if (type == REDIS_RDB_TYPE_HASH_LISTPACK) {
+            RedisObjectPtr blob;
+            if ((blob = r->rdbLoadStringObject(rdb)) == nullptr) {
+                return REDIS_ERR;
+            }
 
-        val->type = OBJ_ZSET;
-        sortMap.insert(std::make_pair(socre, val));
-        indexMap.insert(std::make_pair(val, socre));
-    }
+            if (!rhash->loadPacked(blob->ptr, sdslen(blob->ptr))) {
+                LOG_WARN << "Corrupt hash listpack in RDB file";
+                return REDIS_ERR;
+            }
+        } else {
+            if ((len = r->rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
+
+            for (int32_t i = 0; i < len; i++) {
+                RedisObjectPtr field, val;
+                if ((field = r->rdbLoadStringObject(rdb)) == nullptr) {
+                    return REDIS_ERR;
+                }
 
-    assert(!sortMap.empty());
-    assert(!indexMap.empty());
+                field->type = OBJ_HASH;
+                if ((val = r->rdbLoadStringObject(rdb)) == nullptr) {
+                    return REDIS_ERR;
+                }
+
+                val->type = OBJ_HASH;
+                rhash->set(field, val);
+            }
+        }
 
+        if (rhash->size() == 0) {
+            return REDIS_ERR;
+        }
+        *value = std::move(rhash);
+    } else {
+        LOG_WARN << "Unknown RDB object type " << type;
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* Put a loaded entry into its shard. An existing key is replaced when
+ * replace is set, otherwise nothing changes and false is returned. */
+static bool rdbInsertValue(Redis *redis, const RedisObjectPtr &key, Redis::RedisValue &value,
+                           int64_t expiretime, bool replace) {
     auto &redisShards = redis->getRedisShards();
     size_t index = key->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
-    auto &map = redisShards[index].redisMap;
-    auto &zsetMap = redisShards[index].zsetMap;
+    auto &shard = redisShards[index];
+    key->type = value.index();
     {
-        std::unique_lock <std::mutex> lck(mu);
-        auto it = zsetMap.find(key);
-        assert(it == zsetMap.end());
+        auto lck = redis->lockShard(index);
+        auto it = shard.redisMap.find(key);
+        if (it != shard.redisMap.end()) {
+            if (!replace) {
+                return false;
+            }
 
-        auto iter = map.find(key);
-        assert(iter == map.end());
+            shard.expireMap.erase(key);
+            redis->getSlotIndex().remove(it->first);
+            shard.redisMap.erase(it);
+        }
 
-        zsetMap.insert(std::make_pair(key, std::make_pair(std::move(indexMap), std::move(sortMap))));
-        map.insert(key);
+        shard.redisMap.emplace(key, std::move(value));
+        redis->getSlotIndex().add(key);
+        if (expiretime != REDIS_ERR) {
+            shard.expireMap.emplace(key, expiretime);
+        }
     }
-    return REDIS_OK;
+    return true;
 }
 
-int32_t Rdb::rdbLoadList(Rio *rdb, int32_t type) {
-    std::deque <RedisObjectPtr> list;
+int32_t Rdb::rdbLoadKeyValue(Rio *rdb, int32_t type, int64_t expiretime, int64_t now) {
     RedisObjectPtr key;
-    int32_t len;
     if ((key = rdbLoadStringObject(rdb)) == nullptr) {
         return REDIS_ERR;
     }
 
-    key->type = OBJ_LIST;
-    if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
-        return REDIS_ERR;
+    /* Keys already expired at load time are skipped. */
+    if (expiretime != REDIS_ERR && expiretime <= now) {
+        return rdbSkipValue(rdb, type);
     }
+    return rdbLoadValue(rdb, type, key, expiretime);
+}
 
-    for (int32_t i = 0; i < len; i++) {
-        RedisObjectPtr val;
-        if ((val = rdbLoadObject(type, rdb)) == nullptr) {
-            return REDIS_ERR;
-        }
-
-        val->type = OBJ_LIST;
-        list.push_back(val);
+int32_t Rdb::rdbLoadValue(Rio *rdb, int32_t type, const RedisObjectPtr &key, int64_t expiretime) {
+    Redis::RedisValue value;
+    if (rdbLoadValueStruct(this, rdb, type, &value) == REDIS_ERR) {
+        return REDIS_ERR;
     }
 
-    assert(!list.empty());
-    auto &redisShards = redis->getRedisShards();
-    size_t index = key->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
-    auto &map = redisShards[index].redisMap;
-    auto &listMap = redisShards[index].listMap;
-    {
-        std::unique_lock <std::mutex> lck(mu);
-        auto it = listMap.find(key);
-        assert(it == listMap.end());
+    bool inserted = rdbInsertValue(redis, key, value, expiretime, false);
+    assert(inserted);
+    return REDIS_OK;
+}
 
-        auto iter = map.find(key);
-        assert(iter == map.end());
+/* Read past a string as rdbGenericLoadStringObject() would load it, lzf
+ * data is not decompressed. */
+int32_t Rdb::rdbSkipStringObject(Rio *rdb) {
+    char buf[1024];
+    int32_t isencoded;
+    uint32_t len = rdbLoadLen(rdb, &isencoded);
+    if (isencoded) {
+        switch (len) {
+            case REDIS_RDB_ENC_INT8:
+                return rioRead(rdb, buf, 1) ? REDIS_OK : REDIS_ERR;
+            case REDIS_RDB_ENC_INT16:
+                return rioRead(rdb, buf, 2) ? REDIS_OK : REDIS_ERR;
+            case REDIS_RDB_ENC_INT32:
+                return rioRead(rdb, buf, 4) ? REDIS_OK : REDIS_ERR;
+            case REDIS_RDB_ENC_LZF:
+                if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_RDB_LENERR ||
+                    rdbLoadLen(rdb, nullptr) == REDIS_RDB_LENERR) {
+                    return REDIS_ERR;
+                }
+                break;
+            default:
+                return REDIS_ERR;
+        }
+    }
 
-        map.insert(key);
-        listMap.insert(std::make_pair(key, std::move(list)));
+    if (len == REDIS_RDB_LENERR) {
+        return REDIS_ERR;
     }
 
+    while (len > 0) {
+        uint32_t count = len < sizeof(buf) ? len : sizeof(buf);
+        if (rioRead(rdb, buf, count) == 0) {
+            return REDIS_ERR;
+        }
+        len -= count;
+    }
     return REDIS_OK;
 }
 
-int32_t Rdb::rdbLoadHash(Rio *rdb, int32_t type) {
-    RedisObjectPtr key;
-    int32_t len, rdbver;
-    if ((key = rdbLoadStringObject(rdb)) == nullptr) {
+/* Read past a value of the rdb type, the layout follows rdbLoadValueStruct()
+ * without building anything. */
+int32_t Rdb::rdbSkipValue(Rio *rdb, int32_t type) {
+    uint32_t len, strings = 1;
+    if (type == REDIS_STRING || type == REDIS_RDB_TYPE_SET_INTSET ||
+        type == REDIS_RDB_TYPE_HASH_LISTPACK) {
+        return rdbSkipStringObject(rdb);
+    } else if (type == REDIS_HASH) {
+        strings = 2;
+    } else if (type != REDIS_SET && type != REDIS_ZSET && type != REDIS_LIST) {
+        LOG_WARN << "Unknown RDB object type " << type;
         return REDIS_ERR;
     }
 
-    key->type = OBJ_HASH;
-
-    std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> rhash;
-    if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_ERR) {
+    if ((len = rdbLoadLen(rdb, nullptr)) == REDIS_RDB_LENERR) {
         return REDIS_ERR;
     }
 
-    for (int32_t i = 0; i < len; i++) {
-        RedisObjectPtr key, val;
-        if ((key = rdbLoadStringObject(rdb)) == nullptr) {
+    for (uint32_t i = 0; i < len; i++) {
+        double score;
+        if (type == REDIS_ZSET && rdbLoadBinaryDoubleValue(rdb, &score) == REDIS_ERR) {
             return REDIS_ERR;
         }
 
-        key->type = OBJ_HASH;
-        if ((val = rdbLoadStringObject(rdb)) == nullptr) {
-            return REDIS_ERR;
+        for (uint32_t j = 0; j < strings; j++) {
+            if (rdbSkipStringObject(rdb) == REDIS_ERR) {
+                return REDIS_ERR;
+            }
         }
+    }
+    return REDIS_OK;
+}
 
-        val->type = OBJ_HASH;
-        rhash.insert(std::make_pair(key, val));
+/* Start a full resync of the snapshot to a replica. Nothing is sent here,
+ * the transfer runs on the replica's own loop: the length prefix first, then
+ * one chunk every time the socket becomes writable. */
+bool Rdb::rdbReplication(const char *filename, const TcpConnectionPtr &conn) {
+    FILE *fp;
+    if ((fp = ::fopen(filename, "r")) == nullptr) {
+        return false;
     }
 
-    assert(!rhash.empty());
-    auto &redisShards = redis->getRedisShards();
-    size_t index = key->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
-    auto &map = redisShards[index].redisMap;
-    auto &hashMap = redisShards[index].hashMap;
+    SyncTransferPtr transfer(new SyncTransfer());
+    transfer->conn = conn;
+    transfer->fp = fp;
+    transfer->size = startLoading(fp);
+    transfer->start = mstime();
+    transfer->offset = 0;
+    transfer->lastOffset = 0;
+    transfer->done = false;
+
     {
-        std::unique_lock <std::mutex> lck(mu);
-        auto it = hashMap.find(key);
-        assert(it == hashMap.end());
+        std::unique_lock <std::mutex> lck(syncMutex);
+        syncTransfers[conn->getSockfd()] = transfer;
+    }
 
-        auto iter = map.find(key);
-        if (iter == map.end());
+    conn->getLoop()->runInLoop(std::bind(&Rdb::rdbReplicationInLoop, this, transfer));
+    return true;
+}
 
-        hashMap.insert(std::make_pair(key, std::move(rhash)));
-        map.insert(key);
+void Rdb::rdbReplicationInLoop(const SyncTransferPtr &transfer) {
+    const TcpConnectionPtr &conn = transfer->conn;
+    if (!conn->connected()) {
+        finishSyncTransfer(transfer, false);
+        return;
     }
-    return REDIS_OK;
+
+    /* Each write completion, or writable event after sendPipe(), sends
+     * the next chunk. */
+    conn->setWriteCompleteCallback(std::bind(&Rdb::sendSyncChunk, this, transfer));
+
+    char buf[32];
+    int32_t len = snprintf(buf, sizeof(buf), "$%lld\r\n", (long long) transfer->size);
+    conn->sendInLoop(buf, len);
 }
 
-int32_t Rdb::rdbLoadString(Rio *rdb, int32_t type, int64_t expiretime, int64_t now) {
-    RedisObjectPtr key, val;
-    if ((key = rdbLoadStringObject(rdb)) == nullptr) {
-        return REDIS_ERR;
+void Rdb::sendSyncChunk(const SyncTransferPtr &transfer) {
+    const TcpConnectionPtr &conn = transfer->conn;
+    if (transfer->done) {
+        return;
     }
 
-    if ((val = rdbLoadObject(type, rdb)) == nullptr) {
-        return REDIS_ERR;
+    if (!conn->connected()) {
+        finishSyncTransfer(transfer, false);
+        return;
     }
 
-    key->type = OBJ_STRING;
-    val->type = OBJ_STRING;
-    auto &redisShards = redis->getRedisShards();
-    size_t index = key->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
-    auto &map = redisShards[index].redisMap;
-    auto &stringMap = redisShards[index].stringMap;
-    {
-        std::unique_lock <std::mutex> lck(mu);
-        auto it = map.find(key);
-        assert(it == map.end());
+    if (conn->hasPendingOutput()) {
+        conn->sendPipe();
+        return;
+    }
 
-        auto iter = stringMap.find(key);
-        assert(iter == stringMap.end());
-        map.insert(key);
-        stringMap.insert(std::make_pair(key, val));
+    int64_t offset = transfer->offset;
+    if (offset == transfer->size) {
+        finishSyncTransfer(transfer, true);
+        return;
     }
 
-    if (now < expiretime) {
-        RedisObjectPtr k = createStringObject(key->ptr, sdslen(key->ptr));
-        k->type = OBJ_EXPIRE;
-        redis->setExpire(k, (expiretime - now) / 1000);
+    size_t chunk = std::min<int64_t>(transfer->size - offset, REDIS_SLAVE_SYNC_SIZE);
+    int64_t limit = syncRateLimit;
+    if (limit > 0) {
+        /* Allow one chunk of burst, then wait until the elapsed time
+         * covers the next chunk. */
+        int64_t allowed = limit * (mstime() - transfer->start) / 1000 +
+                          std::min<int64_t>(limit, REDIS_SLAVE_SYNC_SIZE) - offset;
+        if (allowed <= 0) {
+            double delay = (double) (REDIS_SLAVE_SYNC_SIZE - allowed) / limit;
+            conn->getLoop()->runAfter(std::min(delay, 1.0), false,
+                                      std::bind(&Rdb::sendSyncChunk, this, transfer));
+            return;
+        }
+        chunk = std::min<int64_t>(chunk, allowed);
     }
-    return REDIS_OK;
-}
 
-bool Rdb::rdbReplication(char *filename, const TcpConnectionPtr &conn) {
-    Rio rdb;
-    FILE *fp;
-    if ((fp = ::fopen(filename, "r")) == nullptr) {
-        return false;
+    ssize_t nwrote;
+#ifdef __linux__
+    off_t off = offset;
+    nwrote = ::sendfile(conn->getSockfd(), fileno(transfer->fp), &off, chunk);
+#else
+    char buf[REDIS_SLAVE_SYNC_SIZE];
+    nwrote = ::fread(buf, 1, chunk, transfer->fp);
+    if (nwrote > 0) {
+        transfer->offset += nwrote;
+        conn->sendInLoop(buf, nwrote);
+        return;
+    }
+    nwrote = -1;
+#endif
+
+    if (nwrote > 0) {
+        transfer->offset += nwrote;
+    } else if (nwrote == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        LOG_WARN << "Master sync send failure: " << strerror(errno);
+        conn->forceClose();
+        finishSyncTransfer(transfer, false);
+        return;
     }
 
-    rioInitWithFile(&rdb, fp);
-    int32_t sendlen = startLoading(fp);
+    /* Yield to the other connections of this loop, the next chunk goes
+     * out when the socket is writable again. */
+    conn->sendPipe();
+}
 
-    Buffer buf;
-    buf.appendInt32(sendlen);
-    conn->send(&buf);
+void Rdb::finishSyncTransfer(const SyncTransferPtr &transfer, bool success) {
+    if (transfer->done) {
+        return;
+    }
 
-#ifdef _WIN64
-    int32_t fd = ::_fileno(fp);
-#else
-    int32_t fd = ::fileno(fp);
-#endif
+    transfer->done = true;
+    transfer->conn->setWriteCompleteCallback(WriteCompleteCallback());
+    ::fclose(transfer->fp);
 
-    if (fd < 0) {
-        return false;
+    {
+        std::unique_lock <std::mutex> lck(syncMutex);
+        auto it = syncTransfers.find(transfer->conn->getSockfd());
+        if (it != syncTransfers.end() && it->second == transfer) {
+            syncTransfers.erase(it);
+        }
     }
 
-    off_t offset = 0;
-    ssize_t nwrote = 0;
+    if (success) {
+        LOG_INFO << "Master sync send success, " << transfer->size << " bytes in "
+                 << mstime() - transfer->start << " ms";
+    } else {
+        LOG_WARN << "Master sync send failure after " << transfer->offset << " of "
+                 << transfer->size << " bytes";
+    }
+}
 
-    while (sendlen) {
-#ifdef __linux__
-        nwrote = ::sendfile(conn->getSockfd(), fd, &offset, REDIS_SLAVE_SYNC_SIZE);
-#endif
-        if (nwrote >= 0) {
-            sendlen -= nwrote;
+/* Called from the replica's loop when its connection is closed. */
+void Rdb::abortSyncTransfer(int32_t sockfd) {
+    SyncTransferPtr transfer;
+    {
+        std::unique_lock <std::mutex> lck(syncMutex);
+        auto it = syncTransfers.find(sockfd);
+        if (it == syncTransfers.end()) {
+            return;
         }
+        transfer = it->second;
     }
+    finishSyncTransfer(transfer, false);
+}
 
-    ::fclose(fp);
-    return true;
+/* True while a transfer to this replica is running and moved forward since
+ * the last call, so a slow but live link is not closed by the sync timeout. */
+bool Rdb::syncTransferProgress(int32_t sockfd) {
+    std::unique_lock <std::mutex> lck(syncMutex);
+    auto it = syncTransfers.find(sockfd);
+    if (it == syncTransfers.end()) {
+        return false;
+    }
+
+    int64_t offset = it->second->offset;
+    bool progress = offset > it->second->lastOffset;
+    it->second->lastOffset = offset;
+    return progress;
+}
+
+sds Rdb::catSyncTransferInfo(sds info) {
+    std::unique_lock <std::mutex> lck(syncMutex);
+    int64_t now = mstime();
+    int32_t i = 0;
+    info = sdscatprintf(info,
+                        "repl_sync_rate_limit:%lld\r\n"
+                        "repl_sync_transfers:%d\r\n",
+                        (long long) syncRateLimit,
+                        (int32_t) syncTransfers.size());
+    for (auto &it : syncTransfers) {
+        const SyncTransferPtr &transfer = it.second;
+        int64_t offset = transfer->offset;
+        int64_t elapsed = std::max<int64_t>(now - transfer->start, 1);
+        info = sdscatprintf(info,
+                            "sync%d:fd=%d,sent=%lld,size=%lld,progress=%.2f%%,rate=%.2fKB/s\r\n",
+                            i++, it.first,
+                            (long long) offset,
+                            (long long) transfer->size,
+                            transfer->size ? offset * 100.0 / transfer->size : 100.0,
+                            offset * 1000.0 / elapsed / 1024);
+    }
+    return info;
 }
 
 int32_t Rdb::rdbSyncWrite(const char *buf, FILE *fp, size_t len) {
@@ -734,100 +1115,44 @@ int32_t Rdb::rdbSyncWrite(const char *buf, FILE *fp, size_t len) {
     return REDIS_OK;
 }
 
-int32_t Rdb::createDumpPayload(Rio *rdb, const RedisObjectPtr &obj) {
+int32_t Rdb::createDumpPayload(Rio *rdb, const RedisObjectPtr &obj, int64_t *expiretime) {
     auto &redisShards = redis->getRedisShards();
     size_t index = obj->hash % redis->kShards;
-    auto &mu = redisShards[index].mtx;
     auto &map = redisShards[index].redisMap;
-    auto &stringMap = redisShards[index].stringMap;
-    auto &hashMap = redisShards[index].hashMap;
-    auto &listMap = redisShards[index].listMap;
-    auto &zsetMap = redisShards[index].zsetMap;
-    auto &setMap = redisShards[index].setMap;
-
     {
-        std::unique_lock <std::mutex> lck(mu);
+        auto lck = redis->lockShard(index);
         auto iter = map.find(obj);
-        if (iter != map.end()) {
-            if ((*iter)->type == OBJ_STRING) {
-                auto iterr = stringMap.find(obj);
-                assert(iterr != stringMap.end());
-                assert(iterr->first->type == OBJ_STRING);
-                if (rdbSaveValue(rdb, iterr->second) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
-
-            } else if ((*iter)->type == OBJ_LIST) {
-                auto iterr = listMap.find(obj);
-                assert(iterr != listMap.end());
-                assert(iterr->first->type == OBJ_LIST);
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
-
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveValue(rdb, iterrr) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-                }
-            } else if ((*iter)->type == OBJ_HASH) {
-                auto iterr = hashMap.find(obj);
-                assert(iterr != hashMap.end());
-                assert(iterr->first->type == OBJ_HASH);
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
-
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveKeyValuePair(rdb, iterrr.first,
-                                            iterrr.second, -1, -1) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-                }
-            } else if ((*iter)->type == OBJ_ZSET) {
-                auto iterr = zsetMap.find(obj);
-                assert(iterr != zsetMap.end());
-                assert(iterr->first->type == OBJ_ZSET);
-                assert(iterr->second.first.size() == iterr->second.second.size());
-                if (rdbSaveLen(rdb, iterr->second.first.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
-
-                for (auto &iterrr : iterr->second.first) {
-                    if (rdbSaveBinaryDoubleValue(rdb, iterrr.second) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
+        if (iter == map.end()) {
+            return REDIS_ERR;
+        }
 
-                    if (rdbSaveValue(rdb, iterrr.first) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-                }
-            } else if ((*iter)->type == OBJ_SET) {
-                auto iterr = setMap.find(obj);
-                assert(iterr != setMap.end());
-                assert(iterr->first->type == OBJ_SET);
-                if (rdbSaveLen(rdb, iterr->second.size()) == REDIS_ERR) {
-                    return REDIS_ERR;
-                }
+        if (expiretime != nullptr) {
+            auto expire = redisShards[index].expireMap.find(obj);
+            *expiretime = expire == redisShards[index].expireMap.end() ? REDIS_ERR : expire->second;
+        }
 
-                for (auto &iterrr : iterr->second) {
-                    if (rdbSaveValue(rdb, iterrr) == REDIS_ERR) {
-                        return REDIS_ERR;
-                    }
-                }
-            } else {
-                assert(false);
-            }
+        if (rdbSaveType(rdb, rdbValueType(iter->second)) == REDIS_ERR ||
+            rdbSaveValueStruct(this, rdb, iter->second) == REDIS_ERR) {
+            return REDIS_ERR;
         }
     }
+    return REDIS_OK;
+}
 
-    if (rdbSaveType(rdb, RDB_OPCODE_EOF) == REDIS_ERR) {
+int32_t Rdb::restoreDumpPayload(Rio *rdb, const RedisObjectPtr &key, int64_t expiretime,
+                                bool replace, bool *busy) {
+    int32_t type;
+    Redis::RedisValue value;
+    *busy = false;
+    if ((type = rdbLoadType(rdb)) == REDIS_ERR ||
+        rdbLoadValueStruct(this, rdb, type, &value) == REDIS_ERR) {
         return REDIS_ERR;
     }
-    return REDIS_OK;
-}
 
-int32_t Rdb::verifyDumpPayload(Rio *rdb, const RedisObjectPtr &obj) {
+    if (!rdbInsertValue(redis, key, value, expiretime, replace)) {
+        *busy = true;
+        return REDIS_ERR;
+    }
     return REDIS_OK;
 }
 
@@ -839,7 +1164,7 @@ int32_t Rdb::rdbSyncClose(const char *fileName, FILE *fp) {
     if (::fclose(fp) == EOF) return REDIS_ERR;
 
     char tmpfile[256];
-    snprintf(tmpfile, 256, "temp-%d.rdb", std::this_thread::get_id());
+    snprintf(tmpfile, 256, "temp-%zu.rdb", std::hash<std::thread::id>()(std::this_thread::get_id()));
 
     if (::rename(tmpfile, fileName) == REDIS_ERR) return REDIS_ERR;
     return REDIS_OK;
@@ -849,7 +1174,7 @@ int32_t Rdb::rdbWrite(char *filename, const char *buf, size_t len) {
     FILE *fp;
     Rio rdb;
     char tmpfile[256];
-    snprintf(tmpfile, 256, "temp-%d.rdb", std::this_thread::get_id());
+    snprintf(tmpfile, 256, "temp-%zu.rdb", std::hash<std::thread::id>()(std::this_thread::get_id()));
     fp = ::fopen(tmpfile, "w");
     if (!fp) {
         LOG_TRACE << "Failed opening .rdb for saving:" << strerror(errno);
@@ -912,6 +1237,21 @@ time_t Rdb::rdbLoadTime(Rio *rdb) {
 }
 
 int32_t Rdb::rdbLoadRio(Rio *rdb) {
+    uint64_t cksum;
+    if (rdbLoadEntries(rdb, std::bind(&Rdb::rdbLoadKeyValue, this, std::placeholders::_1,
+                                      std::placeholders::_2, std::placeholders::_3,
+                                      std::placeholders::_4)) == REDIS_ERR) {
+        return REDIS_ERR;
+    }
+
+    uint64_t expected = rdb->cksum;
+    if (rdbLoadChecksum(rdb, &cksum) == REDIS_ERR) {
+        return REDIS_ERR;
+    }
+    return rdbVerifyChecksum(cksum, expected);
+}
+
+int32_t Rdb::rdbLoadEntries(Rio *rdb, const KeyValueCallback &loadKeyValue) {
     uint32_t dbid;
     int32_t type, rdbver;
     char buf[1024];
@@ -931,7 +1271,7 @@ int32_t Rdb::rdbLoadRio(Rio *rdb) {
     if (rdbver < REDIS_OK || rdbver > REDIS_RDB_VERSION) {
         LOG_WARN << "Can't handle RDB format version " << rdbver;
         errno = EINVAL;
-        return REDIS_OK;
+        return REDIS_ERR;
     }
 
     int64_t expiretime = REDIS_ERR, now = mstime();
@@ -1001,24 +1341,10 @@ int32_t Rdb::rdbLoadRio(Rio *rdb) {
                 LOG_WARN << "RDB " << (char *) auxkey->ptr << " " << (char *) auxval->ptr;
             }
             continue; /* Read type again. */
-        } else if (type == REDIS_STRING) {
-            if (rdbLoadString(rdb, type, expiretime, now) == REDIS_ERR) {
-                return REDIS_ERR;
-            }
-        } else if (type == REDIS_HASH) {
-            if (rdbLoadHash(rdb, type) == REDIS_ERR) {
-                return REDIS_ERR;
-            }
-        } else if (type == REDIS_LIST) {
-            if (rdbLoadList(rdb, type) == REDIS_ERR) {
-                return REDIS_ERR;
-            }
-        } else if (type == REDIS_SET) {
-            if (rdbLoadSet(rdb, type) == REDIS_ERR) {
-                return REDIS_ERR;
-            }
-        } else if (type == REDIS_ZSET) {
-            if (rdbLoadZset(rdb, type) == REDIS_ERR) {
+        } else if (type == REDIS_STRING || type == REDIS_HASH || type == REDIS_RDB_TYPE_HASH_LISTPACK ||
+                   type == REDIS_LIST || type == REDIS_SET || type == REDIS_RDB_TYPE_SET_INTSET ||
+                   type == REDIS_ZSET) {
+            if (loadKeyValue(rdb, type, expiretime, now) == REDIS_ERR) {
                 return REDIS_ERR;
             }
         } else {
@@ -1027,15 +1353,18 @@ int32_t Rdb::rdbLoadRio(Rio *rdb) {
 
         expiretime = REDIS_ERR;
     }
+    return REDIS_OK;
+}
 
-    uint64_t cksum;
-    uint64_t expected = rdb->cksum;
-
-    if (rioRead(rdb, &cksum, 8) == 0) {
+int32_t Rdb::rdbLoadChecksum(Rio *rdb, uint64_t *cksum) {
+    if (rioRead(rdb, cksum, 8) == 0) {
         return REDIS_ERR;
     }
-    memrev64ifbe(&cksum);
+    memrev64ifbe(cksum);
+    return REDIS_OK;
+}
 
+int32_t Rdb::rdbVerifyChecksum(uint64_t cksum, uint64_t expected) {
     if (cksum == 0) {
         LOG_WARN << "RDB file was saved with checksum disabled: no check performed";
         return REDIS_ERR;
@@ -1048,15 +1377,19 @@ int32_t Rdb::rdbLoadRio(Rio *rdb) {
 
 int32_t Rdb::rdbLoad(const char *filename) {
     FILE *fp;
-    Rio rdb;
     int32_t retval;
     if ((fp = ::fopen(filename, "r")) == nullptr) {
         return REDIS_ERR;
     }
 
-    startLoading(fp);
-    rioInitWithFile(&rdb, fp);
-    retval = rdbLoadRio(&rdb);
+    int64_t size = startLoading(fp);
+    if (size == REDIS_ERR) {
+        ::fclose(fp);
+        return REDIS_ERR;
+    }
+
+    RdbLoader loader(this, RdbLoader::defaultWorkers());
+    retval = loader.load(fp, size);
     ::fclose(fp);
     return retval;
 }
@@ -1114,19 +1447,20 @@ int32_t Rdb::rdbSaveLzfStringObject(Rio *rdb, uint8_t *s, size_t len) {
     int32_t n, nwritten = 0;
     void *out;
 
+    /* 0 means the string is not compressed and is written as it is. */
     if (len <= 4) {
-        return REDIS_NULL;
+        return 0;
     }
 
     outlen = len - 4;
     if ((out = zmalloc(outlen + 1)) == nullptr) {
-        return REDIS_NULL;
+        return 0;
     }
 
     comprlen = lzfCompress(s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
-        return REDIS_NULL;
+        return 0;
     }
 
     byte = (REDIS_RDB_ENCVAL << 6) | REDIS_RDB_ENC_LZF;
@@ -1252,8 +1586,9 @@ ssize_t Rdb::rdbSaveLongLongAsStringObject(Rio *rdb, int64_t value) {
 }
 
 int32_t Rdb::rdbSaveStringObject(Rio *rdb, const RedisObjectPtr &obj) {
-    if (obj->encoding == OBJ_ENCODING_INT) {
-        return rdbSaveLongLongAsStringObject(rdb, *(int32_t *) obj->ptr);
+    int64_t value;
+    if (obj->encoding == OBJ_ENCODING_INT && string2ll(obj->ptr, sdslen(obj->ptr), &value)) {
+        return rdbSaveLongLongAsStringObject(rdb, value);
     } else {
         return rdbSaveRawString(rdb, obj->ptr, sdslen(obj->ptr));
     }
@@ -1420,9 +1755,15 @@ int32_t Rdb::rdbSaveRio(Rio *rdb, int32_t *error, int32_t flags) {
             goto werr;
         }
 
-        uint32_t dbSize, expireSize;
-        dbSize = redis->getDbsize();
-        expireSize = redis->getExpireSize();
+        /* Counted here rather than with getDbsize(), which always locks the
+         * shards: a forked child must not touch the locks it inherited. */
+        uint32_t dbSize = 0, expireSize = 0;
+        for (auto &it : redis->getRedisShards()) {
+            if (blockEnabled) it.mtx.lock();
+            dbSize += it.redisMap.size();
+            expireSize += it.expireMap.size();
+            if (blockEnabled) it.mtx.unlock();
+        }
 
         if (rdbSaveType(rdb, RDB_OPCODE_RESIZEDB) == REDIS_ERR) {
             goto werr;
@@ -1461,7 +1802,7 @@ int32_t Rdb::rdbSave(const char *filename) {
     FILE *fp;
     Rio rdb;
     int32_t error;
-    snprintf(tmpfile, 256, "temp-%d.rdb", std::this_thread::get_id());
+    snprintf(tmpfile, 256, "temp-%zu.rdb", std::hash<std::thread::id>()(std::this_thread::get_id()));
     fp = ::fopen(tmpfile, "w");
     if (!fp) {
         LOG_TRACE << "Failed opening rdb for saving:" << strerror(errno);
@@ -61,6 +61,20 @@ struct RdbState {
     char error[1024];
 };
 
+/* Master side state of a full resync. Every replica reads the snapshot
+ * through its own FILE, so concurrent transfers can share one dump.rdb. */
+struct SyncTransfer {
+    TcpConnectionPtr conn;
+    FILE *fp;
+    int64_t size;
+    int64_t start;
+    std::atomic <int64_t> offset;
+    int64_t lastOffset;        /* Offset seen by the last replica timeout check. */
+    bool done;
+};
+
+typedef std::shared_ptr <SyncTransfer> SyncTransferPtr;
+
 class Redis;
 
 class Rdb {
@@ -123,8 +137,29 @@ public:
 
     void rioInitWithBuffer(Rio *r, sds s);
 
+    void rioInitWithFdset(Rio *r, int32_t *fds, int32_t numfds);
+
+    void rioFreeFdset(Rio *r);
+
+    size_t rioFdsetWrite(Rio *r, const void *buf, size_t len);
+
+    off_t rioFdsetTell(Rio *r);
+
+    int32_t rioFdsetFlush(Rio *r);
+
+    typedef std::function<int32_t(Rio *, int32_t, int64_t, int64_t)> KeyValueCallback;
+
     int32_t rdbLoadRio(Rio *rdb);
 
+    /* Walks the opcodes up to RDB_OPCODE_EOF, every key/value entry is left
+     * to the callback with its type, expire and the load time. */
+    int32_t rdbLoadEntries(Rio *rdb, const KeyValueCallback &loadKeyValue);
+
+    /* Reads the trailing checksum of the file. */
+    int32_t rdbLoadChecksum(Rio *rdb, uint64_t *cksum);
+
+    int32_t rdbVerifyChecksum(uint64_t cksum, uint64_t expected);
+
     int32_t startLoading(FILE *fp);
 
     int32_t rdbSaveBinaryDoubleValue(Rio *rdb, double val);
@@ -139,6 +174,8 @@ public:
 
     int32_t rdbSaveRio(Rio *rdb, int32_t *error, int32_t flags);
 
+    int32_t rdbSaveRioWithEOFMark(Rio *rdb, int32_t *error);
+
     int32_t rdbSaveObject(Rio *rdb, const RedisObjectPtr &o);
 
     int32_t rdbSaveStringObject(Rio *rdb, const RedisObjectPtr &obj);
@@ -166,21 +203,39 @@ public:
 
     int32_t rdbLoadBinaryDoubleValue(Rio *rdb, double *val);
 
-    int32_t rdbLoadString(Rio *rdb, int32_t type, int64_t expiretime, int64_t now);
-
-    int32_t rdbLoadHash(Rio *rdb, int32_t type);
+    /* Reads a key and its value of the rdb type into the keyspace, keys
+     * already expired are skipped. */
+    int32_t rdbLoadKeyValue(Rio *rdb, int32_t type, int64_t expiretime, int64_t now);
 
-    int32_t rdbLoadList(Rio *rdb, int32_t type);
+    /* Reads the value of the rdb type and inserts it under the key. */
+    int32_t rdbLoadValue(Rio *rdb, int32_t type, const RedisObjectPtr &key, int64_t expiretime);
 
-    int32_t rdbLoadZset(Rio *rdb, int32_t type);
+    /* Reads past a value of the rdb type without decoding it. */
+    int32_t rdbSkipValue(Rio *rdb, int32_t type);
 
-    int32_t rdbLoadSet(Rio *rdb, int32_t type);
+    int32_t rdbSkipStringObject(Rio *rdb);
 
     uint32_t rdbLoadLen(Rio *rdb, int32_t *isencoded);
 
     int32_t rdbLoad(const char *fileName);
 
-    bool rdbReplication(char *filename, const TcpConnectionPtr &conn);
+    bool rdbReplication(const char *filename, const TcpConnectionPtr &conn);
+
+    void rdbReplicationInLoop(const SyncTransferPtr &transfer);
+
+    void sendSyncChunk(const SyncTransferPtr &transfer);
+
+    void finishSyncTransfer(const SyncTransferPtr &transfer, bool success);
+
+    void abortSyncTransfer(int32_t sockfd);
+
+    bool syncTransferProgress(int32_t sockfd);
+
+    sds catSyncTransferInfo(sds info);
+
+    void setSyncRateLimit(int64_t limit) { syncRateLimit = limit; }
+
+    int64_t getSyncRateLimit() { return syncRateLimit; }
 
     RedisObjectPtr rdbLoadObject(int32_t type, Rio *rdb);
 
@@ -210,9 +265,18 @@ public:
 
     void setBlockEnable(bool enabled) { blockEnabled = enabled; }
 
-    int32_t createDumpPayload(Rio *rdb, const RedisObjectPtr &obj);
+    /* Writes the type and value of the key as DUMP serializes them,
+     * REDIS_ERR when there is no such key. *expiretime gets the expire of
+     * the key, REDIS_ERR if it has none. */
+    int32_t createDumpPayload(Rio *rdb, const RedisObjectPtr &obj, int64_t *expiretime = nullptr);
+
+    /* Reads what createDumpPayload() wrote into the key. When the key
+     * exists and replace is not set nothing changes, REDIS_ERR is returned
+     * and *busy set. */
+    int32_t restoreDumpPayload(Rio *rdb, const RedisObjectPtr &key, int64_t expiretime,
+                               bool replace, bool *busy);
 
-    int32_t verifyDumpPayload(Rio *rdb, const RedisObjectPtr &obj);
+    Redis *getRedis() { return redis; }
 
 private:
     Rdb(const Rdb &);
@@ -223,6 +287,9 @@ private:
     RdbState rdbState;
     bool blockEnabled;
     int32_t rdbCheckMode;
+    std::mutex syncMutex;
+    std::unordered_map <int32_t, SyncTransferPtr> syncTransfers;
+    std::atomic <int64_t> syncRateLimit;   /* Bytes per second per replica, 0 is unlimited. */
 };
 
 
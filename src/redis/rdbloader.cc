@@ -0,0 +1,257 @@
+#include "rdbloader.h"
+#include "redis.h"
+
+static const size_t kLoadBlockBytes = 4 * 1024 * 1024;
+static const size_t kLoadQueueBlocks = 8;
+static const size_t kLoadBatchBytes = 1024 * 1024;
+static const size_t kLoadBatchEntries = 4096;
+static const size_t kLoadQueueBatches = 8;
+static const int32_t kLoadMaxWorkers = 16;
+
+static int32_t checksumFile(FILE *fp, uint64_t len, uint64_t *cksum) {
+    char buf[64 * 1024];
+    uint64_t crc = 0;
+    ::rewind(fp);
+    while (len > 0) {
+        size_t count = std::min<uint64_t>(len, sizeof(buf));
+        if (::fread(buf, count, 1, fp) != 1) {
+            return REDIS_ERR;
+        }
+
+        crc = crc64(crc, (const unsigned char *) buf, count);
+        len -= count;
+    }
+
+    *cksum = crc;
+    return REDIS_OK;
+}
+
+RdbLoader::RdbLoader(Rdb *rdb, int32_t workers)
+        : rdb(rdb),
+          workers(workers),
+          blocks(kLoadQueueBlocks),
+          checksums(kLoadQueueBlocks),
+          blockPos(0),
+          capture(nullptr),
+          cksum(0),
+          failed(false),
+          records(0) {
+    for (int32_t i = 0; i < workers; i++) {
+        batches.emplace_back(new LoadQueue<BatchPtr>(kLoadQueueBatches));
+        pending.emplace_back(new Batch());
+    }
+}
+
+RdbLoader::~RdbLoader() {
+
+}
+
+int32_t RdbLoader::defaultWorkers() {
+    int32_t cores = std::thread::hardware_concurrency();
+    return std::max(1, std::min(cores, kLoadMaxWorkers));
+}
+
+void RdbLoader::abort() {
+    failed = true;
+    blocks.close();
+    checksums.close();
+    for (auto &it : batches) {
+        it->close();
+    }
+}
+
+void RdbLoader::readBlocks(FILE *fp) {
+    while (true) {
+        BlockPtr data = std::make_shared<std::string>();
+        data->resize(kLoadBlockBytes);
+        size_t n = ::fread(&(*data)[0], 1, kLoadBlockBytes, fp);
+        if (n == 0) {
+            break;
+        }
+
+        data->resize(n);
+        if (!checksums.push(data)) {
+            break;
+        }
+
+        /* Fails once the entries are all read, the checksum still needs
+         * whatever follows them. */
+        blocks.push(data);
+        if (n < kLoadBlockBytes) {
+            break;
+        }
+    }
+
+    checksums.close();
+    blocks.close();
+}
+
+void RdbLoader::checksumBlocks(uint64_t limit) {
+    uint64_t crc = 0, pos = 0;
+    BlockPtr data;
+    while (checksums.pop(data)) {
+        if (pos < limit) {
+            uint64_t len = std::min<uint64_t>(data->size(), limit - pos);
+            crc = crc64(crc, (const unsigned char *) data->data(), len);
+        }
+        pos += data->size();
+    }
+    cksum = crc;
+}
+
+void RdbLoader::decodeBatches(int32_t id) {
+    BatchPtr batch;
+    while (batches[id]->pop(batch)) {
+        Rio r;
+        rdb->rioInitWithBuffer(&r, batch->data);
+        for (auto &it : batch->entries) {
+            if (rdb->rdbLoadValue(&r, it.type, it.key, it.expiretime) == REDIS_ERR) {
+                LOG_WARN << "Corrupt value of key " << (char *) it.key->ptr << " in RDB file";
+                abort();
+                return;
+            }
+        }
+    }
+}
+
+size_t RdbLoader::rioBlockRead(Rio *r, void *buf, size_t len) {
+    char *p = (char *) buf;
+    while (len > 0) {
+        if (block == nullptr || blockPos == block->size()) {
+            if (!blocks.pop(block)) {
+                return 0;
+            }
+            blockPos = 0;
+        }
+
+        size_t count = std::min(len, block->size() - blockPos);
+        memcpy(p, block->data() + blockPos, count);
+        blockPos += count;
+        p += count;
+        len -= count;
+    }
+    return REDIS_OK;
+}
+
+void RdbLoader::rioCapture(Rio *r, const void *buf, size_t len) {
+    if (capture != nullptr) {
+        *capture = sdscatlen(*capture, buf, len);
+    }
+}
+
+int32_t RdbLoader::splitKeyValue(Rio *r, int32_t type, int64_t expiretime, int64_t now) {
+    RedisObjectPtr key;
+    if ((key = rdb->rdbLoadStringObject(r)) == nullptr) {
+        return REDIS_ERR;
+    }
+
+    int32_t id = (key->hash % Redis::kShards) % workers;
+    Batch *batch = pending[id].get();
+    size_t mark = sdslen(batch->data);
+    capture = &batch->data;
+    int32_t retval = rdb->rdbSkipValue(r, type);
+    capture = nullptr;
+    if (retval == REDIS_ERR) {
+        return REDIS_ERR;
+    }
+
+    /* Keys already expired at load time are skipped. */
+    if (expiretime != REDIS_ERR && expiretime <= now) {
+        sdssetlen(batch->data, mark);
+        batch->data[mark] = '\0';
+        return REDIS_OK;
+    }
+
+    batch->entries.push_back({key, type, expiretime});
+    records++;
+    if (sdslen(batch->data) >= kLoadBatchBytes || batch->entries.size() >= kLoadBatchEntries) {
+        return flushBatch(id) ? REDIS_OK : REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+bool RdbLoader::flushBatch(int32_t id) {
+    if (pending[id]->entries.empty()) {
+        return true;
+    }
+
+    BatchPtr batch(new Batch());
+    batch.swap(pending[id]);
+    return batches[id]->push(std::move(batch));
+}
+
+int32_t RdbLoader::load(FILE *fp, int64_t size) {
+    int64_t start = ustime();
+    uint64_t limit = size > 8 ? size - 8 : 0;
+    std::thread reader(&RdbLoader::readBlocks, this, fp);
+    std::thread checker(&RdbLoader::checksumBlocks, this, limit);
+    std::vector <std::thread> threads;
+    for (int32_t i = 0; i < workers; i++) {
+        threads.emplace_back(&RdbLoader::decodeBatches, this, i);
+    }
+
+    Rio r;
+    r.readFuc = std::bind(&RdbLoader::rioBlockRead, this,
+                          std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    r.updateFuc = std::bind(&RdbLoader::rioCapture, this,
+                            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    r.cksum = 0;
+    r.processedBytes = 0;
+    r.maxProcessingChunk = 0;
+
+    uint64_t stored = 0;
+    int32_t retval = rdb->rdbLoadEntries(&r, std::bind(&RdbLoader::splitKeyValue, this,
+                                                        std::placeholders::_1, std::placeholders::_2,
+                                                        std::placeholders::_3, std::placeholders::_4));
+    for (int32_t i = 0; i < workers && retval == REDIS_OK; i++) {
+        if (!flushBatch(i)) {
+            retval = REDIS_ERR;
+        }
+    }
+
+    if (retval == REDIS_OK) {
+        retval = rdb->rdbLoadChecksum(&r, &stored);
+    }
+
+    if (retval == REDIS_ERR) {
+        abort();
+    }
+
+    for (auto &it : batches) {
+        it->close();
+    }
+
+    for (auto &it : threads) {
+        it.join();
+    }
+
+    blocks.close();
+    reader.join();
+    checker.join();
+    if (retval == REDIS_ERR || failed) {
+        return REDIS_ERR;
+    }
+
+    /* The checksum thread assumed the file ends with the checksum, anything
+     * after it was covered too, so the data is checked once more here. */
+    if (r.processedBytes != (size_t) size) {
+        LOG_WARN << "Unexpected data after the RDB checksum";
+        if (checksumFile(fp, r.processedBytes - 8, &cksum) == REDIS_ERR) {
+            return REDIS_ERR;
+        }
+    }
+
+    if (rdb->rdbVerifyChecksum(stored, cksum) == REDIS_ERR) {
+        return REDIS_ERR;
+    }
+
+    double seconds = double(ustime() - start) / (1000 * 1000);
+    if (seconds <= 0) {
+        seconds = 1e-6;
+    }
+
+    LOG_INFO << "RDB loaded " << records << " keys in " << seconds << " seconds by "
+             << workers << " workers: " << int64_t(records / seconds) << " keys/s, "
+             << size / seconds / (1024 * 1024) << " MB/s";
+    return REDIS_OK;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+#include "rdb.h"
+
+/* Bounded queue between the threads of the loader. After close() push()
+ * fails at once and pop() fails when nothing is left. */
+template<typename T>
+class LoadQueue {
+public:
+    explicit LoadQueue(size_t capacity)
+            : capacity(capacity),
+              closed(false) {
+
+    }
+
+    bool push(T item) {
+        std::unique_lock <std::mutex> lck(mtx);
+        notFull.wait(lck, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T &item) {
+        std::unique_lock <std::mutex> lck(mtx);
+        notEmpty.wait(lck, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::unique_lock <std::mutex> lck(mtx);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    LoadQueue(const LoadQueue &);
+
+    void operator=(const LoadQueue &);
+
+    size_t capacity;
+    bool closed;
+    std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque <T> items;
+};
+
+/* Loads an RDB file with a pipeline of threads. A reader thread reads the
+ * file in large blocks and hands each one to a checksum thread and to the
+ * calling thread. The calling thread walks the opcodes, decodes only the
+ * keys and copies the still encoded values into a batch for the worker that
+ * owns the shard of the key. Worker i owns the shards with index % workers
+ * == i, so it decodes and inserts without waiting on the shard locks. */
+class RdbLoader {
+public:
+    RdbLoader(Rdb *rdb, int32_t workers);
+
+    ~RdbLoader();
+
+    static int32_t defaultWorkers();
+
+    int32_t load(FILE *fp, int64_t size);
+
+private:
+    RdbLoader(const RdbLoader &);
+
+    void operator=(const RdbLoader &);
+
+    typedef std::shared_ptr <std::string> BlockPtr;
+
+    struct Entry {
+        RedisObjectPtr key;
+        int32_t type;
+        int64_t expiretime;
+    };
+
+    /* The values of the entries one after another, as they were read. */
+    struct Batch {
+        Batch() : data(sdsempty()) {}
+
+        ~Batch() { sdsfree(data); }
+
+        sds data;
+        std::vector <Entry> entries;
+    };
+
+    typedef std::unique_ptr <Batch> BatchPtr;
+
+    void readBlocks(FILE *fp);
+
+    void checksumBlocks(uint64_t limit);
+
+    void decodeBatches(int32_t id);
+
+    size_t rioBlockRead(Rio *r, void *buf, size_t len);
+
+    void rioCapture(Rio *r, const void *buf, size_t len);
+
+    int32_t splitKeyValue(Rio *r, int32_t type, int64_t expiretime, int64_t now);
+
+    bool flushBatch(int32_t id);
+
+    void abort();
+
+    Rdb *rdb;
+    int32_t workers;
+    LoadQueue <BlockPtr> blocks;
+    LoadQueue <BlockPtr> checksums;
+    std::vector <std::unique_ptr<LoadQueue<BatchPtr>>> batches;
+    std::vector <BatchPtr> pending;
+    BlockPtr block;
+    size_t blockPos;
+    sds *capture;              /* Batch the bytes read go to, if any. */
+    uint64_t cksum;
+    std::atomic<bool> failed;
+    int64_t records;
+};
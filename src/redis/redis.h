@@ -1,439 +1,562 @@
-#pragma once
-
-#include "all.h"
-#include "eventloop.h"
-#include "tcpconnection.h"
-#include "buffer.h"
-#include "tcpserver.h"
-#include "sds.h"
-#include "session.h"
-#include "object.h"
-#include "rdb.h"
-#include "log.h"
-#include "socket.h"
-#include "replication.h"
-#include "cluster.h"
-#include "util.h"
-
-class Redis {
-public:
-    Redis(const char *ip, int16_t port, int16_t threadCount, bool enbaledCluster = false);
-
-    ~Redis();
-
-    void initConfig();
-
-    void scriptingInit();
-
-    void timeOut();
-
-    void serverCron();
-
-    void bgsaveCron();
-
-    void slaveRepliTimeOut(int32_t context);
-
-    void setExpireTimeOut(const RedisObjectPtr &expire);
-
-    void forkWait();
-
-    void run();
-
-    void connCallBack(const TcpConnectionPtr &conn);
-
-    void highWaterCallBack(const TcpConnectionPtr &conn, size_t bytesToSent);
-
-    void writeCompleteCallBack(const TcpConnectionPtr &conn);
-
-    void replyCheck();
-
-    void loadDataFromDisk();
-
-    void flush();
-
-#ifdef _LUA
-    void luaLoadLib(lua_State *lua, const char *libname, lua_CFunction luafunc);
-    static int32_t luaRedisCallCommand(lua_State *lua);
-    static int32_t luaRedisPCallCommand(lua_State *lua);
-    int32_t luaRedisGenericCommand(lua_State *lua, int32_t raise);
-    void luaLoadLibraries(lua_State *lua);
-    void luaRemoveUnsupportedFunctions(lua_State *lua);
-    void scriptingEnableGlobalsProtection(lua_State *lua);
-    int32_t luaCreateFunction(Buffer *buffer, lua_State *lua,
-        char *funcname, const RedisObjectPtr &body);
-    void luaSetGlobalArray(lua_State *lua, char *var,
-        const std::deque<RedisObjectPtr> &elev, int32_t start, int32_t elec);
-    bool evalCommand(const std::deque<RedisObjectPtr> &obj,
-        const SessionPtr &session, const TcpConnectionPtr &conn);
-    void luaReplyToRedisReply(Buffer *buffer, lua_State *lua);
-    void luaPushError(lua_State *lua, char *error);
-#endif
-
-    bool saveCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool pingCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool debugCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool flushdbCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool dbsizeCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool quitCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool delCommand(const std::deque <RedisObjectPtr> &obj,
-                    const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool setCommand(const std::deque <RedisObjectPtr> &obj,
-                    const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool getCommand(const std::deque <RedisObjectPtr> &obj,
-                    const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool hkeysCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool hlenCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool hsetCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool hgetCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool hgetallCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool zaddCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool zrangeCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool zcardCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool zrevrangeCommand(const std::deque <RedisObjectPtr> &obj,
-                          const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool zrangeGenericCommand(const std::deque <RedisObjectPtr> &obj,
-                              const SessionPtr &session, const TcpConnectionPtr &conn, int reverse);
-
-    bool lpushCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool lpopCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool lrangeCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool rpushCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool rpopCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool llenCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool scardCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool saddCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool subscribeCommand(const std::deque <RedisObjectPtr> &obj,
-                          const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool unsubscribeCommand(const std::deque <RedisObjectPtr> &obj,
-                            const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool psubscribeCommand(const std::deque <RedisObjectPtr> &obj,
-                           const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool punsubscribeCommand(const std::deque <RedisObjectPtr> &obj,
-                             const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool publishCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool pubsubCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool existsCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool dumpCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool restoreCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool slaveofCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool syncCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool psyncCommand(const std::deque <RedisObjectPtr> &obj,
-                      const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool commandCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool clusterCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool authCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool configCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool infoCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool clientCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool echoCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool keysCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool bgsaveCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool memoryCommand(const std::deque <RedisObjectPtr> &obj,
-                       const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool sentinelCommand(const std::deque <RedisObjectPtr> &obj,
-                         const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool migrateCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool ttlCommand(const std::deque <RedisObjectPtr> &obj,
-                    const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool incrCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool decrCommand(const std::deque <RedisObjectPtr> &obj,
-                     const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool incrDecrCommand(const RedisObjectPtr &obj,
-                         const SessionPtr &session, const TcpConnectionPtr &conn, int64_t incr);
-
-    bool monitorCommand(const std::deque <RedisObjectPtr> &obj,
-                        const SessionPtr &session, const TcpConnectionPtr &conn);
-
-public:
-#ifndef _WIN64
-
-    int32_t rdbSaveBackground(bool enabled = false);
-
-    bool bgsave(const SessionPtr &session,
-                const TcpConnectionPtr &conn, bool enabled = false);
-
-#endif
-
-    bool save(const SessionPtr &session, const TcpConnectionPtr &conn);
-
-    bool removeCommand(const RedisObjectPtr &obj);
-
-    bool clearClusterMigradeCommand();
-
-    void clearFork();
-
-    void clearCommand();
-
-    void clearSessionState(int32_t sockfd);
-
-    void clearRepliState(int32_t sockfd);
-
-    void clearClusterState(int32_t sockfd);
-
-    void clearPubSubState(int32_t sockfd);
-
-    void clearMonitorState(int32_t sockfd);
-
-    void clearCommand(std::deque <RedisObjectPtr> &commands);
-
-    RedisObjectPtr createDumpPayload(const RedisObjectPtr &dump);
-
-    void feedMonitor(const std::deque <RedisObjectPtr> &obj, int32_t sockfd);
-
-    void structureRedisProtocol(Buffer &buffer, std::deque <RedisObjectPtr> &robjs);
-
-    void setExpire(const RedisObjectPtr &key, double when);
-
-    bool checkCommand(const RedisObjectPtr &cmd);
-
-    EventLoop *getEventLoop() { return &loop; }
-
-    Rdb *getRdb() { return &rdb; }
-
-    Cluster *getCluster() { return &clus; }
-
-    Replication *getReplication() { return &repli; }
-
-    size_t getDbsize();
-
-    size_t getExpireSize();
-
-    int64_t getExpire(const RedisObjectPtr &obj);
-
-    std::string &getIp() { return ip; }
-
-    int16_t getPort() { return port; }
-
-    bool getClusterMap(const RedisObjectPtr &command);
-
-    auto &getHandlerCommandMap() { return handlerCommands; }
-
-    auto &getRedisShards() { return redisShards; }
-
-    auto &getSession() { return sessions; }
-
-    auto &getSessionConn() { return sessionConns; }
-
-    auto &getClusterConn() { return clusterConns; }
-
-    auto &getRepliTimer() { return repliTimers; }
-
-    auto &getSlaveConn() { return slaveConns; }
-
-    auto &getExpireTimer() { return expireTimers; }
-
-    auto &getClusterMutex() { return clusterMutex; }
-
-    auto &getSlaveMutex() { return slaveMutex; }
-
-    auto &getExpireMutex() { return expireMutex; }
-
-    auto &getMutex() { return mtx; }
-
-    auto &getForkMutex() { return forkMutex; }
-
-    auto &pubSubMutex() { return pubsubMutex; }
-
-public:
-    const static int32_t kShards = 1024;
-    typedef std::function<bool(const std::deque <RedisObjectPtr> &,
-                               const SessionPtr &, const TcpConnectionPtr &)> CommandFunc;
-    typedef std::unordered_map <RedisObjectPtr,
-    RedisObjectPtr, Hash, Equal> StringMap;
-    typedef std::unordered_map <RedisObjectPtr, std::unordered_map<RedisObjectPtr,
-            RedisObjectPtr, Hash, Equal>, Hash, Equal> HashMap;
-    typedef std::unordered_map <RedisObjectPtr,
-    std::deque<RedisObjectPtr>, Hash, Equal> ListMap;
-    typedef std::unordered_map<RedisObjectPtr, double, Hash, Equal> SortIndexMap;
-    typedef std::multimap<double, RedisObjectPtr> SortMap;
-    typedef std::unordered_map <RedisObjectPtr,
-    std::pair<SortIndexMap, SortMap>, Hash, Equal> ZsetMap;
-    typedef std::unordered_map <RedisObjectPtr,
-    std::unordered_set<RedisObjectPtr, Hash, Equal>, Hash, Equal> SetMap;
-    typedef std::unordered_set <RedisObjectPtr, Hash, Equal> RedisMap;
-    typedef std::unordered_set <RedisObjectPtr, Hash, Equal> Command;
-
-private:
-    Redis(const Redis &);
-
-    void operator=(const Redis &);
-
-    std::unordered_map <int32_t, SessionPtr> sessions;
-    std::unordered_map <int32_t, TcpConnectionPtr> sessionConns;
-    std::unordered_map <int32_t, TcpConnectionPtr> slaveConns;
-    std::unordered_map <int32_t, TcpConnectionPtr> clusterConns;
-    std::unordered_map <int32_t, TimerPtr> repliTimers;
-    std::unordered_map <RedisObjectPtr, TimerPtr, Hash, Equal> expireTimers;
-    std::unordered_map <RedisObjectPtr,
-    std::unordered_map<int32_t, TcpConnectionPtr>, Hash, Equal> pubSubs;
-    std::unordered_map <int32_t, TcpConnectionPtr> monitorConns;
-    std::unordered_map <RedisObjectPtr, CommandFunc, Hash, Equal> handlerCommands;
-    std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> luaScipts;
-
-    Command checkCommands;
-    Command stopReplis;
-    Command replyCommands;
-    Command cluterCommands;
-
-    struct RedisMapLock {
-        RedisMap redisMap;
-        StringMap stringMap;
-        HashMap hashMap;
-        ListMap listMap;
-        ZsetMap zsetMap;
-        SetMap setMap;
-        std::mutex mtx;
-    };
-
-    std::array <RedisMapLock, kShards> redisShards;
-
-    EventLoop loop;
-    TcpServer server;
-
-    std::mutex mtx;
-    std::mutex slaveMutex;
-    std::mutex expireMutex;
-    std::mutex sentinelMutex;
-    std::mutex clusterMutex;
-    std::mutex forkMutex;
-    std::mutex pubsubMutex;
-    std::mutex monitorMutex;
-public:
-    std::atomic<bool> clusterEnabled;
-    std::atomic<bool> slaveEnabled;
-    std::atomic<bool> authEnabled;
-    std::atomic<bool> repliEnabled;
-    std::atomic<bool> sentinelEnabled;
-    std::atomic<bool> clusterSlotEnabled;
-    std::atomic<bool> clusterRepliMigratEnabled;
-    std::atomic<bool> clusterRepliImportEnabeld;
-    std::atomic<bool> forkEnabled;
-    std::atomic<bool> monitorEnabled;
-
-    std::atomic <int32_t> forkCondWaitCount;
-    std::atomic <int32_t> rdbChildPid;
-    std::atomic <int32_t> salveCount;
-
-    std::condition_variable expireCondition;
-    std::condition_variable forkCondition;
-
-    Buffer slaveCached;
-    Buffer clusterMigratCached;
-    Buffer clusterImportCached;
-
-    std::string ip;
-    std::string password;
-    std::string masterHost;
-    std::string ipPort;
-    std::string master;
-    std::string slave;
-
-#ifdef _LUA
-    lua_State *lua;
-#endif
-    int16_t port;
-    int16_t threadCount;
-    int32_t masterPort;
-    int32_t dbnum;
-    int32_t slavefd;
-    int32_t masterfd;
-private:
-    Replication repli;
-    Cluster clus;
-    Rdb rdb;
-};
-
-
+#pragma once
+
+#include "all.h"
+#include "eventloop.h"
+#include "tcpconnection.h"
+#include "buffer.h"
+#include "tcpserver.h"
+#include "sds.h"
+#include "session.h"
+#include "object.h"
+#include "rdb.h"
+#include "aof.h"
+#include "log.h"
+#include "socket.h"
+#include "replication.h"
+#include "cluster.h"
+#include "dispatcher.h"
+#include "zset.h"
+#include "quicklist.h"
+#include "hash.h"
+#include "set.h"
+#include "scan.h"
+#include "slotindex.h"
+#include "migrate.h"
+#include "pubsub.h"
+#include "util.h"
+
+class Redis {
+public:
+    Redis(const char *ip, int16_t port, int16_t threadCount,
+          bool enbaledCluster = false, bool appendOnly = false,
+          TcpServer::AcceptMode acceptMode = TcpServer::kSingleAcceptor);
+
+    ~Redis();
+
+    void initConfig();
+
+    void scriptingInit();
+
+    void timeOut();
+
+    void serverCron();
+
+    void bgsaveCron();
+
+    void slaveRepliTimeOut(int32_t context);
+
+    void closeWaitBgsaveSlaves();
+
+    void activeExpireCycle();
+
+    void updateClocksCron();
+
+    std::vector<EventLoop *> getAllLoops();
+
+    void forkWait();
+
+    void run();
+
+    void connCallBack(const TcpConnectionPtr &conn);
+
+    void highWaterCallBack(const TcpConnectionPtr &conn, size_t bytesToSent);
+
+    void writeCompleteCallBack(const TcpConnectionPtr &conn);
+
+    void replyCheck();
+
+    void loadDataFromDisk();
+
+    void flush();
+
+#ifdef _LUA
+    void luaLoadLib(lua_State *lua, const char *libname, lua_CFunction luafunc);
+    static int32_t luaRedisCallCommand(lua_State *lua);
+    static int32_t luaRedisPCallCommand(lua_State *lua);
+    int32_t luaRedisGenericCommand(lua_State *lua, int32_t raise);
+    void luaLoadLibraries(lua_State *lua);
+    void luaRemoveUnsupportedFunctions(lua_State *lua);
+    void scriptingEnableGlobalsProtection(lua_State *lua);
+    int32_t luaCreateFunction(Buffer *buffer, lua_State *lua,
+        char *funcname, const RedisObjectPtr &body);
+    void luaSetGlobalArray(lua_State *lua, char *var,
+        const std::deque<RedisObjectPtr> &elev, int32_t start, int32_t elec);
+    bool evalCommand(const std::deque<RedisObjectPtr> &obj,
+        const SessionPtr &session, const TcpConnectionPtr &conn);
+    void luaReplyToRedisReply(Buffer *buffer, lua_State *lua);
+    void luaPushError(lua_State *lua, char *error);
+#endif
+
+    bool saveCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool pingCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool debugCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool flushdbCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool dbsizeCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool quitCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool delCommand(const std::deque <RedisObjectPtr> &obj,
+                    const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool setCommand(const std::deque <RedisObjectPtr> &obj,
+                    const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool getCommand(const std::deque <RedisObjectPtr> &obj,
+                    const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool mgetCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hkeysCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hlenCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hsetCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hgetCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hgetallCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zaddCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrangeCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zcardCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrevrangeCommand(const std::deque <RedisObjectPtr> &obj,
+                          const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrangeGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                              const SessionPtr &session, const TcpConnectionPtr &conn, int reverse);
+
+    bool zrangebyscoreCommand(const std::deque <RedisObjectPtr> &obj,
+                              const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrankCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrevrankCommand(const std::deque <RedisObjectPtr> &obj,
+                         const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zrankGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                             const SessionPtr &session, const TcpConnectionPtr &conn, bool reverse);
+
+    bool zscoreCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zremCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool lpushCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool lpopCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool lrangeCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool rpushCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool rpopCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool llenCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool pushGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                            const SessionPtr &session, const TcpConnectionPtr &conn, bool head);
+
+    bool popGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                           const SessionPtr &session, const TcpConnectionPtr &conn, bool head);
+
+    bool scardCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool saddCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool subscribeCommand(const std::deque <RedisObjectPtr> &obj,
+                          const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool unsubscribeCommand(const std::deque <RedisObjectPtr> &obj,
+                            const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool psubscribeCommand(const std::deque <RedisObjectPtr> &obj,
+                           const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool punsubscribeCommand(const std::deque <RedisObjectPtr> &obj,
+                             const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool publishCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool pubsubCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool existsCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool dumpCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool restoreCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool slaveofCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool syncCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool psyncCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    void fullResync(const SessionPtr &session, const TcpConnectionPtr &conn, bool psync);
+
+    bool commandCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool clusterCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool authCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool configCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool infoCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool clientCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool echoCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool keysCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool scanCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool hscanCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool sscanCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool zscanCommand(const std::deque <RedisObjectPtr> &obj,
+                      const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool scanGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                            const SessionPtr &session, const TcpConnectionPtr &conn, int32_t type);
+
+    bool bgsaveCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool bgrewriteaofCommand(const std::deque <RedisObjectPtr> &obj,
+                             const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool memoryCommand(const std::deque <RedisObjectPtr> &obj,
+                       const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool sentinelCommand(const std::deque <RedisObjectPtr> &obj,
+                         const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool migrateCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool ttlCommand(const std::deque <RedisObjectPtr> &obj,
+                    const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool pttlCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool ttlGenericCommand(const std::deque <RedisObjectPtr> &obj,
+                           const SessionPtr &session, const TcpConnectionPtr &conn, bool outputMs);
+
+    bool incrCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool decrCommand(const std::deque <RedisObjectPtr> &obj,
+                     const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool incrDecrCommand(const RedisObjectPtr &obj,
+                         const SessionPtr &session, const TcpConnectionPtr &conn, int64_t incr);
+
+    bool monitorCommand(const std::deque <RedisObjectPtr> &obj,
+                        const SessionPtr &session, const TcpConnectionPtr &conn);
+
+public:
+#ifndef _WIN64
+
+    int32_t rdbSaveBackground(bool enabled = false);
+
+    int32_t rdbSaveToSlavesSockets(const std::string &preamble);
+
+    pid_t forkChild();
+
+    bool bgsave(const SessionPtr &session,
+                const TcpConnectionPtr &conn, bool enabled = false);
+
+#endif
+
+    bool save(const SessionPtr &session, const TcpConnectionPtr &conn);
+
+    bool removeCommand(const RedisObjectPtr &obj);
+
+    bool clearClusterMigradeCommand();
+
+    void clearFork();
+
+    void clearCommand();
+
+    void clearSessionState(int32_t sockfd);
+
+    void clearRepliState(int32_t sockfd);
+
+    void clearClusterState(int32_t sockfd);
+
+    void clearPubSubState(int32_t sockfd);
+
+    void clearMonitorState(int32_t sockfd);
+
+    void clearCommand(std::deque <RedisObjectPtr> &commands);
+
+    RedisObjectPtr createDumpPayload(const RedisObjectPtr &dump, int64_t *expiretime = nullptr);
+
+    void feedMonitor(const std::deque <RedisObjectPtr> &obj, int32_t sockfd);
+
+    void structureRedisProtocol(Buffer &buffer, std::deque <RedisObjectPtr> &robjs);
+
+    bool checkCommand(const RedisObjectPtr &cmd);
+
+    bool denyOomCommand(const RedisObjectPtr &cmd);
+
+    int32_t freeMemoryIfNeeded();
+
+    bool setMaxmemoryPolicy(const char *name);
+
+    const char *getMaxmemoryPolicyName();
+
+    int32_t readCommandShard(const RedisObjectPtr &cmd, const std::deque <RedisObjectPtr> &obj,
+                             RedisObjectPtr *name);
+
+    void holdShard(std::unique_lock <std::mutex> &lck, int32_t index);
+
+    void lockWriteShards(const RedisObjectPtr &cmd, const std::deque <RedisObjectPtr> &obj,
+                         std::vector <std::unique_lock<std::mutex>> &locks);
+
+    void unlockWriteShards(std::vector <std::unique_lock<std::mutex>> &locks);
+
+    std::unique_lock <std::mutex> lockShard(size_t index);
+
+    EventLoop *getEventLoop() { return &loop; }
+
+    Rdb *getRdb() { return &rdb; }
+
+    Aof *getAof() { return &aof; }
+
+    Cluster *getCluster() { return &clus; }
+
+    Replication *getReplication() { return &repli; }
+
+    Migrator *getMigrator() { return &migrator; }
+
+    PubSub *getPubSub() { return &pubsub; }
+
+    Dispatcher *getDispatcher() { return &dispatcher; }
+
+    size_t getDbsize();
+
+    size_t getExpireSize();
+
+    std::string &getIp() { return ip; }
+
+    int16_t getPort() { return port; }
+
+    bool getClusterMap(const RedisObjectPtr &command);
+
+    auto &getHandlerCommandMap() { return handlerCommands; }
+
+    auto &getRedisShards() { return redisShards; }
+
+    auto &getSlotIndex() { return slotIndex; }
+
+    auto &getSession() { return sessions; }
+
+    auto &getSessionConn() { return sessionConns; }
+
+    auto &getClusterConn() { return clusterConns; }
+
+    auto &getRepliTimer() { return repliTimers; }
+
+    auto &getSlaveConn() { return slaveConns; }
+
+    auto &getSlaveSyncOffsets() { return slaveSyncOffsets; }
+
+    auto &getClusterMutex() { return clusterMutex; }
+
+    auto &getSlaveMutex() { return slaveMutex; }
+
+    auto &getMutex() { return mtx; }
+
+    auto &getForkMutex() { return forkMutex; }
+
+public:
+    const static int32_t kShards = 1024;
+    typedef std::function<bool(const std::deque <RedisObjectPtr> &,
+                               const SessionPtr &, const TcpConnectionPtr &)> CommandFunc;
+    typedef Quicklist ListValue;
+    typedef SetType SetValue;
+    typedef Zset ZsetValue;
+    typedef HashType HashValue;
+    // alternatives follow OBJ_STRING..OBJ_HASH, so std::get<OBJ_LIST>(value) is the list payload
+    typedef std::variant <RedisObjectPtr, std::unique_ptr<ListValue>, std::unique_ptr<SetValue>,
+    std::unique_ptr<ZsetValue>, std::unique_ptr<HashValue>> RedisValue;
+    typedef std::unordered_map <RedisObjectPtr, RedisValue, Hash, Equal> RedisMap;
+    typedef std::unordered_map <RedisObjectPtr, int64_t, Hash, Equal> ExpireMap;
+    typedef std::unordered_set <RedisObjectPtr, Hash, Equal> Command;
+
+private:
+    Redis(const Redis &);
+
+    void operator=(const Redis &);
+
+    std::unordered_map <int32_t, SessionPtr> sessions;
+    std::unordered_map <int32_t, TcpConnectionPtr> sessionConns;
+    std::unordered_map <int32_t, TcpConnectionPtr> slaveConns;
+    std::unordered_map <int32_t, int64_t> slaveSyncOffsets;   /* Replicas loading a snapshot, and its offset. */
+    std::unordered_map <int32_t, TcpConnectionPtr> clusterConns;
+    std::unordered_map <int32_t, TimerPtr> repliTimers;
+    std::unordered_map <int32_t, TcpConnectionPtr> monitorConns;
+    std::unordered_map <RedisObjectPtr, CommandFunc, Hash, Equal> handlerCommands;
+    std::unordered_map <RedisObjectPtr, RedisObjectPtr, Hash, Equal> luaScipts;
+
+    Command checkCommands;
+    Command readCommands;
+    Command stopReplis;
+    Command replyCommands;
+    Command cluterCommands;
+    Command denyoomCommands;
+
+    /* A key sampled for eviction, the best candidates have the highest idle. */
+    struct EvictionCandidate {
+        uint64_t idle;
+        RedisObjectPtr key;
+    };
+
+    // expireMap holds the absolute unix time in milliseconds of every volatile key
+    struct RedisMapLock {
+        RedisMap redisMap;
+        ExpireMap expireMap;
+        std::vector <EvictionCandidate> evictionPool;   /* Ascending idle, at most REDIS_EVPOOL_SIZE. */
+        std::mutex mtx;
+    };
+
+    bool expireIfNeeded(RedisMapLock &shard, const RedisObjectPtr &key);
+
+    RedisMap::iterator lookupKey(RedisMapLock &shard, const RedisObjectPtr &key);
+
+    void evictionPoolPopulate(RedisMapLock &shard);
+
+    bool evictFromShard(RedisMapLock &shard);
+
+    std::array <RedisMapLock, kShards> redisShards;
+    SlotIndex slotIndex;      /* Keys by cluster slot, in cluster mode only. */
+    int32_t expireCursor;
+    std::atomic <int64_t> statExpiredKeys;
+    std::atomic <int64_t> statEvictedKeys;
+    std::atomic <int64_t> statEvictionTime;   /* Microseconds spent evicting. */
+    std::atomic <uint32_t> evictCursor;       /* Shard the next eviction samples. */
+
+    EventLoop loop;
+    TcpServer server;
+
+    std::mutex mtx;
+    std::mutex slaveMutex;
+    std::mutex sentinelMutex;
+    std::mutex clusterMutex;
+    std::mutex forkMutex;
+    std::mutex monitorMutex;
+public:
+    std::atomic<bool> clusterEnabled;
+    std::atomic<bool> slaveEnabled;
+    std::atomic<bool> authEnabled;
+    std::atomic<bool> repliEnabled;
+    std::atomic<bool> sentinelEnabled;
+    std::atomic<bool> clusterSlotEnabled;
+    std::atomic<bool> clusterRepliMigratEnabled;
+    std::atomic<bool> clusterRepliImportEnabeld;
+    std::atomic<bool> forkEnabled;
+    std::atomic<bool> monitorEnabled;
+    std::atomic<bool> aofEnabled;
+
+    std::atomic <int32_t> forkCondWaitCount;
+    std::atomic <int32_t> rdbChildPid;
+    std::atomic<bool> rdbChildDiskless;   /* The child streams to replica sockets. */
+    std::atomic<bool> replDisklessSync;
+    std::atomic<bool> threadPerCore;      /* Commands run on the core owning their keys. */
+    std::atomic <int32_t> listCompressDepth;   /* Of lists created from now on. */
+    std::atomic <int32_t> hashMaxListpackEntries;   /* Limits of hashes and sets created from now on. */
+    std::atomic <int32_t> hashMaxListpackValue;
+    std::atomic <int32_t> setMaxIntsetEntries;
+    std::atomic <uint64_t> maxmemory;         /* 0 for no limit. */
+    std::atomic <int32_t> maxmemoryPolicy;
+    std::atomic <int32_t> maxmemorySamples;   /* Keys sampled per eviction. */
+
+    std::condition_variable expireCondition;
+    std::condition_variable forkCondition;
+
+    Buffer clusterMigratCached;
+    Buffer clusterImportCached;
+
+    std::string ip;
+    std::string password;
+    std::string masterHost;
+    std::string ipPort;
+    std::string master;
+    std::string slave;
+
+#ifdef _LUA
+    lua_State *lua;
+#endif
+    int16_t port;
+    int16_t threadCount;
+    int32_t masterPort;
+    int32_t dbnum;
+    std::vector <int32_t> waitBgsaveSlaves;   /* Replicas waiting for the running BGSAVE. */
+    int64_t rdbChildReplOffset;   /* Replication offset at the fork of the running BGSAVE. */
+    int32_t masterfd;
+private:
+    Replication repli;
+    Cluster clus;
+    Rdb rdb;
+    Aof aof;
+    Dispatcher dispatcher;
+    Migrator migrator;
+    PubSub pubsub;
+};
+
+
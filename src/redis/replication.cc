@@ -8,8 +8,16 @@ Replication::Replication(Redis *redis)
           salveLen(0),
           salveReadLen(0),
           slaveSyncEnabled(false),
-          client(nullptr) {
-
+          client(nullptr),
+          fp(nullptr),
+          masterReplOffset(0),
+          backlogIdx(0),
+          backlogHistlen(0),
+          noSlavesSince(0),
+          replOffset(-1),
+          psyncWaiting(false) {
+    getRandomHexChars(replid, CONFIG_RUN_ID_SIZE);
+    replid[CONFIG_RUN_ID_SIZE] = '\0';
 }
 
 Replication::~Replication() {
@@ -22,23 +30,37 @@ void Replication::connectMaster() {
     loop.run();
 }
 
+/* A master without replicas for a long time frees its backlog. The stream
+ * is no longer recorded from then on, so the history gets a new id and no
+ * replica can continue from an offset of the old one. */
 void Replication::replicationCron() {
-
+    std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
+    if (!backlog.empty() && redis->getSlaveConn().empty() && noSlavesSince > 0 &&
+        time(nullptr) - noSlavesSince > REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT) {
+        freeReplicationBacklog();
+        LOG_INFO << "Replication backlog freed after " << REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT
+                 << " seconds without connected replicas";
+    }
 }
 
 void Replication::disConnect() {
-    client->disConnect();
+    if (client) {
+        client->stop();
+        client->disConnect();
+    }
 }
 
 void Replication::syncWrite(const TcpConnectionPtr &conn) {
-    char tmpfile[256];
-    snprintf(tmpfile, 256, "temp-%d.rdb", std::this_thread::get_id());
-    fp = ::fopen(tmpfile, "w");
-    if (!fp) {
-        LOG_TRACE << "Failed opening .rdb for saving:" << strerror(errno);
-        return;
+    char buf[128];
+    int32_t len;
+    if (masterReplid.empty()) {
+        len = snprintf(buf, sizeof(buf), "PSYNC ? -1\r\n");
+    } else {
+        len = snprintf(buf, sizeof(buf), "PSYNC %s %lld\r\n",
+                       masterReplid.c_str(), (long long) replOffset);
     }
-    conn->send("sync\r\n", 6);
+    psyncWaiting = true;
+    conn->send(buf, len);
 }
 
 void Replication::syncWithMaster(const TcpConnectionPtr &conn) {
@@ -58,83 +80,347 @@ void Replication::syncWithMaster(const TcpConnectionPtr &conn) {
 }
 
 void Replication::close() {
-    ::fclose(fp);
+    if (fp) {
+        ::fclose(fp);
+        fp = nullptr;
+    }
     salveLen = 0;
     repliConn->forceClose();
 }
 
+/* The snapshot is preceded by a bulk header: $<len> when the master sends
+ * its dump.rdb, or $EOF:<mark> when a diskless sync streams it straight
+ * from the fork child, in which case the same mark terminates the payload. */
 void Replication::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
-    while (buffer->readableBytes() >= sizeof(int32_t)) {
-        if (salveLen == 0) {
-            salveLen = buffer->peekInt32();
-            buffer->retrieveInt32();
-            if (buffer->readableBytes() == 0) {
-                break;
-            }
+    if (psyncWaiting) {
+        int32_t status = processPsyncReply(conn, buffer);
+        if (status != REDIS_OK || psyncWaiting || fp == nullptr) {
+            return;
         }
+    }
 
-        int32_t status = redis->getRdb()->rdbSyncWrite(buffer->peek(),
-                                                       fp, buffer->readableBytes());
+    if (salveLen == 0 && eofMark.empty()) {
+        const char *crlf = buffer->findCRLF();
+        if (crlf == nullptr) {
+            return;
+        }
+
+        if (buffer->peek()[0] != '$') {
+            LOG_WARN << "Bad protocol from MASTER, the first byte is not '$'";
+            conn->forceClose();
+            return;
+        }
+
+        if (crlf - buffer->peek() == 5 + RDB_EOF_MARK_SIZE &&
+            memcmp(buffer->peek(), "$EOF:", 5) == 0) {
+            eofMark.assign(buffer->peek() + 5, RDB_EOF_MARK_SIZE);
+            LOG_INFO << "MASTER <-> REPLICA sync: receiving streamed RDB from master";
+        } else {
+            salveLen = atoi(buffer->peek() + 1);
+            LOG_INFO << "MASTER <-> REPLICA sync: receiving " << salveLen << " bytes from master";
+        }
+        buffer->retrieveUntil(crlf + 2);
+    }
+
+    if (!eofMark.empty()) {
+        /* Hold back the last bytes, they may be the end mark. */
+        if (buffer->readableBytes() > RDB_EOF_MARK_SIZE) {
+            size_t len = buffer->readableBytes() - RDB_EOF_MARK_SIZE;
+            int32_t status = redis->getRdb()->rdbSyncWrite(buffer->peek(), fp, len);
+            assert(status != REDIS_ERR);
+            salveReadLen += len;
+            buffer->retrieve(len);
+        }
+
+        if (buffer->readableBytes() < RDB_EOF_MARK_SIZE ||
+            memcmp(buffer->peek(), eofMark.data(), RDB_EOF_MARK_SIZE) != 0) {
+            return;
+        }
+
+        buffer->retrieve(RDB_EOF_MARK_SIZE);
+        eofMark.clear();
+    } else {
+        size_t len = std::min<size_t>(buffer->readableBytes(), salveLen - salveReadLen);
+        int32_t status = redis->getRdb()->rdbSyncWrite(buffer->peek(), fp, len);
         assert(status != REDIS_ERR);
+        salveReadLen += len;
+        buffer->retrieve(len);
+
+        if (salveReadLen < salveLen) {
+            return;
+        }
+    }
+
+    redis->getRdb()->rdbSyncClose(REDIS_DEFAULT_RDB_FILENGTHAME, fp);
+    fp = nullptr;
+    redis->clearCommand();
+
+    assert(redis->getRdb()->rdbLoad(REDIS_DEFAULT_RDB_FILENGTHAME) != REDIS_ERR);
+    {
+        std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
+        masterReplid = syncReplid;
+    }
+    replOffset = syncOffset;
+    createMasterSession(conn);
+
+    conn->send(shared.ok->ptr, sdslen(shared.ok->ptr));
+    LOG_INFO << "Replication load rdb success";
+}
+
+/* From here on the master link is parsed as a client that sends the write
+ * stream, its replies are never sent back. */
+SessionPtr Replication::createMasterSession(const TcpConnectionPtr &conn) {
+    std::shared_ptr <Session> session(new Session(redis, conn));
+    std::unique_lock <std::mutex> lck(redis->getMutex());
+    auto &sessions = redis->getSession();
+    sessions[conn->getSockfd()] = session;
+    auto &sessionConns = redis->getSessionConn();
+    sessionConns[conn->getSockfd()] = conn;
+    return session;
+}
+
+/* +FULLRESYNC <replid> <offset> precedes the snapshot of the master, with
+ * +CONTINUE the stream goes on right after the offset we sent. */
+int32_t Replication::processPsyncReply(const TcpConnectionPtr &conn, Buffer *buffer) {
+    const char *crlf = buffer->findCRLF();
+    if (crlf == nullptr) {
+        return REDIS_OK;
+    }
+
+    std::string reply(buffer->peek(), crlf);
+    buffer->retrieveUntil(crlf + 2);
+    psyncWaiting = false;
+
+    if (reply.compare(0, 12, "+FULLRESYNC ") == 0 &&
+        reply.size() > 13 + CONFIG_RUN_ID_SIZE) {
+        /* Only taken over once the snapshot is loaded, a link lost during
+         * the transfer still continues from the data we have. */
+        syncReplid = reply.substr(12, CONFIG_RUN_ID_SIZE);
+        syncOffset = strtoll(reply.c_str() + 13 + CONFIG_RUN_ID_SIZE, nullptr, 10);
+        LOG_INFO << "Full resync from master: " << syncReplid << ":" << syncOffset;
+
+        return openSyncFile(conn);
+    }
+
+    if (reply.compare(0, 9, "+CONTINUE") == 0) {
+        LOG_INFO << "MASTER <-> REPLICA sync: Master accepted a Partial Resynchronization "
+                 << "from offset " << replOffset;
+        SessionPtr session = createMasterSession(conn);
+        if (buffer->readableBytes() > 0) {
+            session->readCallback(conn, buffer);
+        }
+        return REDIS_OK;
+    }
+
+    if (reply[0] == '-') {
+        /* A master without PSYNC, the snapshot follows a plain SYNC. */
+        LOG_INFO << "Master does not support PSYNC, falling back to SYNC: " << reply;
+        syncReplid.clear();
+        syncOffset = -1;
+        conn->send("SYNC\r\n", 6);
+        return openSyncFile(conn);
+    }
+
+    LOG_WARN << "Unexpected reply to PSYNC from master: " << reply;
+    conn->forceClose();
+    return REDIS_ERR;
+}
+
+int32_t Replication::openSyncFile(const TcpConnectionPtr &conn) {
+    char tmpfile[256];
+    snprintf(tmpfile, 256, "temp-%zu.rdb", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    fp = ::fopen(tmpfile, "w");
+    if (!fp) {
+        LOG_WARN << "Failed opening .rdb for saving:" << strerror(errno);
+        conn->forceClose();
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+void Replication::createReplicationBacklog() {
+    if (!backlog.empty()) {
+        return;
+    }
+
+    backlog.resize(REDIS_DEFAULT_REPL_BACKLOG_SIZE);
+    backlogIdx = 0;
+    backlogHistlen = 0;
+}
+
+void Replication::freeReplicationBacklog() {
+    std::vector<char> empty;
+    backlog.swap(empty);
+    backlogIdx = 0;
+    backlogHistlen = 0;
+    noSlavesSince = 0;
+    getRandomHexChars(replid, CONFIG_RUN_ID_SIZE);
+    if (redis->masterfd <= 0) {
+        redis->repliEnabled = false;
+    }
+}
 
-        salveReadLen += buffer->readableBytes();
+void Replication::feedReplicationBacklog(const char *p, size_t len) {
+    masterReplOffset += len;
+    while (len > 0) {
+        size_t thislen = std::min(backlog.size() - backlogIdx, len);
+        memcpy(backlog.data() + backlogIdx, p, thislen);
+        backlogIdx += thislen;
+        if (backlogIdx == backlog.size()) {
+            backlogIdx = 0;
+        }
+        len -= thislen;
+        p += thislen;
+        backlogHistlen = std::min<int64_t>(backlogHistlen + thislen, backlog.size());
+    }
+}
+
+/* Appends the batch of a session to the backlog and sends it to every
+ * replica that is online, replicas still loading a snapshot get it from
+ * the backlog once they are done. */
+void Replication::replicationFeedSlaves(Buffer *buffer) {
+    std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
+    if (backlog.empty()) {
         buffer->retrieveAll();
+        return;
+    }
 
-        assert(salveReadLen <= salveLen);
-        if (salveLen == salveReadLen) {
-            redis->getRdb()->rdbSyncClose(REDIS_DEFAULT_RDB_FILENGTHAME, fp);
-            redis->clearCommand();
+    std::string_view stream(buffer->peek(), buffer->readableBytes());
+    feedReplicationBacklog(stream.data(), stream.size());
 
-            assert(redis->getRdb()->rdbLoad(REDIS_DEFAULT_RDB_FILENGTHAME) != REDIS_ERR);
-            std::shared_ptr <Session> session(new Session(redis, conn));
-            {
-                std::unique_lock <std::mutex> lck(redis->getMutex());
-                auto &sessions = redis->getSession();
-                sessions[conn->getSockfd()] = session;
-                auto &sessionConns = redis->getSessionConn();
-                sessionConns[conn->getSockfd()] = conn;
-            }
+    auto &syncOffsets = redis->getSlaveSyncOffsets();
+    for (auto &it : redis->getSlaveConn()) {
+        if (syncOffsets.find(it.first) == syncOffsets.end()) {
+            it.second->send(stream);
+        }
+    }
+    buffer->retrieveAll();
+}
+
+/* Sends the stream from offset on, false when these bytes are no longer
+ * in the backlog. */
+bool Replication::addReplyReplicationBacklog(const TcpConnectionPtr &conn, int64_t offset) {
+    if (backlog.empty() || offset < masterReplOffset - backlogHistlen || offset > masterReplOffset) {
+        return false;
+    }
+
+    int64_t skip = offset - (masterReplOffset - backlogHistlen);
+    size_t j = (backlogIdx + backlog.size() - backlogHistlen + skip) % backlog.size();
+    int64_t len = backlogHistlen - skip;
 
-            conn->send(shared.ok->ptr, sdslen(shared.ok->ptr));
-            LOG_INFO << "Replication load rdb success";
+    std::string bytes;
+    bytes.reserve(len);
+    while (len > 0) {
+        size_t thislen = std::min<int64_t>(backlog.size() - j, len);
+        bytes.append(backlog.data() + j, thislen);
+        len -= thislen;
+        j = 0;
+    }
+
+    if (!bytes.empty()) {
+        conn->send(bytes);
+    }
+    return true;
+}
+
+bool Replication::tryPartialResynchronization(const TcpConnectionPtr &conn,
+                                              const char *masterReplid, int64_t offset) {
+    if (strcasecmp(masterReplid, replid) != 0) {
+        if (masterReplid[0] != '?') {
+            LOG_INFO << "Partial resynchronization not accepted: replication id mismatch";
         }
+        return false;
+    }
+
+    if (backlog.empty() || offset < masterReplOffset - backlogHistlen || offset > masterReplOffset) {
+        LOG_INFO << "Unable to partial resync with replica for lack of backlog, "
+                 << "the replica asked for offset " << offset;
+        return false;
+    }
+
+    conn->send("+CONTINUE\r\n", 11);
+    addReplyReplicationBacklog(conn, offset);
+    redis->getSlaveConn()[conn->getSockfd()] = conn;
+    noSlavesSince = 0;
+    LOG_INFO << "Partial resynchronization request accepted, sending "
+             << masterReplOffset - offset << " bytes of backlog starting from offset " << offset;
+    return true;
+}
+
+void Replication::slaveDisconnected() {
+    if (redis->getSlaveConn().empty()) {
+        noSlavesSince = time(nullptr);
+    }
+}
+
+sds Replication::catReplicationInfo(sds info) {
+    if (redis->masterfd > 0 || !masterReplid.empty()) {
+        info = sdscatprintf(info,
+                            "master_link_status:%s\r\n"
+                            "master_replid:%s\r\n"
+                            "slave_repl_offset:%lld\r\n",
+                            redis->masterfd > 0 && !psyncWaiting ? "up" : "down",
+                            masterReplid.c_str(),
+                            (long long) replOffset);
+    } else {
+        info = sdscatprintf(info,
+                            "master_replid:%s\r\n"
+                            "master_repl_offset:%lld\r\n"
+                            "repl_backlog_active:%d\r\n"
+                            "repl_backlog_size:%zu\r\n"
+                            "repl_backlog_first_byte_offset:%lld\r\n"
+                            "repl_backlog_histlen:%lld\r\n",
+                            replid,
+                            (long long) masterReplOffset,
+                            !backlog.empty(),
+                            backlog.size(),
+                            (long long) (masterReplOffset - backlogHistlen),
+                            (long long) backlogHistlen);
     }
+    return info;
 }
 
+/* A replica acknowledges the loaded snapshot with +OK, it is sent the
+ * stream since the fork from the backlog and is online from then on. */
 void Replication::slaveCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
     while (buffer->readableBytes() >= sdslen(shared.ok->ptr)) {
+        if (memcmp(buffer->peek(), shared.ok->ptr, sdslen(shared.ok->ptr)) != 0) {
+            break;
+        }
+        buffer->retrieve(sdslen(shared.ok->ptr));
+
         std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
-        auto &salveConn = redis->getSlaveConn();
-        auto it = salveConn.find(conn->getSockfd());
-        if (it != salveConn.end()) {
-            if (memcmp(buffer->peek(), shared.ok->ptr, sdslen(shared.ok->ptr)) == 0) {
-                buffer->retrieve(sdslen(shared.ok->ptr));
-                if (++redis->salveCount >= salveConn.size()) {
-                    if (redis->slaveCached.readableBytes() > 0) {
-                        conn->send(&redis->slaveCached);
-                        Buffer buffer;
-                        redis->slaveCached.swap(buffer);
-                    }
-
-                    auto &repliTimer = redis->getRepliTimer();
-                    auto iter = repliTimer.find(conn->getSockfd());
-                    assert(iter != repliTimer.end());
-                    assert(iter->second != nullptr);
-                    conn->getLoop()->cancelAfter(iter->second);
-                    repliTimer.erase(conn->getSockfd());
-
-                    {
-                        std::shared_ptr <Session> session(new Session(redis, conn));
-                        auto &sessions = redis->getSession();
-                        std::unique_lock <std::mutex> lck(redis->getMutex());
-                        sessions[conn->getSockfd()] = session;
-                        auto &sessionConns = redis->getSessionConn();
-                        sessionConns[conn->getSockfd()] = conn;
-                    }
-                    LOG_INFO << "Slaveof sync success";
-                }
-            }
+        auto &syncOffsets = redis->getSlaveSyncOffsets();
+        auto it = syncOffsets.find(conn->getSockfd());
+        if (it == syncOffsets.end()) {
+            continue;
         }
+
+        int64_t offset = it->second;
+        syncOffsets.erase(it);
+        if (!addReplyReplicationBacklog(conn, offset)) {
+            LOG_WARN << "Replica loaded a snapshot at offset " << offset
+                     << " that is no longer in the backlog, closing it";
+            conn->forceClose();
+            continue;
+        }
+
+        auto &repliTimer = redis->getRepliTimer();
+        auto iter = repliTimer.find(conn->getSockfd());
+        assert(iter != repliTimer.end());
+        assert(iter->second != nullptr);
+        conn->getLoop()->cancelAfter(iter->second);
+        repliTimer.erase(iter);
+
+        {
+            std::shared_ptr <Session> session(new Session(redis, conn));
+            auto &sessions = redis->getSession();
+            std::unique_lock <std::mutex> lck(redis->getMutex());
+            sessions[conn->getSockfd()] = session;
+            auto &sessionConns = redis->getSessionConn();
+            sessionConns[conn->getSockfd()] = conn;
+        }
+        LOG_INFO << "Slaveof sync success, streaming from offset " << offset;
     }
 }
 
@@ -144,6 +430,8 @@ void Replication::connCallback(const TcpConnectionPtr &conn) {
         char buf[64] = "";
         uint16_t port = 0;
         salveLen = 0;
+        salveReadLen = 0;
+        eofMark.clear();
         auto addr = Socket::getPeerAddr(conn->getSockfd());
         Socket::toIp(buf, sizeof(buf), (const struct sockaddr *) &addr);
         Socket::toPort(&port, (const struct sockaddr *) &addr);
@@ -161,6 +449,12 @@ void Replication::connCallback(const TcpConnectionPtr &conn) {
         repliConn = nullptr;
         salveReadLen = 0;
         salveLen = 0;
+        psyncWaiting = false;
+        eofMark.clear();
+        if (fp) {
+            ::fclose(fp);
+            fp = nullptr;
+        }
         redis->masterHost.clear();
         redis->masterPort = 0;
         redis->masterfd = 0;
@@ -183,15 +477,22 @@ void Replication::replicationSetMaster(const RedisObjectPtr &obj, int16_t port)
         }
     }
 
+    /* Data of another master has nothing in common with our offset. */
+    {
+        std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
+        masterReplid.clear();
+    }
+    replOffset = -1;
+
+    this->ip = obj->ptr;
+    this->port = port;
     TcpClientPtr client(new TcpClient(loop, ip.c_str(), port, this));
+    client->enableRetry();
     client->setConnectionCallback(std::bind(&Replication::connCallback,
                                             this, std::placeholders::_1));
     client->setMessageCallback(std::bind(&Replication::readCallback,
                                          this, std::placeholders::_1, std::placeholders::_2));
     client->connect();
-
-    this->ip = obj->ptr;
-    this->port = port;
     this->client = client;
 }
 
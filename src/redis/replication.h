@@ -35,15 +35,46 @@ public:
 
     void close();
 
+    /* Master side, called with the slave mutex held. */
+    void createReplicationBacklog();
+
+    void freeReplicationBacklog();
+
+    void feedReplicationBacklog(const char *p, size_t len);
+
+    void replicationFeedSlaves(Buffer *buffer);
+
+    bool addReplyReplicationBacklog(const TcpConnectionPtr &conn, int64_t offset);
+
+    bool tryPartialResynchronization(const TcpConnectionPtr &conn, const char *replid, int64_t offset);
+
+    void slaveDisconnected();
+
+    const char *getReplid() { return replid; }
+
+    int64_t getMasterReplOffset() { return masterReplOffset; }
+
+    /* Replica side. */
+    void addReplOffset(int64_t len) { replOffset += len; }
+
+    sds catReplicationInfo(sds info);
+
 private:
     Replication(const Replication &);
 
     void operator=(const Replication &);
 
+    SessionPtr createMasterSession(const TcpConnectionPtr &conn);
+
+    int32_t processPsyncReply(const TcpConnectionPtr &conn, Buffer *buffer);
+
+    int32_t openSyncFile(const TcpConnectionPtr &conn);
+
     Redis *redis;
     EventLoop *loop;
     TcpClientPtr client;
     std::string ip;
+    std::string eofMark;   /* End mark of a diskless snapshot, empty otherwise. */
     Buffer sendBuf;
     FILE *fp;
     TcpConnectionPtr repliConn;
@@ -54,5 +85,22 @@ private:
     std::atomic <int32_t> salveLen;
     std::atomic <int32_t> salveReadLen;
     std::atomic<bool> slaveSyncEnabled;
+
+    /* Every byte of the write stream sent to replicas is also kept in a ring
+     * buffer, a replica that lost its link asks for the bytes after the
+     * offset it processed and is only resynchronized in full when they fell
+     * out of the backlog, or the history (replid) is not the same. */
+    char replid[CONFIG_RUN_ID_SIZE + 1];
+    int64_t masterReplOffset;      /* Bytes fed to the write stream. */
+    std::vector<char> backlog;
+    size_t backlogIdx;             /* Next byte to write in the ring. */
+    int64_t backlogHistlen;        /* Valid bytes in the ring. */
+    int64_t noSlavesSince;
+
+    std::string masterReplid;      /* History the replica data belongs to. */
+    std::atomic <int64_t> replOffset;   /* Bytes of the stream the replica processed, -1 if none. */
+    bool psyncWaiting;             /* The reply to PSYNC was not read yet. */
+    std::string syncReplid;        /* Taken over with the snapshot of a full resync. */
+    int64_t syncOffset;
 };
 
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "all.h"
+
+/* Cursor of the SCAN family over a std::unordered_map or set. The low
+ * kScanBucketBits are the bucket to continue from, the kScanTagBits above
+ * them the low bits of the bucket count the cursor was taken with. A table
+ * rehashed in between is scanned again from its first bucket, so an element
+ * present for the whole scan is returned at least once, maybe more. */
+static const uint64_t kScanBucketBits = 32;
+static const uint64_t kScanTagBits = 20;
+
+/* Visits whole buckets from cursor on until count elements were seen or
+ * count * 10 buckets were visited, count is decreased by the elements seen.
+ * Returns the cursor to continue from, 0 once the table is done. */
+template <typename Table, typename Visitor>
+uint64_t scanTable(const Table &table, uint64_t cursor, size_t *count, const Visitor &visitor) {
+    uint64_t buckets = table.bucket_count();
+    uint64_t tag = buckets & ((1ULL << kScanTagBits) - 1);
+    uint64_t bucket = cursor & ((1ULL << kScanBucketBits) - 1);
+    if ((cursor >> kScanBucketBits) != tag || bucket >= buckets) {
+        bucket = 0;
+    }
+
+    size_t visits = *count * 10;
+    for (; bucket < buckets && *count > 0 && visits > 0; bucket++, visits--) {
+        for (auto it = table.begin(bucket); it != table.end(bucket); ++it) {
+            visitor(*it);
+            if (*count > 0) {
+                (*count)--;
+            }
+        }
+    }
+    return bucket < buckets ? (tag << kScanBucketBits) | bucket : 0;
+}
@@ -1,415 +1,671 @@
-#include "session.h"
-#include "redis.h"
-
-Session::Session(Redis *redis, const TcpConnectionPtr &conn)
-        : reqtype(0),
-          multibulklen(0),
-          bulklen(-1),
-          argc(0),
-          redis(redis),
-          authEnabled(false),
-          replyBuffer(false),
-          fromMaster(false),
-          fromSlave(false),
-          pos(0) {
-    cmd = createStringObject(nullptr, REDIS_COMMAND_LENGTH);
-    conn->setMessageCallback(std::bind(&Session::readCallback,
-                                       this, std::placeholders::_1, std::placeholders::_2));
-}
-
-Session::~Session() {
-
-}
-
-void Session::clearCommand() {
-    redisCommands.clear();
-}
-
-/* This function is called every time, in the client structure 'c', there is
- * more query buffer to process, because we read more data from the socket
- * or because a client was blocked and later reactivated, so there could be
- * pending query buffer, already representing a full command, to process. */
-
-void Session::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
-    /* Keep processing while there is something in the input buffer */
-    while (buffer->readableBytes() > 0) {
-        /* Determine request type when unknown. */
-        if (!reqtype) {
-            if ((buffer->peek()[pos]) == '*') {
-                reqtype = REDIS_REQ_MULTIBULK;
-            } else {
-                reqtype = REDIS_REQ_INLINE;
-            }
-        }
-
-        if (reqtype == REDIS_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(conn, buffer) != REDIS_OK) {
-                break;
-            }
-        } else if (reqtype == REDIS_REQ_INLINE) {
-            if (processInlineBuffer(conn, buffer) != REDIS_OK) {
-                break;
-            }
-        } else {
-            LOG_WARN << "Unknown request type";
-        }
-
-        assert(multibulklen == 0);
-        processCommand(conn);
-        reset();
-    }
-
-    /* If there already are entries in the reply list, we cannot
-     * add anything more to the static buffer. */
-    if (conn->outputBuffer()->readableBytes() > 0) {
-        conn->sendPipe();
-    }
-
-    if (pubsubBuffer.readableBytes() > 0) {
-        pubsubBuffer.retrieveAll();
-    }
-
-    if (redis->repliEnabled) {
-        std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
-        auto &slaveConns = redis->getSlaveConn();
-        for (auto &it : slaveConns) {
-            if (slaveBuffer.readableBytes() > 0) {
-                it.second->send(&slaveBuffer);
-            }
-        }
-        slaveBuffer.retrieveAll();
-    }
-}
-
-void Session::setAuth(bool enbaled) {
-    authEnabled = enbaled;
-}
-
-/* Only reset the client when the command was executed. */
-int32_t Session::processCommand(const TcpConnectionPtr &conn) {
-    if (redis->authEnabled) {
-        if (!authEnabled) {
-            if (STRCMP(redisCommands[0]->ptr, "auth") != 0) {
-                addReplyErrorFormat(conn->outputBuffer(), "NOAUTH Authentication required");
-                return REDIS_ERR;
-            }
-        }
-    }
-
-    if (redis->clusterEnabled) {
-        if (redis->getClusterMap(cmd)) {
-            goto jump;
-        }
-
-        if (redisCommands.empty()) {
-            goto jump;
-        }
-
-        char *key = redisCommands[0]->ptr;
-        int32_t hashslot = redis->getCluster()->keyHashSlot(key, sdslen(key));
-
-        std::unique_lock <std::mutex> lck(redis->getClusterMutex());
-        if (redis->clusterRepliMigratEnabled) {
-            auto &map = redis->getCluster()->getMigrating();
-            for (auto &it : map) {
-                auto iter = it.second.find(hashslot);
-                if (iter != it.second.end()) {
-                    redis->structureRedisProtocol(redis->clusterMigratCached, redisCommands);
-                    goto jump;
-                }
-            }
-        }
-
-        if (redis->clusterRepliImportEnabeld) {
-            auto &map = redis->getCluster()->getImporting();
-            for (auto &it : map) {
-                auto iter = it.second.find(hashslot);
-                if (iter != it.second.end()) {
-                    replyBuffer = true;
-                    goto jump;
-                }
-            }
-        }
-
-        auto it = redis->getCluster()->checkClusterSlot(hashslot);
-        if (it == nullptr) {
-            redis->getCluster()->clusterRedirectClient(conn, shared_from_this(),
-                                                       nullptr, hashslot, CLUSTER_REDIR_DOWN_UNBOUND);
-            return REDIS_ERR;
-        } else {
-            if (redis->ip == it->ip && redis->port == it->port) {
-                //FIXME
-            } else {
-                redis->getCluster()->clusterRedirectClient(conn, shared_from_this(),
-                                                           it, hashslot, CLUSTER_REDIR_MOVED);
-                return REDIS_ERR;
-            }
-        }
-    }
-
-    jump:
-
-    if (redis->repliEnabled) {
-        if (conn->getSockfd() == redis->masterfd) {
-            fromMaster = true;
-
-            if (!redis->checkCommand(cmd)) {
-                return REDIS_ERR;
-            }
-        } else if (redis->masterfd > 0) {
-            if (redis->checkCommand(cmd)) {
-                addReplyErrorFormat(conn->outputBuffer(), "slaveof cmd unknown");
-                return REDIS_ERR;
-            }
-        } else {
-            if (redis->checkCommand(cmd)) {
-                redisCommands.push_front(cmd);
-                {
-                    std::unique_lock <std::mutex> lck(redis->getSlaveMutex());
-                    if (redis->salveCount < redis->getSlaveConn().size()) {
-                        redis->structureRedisProtocol(redis->slaveCached, redisCommands);
-                    } else {
-                        redis->structureRedisProtocol(slaveBuffer, redisCommands);
-                    }
-                }
-                redisCommands.pop_front();
-            }
-        }
-    }
-
-    auto &handlerCommands = redis->getHandlerCommandMap();
-    auto it = handlerCommands.find(cmd);
-    if (it == handlerCommands.end()) {
-        addReplyErrorFormat(conn->outputBuffer(),
-                            "unknown command `%s`, with args beginning", cmd->ptr);
-        return REDIS_ERR;
-    } else {
-        if (!it->second(redisCommands, shared_from_this(), conn)) {
-            addReplyErrorFormat(conn->outputBuffer(),
-                                "wrong number of arguments`%s`, for command", cmd->ptr);
-        } else {
-            if (redis->monitorEnabled) {
-                redisCommands.push_back(cmd);
-                redis->feedMonitor(redisCommands, conn->getSockfd());
-            }
-        }
-    }
-    return REDIS_OK;
-}
-
-void Session::resetVlaue() {
-
-}
-
-void Session::reset() {
-    reqtype = 0;
-    argc = 0;
-    multibulklen = 0;
-    bulklen = -1;
-    redisCommands.clear();
-
-    if (replyBuffer) {
-        replyBuffer = false;
-    }
-
-    if (fromMaster) {
-        slaveBuffer.retrieveAll();
-        pubsubBuffer.retrieveAll();
-        fromMaster = false;
-    }
-}
-
-/* Like processMultibulkBuffer(), but for the inline protocol instead of RESP,
- * this function consumes the client query buffer and creates a command ready
- * to be executed inside the client structure. Returns C_OK if the command
- * is ready to be executed, or C_ERR if there is still protocol to read to
- * have a well formed command. The function also returns C_ERR when there is
- * a protocol error: in such a case the client structure is setup to reply
- * with the error and close the connection. */
-
-int32_t Session::processInlineBuffer(const TcpConnectionPtr &conn, Buffer *buffer) {
-    const char *newline;
-    const char *queryBuf = buffer->peek();
-    int32_t j, linefeedChars = 1;
-    size_t queryLen;
-    sds *argv, aux;
-    /* Search for end of line */
-    newline = strchr(queryBuf, '\n');
-
-    /* Nothing to do without a \r\n */
-    if (newline == nullptr) {
-        return REDIS_ERR;
-    }
-
-    /* Handle the \r\n case. */
-    if (newline && newline != queryBuf && *(newline - 1) == '\r')
-        newline--, linefeedChars++;
-
-    /* Split the input buffer up to the \r\n */
-    queryLen = newline - queryBuf;
-    if ((queryLen + linefeedChars) > buffer->readableBytes()) {
-        return REDIS_ERR;
-    }
-
-    aux = sdsnewlen(queryBuf, queryLen);
-    argv = sdssplitargs(aux, &argc);
-    sdsfree(aux);
-
-    if (argv == nullptr) {
-        addReplyError(conn->outputBuffer(), "Protocol error: unbalanced quotes in request");
-        conn->shutdown();
-        return REDIS_ERR;
-    }
-
-    /* Leave data after the first line of the query in the buffer */
-    buffer->retrieve(queryLen + linefeedChars);
-
-    /* Create redis objects for all arguments. */
-    for (j = 0; j < argc; j++) {
-        if (j == 0) {
-            cmd->ptr = sdscpylen((sds) (cmd->ptr), argv[j], sdslen(argv[j]));
-            if (cmd->ptr[0] >= 'A' && cmd->ptr[0] <= 'Z') {
-                int len = sdslen(cmd->ptr);
-                for (int i = 0; i < len; i++) {
-                    cmd->ptr[i] += 32;
-                }
-            }
-            cmd->calHash();
-        } else {
-            RedisObjectPtr obj = createStringObject(argv[j], sdslen(argv[j]));
-            redisCommands.push_back(obj);
-        }
-        sdsfree(argv[j]);
-    }
-
-    zfree(argv);
-    return REDIS_OK;
-}
-
-/* Process the query buffer for client 'c', setting up the client argument
- * vector for command execution. Returns C_OK if after running the function
- * the client has a well-formed ready to be processed command, otherwise
- * C_ERR if there is still to read more buffer to get the full command.
- * The function also returns C_ERR when there is a protocol error: in such a
- * case the client structure is setup to reply with the error and close
- * the connection.
- *
- * This function is called if processInputBuffer() detects that the next
- * command is in RESP format, so the first byte in the command is found
- * to be '*'. Otherwise for inline commands processInlineBuffer() is called. */
-
-int32_t Session::processMultibulkBuffer(const TcpConnectionPtr &conn, Buffer *buffer) {
-    const char *newline = nullptr;
-    int32_t ok;
-    int64_t ll = 0;
-    const char *queryBuf = buffer->peek();
-    if (multibulklen == 0) {
-        /* Multi bulk length cannot be read without a \r\n */
-        newline = strchr(queryBuf + pos, '\r');
-        if (newline == nullptr) {
-            return REDIS_ERR;
-        }
-
-        /* Buffer should also contain \n */
-        if ((newline - (queryBuf + pos)) > (buffer->readableBytes() - pos - 2)) {
-            return REDIS_ERR;
-        }
-
-        if (queryBuf[pos] != '*') {
-            addReplyError(conn->outputBuffer(), "Protocol error: *");
-            conn->shutdown();
-            return REDIS_ERR;
-        }
-
-        /* We know for sure there is a whole line since newline != NULL,
-         * so go ahead and find out the multi bulk length. */
-        ok = string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
-        if (!ok || ll > REDIS_MBULK_BIG_ARG || ll <= 0) {
-            addReplyError(conn->outputBuffer(), "Protocol error: invalid multibulk length");
-            conn->shutdown();
-            return REDIS_ERR;
-        }
-
-        pos += (newline - (queryBuf + pos)) + 2;
-        multibulklen = ll;
-    }
-
-    while (multibulklen) {
-        /* Read bulk length if unknown */
-        if (bulklen == -1) {
-            newline = strchr(queryBuf + pos, '\r');
-            if (newline == nullptr) {
-                break;
-            }
-
-            /* Buffer should also contain \n */
-            if ((newline - (queryBuf + pos)) > (buffer->readableBytes() - pos - 2)) {
-                return REDIS_ERR;
-            }
-
-
-            if (queryBuf[pos] != '$') {
-                addReplyErrorFormat(conn->outputBuffer(),
-                                    "Protocol error: expected '$',got '%c'", queryBuf[pos]);
-                conn->shutdown();
-                return REDIS_ERR;
-            }
-
-            ok = string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
-            if (!ok || ll < 0 || ll > REDIS_MBULK_BIG_ARG) {
-                addReplyError(conn->outputBuffer(),
-                              "Protocol error: invalid bulk length");
-                conn->shutdown();
-                return REDIS_ERR;
-            }
-
-            pos += (newline - (queryBuf + pos)) + 2;
-            bulklen = ll;
-        }
-
-        /* Read bulk argument */
-        if ((buffer->readableBytes() - pos) < (bulklen + 2)) {
-            break;
-        } else {
-            /* Optimization: if the buffer contains JUST our bulk element
-            * instead of creating a new object by *copying* the sds we
-            * just use the current sds string. */
-            if (++argc == 1) {
-                cmd->ptr = sdscpylen(cmd->ptr, queryBuf + pos, bulklen);
-                if (cmd->ptr[0] >= 'A' && cmd->ptr[0] <= 'Z') {
-                    int len = sdslen(cmd->ptr);
-                    for (int i = 0; i < len; i++) {
-                        cmd->ptr[i] += 32;
-                    }
-                }
-                cmd->calHash();
-            } else {
-                RedisObjectPtr obj = createStringObject((char *) (queryBuf + pos), bulklen);
-                redisCommands.push_back(obj);
-            }
-
-            pos += bulklen + 2;
-            bulklen = -1;
-            multibulklen--;
-        }
-    }
-
-    /* We're done when c->multibulk == 0 */
-    if (multibulklen == 0) {
-        /* Trim to pos */
-        assert(pos <= buffer->readableBytes());
-        buffer->retrieve(pos);
-        pos = 0;
-        return REDIS_OK;
-    }
-
-    /* Still not ready to process the command */
-    return REDIS_ERR;
-}
-
-
-
-
-
-
-
+#include "session.h"
+#include "redis.h"
+
+static const size_t kMaxPendingReads = 1024;
+static const int32_t kMaxReadBuffer = 64 * 1024;
+
+Session::Session(Redis *redis, const TcpConnectionPtr &conn)
+        : reqtype(0),
+          multibulklen(0),
+          bulklen(-1),
+          argc(0),
+          redis(redis),
+          authEnabled(false),
+          replyBuffer(false),
+          fromMaster(false),
+          fromSlave(false),
+          pos(0),
+          aofOffset(0),
+          aofFsynced(0),
+          masterReadLen(0),
+          subscriptions(0),
+          fsyncWaiting(false),
+          forwardWaiting(false),
+          readCount(0) {
+    cmd = createRawStringObject(nullptr, REDIS_COMMAND_LENGTH);
+    conn->setMessageCallback(std::bind(&Session::readCallback,
+                                       this, std::placeholders::_1, std::placeholders::_2));
+}
+
+Session::~Session() {
+
+}
+
+void Session::clearCommand() {
+    redisCommands.clear();
+}
+
+/* This function is called every time, in the client structure 'c', there is
+ * more query buffer to process, because we read more data from the socket
+ * or because a client was blocked and later reactivated, so there could be
+ * pending query buffer, already representing a full command, to process. */
+
+void Session::readCallback(const TcpConnectionPtr &conn, Buffer *buffer) {
+    bool master = conn->getSockfd() == redis->masterfd;
+    /* Keep processing while there is something in the input buffer */
+    while (!forwardWaiting && buffer->readableBytes() > 0) {
+        size_t readable = buffer->readableBytes();
+        /* Determine request type when unknown. */
+        if (!reqtype) {
+            if ((buffer->peek()[pos]) == '*') {
+                reqtype = REDIS_REQ_MULTIBULK;
+            } else {
+                reqtype = REDIS_REQ_INLINE;
+            }
+        }
+
+        int32_t status = REDIS_ERR;
+        if (reqtype == REDIS_REQ_MULTIBULK) {
+            status = processMultibulkBuffer(conn, buffer);
+        } else if (reqtype == REDIS_REQ_INLINE) {
+            status = processInlineBuffer(conn, buffer);
+        } else {
+            LOG_WARN << "Unknown request type";
+        }
+
+        /* The replication offset only moves past whole commands, the
+         * bytes of a partial one are counted when it completes. */
+        masterReadLen += readable - buffer->readableBytes();
+        if (status != REDIS_OK) {
+            break;
+        }
+
+        assert(multibulklen == 0);
+        /* Pipelined reads on keys of this core are collected and run by
+         * shard in processReads(), any other command runs them first. */
+        RedisObjectPtr name;
+        int32_t shard = forwards.empty() && !master ? redis->readCommandShard(cmd, redisCommands, &name) : -1;
+        if (shard >= 0) {
+            if (readCount == reads.size()) {
+                reads.emplace_back();
+            }
+
+            /* The arguments stay in objects of argvPool, the next command
+             * is parsed into the pool the slot kept from its last read. */
+            PendingRead &read = reads[readCount++];
+            read.cmd = name;
+            read.shard = shard;
+            read.argv.swap(redisCommands);
+            read.pool.swap(argvPool);
+            if (readCount == kMaxPendingReads) {
+                processReads(conn);
+            }
+        } else {
+            processReads(conn);
+
+            /* Behind a forwarded command only commands the dispatcher takes may
+             * run, any other waits until forwardCallback() finds none left. */
+            if (!forwards.empty() && !redis->getDispatcher()->isRoutable(cmd)) {
+                forwardWaiting = true;
+                break;
+            }
+
+            size_t replied = conn->outputBuffer()->readableBytes();
+            bool ordered = !forwards.empty();
+            conn->setReferencesEnabled(!ordered && !master);
+            processCommand(conn);
+            if (ordered) {
+                holdReply(conn, replied);
+            }
+        }
+        reset();
+
+        if (master) {
+            redis->getReplication()->addReplOffset(masterReadLen);
+        }
+        masterReadLen = 0;
+    }
+
+    processReads(conn);
+    flushForwards(conn);
+
+    /* The master does not read replies to the stream it sends. */
+    if (master) {
+        conn->outputBuffer()->retrieveAll();
+    }
+
+    /* If there already are entries in the reply list, we cannot
+     * add anything more to the static buffer. Replies held back for
+     * the append only file are sent by fsyncCallback(). */
+    if (!fsyncWaiting && !waitForFsync(conn) && conn->hasPendingOutput()) {
+        conn->flushOutput();
+    }
+
+    if (pubsubBuffer.readableBytes() > 0) {
+        pubsubBuffer.retrieveAll();
+    }
+
+    if (slaveBuffer.readableBytes() > 0) {
+        redis->getReplication()->replicationFeedSlaves(&slaveBuffer);
+    }
+}
+
+/* Runs the reads collected by readCallback(). They are sorted by shard,
+ * the reads of one shard keep their order, and each shard is locked once
+ * for all of its reads. Nothing else of the session runs in
+ * between, so only the replies have to be put back in the order the
+ * commands came in. */
+void Session::processReads(const TcpConnectionPtr &conn) {
+    if (readCount == 0) {
+        return;
+    }
+
+    /* Sorting pays only when a shard comes back after another one, it costs
+     * a copy of the replies and their references. */
+    static thread_local uint32_t shardSeen[Redis::kShards];
+    static thread_local uint32_t shardEpoch = 0;
+    if (++shardEpoch == 0) {
+        memset(shardSeen, 0, sizeof(shardSeen));
+        shardEpoch = 1;
+    }
+
+    bool sorted = true;
+    for (size_t i = 0; i < readCount && sorted; i++) {
+        int32_t shard = reads[i].shard;
+        if (i > 0 && shard == reads[i - 1].shard) {
+            continue;
+        }
+        sorted = shardSeen[shard] != shardEpoch;
+        shardSeen[shard] = shardEpoch;
+    }
+
+    readOrder.resize(readCount);
+    for (size_t i = 0; i < readCount; i++) {
+        readOrder[i] = i;
+    }
+
+    if (!sorted) {
+        std::sort(readOrder.begin(), readOrder.end(), [this](size_t a, size_t b) {
+            return reads[a].shard < reads[b].shard || (reads[a].shard == reads[b].shard && a < b);
+        });
+    }
+
+    /* A reply that is moved afterwards has to be in the buffer itself. */
+    conn->setReferencesEnabled(sorted);
+    Buffer *buffer = conn->outputBuffer();
+    size_t start = buffer->readableBytes();
+    readReplies.resize(readCount);
+    std::unique_lock <std::mutex> shardLock;
+
+    /* The command parsed last may be one that waits for the reads. */
+    RedisObjectPtr name = cmd;
+    for (auto i : readOrder) {
+        PendingRead &read = reads[i];
+        redis->holdShard(shardLock, read.shard);
+        cmd = read.cmd;
+        redisCommands.swap(read.argv);
+        size_t offset = buffer->readableBytes();
+        processCommand(conn);
+        readReplies[i] = std::make_pair(offset, buffer->readableBytes() - offset);
+        redisCommands.swap(read.argv);
+        read.argv.clear();
+    }
+    redis->holdShard(shardLock, -1);
+    cmd = name;
+
+    if (!sorted) {
+        for (size_t i = 0; i < readCount; i++) {
+            readBuffer.append(buffer->peek() + readReplies[i].first, readReplies[i].second);
+        }
+        buffer->unwrite(buffer->readableBytes() - start);
+        buffer->append(readBuffer.peek(), readBuffer.readableBytes());
+        readBuffer.retrieveAll();
+        if (readBuffer.internalCapacity() > kMaxReadBuffer) {
+            readBuffer.shrink(0);
+        }
+    }
+    readCount = 0;
+}
+
+/* With appendfsync always the replies to write commands are held back until
+ * the append only file reached the disk. Returns true if the session has to
+ * wait, fsyncCallback() is then queued on the connection loop by the writer. */
+bool Session::waitForFsync(const TcpConnectionPtr &conn) {
+    if (aofOffset <= aofFsynced ||
+        redis->getAof()->getFsyncPolicy() != AOF_FSYNC_ALWAYS) {
+        return false;
+    }
+
+    int64_t offset = aofOffset;
+    SessionPtr session = shared_from_this();
+    fsyncWaiting = true;
+    redis->getAof()->addFsyncCallback(offset, [session, conn, offset]() {
+        conn->getLoop()->queueInLoop(std::bind(&Session::fsyncCallback, session, conn, offset));
+    });
+    return true;
+}
+
+void Session::fsyncCallback(const TcpConnectionPtr &conn, int64_t offset) {
+    fsyncWaiting = false;
+    aofFsynced = offset;
+    if (!waitForFsync(conn) && conn->hasPendingOutput()) {
+        conn->flushOutput();
+    }
+}
+
+/* Called by the dispatcher on the loop of the connection when one of the
+ * forwarded commands is complete. */
+void Session::forwardCallback(const TcpConnectionPtr &conn) {
+    flushForwards(conn);
+    if (forwardWaiting && forwards.empty()) {
+        forwardWaiting = false;
+        conn->setReferencesEnabled(true);
+        processCommand(conn);
+        reset();
+    }
+    readCallback(conn, conn->intputBuffer());
+}
+
+/* A reply written while forwarded commands are out is queued behind them. */
+void Session::holdReply(const TcpConnectionPtr &conn, size_t replied) {
+    Buffer *buffer = conn->outputBuffer();
+    size_t len = buffer->readableBytes() - replied;
+    if (len == 0) {
+        return;
+    }
+
+    std::unique_ptr <ForwardedCommand> held(new ForwardedCommand);
+    held->reply.append(buffer->peek() + replied, len);
+    buffer->unwrite(len);
+    forwards.push_back(std::move(held));
+}
+
+/* Moves the replies of the complete forwarded commands at the front to the
+ * output buffer. */
+void Session::flushForwards(const TcpConnectionPtr &conn) {
+    while (!forwards.empty() && forwards.front()->pending == 0) {
+        auto &front = forwards.front();
+        conn->outputBuffer()->append(front->reply.peek(), front->reply.readableBytes());
+        aofOffset = std::max(aofOffset, front->aofOffset);
+        forwards.pop_front();
+    }
+}
+
+void Session::setAuth(bool enbaled) {
+    authEnabled = enbaled;
+}
+
+/* Only reset the client when the command was executed. */
+int32_t Session::processCommand(const TcpConnectionPtr &conn) {
+    if (redis->authEnabled) {
+        if (!authEnabled) {
+            if (STRCMP(redisCommands[0]->ptr, "auth") != 0) {
+                addReplyErrorFormat(conn->outputBuffer(), "NOAUTH Authentication required");
+                return REDIS_ERR;
+            }
+        }
+    }
+
+    /* Messages are pushed to a subscribed connection at any time, a reply
+     * to another command could not be told apart from them. */
+    if (subscriptions > 0 && strcmp(cmd->ptr, "subscribe") && strcmp(cmd->ptr, "unsubscribe") &&
+        strcmp(cmd->ptr, "psubscribe") && strcmp(cmd->ptr, "punsubscribe") &&
+        strcmp(cmd->ptr, "ping") && strcmp(cmd->ptr, "quit")) {
+        addReplyError(conn->outputBuffer(),
+                      "only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT allowed in this context");
+        return REDIS_ERR;
+    }
+
+    if (redis->clusterEnabled) {
+        if (redis->getClusterMap(cmd)) {
+            goto jump;
+        }
+
+        if (redisCommands.empty()) {
+            goto jump;
+        }
+
+        char *key = redisCommands[0]->ptr;
+        int32_t hashslot = redis->getCluster()->keyHashSlot(key, sdslen(key));
+
+        ClusterRoute route = redis->getCluster()->getRoute(hashslot);
+        if (route.migrating && redis->clusterRepliMigratEnabled) {
+            std::unique_lock <std::mutex> lck(redis->getClusterMutex());
+            redis->structureRedisProtocol(redis->clusterMigratCached, redisCommands);
+            goto jump;
+        }
+
+        if (route.importing && redis->clusterRepliImportEnabeld) {
+            replyBuffer = true;
+            goto jump;
+        }
+
+        if (route.node == nullptr) {
+            redis->getCluster()->clusterRedirectClient(conn, shared_from_this(),
+                                                       nullptr, hashslot, CLUSTER_REDIR_DOWN_UNBOUND);
+            return REDIS_ERR;
+        } else if (!route.self) {
+            redis->getCluster()->clusterRedirectClient(conn, shared_from_this(),
+                                                       route.node, hashslot, CLUSTER_REDIR_MOVED);
+            return REDIS_ERR;
+        }
+    }
+
+    jump:
+
+    /* A write that may grow the dataset first makes room under maxmemory,
+     * the master stream is applied whatever the memory use. */
+    if (redis->maxmemory > 0 && conn->getSockfd() != redis->masterfd &&
+        redis->denyOomCommand(cmd) && redis->freeMemoryIfNeeded() == REDIS_ERR) {
+        addReply(conn->outputBuffer(), shared.oomerr);
+        return REDIS_ERR;
+    }
+
+    if (redis->repliEnabled) {
+        if (conn->getSockfd() == redis->masterfd) {
+            fromMaster = true;
+
+            if (!redis->checkCommand(cmd)) {
+                return REDIS_ERR;
+            }
+        } else if (redis->masterfd > 0) {
+            if (redis->checkCommand(cmd)) {
+                addReplyErrorFormat(conn->outputBuffer(), "slaveof cmd unknown");
+                return REDIS_ERR;
+            }
+        } else {
+            if (redis->checkCommand(cmd)) {
+                redisCommands.push_front(cmd);
+                redis->structureRedisProtocol(slaveBuffer, redisCommands);
+                redisCommands.pop_front();
+            }
+        }
+    }
+
+    auto &handlerCommands = redis->getHandlerCommandMap();
+    auto it = handlerCommands.find(cmd);
+    if (it == handlerCommands.end()) {
+        addReplyErrorFormat(conn->outputBuffer(),
+                            "unknown command `%s`, with args beginning", cmd->ptr);
+        return REDIS_ERR;
+    } else {
+        /* In thread per core mode a command on keys of other cores runs
+         * there, the master stream is always applied in place. */
+        ForwardedCommand *forward = nullptr;
+        if (conn->getSockfd() != redis->masterfd) {
+            forward = redis->getDispatcher()->dispatch(it->first, redisCommands, shared_from_this(),
+                                                       conn, !forwards.empty());
+        }
+
+        if (forward != nullptr) {
+            forwards.emplace_back(forward);
+            if (redis->monitorEnabled) {
+                redisCommands.push_back(cmd);
+                redis->feedMonitor(redisCommands, conn->getSockfd());
+            }
+            return REDIS_OK;
+        }
+
+        /* Keep a background rewrite from forking between the execution
+         * of a write and its append to the log, and other writes off its
+         * keys until then, so the log has them in the order they ran. */
+        bool logged = redis->aofEnabled && redis->checkCommand(cmd);
+        std::shared_lock <std::shared_mutex> lck;
+        std::vector <std::unique_lock<std::mutex>> shardLocks;
+        if (logged) {
+            lck = std::shared_lock<std::shared_mutex>(redis->getAof()->getRewriteMutex());
+            redis->lockWriteShards(cmd, redisCommands, shardLocks);
+        }
+
+        if (!it->second(redisCommands, shared_from_this(), conn)) {
+            addReplyErrorFormat(conn->outputBuffer(),
+                                "wrong number of arguments`%s`, for command", cmd->ptr);
+        } else {
+            if (logged) {
+                redisCommands.push_front(cmd);
+                aofOffset = redis->getAof()->feedAppendOnlyFile(redisCommands);
+                redisCommands.pop_front();
+            }
+
+            if (redis->monitorEnabled) {
+                redisCommands.push_back(cmd);
+                redis->feedMonitor(redisCommands, conn->getSockfd());
+            }
+        }
+        redis->unlockWriteShards(shardLocks);
+    }
+    return REDIS_OK;
+}
+
+void Session::resetVlaue() {
+
+}
+
+void Session::reset() {
+    reqtype = 0;
+    argc = 0;
+    multibulklen = 0;
+    bulklen = -1;
+    redisCommands.clear();
+
+    if (replyBuffer) {
+        replyBuffer = false;
+    }
+
+    if (fromMaster) {
+        slaveBuffer.retrieveAll();
+        pubsubBuffer.retrieveAll();
+        fromMaster = false;
+    }
+}
+
+/* Like processMultibulkBuffer(), but for the inline protocol instead of RESP,
+ * this function consumes the client query buffer and creates a command ready
+ * to be executed inside the client structure. Returns C_OK if the command
+ * is ready to be executed, or C_ERR if there is still protocol to read to
+ * have a well formed command. The function also returns C_ERR when there is
+ * a protocol error: in such a case the client structure is setup to reply
+ * with the error and close the connection. */
+
+int32_t Session::processInlineBuffer(const TcpConnectionPtr &conn, Buffer *buffer) {
+    const char *newline;
+    const char *queryBuf = buffer->peek();
+    int32_t j, linefeedChars = 1;
+    size_t queryLen;
+    sds *argv, aux;
+    /* Search for end of line */
+    newline = buffer->findEOL();
+
+    /* Nothing to do without a \r\n */
+    if (newline == nullptr) {
+        return REDIS_ERR;
+    }
+
+    /* Handle the \r\n case. */
+    if (newline && newline != queryBuf && *(newline - 1) == '\r')
+        newline--, linefeedChars++;
+
+    /* Split the input buffer up to the \r\n */
+    queryLen = newline - queryBuf;
+    if ((queryLen + linefeedChars) > buffer->readableBytes()) {
+        return REDIS_ERR;
+    }
+
+    aux = sdsnewlen(queryBuf, queryLen);
+    argv = sdssplitargs(aux, &argc);
+    sdsfree(aux);
+
+    if (argv == nullptr) {
+        addReplyError(conn->outputBuffer(), "Protocol error: unbalanced quotes in request");
+        conn->shutdown();
+        return REDIS_ERR;
+    }
+
+    /* Leave data after the first line of the query in the buffer */
+    buffer->retrieve(queryLen + linefeedChars);
+
+    /* Create redis objects for all arguments. */
+    for (j = 0; j < argc; j++) {
+        if (j == 0) {
+            cmd->ptr = sdscpylen((sds) (cmd->ptr), argv[j], sdslen(argv[j]));
+            if (cmd->ptr[0] >= 'A' && cmd->ptr[0] <= 'Z') {
+                int len = sdslen(cmd->ptr);
+                for (int i = 0; i < len; i++) {
+                    cmd->ptr[i] += 32;
+                }
+            }
+            cmd->calHash();
+        } else {
+            RedisObjectPtr obj = createStringObject(argv[j], sdslen(argv[j]));
+            redisCommands.push_back(obj);
+        }
+        sdsfree(argv[j]);
+    }
+
+    zfree(argv);
+    return REDIS_OK;
+}
+
+/* Process the query buffer for client 'c', setting up the client argument
+ * vector for command execution. Returns C_OK if after running the function
+ * the client has a well-formed ready to be processed command, otherwise
+ * C_ERR if there is still to read more buffer to get the full command.
+ * The function also returns C_ERR when there is a protocol error: in such a
+ * case the client structure is setup to reply with the error and close
+ * the connection.
+ *
+ * This function is called if processInputBuffer() detects that the next
+ * command is in RESP format, so the first byte in the command is found
+ * to be '*'. Otherwise for inline commands processInlineBuffer() is called. */
+
+/* Arguments are first recorded as (offset, length) slices of the input
+ * buffer, nothing is copied or allocated until the whole command is there.
+ * Offsets are relative to peek(), so they survive the buffer compacting
+ * itself while more data is appended. */
+int32_t Session::processMultibulkBuffer(const TcpConnectionPtr &conn, Buffer *buffer) {
+    const char *newline = nullptr;
+    int32_t ok;
+    int64_t ll = 0;
+    const char *queryBuf = buffer->peek();
+    if (multibulklen == 0) {
+        /* Multi bulk length cannot be read without a \r\n */
+        newline = buffer->findCRLF(queryBuf + pos);
+        if (newline == nullptr) {
+            return REDIS_ERR;
+        }
+
+        if (queryBuf[pos] != '*') {
+            addReplyError(conn->outputBuffer(), "Protocol error: *");
+            conn->shutdown();
+            return REDIS_ERR;
+        }
+
+        /* We know for sure there is a whole line since newline != NULL,
+         * so go ahead and find out the multi bulk length. */
+        ok = string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
+        if (!ok || ll > REDIS_MBULK_BIG_ARG || ll <= 0) {
+            addReplyError(conn->outputBuffer(), "Protocol error: invalid multibulk length");
+            conn->shutdown();
+            return REDIS_ERR;
+        }
+
+        pos = newline - queryBuf + 2;
+        multibulklen = ll;
+        argvSlices.clear();
+    }
+
+    while (multibulklen) {
+        /* Read bulk length if unknown */
+        if (bulklen == -1) {
+            newline = buffer->findCRLF(queryBuf + pos);
+            if (newline == nullptr) {
+                break;
+            }
+
+            if (queryBuf[pos] != '$') {
+                addReplyErrorFormat(conn->outputBuffer(),
+                                    "Protocol error: expected '$',got '%c'", queryBuf[pos]);
+                conn->shutdown();
+                return REDIS_ERR;
+            }
+
+            ok = string2ll(queryBuf + pos + 1, newline - (queryBuf + pos + 1), &ll);
+            if (!ok || ll < 0 || ll > REDIS_MBULK_BIG_ARG) {
+                addReplyError(conn->outputBuffer(),
+                              "Protocol error: invalid bulk length");
+                conn->shutdown();
+                return REDIS_ERR;
+            }
+
+            pos = newline - queryBuf + 2;
+            bulklen = ll;
+        }
+
+        /* Read bulk argument */
+        if (buffer->readableBytes() - pos < (size_t) bulklen + 2) {
+            break;
+        }
+
+        argvSlices.emplace_back(pos, bulklen);
+        pos += bulklen + 2;
+        bulklen = -1;
+        multibulklen--;
+    }
+
+    /* We're done when c->multibulk == 0 */
+    if (multibulklen == 0) {
+        createArgv(queryBuf);
+        /* Trim to pos */
+        assert(pos <= buffer->readableBytes());
+        buffer->retrieve(pos);
+        pos = 0;
+        return REDIS_OK;
+    }
+
+    /* Still not ready to process the command */
+    return REDIS_ERR;
+}
+
+/* The command name goes into the reused cmd object, the other arguments
+ * into objects of argvPool that no command kept a reference to. Only an
+ * argument that was stored, in the keyspace or anywhere else, costs a new
+ * allocation for the next command. */
+void Session::createArgv(const char *queryBuf) {
+    argc = argvSlices.size();
+    cmd->ptr = sdscpylen(cmd->ptr, queryBuf + argvSlices[0].first, argvSlices[0].second);
+    for (size_t i = 0; i < sdslen(cmd->ptr); i++) {
+        if (cmd->ptr[i] >= 'A' && cmd->ptr[i] <= 'Z') {
+            cmd->ptr[i] += 32;
+        }
+    }
+    cmd->calHash();
+
+    for (size_t i = 1; i < argvSlices.size(); i++) {
+        const char *p = queryBuf + argvSlices[i].first;
+        size_t len = argvSlices[i].second;
+        if (i > argvPool.size()) {
+            if (argvPool.size() < REDIS_ARGV_POOL_SIZE) {
+                argvPool.push_back(createStringObject((char *) p, len));
+                redisCommands.push_back(argvPool.back());
+            } else {
+                redisCommands.push_back(createStringObject((char *) p, len));
+            }
+            continue;
+        }
+
+        /* An embedded string is reused only while the argument fits in it. */
+        RedisObjectPtr &obj = argvPool[i - 1];
+        if (obj.use_count() == 1 && (obj->embedded ? len <= sdsalloc(obj->ptr) :
+                                     sdsalloc(obj->ptr) <= REDIS_ARGV_POOL_MAX_BYTES)) {
+            /* use_count() is a relaxed load. The thread that dropped the
+             * last other reference did it with a release decrement, the
+             * fence orders its reads of the object before our writes. */
+            std::atomic_thread_fence(std::memory_order_acquire);
+            obj->ptr = sdscpylen(obj->ptr, p, len);
+            obj->type = REDIS_STRING;
+            obj->encoding = obj->embedded ? REDIS_ENCODING_EMBSTR : REDIS_ENCODING_RAW;
+            obj->lru = objectLruInit.load(std::memory_order_relaxed);
+            obj->calHash();
+        } else {
+            obj = createStringObject((char *) p, len);
+        }
+        redisCommands.push_back(obj);
+    }
+}
+
+
+
+
+
+
+
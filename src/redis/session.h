@@ -1,56 +1,100 @@
-#pragma once
-
-#include "all.h"
-#include "tcpconnection.h"
-#include "object.h"
-#include "sds.h"
-#include "util.h"
-
-class Redis;
-
-class Session : public std::enable_shared_from_this<Session> {
-public:
-    Session(Redis *redis, const TcpConnectionPtr &conn);
-
-    ~Session();
-
-    void clearCommand();
-
-    void resetVlaue();
-
-    void reset();
-
-    void readCallback(const TcpConnectionPtr &conn, Buffer *buffer);
-
-    int32_t processMultibulkBuffer(const TcpConnectionPtr &conn, Buffer *buffer);
-
-    int32_t processInlineBuffer(const TcpConnectionPtr &conn, Buffer *buffer);
-
-    int32_t processCommand(const TcpConnectionPtr &conn);
-
-    void setAuth(bool enbaled);
-
-private:
-    Session(const Session &);
-
-    void operator=(const Session &);
-
-    Redis *redis;
-    RedisObjectPtr cmd;
-    std::deque <RedisObjectPtr> redisCommands;
-
-    int32_t reqtype;
-    int32_t multibulklen;
-    int64_t bulklen;
-    int32_t argc;
-    size_t pos;
-
-    Buffer slaveBuffer;
-    Buffer pubsubBuffer;
-
-    bool authEnabled;
-    bool replyBuffer;
-    bool fromMaster;
-    bool fromSlave;
-};
-
+#pragma once
+
+#include "all.h"
+#include "tcpconnection.h"
+#include "object.h"
+#include "sds.h"
+#include "util.h"
+#include "dispatcher.h"
+
+class Redis;
+
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(Redis *redis, const TcpConnectionPtr &conn);
+
+    ~Session();
+
+    void clearCommand();
+
+    void resetVlaue();
+
+    void reset();
+
+    void readCallback(const TcpConnectionPtr &conn, Buffer *buffer);
+
+    int32_t processMultibulkBuffer(const TcpConnectionPtr &conn, Buffer *buffer);
+
+    int32_t processInlineBuffer(const TcpConnectionPtr &conn, Buffer *buffer);
+
+    void createArgv(const char *queryBuf);
+
+    int32_t processCommand(const TcpConnectionPtr &conn);
+
+    bool waitForFsync(const TcpConnectionPtr &conn);
+
+    void fsyncCallback(const TcpConnectionPtr &conn, int64_t offset);
+
+    void forwardCallback(const TcpConnectionPtr &conn);
+
+    void processReads(const TcpConnectionPtr &conn);
+
+    void holdReply(const TcpConnectionPtr &conn, size_t replied);
+
+    void flushForwards(const TcpConnectionPtr &conn);
+
+    void setAuth(bool enbaled);
+
+    void setSubscriptions(int32_t count) { subscriptions = count; }
+
+private:
+    Session(const Session &);
+
+    void operator=(const Session &);
+
+    Redis *redis;
+    RedisObjectPtr cmd;
+    std::deque <RedisObjectPtr> redisCommands;
+    std::vector <std::pair<size_t, size_t>> argvSlices;   /* Offset and length in the input buffer. */
+    /* Argument objects rewritten in place for the next command once only
+     * the pool holds them. A stored argument may have been released by
+     * another thread (an expire cycle, a client on another loop), so the
+     * rewrite must come after an acquire fence, see createArgv(). */
+    std::vector <RedisObjectPtr> argvPool;
+
+    int32_t reqtype;
+    int32_t multibulklen;
+    int64_t bulklen;
+    int32_t argc;
+    size_t pos;
+    int64_t aofOffset;
+    int64_t aofFsynced;
+    int64_t masterReadLen;     /* Bytes of the command being read from the master. */
+    int32_t subscriptions;     /* Channels and patterns, other commands are refused while any. */
+    bool fsyncWaiting;
+    bool forwardWaiting;      /* The parsed command waits for the forwards to complete. */
+    std::deque <std::unique_ptr<ForwardedCommand>> forwards;   /* Replies held in command order. */
+
+    /* A pipelined read that was parsed but did not run yet. The slots are
+     * reused, with their deques and argument pools. */
+    struct PendingRead {
+        RedisObjectPtr cmd;
+        std::deque <RedisObjectPtr> argv;
+        std::vector <RedisObjectPtr> pool;
+        int32_t shard;
+    };
+    std::vector <PendingRead> reads;
+    size_t readCount;
+    std::vector <size_t> readOrder;
+    std::vector <std::pair<size_t, size_t>> readReplies;   /* Offset and length in the output buffer. */
+    Buffer readBuffer;         /* The replies put back in order. */
+
+    Buffer slaveBuffer;
+    Buffer pubsubBuffer;
+
+    bool authEnabled;
+    bool replyBuffer;
+    bool fromMaster;
+    bool fromSlave;
+};
+
@@ -0,0 +1,87 @@
+#include "set.h"
+#include "util.h"
+#include "scan.h"
+
+SetType::SetType(size_t maxIntsetEntries)
+        : maxEntries(maxIntsetEntries) {
+
+}
+
+/* Returns true when the member is new. */
+bool SetType::add(const RedisObjectPtr &member) {
+    int64_t value;
+    if (!dict) {
+        if (string2ll(member->ptr, sdslen(member->ptr), &value)) {
+            if (intset.find(value)) {
+                return false;
+            }
+
+            if (intset.size() < maxEntries) {
+                return intset.add(value);
+            }
+        }
+        convert();
+    }
+    return dict->insert(member).second;
+}
+
+bool SetType::contains(const RedisObjectPtr &member) const {
+    if (dict) {
+        return dict->find(member) != dict->end();
+    }
+
+    int64_t value;
+    return string2ll(member->ptr, sdslen(member->ptr), &value) && intset.find(value);
+}
+
+void SetType::forEach(const Visitor &visitor) const {
+    if (dict) {
+        for (auto &it : *dict) {
+            visitor(it->ptr, sdslen(it->ptr));
+        }
+        return;
+    }
+
+    char buf[LONG_STR_SIZE];
+    for (size_t i = 0; i < intset.size(); i++) {
+        int32_t len = ll2string(buf, sizeof(buf), intset.get(i));
+        visitor(buf, len);
+    }
+}
+
+uint64_t SetType::scan(uint64_t cursor, size_t count, const Visitor &visitor) const {
+    if (!dict) {
+        forEach(visitor);
+        return 0;
+    }
+
+    return scanTable(*dict, cursor, &count, [&visitor](const RedisObjectPtr &member) {
+        visitor(member->ptr, sdslen(member->ptr));
+    });
+}
+
+/* Takes the intset of an RDB file, one beyond the limit becomes a dict. */
+bool SetType::loadIntset(const char *p, size_t len) {
+    assert(!dict && intset.size() == 0);
+    if (!intset.load(p, len)) {
+        return false;
+    }
+
+    if (intset.size() > maxEntries) {
+        convert();
+    }
+    return true;
+}
+
+void SetType::convert() {
+    std::unique_ptr <std::unordered_set<RedisObjectPtr, Hash, Equal>> table(
+            new std::unordered_set<RedisObjectPtr, Hash, Equal>(intset.size()));
+    forEach([&table](const char *member, size_t len) {
+        RedisObjectPtr m = createStringObject(const_cast<char *>(member), len);
+        m->type = OBJ_SET;
+        table->insert(m);
+    });
+
+    dict = std::move(table);
+    intset = Intset();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+#include "intset.h"
+
+/* Set of a key. While every member is an integer and there are at most
+ * maxIntsetEntries of them it is an intset, otherwise a dict. */
+class SetType {
+public:
+    typedef std::function<void(const char *member, size_t len)> Visitor;
+
+    SetType(size_t maxIntsetEntries = REDIS_DEFAULT_SET_MAX_INTSET_ENTRIES);
+
+    size_t size() const { return dict ? dict->size() : intset.size(); }
+
+    bool isIntset() const { return dict == nullptr; }
+
+    bool add(const RedisObjectPtr &member);
+
+    bool contains(const RedisObjectPtr &member) const;
+
+    void forEach(const Visitor &visitor) const;
+
+    /* Continues the scan at cursor (see scan.h), an intset is visited
+     * whole and gives cursor 0. */
+    uint64_t scan(uint64_t cursor, size_t count, const Visitor &visitor) const;
+
+    const Intset &getIntset() const { return intset; }
+
+    bool loadIntset(const char *p, size_t len);
+
+private:
+    SetType(const SetType &);
+
+    void operator=(const SetType &);
+
+    void convert();
+
+    uint32_t maxEntries;
+    Intset intset;
+    std::unique_ptr <std::unordered_set<RedisObjectPtr, Hash, Equal>> dict;
+};
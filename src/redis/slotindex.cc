@@ -0,0 +1,53 @@
+#include "slotindex.h"
+
+SlotIndex::SlotIndex(bool enabled)
+        : slots(enabled ? new Slot[CLUSTER_SLOTS] : nullptr) {
+
+}
+
+SlotIndex::~SlotIndex() {
+
+}
+
+void SlotIndex::add(const RedisObjectPtr &key) {
+    if (slots == nullptr) {
+        return;
+    }
+
+    Slot &slot = slots[key->getHashSlot()];
+    std::unique_lock <std::mutex> lck(slot.mtx);
+    slot.keys.insert(key);
+}
+
+void SlotIndex::remove(const RedisObjectPtr &key) {
+    if (slots == nullptr) {
+        return;
+    }
+
+    Slot &slot = slots[key->getHashSlot()];
+    std::unique_lock <std::mutex> lck(slot.mtx);
+    slot.keys.erase(key);
+}
+
+size_t SlotIndex::countKeys(int32_t slot) {
+    if (slots == nullptr) {
+        return 0;
+    }
+
+    std::unique_lock <std::mutex> lck(slots[slot].mtx);
+    return slots[slot].keys.size();
+}
+
+void SlotIndex::getKeys(int32_t slot, std::vector <RedisObjectPtr> &keys, int32_t count) {
+    if (slots == nullptr || count <= 0) {
+        return;
+    }
+
+    std::unique_lock <std::mutex> lck(slots[slot].mtx);
+    for (auto &key : slots[slot].keys) {
+        keys.push_back(createRawStringObject(key->type, key->ptr, sdslen(key->ptr)));
+        if (--count == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+
+/* Keys of the keyspace by cluster slot, kept in cluster mode so that
+ * GETKEYSINSLOT, COUNTKEYSINSLOT and slot migration visit the keys of one
+ * slot instead of the whole keyspace. The keyspace calls add() and remove()
+ * with the lock of the key's shard held, every slot has a lock of its own
+ * taken after it. A disabled index ignores all calls. */
+class SlotIndex {
+public:
+    explicit SlotIndex(bool enabled);
+
+    ~SlotIndex();
+
+    bool isEnabled() const { return slots != nullptr; }
+
+    void add(const RedisObjectPtr &key);
+
+    void remove(const RedisObjectPtr &key);
+
+    size_t countKeys(int32_t slot);
+
+    /* Appends copies of at most count keys of the slot. */
+    void getKeys(int32_t slot, std::vector <RedisObjectPtr> &keys, int32_t count);
+
+private:
+    SlotIndex(const SlotIndex &);
+
+    void operator=(const SlotIndex &);
+
+    struct Slot {
+        std::mutex mtx;
+        std::unordered_set <RedisObjectPtr, Hash, Equal> keys;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+};
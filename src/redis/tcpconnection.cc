@@ -2,10 +2,24 @@
 #include "tcpconnection.h"
 #include "socket.h"
 
+/* Bounds of the room reserved for a read, see adjustReadSize(). */
+static const int32_t kInitialReadSize = 4096;
+static const int32_t kMinReadSize = 1024;
+static const int32_t kMaxReadSize = 1024 * 1024;
+static const int32_t kShortReads = 4;
+
 TcpConnection::TcpConnection(EventLoop *loop, int32_t sockfd, const std::any &context)
 	: loop(loop),
 	sockfd(sockfd),
 	reading(true),
+	readBuffer(loop->getBufferPool()),
+	writeBuffer(loop->getBufferPool()),
+	referencesEnabled(false),
+	asyncSend(loop->usesIoUring()),
+	sendingBuffer(loop->getBufferPool()),
+	sendRequest(0),
+	readSize(kInitialReadSize),
+	shortReads(0),
 	state(kConnecting),
 	channel(new Channel(loop, sockfd)),
 	context(context) {
@@ -17,6 +31,9 @@ TcpConnection::TcpConnection(EventLoop *loop, int32_t sockfd, const std::any &co
 		std::bind(&TcpConnection::handleClose, this));
 	channel->setErrorCallback(
 		std::bind(&TcpConnection::handleError, this));
+	if (loop->usesIoUring()) {
+		channel->setReceiveBuffer(&readBuffer);
+	}
 }
 
 TcpConnection::~TcpConnection() {
@@ -52,7 +69,7 @@ void TcpConnection::forceCloseInLoop() {
 
 void TcpConnection::shutdownInLoop() {
 	loop->assertInLoopThread();
-	if (!channel->isWriting()) {
+	if (!channel->isWriting() && sendRequest == 0) {
 		if (Socket::shutdown(sockfd) < 0) {
 			LOG_DEBUG << "";
 		}
@@ -62,9 +79,23 @@ void TcpConnection::shutdownInLoop() {
 void TcpConnection::handleRead() {
 	loop->assertInLoopThread();
 	int saveErrno = 0;
-	ssize_t n = readBuffer.readFd(channel->getfd(), &saveErrno);
+	ssize_t n;
+	if (channel->getReceiveBuffer() != nullptr) {
+		// The loop's io_uring received into readBuffer already.
+		n = loop->takeReceived(channel.get(), &saveErrno);
+	}
+	else {
+		readBuffer.ensureWritableBytes(readSize);
+		int32_t writable = readBuffer.writableBytes();
+		n = readBuffer.readFd(channel->getfd(), &saveErrno);
+		if (n > 0) {
+			adjustReadSize(n, writable);
+		}
+	}
+
 	if (n > 0) {
 		messageCallback(shared_from_this(), &readBuffer);
+		readBuffer.release();
 	}
 #ifdef _WIN64
 	else if (n == 0 || saveErrno == WSAECONNRESET) {
@@ -82,6 +113,11 @@ void TcpConnection::handleRead() {
 		if (errno != ECONNRESET || errno != ETIMEDOUT) {
 
 		}
+
+		// Nothing polls a socket received by the io_uring for a hang up.
+		if (channel->getReceiveBuffer() != nullptr && errno != EAGAIN) {
+			handleClose();
+		}
 	}
 #endif
 }
@@ -90,15 +126,26 @@ void TcpConnection::handleWrite() {
 	loop->assertInLoopThread();
 
 	if (channel->isWriting()) {
-		if (writeBuffer.readableBytes() <=0) {
+		if (asyncSend && hasPendingOutput()) {
+			// The completion of the send goes on with the rest.
+			channel->disableWriting();
+			startSend();
+			return ;
+		}
+
+		if (!hasPendingOutput()) {
+			// sendPipe() on an empty buffer waits for the socket to become
+			// writable, e.g. a full resync that writes with sendfile().
 			channel->disableWriting();
+			if (writeCompleteCallback) {
+				loop->queueInLoop(std::bind(writeCompleteCallback, shared_from_this()));
+			}
 			return ;
 		}
 		
-		ssize_t n = Socket::write(channel->getfd(), writeBuffer.peek(), writeBuffer.readableBytes());
+		ssize_t n = writeOutput();
 		if (n > 0) {
-			writeBuffer.retrieve(n);
-			if (writeBuffer.readableBytes() == 0) {
+			if (!hasPendingOutput()) {
 				channel->disableWriting();
 				if (writeCompleteCallback) {
 					loop->queueInLoop(std::bind(writeCompleteCallback, shared_from_this()));
@@ -118,11 +165,206 @@ void TcpConnection::handleWrite() {
 	}
 }
 
+/* Writes as much of the output as the socket takes with one writev(): the
+ * bytes of writeBuffer with the references queued between them. */
+ssize_t TcpConnection::writeOutput() {
+	static const int32_t kMaxIov = 64;
+	IOV_TYPE vec[kMaxIov];
+	int32_t iovcnt = fillOutput(&writeBuffer, references, vec, kMaxIov);
+	ssize_t n = Socket::writev(channel->getfd(), vec, iovcnt);
+	if (n > 0) {
+		consumeOutput(&writeBuffer, &references, n);
+	}
+
+	if (writeBuffer.readableBytes() == 0) {
+		writeBuffer.release();
+	}
+	return n;
+}
+
+/* Fills vec with the bytes of buffer and the references queued between
+ * them, up to maxIov entries. Returns the entries used. */
+int32_t TcpConnection::fillOutput(Buffer *buffer, const ReferenceList &refs,
+	IOV_TYPE *vec, int32_t maxIov) {
+	int32_t iovcnt = 0;
+	auto add = [&](const char *data, size_t len) {
+#ifdef _WIN64
+		vec[iovcnt].buf = const_cast<char *>(data);
+		vec[iovcnt].len = len;
+#else
+		vec[iovcnt].iov_base = const_cast<char *>(data);
+		vec[iovcnt].iov_len = len;
+#endif
+		iovcnt++;
+	};
+
+	const char *p = buffer->peek();
+	int32_t from = 0;
+	size_t added = 0;
+	for (auto &it : refs) {
+		if (iovcnt + 2 > maxIov) {
+			break;
+		}
+
+		if (it.offset > from) {
+			add(p + from, it.offset - from);
+			from = it.offset;
+		}
+		add(it.data, it.len);
+		added++;
+	}
+
+	if (added == refs.size() && from < buffer->readableBytes()) {
+		add(p + from, buffer->readableBytes() - from);
+	}
+	return iovcnt;
+}
+
+/* Drops the first n bytes written from buffer and refs. */
+void TcpConnection::consumeOutput(Buffer *buffer, ReferenceList *refs, size_t n) {
+	size_t left = n;
+	while (left > 0) {
+		if (!refs->empty() && refs->front().offset == 0) {
+			auto &front = refs->front();
+			size_t len = std::min(left, front.len);
+			front.data += len;
+			front.len -= len;
+			left -= len;
+			if (front.len == 0) {
+				refs->pop_front();
+			}
+		} else {
+			int32_t chunk = refs->empty() ? buffer->readableBytes() : refs->front().offset;
+			int32_t len = std::min(left, (size_t) chunk);
+			buffer->retrieve(len);
+			for (auto &it : *refs) {
+				it.offset -= len;
+			}
+			left -= len;
+		}
+	}
+}
+
+/* Sends the output with the loop's io_uring. The output moves to
+ * sendingBuffer, where it stays put until the kernel is done with it, the
+ * request goes out with the loop's next wait along with the other sends. */
+void TcpConnection::startSend() {
+	static const int32_t kMaxIov = 64;
+	if (sendRequest != 0) {
+		return;
+	}
+
+	if (sendingBuffer.readableBytes() == 0 && sendingReferences.empty()) {
+		if (writeBuffer.readableBytes() == 0 && references.empty()) {
+			return;
+		}
+		sendingBuffer.swap(writeBuffer);
+		sendingReferences.swap(references);
+	}
+
+	IOV_TYPE vec[kMaxIov];
+	int32_t iovcnt = fillOutput(&sendingBuffer, sendingReferences, vec, kMaxIov);
+	sendRequest = loop->submitSend(sockfd, vec, iovcnt,
+		std::bind(&TcpConnection::handleSendComplete, shared_from_this(), std::placeholders::_1));
+}
+
+void TcpConnection::handleSendComplete(ssize_t n) {
+	loop->assertInLoopThread();
+	sendRequest = 0;
+	if (n == -EAGAIN) {
+		if (!channel->isNoneEvent()) {
+			channel->enableWriting();
+		}
+		return;
+	}
+
+	if (n <= 0 || state == kDisconnected) {
+		// Closed or failing, the read side reports it.
+		sendingBuffer.retrieveAll();
+		sendingReferences.clear();
+		sendingBuffer.release();
+		return;
+	}
+
+	consumeOutput(&sendingBuffer, &sendingReferences, n);
+	if (sendingBuffer.readableBytes() == 0) {
+		sendingBuffer.release();
+	}
+
+	if (hasPendingOutput()) {
+		startSend();
+		return;
+	}
+
+	if (writeCompleteCallback) {
+		loop->queueInLoop(std::bind(writeCompleteCallback, shared_from_this()));
+	}
+
+	if (state == kDisconnecting) {
+		shutdownInLoop();
+	}
+}
+
+/* A read that filled the room reserved for it doubles the next one, a few
+ * reads in a row that used less than a quarter of it halve it. */
+void TcpConnection::adjustReadSize(ssize_t n, int32_t writable) {
+	if (n == writable) {
+		readSize = std::min(readSize * 2, kMaxReadSize);
+		shortReads = 0;
+	}
+	else if (n < readSize / 4 && ++shortReads >= kShortReads) {
+		readSize = std::max(readSize / 2, kMinReadSize);
+		shortReads = 0;
+	}
+}
+
+/* Called at the end of a batch of replies: writes the output right away
+ * instead of waiting a loop iteration for EPOLLOUT. Writing is enabled only
+ * for what the socket did not take, handleWrite() sends that later. */
+void TcpConnection::flushOutput() {
+	loop->assertInLoopThread();
+	if (state == kDisconnected || channel->isNoneEvent() || channel->isWriting() ||
+		!hasPendingOutput()) {
+		return;
+	}
+
+	if (asyncSend) {
+		startSend();
+		return;
+	}
+
+	ssize_t n = writeOutput();
+	if (n < 0 && errno != EWOULDBLOCK && errno != EINTR) {
+		return;
+	}
+
+	if (hasPendingOutput()) {
+		channel->enableWriting();
+	}
+}
+
+/* Queues len bytes at data after the output buffered so far, written from
+ * there instead of being copied; owner keeps them alive until then. Returns
+ * false when references are disabled on the connection and the caller has
+ * to copy the bytes. */
+bool TcpConnection::appendReference(const std::shared_ptr<const void> &owner,
+	const char *data, size_t len) {
+	if (!referencesEnabled) {
+		return false;
+	}
+
+	references.push_back(OutputReference{writeBuffer.readableBytes(), owner, data, len});
+	return true;
+}
+
 void TcpConnection::handleClose() {
 	loop->assertInLoopThread();
 	assert(state == kConnected || state == kDisconnecting);
 	setState(kDisconnected);
 	channel->disableAll();
+	if (sendRequest != 0) {
+		loop->cancelRequest(sendRequest);
+	}
 	TcpConnectionPtr guardThis(shared_from_this());
 	connectionCallback(guardThis);
 	closeCallback(guardThis);
@@ -280,8 +522,8 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
 		return;
 	}
 
-	if (!channel->isWriting() && writeBuffer.readableBytes() == 0) {
-		Socket::write(channel->getfd(), data, len);
+	if (!asyncSend && !channel->isWriting() && !hasPendingOutput()) {
+		nwrote = Socket::write(channel->getfd(), data, len);
 		if (nwrote >= 0) {
 			remaining = len - nwrote;
 			if (remaining == 0 && writeCompleteCallback) {
@@ -298,20 +540,23 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
 				}
 			}
 		}
+	}
 
-		assert(remaining <= len);
-		if (!faultError && remaining > 0) {
-			size_t oldLen = writeBuffer.readableBytes();
-			if (oldLen + remaining >= highWaterMark
-				&& oldLen < highWaterMark
-				&& highWaterMarkCallback) {
-				loop->queueInLoop(std::bind(highWaterMarkCallback, shared_from_this(), oldLen + remaining));
-			}
+	assert(remaining <= len);
+	if (!faultError && remaining > 0) {
+		size_t oldLen = writeBuffer.readableBytes();
+		if (oldLen + remaining >= highWaterMark
+			&& oldLen < highWaterMark
+			&& highWaterMarkCallback) {
+			loop->queueInLoop(std::bind(highWaterMarkCallback, shared_from_this(), oldLen + remaining));
+		}
 
-			writeBuffer.append(static_cast<const char *>(data) + nwrote, remaining);
-			if (!channel->isWriting()) {
-				channel->enableWriting();
-			}
+		writeBuffer.append(static_cast<const char *>(data) + nwrote, remaining);
+		if (asyncSend) {
+			startSend();
+		}
+		else if (!channel->isWriting()) {
+			channel->enableWriting();
 		}
 	}
 }
@@ -330,6 +575,9 @@ void TcpConnection::connectDestroyed() {
 	if (state == kConnected) {
 		setState(kDisconnected);
 		channel->disableAll();
+		if (sendRequest != 0) {
+			loop->cancelRequest(sendRequest);
+		}
 		connectionCallback(shared_from_this());
 	}
 	channel->remove();
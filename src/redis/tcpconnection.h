@@ -66,6 +66,17 @@ public:
 
     void sendPipe(const void *message, int32_t len);
 
+    void flushOutput();
+
+    bool appendReference(const std::shared_ptr<const void> &owner, const char *data, size_t len);
+
+    void setReferencesEnabled(bool enabled) { referencesEnabled = enabled; }
+
+    bool hasPendingOutput() const {
+        return writeBuffer.readableBytes() > 0 || !references.empty() ||
+               sendingBuffer.readableBytes() > 0 || !sendingReferences.empty() || sendRequest != 0;
+    }
+
     void send(const void *message, int32_t len);
 
     void send(Buffer *message);
@@ -125,12 +136,45 @@ private:
 
     void operator=(const TcpConnection &);
 
+    ssize_t writeOutput();
+
+    void adjustReadSize(ssize_t n, int32_t writable);
+
+    /* Bytes written from memory held by owner, between the first offset
+     * readable bytes of writeBuffer and the rest. */
+    struct OutputReference {
+        int32_t offset;
+        std::shared_ptr<const void> owner;
+        const char *data;
+        size_t len;
+    };
+
+    typedef std::deque <OutputReference> ReferenceList;
+
+    int32_t fillOutput(Buffer *buffer, const ReferenceList &refs, IOV_TYPE *vec, int32_t maxIov);
+
+    void consumeOutput(Buffer *buffer, ReferenceList *refs, size_t n);
+
+    void startSend();
+
+    void handleSendComplete(ssize_t n);
+
     EventLoop *loop;
     int32_t sockfd;
     bool reading;
 
     Buffer readBuffer;
     Buffer writeBuffer;
+    ReferenceList references;
+    bool referencesEnabled;
+    /* With the loop's io_uring the output moves here while a send of it is
+     * in flight, sendRequest, and new output gathers in writeBuffer. */
+    bool asyncSend;
+    Buffer sendingBuffer;
+    ReferenceList sendingReferences;
+    uint64_t sendRequest;
+    int32_t readSize;           /* Room reserved for the next read. */
+    int32_t shortReads;
     ConnectionCallback connectionCallback;
     MessageCallback messageCallback;
     WriteCompleteCallback writeCompleteCallback;
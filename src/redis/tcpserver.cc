@@ -1,8 +1,22 @@
 #include "tcpserver.h"
 #include "tcpconnection.h"
 
+#ifdef __linux__
+static void pinThread(int32_t cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (::pthread_setaffinity_np(::pthread_self(), sizeof set, &set) != 0) {
+		LOG_WARN << "Pin loop thread to cpu " << cpu << " failed";
+	}
+}
+#endif
+
 TcpServer::TcpServer(EventLoop *loop, const char *ip, int16_t port, const std::any &context)
 	: loop(loop),
+	ip(ip),
+	port(port),
+	acceptMode(kSingleAcceptor),
 	acceptor(new Acceptor(loop, ip, port)),
 	threadPool(new ThreadPool(loop)),
 	context(context) {
@@ -17,6 +31,17 @@ TcpServer::~TcpServer() {
 		conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
 		conn.reset();
 	}
+
+	for (auto &it : loopConnections) {
+		for (auto &iter : it.second) {
+			it.first->runInLoop(std::bind(&TcpConnection::connectDestroyed, iter.second));
+		}
+	}
+
+	for (auto &it : loopAcceptors) {
+		Acceptor *acceptor = it.release();
+		acceptor->getLoop()->runInLoop([acceptor]() { delete acceptor; });
+	}
 }
 
 void TcpServer::newConnection(int32_t sockfd) {
@@ -37,9 +62,66 @@ void TcpServer::setThreadNum(int16_t numThreads) {
 
 void TcpServer::start() {
 	threadPool->start(threadInitCallback);
+	if (acceptMode != kSingleAcceptor && threadPool->getAllLoops()[0] != loop) {
+		startLoopAcceptors();
+		return;
+	}
 	acceptor->listen();
 }
 
+/* Worker i accepts on the i-th socket of the SO_REUSEPORT group. The first
+ * is the one bound in the constructor, which holds the port all along. */
+void TcpServer::startLoopAcceptors() {
+	auto loops = threadPool->getAllLoops();
+	int32_t firstfd = acceptor->releaseSocket();
+	acceptor.reset();
+
+	for (size_t i = 0; i < loops.size(); i++) {
+		EventLoop *ioLoop = loops[i];
+		int32_t sockfd = i == 0 ? firstfd : Socket::createTcpSocket(ip.c_str(), port);
+		AcceptorPtr loopAcceptor(new Acceptor(ioLoop, sockfd));
+		loopAcceptor->setNewConnectionCallback(
+			std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, std::placeholders::_1));
+		loopConnections[ioLoop];
+		loopAcceptors.push_back(std::move(loopAcceptor));
+	}
+
+#ifdef __linux__
+	if (acceptMode == kReusePortCpu) {
+		int32_t cpus = std::max<int32_t>(::sysconf(_SC_NPROCESSORS_ONLN), 1);
+		for (size_t i = 0; i < loops.size(); i++) {
+			loops[i]->runInLoop(std::bind(&pinThread, i % cpus));
+		}
+		Socket::setReusePortCpuSteering(firstfd, loops.size());
+	}
+#endif
+
+	for (auto &it : loopAcceptors) {
+		it->getLoop()->runInLoop(std::bind(&Acceptor::listen, it.get()));
+	}
+}
+
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int32_t sockfd) {
+	ioLoop->assertInLoopThread();
+	TcpConnectionPtr conn(new TcpConnection(ioLoop, sockfd, context));
+	loopConnections.at(ioLoop)[sockfd] = conn;
+	conn->setConnectionCallback(std::move(connectionCallback));
+	conn->setMessageCallback(std::move(messageCallback));
+	conn->setWriteCompleteCallback(std::move(writeCompleteCallback));
+	conn->setCloseCallback(std::bind(&TcpServer::removeLoopConnection, this, std::placeholders::_1));
+	conn->connectEstablished();
+}
+
+/* Called on the loop of the connection, from its handleClose(). */
+void TcpServer::removeLoopConnection(const TcpConnectionPtr &conn) {
+	EventLoop *ioLoop = conn->getLoop();
+	ioLoop->assertInLoopThread();
+	size_t n = loopConnections.at(ioLoop).erase(conn->getSockfd());
+	(void)n;
+	assert(n == 1);
+	ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
 void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
 	loop->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
 }
@@ -10,6 +10,16 @@ class TcpServer {
 public:
 	typedef std::function<void(EventLoop *)> ThreadInitCallback;
 
+	// How start() accepts when there are worker loops. kSingleAcceptor
+	// accepts on the base loop and hands the connections to the workers
+	// round robin. kReusePort gives every worker a SO_REUSEPORT socket of
+	// its own, so a connection is accepted and set up on the loop that
+	// serves it. kReusePortCpu also pins worker i to cpu i and steers a
+	// connection to the worker of the cpu it came in on.
+	enum AcceptMode {
+		kSingleAcceptor, kReusePort, kReusePortCpu
+	};
+
 	TcpServer(EventLoop *loop, const char *ip, int16_t port, const std::any &context);
 
 	~TcpServer();
@@ -32,6 +42,8 @@ public:
 
 	void setThreadNum(int16_t numThreads);
 
+	void setAcceptMode(AcceptMode mode) { acceptMode = mode; }
+
 	EventLoop *getLoop() const { return loop; }
 
 	ThreadPoolPtr getThreadPool() { return threadPool; }
@@ -47,7 +59,16 @@ private:
 
 	void operator=(const TcpServer &);
 
+	void startLoopAcceptors();
+
+	void newConnectionInLoop(EventLoop *ioLoop, int32_t sockfd);
+
+	void removeLoopConnection(const TcpConnectionPtr &conn);
+
 	EventLoop *loop;
+	std::string ip;
+	int16_t port;
+	AcceptMode acceptMode;
 	AcceptorPtr acceptor;
 	ThreadPoolPtr threadPool;
 	ConnectionCallback connectionCallback;
@@ -57,6 +78,10 @@ private:
 
 	typedef std::unordered_map <int32_t, TcpConnectionPtr> ConnectionMap;
 	ConnectionMap connections;
+	// With SO_REUSEPORT each worker loop keeps the connections it accepted,
+	// the map of a loop is only touched from its thread.
+	std::vector <AcceptorPtr> loopAcceptors;
+	std::unordered_map <EventLoop *, ConnectionMap> loopConnections;
 	std::any context;
 
 };
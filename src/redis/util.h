@@ -250,6 +250,10 @@ static const uint16_t crc16tab[256] =
 
 uint16_t crc16(const char *buf, int len);
 
+/* Cluster slot of a key, only the part between the first { and the next }
+ * is hashed when it is not empty. */
+uint32_t keyHashSlot(const char *key, int32_t keylen);
+
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 
 #ifdef REDIS_TEST
@@ -345,6 +349,8 @@ void memrev64(void *p);
 
 void bytesToHuman(char *s, uint64_t n);
 
+int64_t memtoll(const char *p, int32_t *err);
+
 std::string base64Encode(unsigned char const *, unsigned int len);
 
 std::string base64Decode(std::string const &s);
@@ -349,25 +349,36 @@ void setproctitle(const char *fmt, ...);
 #define REDIS_ATOMIC_API "pthread-mutex"
 #endif
 
+/* used_memory is spread over counters on cache lines of their own. A thread
+ * adds to the counter it got on its first allocation, so allocations on
+ * different threads do not contend on one line. Memory freed on another
+ * thread than it was allocated on moves between counters, only the sum that
+ * zmalloc_used_memory() takes means anything. */
+#define ZMALLOC_COUNTERS 64
+
+struct alignas(64) ZmallocCounter {
+    std::atomic <size_t> bytes;
+};
+
+static ZmallocCounter used_memory[ZMALLOC_COUNTERS];
+static std::atomic <uint32_t> used_memory_next(0);
+
+static inline std::atomic <size_t> &zmalloc_counter() {
+    static thread_local uint32_t index =
+            used_memory_next.fetch_add(1, std::memory_order_relaxed) % ZMALLOC_COUNTERS;
+    return used_memory[index].bytes;
+}
+
 #define update_zmalloc_stat_alloc(__n) do { \
     size_t _n = (__n); \
-    if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
-    atomicIncr(used_memory,__n); \
+    zmalloc_counter().fetch_add(_n, std::memory_order_relaxed); \
 } while(0)
 
 #define update_zmalloc_stat_free(__n) do { \
     size_t _n = (__n); \
-    if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
-    atomicDecr(used_memory,__n); \
+    zmalloc_counter().fetch_sub(_n, std::memory_order_relaxed); \
 } while(0)
 
-static size_t used_memory = 0;
-#ifdef _WIN64
-std::mutex mutex;
-#else
-pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
-#endif
-
 static void zmalloc_default_oom(size_t size) {
     fprintf(stderr, "zmalloc: Out of memory trying to allocate %zu bytes\n",
             size);
@@ -379,6 +390,21 @@ static void(*zmalloc_oom_handler)(size_t)
 =
 zmalloc_default_oom;
 
+/* Like zmalloc() but returns NULL when out of memory. */
+static void *ztrymalloc(size_t size) {
+    void *ptr = malloc(size + PREFIX_SIZE);
+
+    if (!ptr) return NULL;
+#ifdef HAVE_MALLOC_SIZE
+    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    return ptr;
+#else
+    *((size_t *) ptr) = size;
+    update_zmalloc_stat_alloc(size + PREFIX_SIZE);
+    return (char *) ptr + PREFIX_SIZE;
+#endif
+}
+
 void *zmalloc(size_t size) {
     void *ptr = malloc(size + PREFIX_SIZE);
 
@@ -500,9 +526,54 @@ char *zstrdup(const char *s) {
     return p;
 }
 
+/* The keyspace containers (hash table and list nodes, skiplist levels,
+ * listpacks in std::string) allocate through operator new: it goes through
+ * zmalloc too, so that used_memory, and maxmemory with it, covers them. */
+void *operator new(size_t size) {
+    return zmalloc(size);
+}
+
+void *operator new[](size_t size) {
+    return zmalloc(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return ztrymalloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return ztrymalloc(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    zfree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    zfree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    zfree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    zfree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    zfree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    zfree(ptr);
+}
+
 size_t zmalloc_used_memory(void) {
-    size_t um;
-    atomicGet(used_memory, um);
+    size_t um = 0;
+    for (auto &it : used_memory) {
+        um += it.bytes.load(std::memory_order_relaxed);
+    }
     return um;
 }
 
@@ -0,0 +1,550 @@
+#include "zset.h"
+#include "scan.h"
+
+#include <cmath>
+
+/* A packed entry is the score, one byte with the member length, then the
+ * member. Members longer than REDIS_ZSET_MAX_PACKED_VALUE convert the set. */
+static const size_t kPackedHeader = sizeof(double) + 1;
+
+static double packedScore(const char *p) {
+    double score;
+    memcpy(&score, p, sizeof(double));
+    return score;
+}
+
+static size_t packedLen(const char *p) {
+    return (uint8_t) p[sizeof(double)];
+}
+
+/* Order of two entries, by score and then by the member bytes. */
+static int32_t zsetCompare(double s1, const char *m1, size_t l1,
+                           double s2, const char *m2, size_t l2) {
+    if (s1 != s2) {
+        return s1 < s2 ? -1 : 1;
+    }
+
+    int32_t cmp = memcmp(m1, m2, std::min(l1, l2));
+    if (cmp != 0) {
+        return cmp;
+    }
+    return l1 < l2 ? -1 : (l1 > l2 ? 1 : 0);
+}
+
+static int32_t zsetCompare(double s1, const RedisObjectPtr &m1, double s2, const RedisObjectPtr &m2) {
+    return zsetCompare(s1, m1->ptr, sdslen(m1->ptr), s2, m2->ptr, sdslen(m2->ptr));
+}
+
+static bool zslValueGteMin(double value, const ZRangeSpec &spec) {
+    return spec.minex ? (value > spec.min) : (value >= spec.min);
+}
+
+static bool zslValueLteMax(double value, const ZRangeSpec &spec) {
+    return spec.maxex ? (value < spec.max) : (value <= spec.max);
+}
+
+/* Parses min and max of ZRANGEBYSCORE, a leading '(' excludes the end.
+ * "-inf" and "+inf" are taken by strtod. */
+int32_t zslParseRange(const RedisObjectPtr &min, const RedisObjectPtr &max, ZRangeSpec *spec) {
+    char *eptr;
+    spec->minex = spec->maxex = false;
+
+    if (min->ptr[0] == '(') {
+        spec->min = strtod(min->ptr + 1, &eptr);
+        if (eptr[0] != '\0' || std::isnan(spec->min)) {
+            return REDIS_ERR;
+        }
+        spec->minex = true;
+    } else {
+        spec->min = strtod(min->ptr, &eptr);
+        if (eptr[0] != '\0' || std::isnan(spec->min)) {
+            return REDIS_ERR;
+        }
+    }
+
+    if (max->ptr[0] == '(') {
+        spec->max = strtod(max->ptr + 1, &eptr);
+        if (eptr[0] != '\0' || std::isnan(spec->max)) {
+            return REDIS_ERR;
+        }
+        spec->maxex = true;
+    } else {
+        spec->max = strtod(max->ptr, &eptr);
+        if (eptr[0] != '\0' || std::isnan(spec->max)) {
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+Zset::Zset()
+        : packed(true),
+          length(0),
+          header(nullptr),
+          tail(nullptr),
+          level(1) {
+
+}
+
+Zset::~Zset() {
+    if (header == nullptr) {
+        return;
+    }
+
+    Node *node = header->level[0].forward;
+    while (node != nullptr) {
+        Node *next = node->level[0].forward;
+        freeNode(node);
+        node = next;
+    }
+    freeNode(header);
+}
+
+Zset::Node *Zset::createNode(int32_t level, double score, const RedisObjectPtr &member) {
+    Node *node = (Node *) zmalloc(sizeof(Node) + (level - 1) * sizeof(Node::Level));
+    new(&node->member) RedisObjectPtr(member);
+    node->score = score;
+    node->backward = nullptr;
+    return node;
+}
+
+void Zset::freeNode(Node *node) {
+    node->member.~RedisObjectPtr();
+    zfree(node);
+}
+
+/* Returns a level between 1 and kMaxLevel, where each level is a quarter as
+ * likely as the one below it. */
+int32_t Zset::randomLevel() {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    int32_t level = 1;
+    while (level < kMaxLevel && (gen() & 0xFFFF) < (0xFFFF >> 2)) {
+        level++;
+    }
+    return level;
+}
+
+/* Inserts a member that is not in the skiplist yet. */
+Zset::Node *Zset::insertNode(double score, const RedisObjectPtr &member) {
+    Node *update[kMaxLevel];
+    size_t rank[kMaxLevel];
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        /* The rank of the node update[i] will be. */
+        rank[i] = i == (level - 1) ? 0 : rank[i + 1];
+        while (x->level[i].forward &&
+               zsetCompare(x->level[i].forward->score, x->level[i].forward->member, score, member) < 0) {
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    int32_t lvl = randomLevel();
+    if (lvl > level) {
+        for (int32_t i = level; i < lvl; i++) {
+            rank[i] = 0;
+            update[i] = header;
+            update[i]->level[i].span = length;
+        }
+        level = lvl;
+    }
+
+    x = createNode(lvl, score, member);
+    for (int32_t i = 0; i < lvl; i++) {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+
+        /* The span of update[i] is split by the new node. */
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    /* Levels above the new node skip one more. */
+    for (int32_t i = lvl; i < level; i++) {
+        update[i]->level[i].span++;
+    }
+
+    x->backward = (update[0] == header) ? nullptr : update[0];
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x;
+    } else {
+        tail = x;
+    }
+    length++;
+    return x;
+}
+
+/* Unlinks x, update holds the last node before x on every level. */
+void Zset::deleteNode(Node *x, Node **update) {
+    for (int32_t i = 0; i < level; i++) {
+        if (update[i]->level[i].forward == x) {
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+        } else {
+            update[i]->level[i].span -= 1;
+        }
+    }
+
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x->backward;
+    } else {
+        tail = x->backward;
+    }
+
+    while (level > 1 && header->level[level - 1].forward == nullptr) {
+        level--;
+    }
+    length--;
+}
+
+bool Zset::removeNode(double score, const RedisObjectPtr &member) {
+    Node *update[kMaxLevel];
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               zsetCompare(x->level[i].forward->score, x->level[i].forward->member, score, member) < 0) {
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    if (x && zsetCompare(x->score, x->member, score, member) == 0) {
+        deleteNode(x, update);
+        freeNode(x);
+        return true;
+    }
+    return false;
+}
+
+/* A node keeps its place if the new score still sorts it between its
+ * neighbours, otherwise it is unlinked and inserted again. */
+void Zset::updateScore(double curscore, const RedisObjectPtr &member, double newscore) {
+    Node *update[kMaxLevel];
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               zsetCompare(x->level[i].forward->score, x->level[i].forward->member, curscore, member) < 0) {
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    assert(x && zsetCompare(x->score, x->member, curscore, member) == 0);
+    if ((x->backward == nullptr ||
+         zsetCompare(x->backward->score, x->backward->member, newscore, member) < 0) &&
+        (x->level[0].forward == nullptr ||
+         zsetCompare(x->level[0].forward->score, x->level[0].forward->member, newscore, member) > 0)) {
+        x->score = newscore;
+        return;
+    }
+
+    RedisObjectPtr ele = x->member;
+    deleteNode(x, update);
+    freeNode(x);
+    insertNode(newscore, ele);
+}
+
+/* 1 based rank of the node, 0 if it is not in the skiplist. */
+size_t Zset::nodeRank(double score, const RedisObjectPtr &member) const {
+    size_t rank = 0;
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               zsetCompare(x->level[i].forward->score, x->level[i].forward->member, score, member) <= 0) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        if (x != header && zsetCompare(x->score, x->member, score, member) == 0) {
+            return rank;
+        }
+    }
+    return 0;
+}
+
+/* Node at the 1 based rank, following the spans from the top level down. */
+Zset::Node *Zset::nodeByRank(size_t rank) const {
+    size_t traversed = 0;
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && (traversed + x->level[i].span) <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        if (traversed == rank) {
+            return x;
+        }
+    }
+    return nullptr;
+}
+
+/* Offset of the member's entry, std::string::npos if it is not there. */
+size_t Zset::packedFind(const char *member, size_t len, double *score, size_t *rank) const {
+    const char *p = entries.data();
+    size_t n = 0;
+    for (size_t pos = 0; pos < entries.size(); n++) {
+        size_t elen = packedLen(p + pos);
+        if (elen == len && memcmp(p + pos + kPackedHeader, member, len) == 0) {
+            if (score) {
+                *score = packedScore(p + pos);
+            }
+
+            if (rank) {
+                *rank = n;
+            }
+            return pos;
+        }
+        pos += kPackedHeader + elen;
+    }
+    return std::string::npos;
+}
+
+void Zset::packedInsert(const char *member, size_t len, double score) {
+    const char *p = entries.data();
+    size_t pos = 0;
+    while (pos < entries.size()) {
+        size_t elen = packedLen(p + pos);
+        if (zsetCompare(packedScore(p + pos), p + pos + kPackedHeader, elen, score, member, len) > 0) {
+            break;
+        }
+        pos += kPackedHeader + elen;
+    }
+
+    char head[kPackedHeader];
+    memcpy(head, &score, sizeof(double));
+    head[sizeof(double)] = (char) len;
+    entries.insert(pos, head, kPackedHeader);
+    entries.insert(pos + kPackedHeader, member, len);
+    length++;
+}
+
+/* Moves the packed entries to the skiplist and the dict, for good. */
+void Zset::convert() {
+    assert(packed);
+    header = createNode(kMaxLevel, 0, nullptr);
+    for (int32_t i = 0; i < kMaxLevel; i++) {
+        header->level[i].forward = nullptr;
+        header->level[i].span = 0;
+    }
+
+    std::string old;
+    old.swap(entries);
+    packed = false;
+    length = 0;
+    dict.reserve(REDIS_ZSET_MAX_PACKED_ENTRIES * 2);
+
+    const char *p = old.data();
+    for (size_t pos = 0; pos < old.size();) {
+        size_t elen = packedLen(p + pos);
+        double score = packedScore(p + pos);
+        RedisObjectPtr member = createStringObject(const_cast<char *>(p + pos + kPackedHeader), elen);
+        insertNode(score, member);
+        dict.emplace(member, score);
+        pos += kPackedHeader + elen;
+    }
+}
+
+/* Sets the score of the member, adding it if needed. */
+int32_t Zset::add(const RedisObjectPtr &member, double score) {
+    size_t len = sdslen(member->ptr);
+    if (packed) {
+        double cur;
+        size_t pos = packedFind(member->ptr, len, &cur, nullptr);
+        if (pos != std::string::npos) {
+            if (cur == score) {
+                return kNone;
+            }
+
+            entries.erase(pos, kPackedHeader + len);
+            length--;
+            packedInsert(member->ptr, len, score);
+            return kUpdated;
+        }
+
+        if (len <= REDIS_ZSET_MAX_PACKED_VALUE && length < REDIS_ZSET_MAX_PACKED_ENTRIES) {
+            packedInsert(member->ptr, len, score);
+            return kAdded;
+        }
+        convert();
+    }
+
+    auto it = dict.find(member);
+    if (it != dict.end()) {
+        if (it->second == score) {
+            return kNone;
+        }
+
+        updateScore(it->second, it->first, score);
+        it->second = score;
+        return kUpdated;
+    }
+
+    insertNode(score, member);
+    dict.emplace(member, score);
+    return kAdded;
+}
+
+bool Zset::remove(const RedisObjectPtr &member) {
+    if (packed) {
+        size_t len = sdslen(member->ptr);
+        size_t pos = packedFind(member->ptr, len, nullptr, nullptr);
+        if (pos == std::string::npos) {
+            return false;
+        }
+
+        entries.erase(pos, kPackedHeader + len);
+        length--;
+        return true;
+    }
+
+    auto it = dict.find(member);
+    if (it == dict.end()) {
+        return false;
+    }
+
+    /* The node may hold the last reference to the member. */
+    RedisObjectPtr ele = it->first;
+    double score = it->second;
+    dict.erase(it);
+    bool removed = removeNode(score, ele);
+    assert(removed);
+    return true;
+}
+
+bool Zset::getScore(const RedisObjectPtr &member, double *score) const {
+    if (packed) {
+        return packedFind(member->ptr, sdslen(member->ptr), score, nullptr) != std::string::npos;
+    }
+
+    auto it = dict.find(member);
+    if (it == dict.end()) {
+        return false;
+    }
+
+    *score = it->second;
+    return true;
+}
+
+/* Rank of the member, from the highest score when reverse is set, or -1. */
+int64_t Zset::getRank(const RedisObjectPtr &member, bool reverse) const {
+    size_t rank;
+    if (packed) {
+        if (packedFind(member->ptr, sdslen(member->ptr), nullptr, &rank) == std::string::npos) {
+            return -1;
+        }
+    } else {
+        auto it = dict.find(member);
+        if (it == dict.end()) {
+            return -1;
+        }
+
+        rank = nodeRank(it->second, it->first);
+        assert(rank != 0);
+        rank--;
+    }
+    return reverse ? length - 1 - rank : rank;
+}
+
+/* Ranks of the first and the last member with a score in range, false if
+ * there is none. */
+bool Zset::getRankRange(const ZRangeSpec &range, size_t *first, size_t *last) const {
+    if (range.min > range.max || (range.min == range.max && (range.minex || range.maxex))) {
+        return false;
+    }
+
+    if (packed) {
+        const char *p = entries.data();
+        size_t n = 0;
+        bool found = false;
+        for (size_t pos = 0; pos < entries.size(); n++) {
+            double score = packedScore(p + pos);
+            if (!zslValueLteMax(score, range)) {
+                break;
+            }
+
+            if (zslValueGteMin(score, range)) {
+                if (!found) {
+                    *first = n;
+                    found = true;
+                }
+                *last = n;
+            }
+            pos += kPackedHeader + packedLen(p + pos);
+        }
+        return found;
+    }
+
+    /* Last node below min, then the node after it is the first in range. */
+    size_t rank = 0;
+    Node *x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && !zslValueGteMin(x->level[i].forward->score, range)) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+
+    x = x->level[0].forward;
+    if (x == nullptr || !zslValueLteMax(x->score, range)) {
+        return false;
+    }
+    *first = rank;
+
+    /* Last node not above max. */
+    rank = 0;
+    x = header;
+    for (int32_t i = level - 1; i >= 0; i--) {
+        while (x->level[i].forward && zslValueLteMax(x->level[i].forward->score, range)) {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    *last = rank - 1;
+    return true;
+}
+
+/* Visits the members from rank start to end, both included and in range.
+ * With reverse the ranks count from the highest score. */
+void Zset::rangeByRank(size_t start, size_t end, bool reverse, const Visitor &visitor) const {
+    assert(start <= end && end < length);
+    if (packed) {
+        std::vector <size_t> offsets;
+        offsets.reserve(length);
+        for (size_t pos = 0; pos < entries.size(); pos += kPackedHeader + packedLen(entries.data() + pos)) {
+            offsets.push_back(pos);
+        }
+
+        for (size_t i = start; i <= end; i++) {
+            const char *p = entries.data() + offsets[reverse ? length - 1 - i : i];
+            visitor(p + kPackedHeader, packedLen(p), packedScore(p));
+        }
+        return;
+    }
+
+    Node *x = nodeByRank(reverse ? length - start : start + 1);
+    for (size_t i = start; i <= end; i++) {
+        visitor(x->member->ptr, sdslen(x->member->ptr), x->score);
+        x = reverse ? x->backward : x->level[0].forward;
+    }
+}
+
+void Zset::forEach(const Visitor &visitor) const {
+    if (length > 0) {
+        rangeByRank(0, length - 1, false, visitor);
+    }
+}
+
+uint64_t Zset::scan(uint64_t cursor, size_t count, const Visitor &visitor) const {
+    if (packed) {
+        forEach(visitor);
+        return 0;
+    }
+
+    return scanTable(dict, cursor, &count, [&visitor](const auto &it) {
+        visitor(it.first->ptr, sdslen(it.first->ptr), it.second);
+    });
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "all.h"
+#include "object.h"
+
+/* Score interval of ZRANGEBYSCORE, an end is left out when minex/maxex is set. */
+struct ZRangeSpec {
+    double min;
+    double max;
+    bool minex;
+    bool maxex;
+};
+
+int32_t zslParseRange(const RedisObjectPtr &min, const RedisObjectPtr &max, ZRangeSpec *spec);
+
+/* Sorted set ordered by score, then by member. Small sets are kept packed
+ * like a listpack: one buffer of (score, member length, member) entries in
+ * order. A larger set is converted to a skiplist whose levels carry the
+ * number of nodes they skip, so ranks are found in O(log N), plus a dict
+ * from member to score. Ranks are 0 based. */
+class Zset {
+public:
+    typedef std::function<void(const char *member, size_t len, double score)> Visitor;
+
+    /* Results of add(). */
+    static const int32_t kNone = 0;
+    static const int32_t kAdded = 1;
+    static const int32_t kUpdated = 2;
+
+    Zset();
+
+    ~Zset();
+
+    size_t size() const { return length; }
+
+    bool isPacked() const { return packed; }
+
+    int32_t add(const RedisObjectPtr &member, double score);
+
+    bool remove(const RedisObjectPtr &member);
+
+    bool getScore(const RedisObjectPtr &member, double *score) const;
+
+    int64_t getRank(const RedisObjectPtr &member, bool reverse) const;
+
+    bool getRankRange(const ZRangeSpec &range, size_t *first, size_t *last) const;
+
+    void rangeByRank(size_t start, size_t end, bool reverse, const Visitor &visitor) const;
+
+    void forEach(const Visitor &visitor) const;
+
+    /* Continues the scan at cursor (see scan.h), a packed set is visited
+     * whole and gives cursor 0. */
+    uint64_t scan(uint64_t cursor, size_t count, const Visitor &visitor) const;
+
+private:
+    Zset(const Zset &);
+
+    void operator=(const Zset &);
+
+    struct Node {
+        RedisObjectPtr member;
+        double score;
+        Node *backward;
+        struct Level {
+            Node *forward;
+            size_t span;      /* Nodes between this one and forward. */
+        } level[1];
+    };
+
+    static const int32_t kMaxLevel = 32;
+
+    Node *createNode(int32_t level, double score, const RedisObjectPtr &member);
+
+    void freeNode(Node *node);
+
+    int32_t randomLevel();
+
+    Node *insertNode(double score, const RedisObjectPtr &member);
+
+    void deleteNode(Node *node, Node **update);
+
+    bool removeNode(double score, const RedisObjectPtr &member);
+
+    void updateScore(double curscore, const RedisObjectPtr &member, double newscore);
+
+    size_t nodeRank(double score, const RedisObjectPtr &member) const;
+
+    Node *nodeByRank(size_t rank) const;
+
+    size_t packedFind(const char *member, size_t len, double *score, size_t *rank) const;
+
+    void packedInsert(const char *member, size_t len, double score);
+
+    void convert();
+
+    bool packed;
+    size_t length;
+    std::string entries;   /* Packed encoding. */
+    Node *header;
+    Node *tail;
+    int32_t level;
+    std::unordered_map <RedisObjectPtr, double, Hash, Equal> dict;
+};